@@ -25,6 +25,7 @@
 #pragma once
 
 #include <algorithm>
+#include <functional>
 #include <list>
 #include <vector>
 
@@ -177,29 +178,66 @@ namespace carve {
 
 			void groupIntersections();
 
-			void _generateVertexVertexIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb);
-			void generateVertexVertexIntersections( meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b);
+			/**
+			 * \brief A possible intersection found by one of the
+			 * generate*Intersections() tests.
+			 *
+			 * The tests of one stage run in parallel and only read the
+			 * recorded intersections. The hits are recorded afterwards by
+			 * recordIntersectionHits(), in the order of the face pairs.
+			 */
+			struct IntersectionHit {
+				enum hit_type_t { VERTEX_VERTEX, VERTEX_EDGE, EDGE_EDGE, EDGE_EDGE_DEGENERATE, VERTEX_FACE, EDGE_FACE };
+
+				hit_type_t hit_type;
+				meshset_t::vertex_t* vertex;
+				meshset_t::edge_t* edge_a;
+				meshset_t::edge_t* edge_b;
+				meshset_t::face_t* face;
+				meshset_t::vertex_t::vector_t point;
+
+				IntersectionHit(hit_type_t _hit_type, meshset_t::vertex_t* _vertex, meshset_t::edge_t* _edge_a, meshset_t::edge_t* _edge_b,
+					meshset_t::face_t* _face, const meshset_t::vertex_t::vector_t& _point)
+					: hit_type(_hit_type), vertex(_vertex), edge_a(_edge_a), edge_b(_edge_b), face(_face), point(_point) {}
+			};
 
-			void _generateVertexEdgeIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb);
-			void generateVertexEdgeIntersections( meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b);
+			typedef std::vector<IntersectionHit> intersection_hits_t;
+			typedef std::vector<std::pair<meshset_t::face_t*, meshset_t::face_t*> > face_pair_candidates_t;
+			typedef void (CSG::*face_pair_test_t)(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b, intersection_hits_t& hits);
 
-			void _generateEdgeEdgeIntersections(meshset_t::edge_t* ea, meshset_t::edge_t* eb);
-			void generateEdgeEdgeIntersections(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b);
+			void _generateVertexVertexIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb, intersection_hits_t& hits);
+			void generateVertexVertexIntersections( meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b, intersection_hits_t& hits);
 
-			void _generateVertexFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb);
-			void generateVertexFaceIntersections( meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b);
+			void _generateVertexEdgeIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb, intersection_hits_t& hits);
+			void generateVertexEdgeIntersections( meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b, intersection_hits_t& hits);
 
-			void _generateEdgeFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb);
-			void generateEdgeFaceIntersections(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b);
+			void _generateEdgeEdgeIntersections(meshset_t::edge_t* ea, meshset_t::edge_t* eb, intersection_hits_t& hits);
+			void generateEdgeEdgeIntersections(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b, intersection_hits_t& hits);
+
+			void _generateVertexFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb, intersection_hits_t& hits);
+			void generateVertexFaceIntersections( meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b, intersection_hits_t& hits);
+
+			void _generateEdgeFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb, intersection_hits_t& hits);
+			void generateEdgeFaceIntersections(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b, intersection_hits_t& hits);
+
+			void recordIntersectionHits(const intersection_hits_t& hits);
 
-			void generateIntersectionCandidates(meshset_t* a, const face_rtree_t* a_node, meshset_t* b, const face_rtree_t* b_node, face_pairs_t& face_pairs, bool descend_a = true);
 			/**
-			 * \brief Compute all points of intersection between poly \a a and poly \a b
+			 * \brief Run one test stage of generateIntersections() for all face pairs.
 			 *
-			 * @param a Polyhedron a.
-			 * @param b Polyhedron b.
+			 * @param face_pairs The face pairs, in the order of the sequential loop.
+			 * @param test The test to run for each face pair.
 			 */
-			void generateIntersections(meshset_t* a, const face_rtree_t* a_node, meshset_t* b, const face_rtree_t* b_node, detail::Data& data);
+			void generateIntersectionHits(const std::vector<const face_pairs_t::value_type*>& face_pairs, face_pair_test_t test);
+
+			void generateIntersectionCandidates(const face_rtree_t* a_node, const face_rtree_t* b_node, face_pair_candidates_t& candidates, bool descend_a = true);
+			/**
+			 * \brief Compute all points of intersection between poly a and poly b
+			 *
+			 * @param a_node Face tree of polyhedron a.
+			 * @param b_node Face tree of polyhedron b.
+			 */
+			void generateIntersections(const face_rtree_t* a_node, const face_rtree_t* b_node, detail::Data& data);
 
 			/**
 			 * \brief Generate tables of intersecting pairs of faces.
@@ -387,6 +425,19 @@ namespace carve {
 			CSG::Hooks hooks; /**< The manager for calculation hooks. */
 			double CARVE_EPSILON;
 
+			/**
+			 * \brief Optional check for cancellation, called between the stages and in the
+			 * main loops of a computation, possibly from several threads at once. If it
+			 * returns true, the computation is aborted with a carve::exception.
+			 */
+			std::function<bool()> interrupt_check;
+
+			void checkInterrupt() const {
+				if( interrupt_check && interrupt_check() ) {
+					throw carve::exception("CSG computation interrupted");
+				}
+			}
+
 			CSG(double _CARVE_EPSILON);
 			~CSG();
 
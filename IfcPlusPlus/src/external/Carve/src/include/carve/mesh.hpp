@@ -33,7 +33,17 @@
 #include <carve/rtree.hpp>
 #include <carve/tag.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <vector>
+
+#ifndef CARVE_USE_MESH_POOL
+#define CARVE_USE_MESH_POOL 1
+#endif
 
 namespace carve {
 	namespace poly {
@@ -125,6 +135,197 @@ namespace carve {
 			struct list_iter_t;
 			template <typename list_t, typename mapping_t>
 			struct mapped_list_iter_t;
+
+			// Returns a new stamp on each call. Stamps are unique over all meshsets and never 0
+			inline size_t nextModificationStamp() {
+				static std::atomic<size_t> counter(0);
+				return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+			}
+
+			/**
+			 * \brief Allocator for the Edge and Face objects of meshes, which are created and deleted in large numbers.
+			 *
+			 * Blocks are cut from slabs and kept in a free list per thread, so allocation and deallocation do not lock.
+			 * If a free list grows beyond two batches (for example when meshes built in a worker thread are deleted in
+			 * another thread), a batch is handed to a shared depot, from which threads refill before cutting a new slab.
+			 * Slabs are kept for later meshes, until releaseUnusedSlabs returns the ones without allocated blocks to the system.
+			 * Free blocks in the lists of other threads are not visible to releaseUnusedSlabs, their slabs are kept.
+			 */
+			template <size_t object_size>
+			class PoolAllocator {
+				struct FreeBlock {
+					FreeBlock* next;
+				};
+
+				struct Batch {
+					FreeBlock* head;
+					size_t count;
+				};
+
+				static const size_t BLOCK_SIZE = (object_size + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+				static const size_t BLOCKS_PER_SLAB = 1024;
+				static const size_t BATCH_SIZE = 1024;
+
+				struct ThreadCache;
+
+				struct Depot {
+					std::mutex mutex;
+					std::vector<Batch> batches;
+					std::vector<char*> slabs;
+				};
+
+				struct ThreadCache {
+					FreeBlock* head = nullptr;
+					size_t count = 0;
+
+					~ThreadCache() {
+						Depot& d = depot();
+						std::lock_guard<std::mutex> lock(d.mutex);
+						if( head != nullptr ) {
+							d.batches.push_back(Batch{ head, count });
+						}
+					}
+				};
+
+				// never destroyed, blocks may still be deallocated by static destructors of other translation units
+				static Depot& depot() {
+					static Depot* d = new Depot();
+					return *d;
+				}
+
+				static ThreadCache& threadCache() {
+					static thread_local ThreadCache cache;
+					return cache;
+				}
+
+				static void refill(ThreadCache& cache) {
+					Depot& d = depot();
+					char* slab = nullptr;
+					{
+						std::lock_guard<std::mutex> lock(d.mutex);
+						if( !d.batches.empty() ) {
+							cache.head = d.batches.back().head;
+							cache.count = d.batches.back().count;
+							d.batches.pop_back();
+							return;
+						}
+						slab = static_cast<char*>(::operator new(BLOCK_SIZE * BLOCKS_PER_SLAB));
+						d.slabs.push_back(slab);
+					}
+
+					for( size_t i = BLOCKS_PER_SLAB; i > 0; --i ) {
+						FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + (i - 1) * BLOCK_SIZE);
+						block->next = cache.head;
+						cache.head = block;
+					}
+					cache.count += BLOCKS_PER_SLAB;
+				}
+
+			public:
+				static void* allocate() {
+					ThreadCache& cache = threadCache();
+					if( cache.head == nullptr ) {
+						refill(cache);
+					}
+					FreeBlock* block = cache.head;
+					cache.head = block->next;
+					--cache.count;
+					return block;
+				}
+
+				static void deallocate(void* p) {
+					ThreadCache& cache = threadCache();
+					FreeBlock* block = static_cast<FreeBlock*>(p);
+					block->next = cache.head;
+					cache.head = block;
+					if( ++cache.count < 2 * BATCH_SIZE ) {
+						return;
+					}
+
+					FreeBlock* batch_head = cache.head;
+					FreeBlock* batch_tail = batch_head;
+					for( size_t i = 1; i < BATCH_SIZE; ++i ) {
+						batch_tail = batch_tail->next;
+					}
+					cache.head = batch_tail->next;
+					cache.count -= BATCH_SIZE;
+					batch_tail->next = nullptr;
+
+					Depot& d = depot();
+					std::lock_guard<std::mutex> lock(d.mutex);
+					d.batches.push_back(Batch{ batch_head, BATCH_SIZE });
+				}
+
+				/**
+				 * \brief Returns slabs of which all blocks are free to the system, and the number of bytes released.
+				 *
+				 * Only the batches in the depot and the free list of the calling thread are walked, so other threads may
+				 * allocate and delete Edges or Faces meanwhile. Blocks in their free lists count as allocated.
+				 * The remaining free blocks are moved to the depot.
+				 */
+				static size_t releaseUnusedSlabs() {
+					ThreadCache& cache = threadCache();
+					Depot& d = depot();
+					std::lock_guard<std::mutex> lock(d.mutex);
+					if( d.slabs.empty() ) {
+						return 0;
+					}
+
+					std::less<const char*> less;
+					std::sort(d.slabs.begin(), d.slabs.end(), less);
+					auto slabIndex = [&](const FreeBlock* block) {
+						return size_t(std::upper_bound(d.slabs.begin(), d.slabs.end(), reinterpret_cast<const char*>(block), less) - d.slabs.begin()) - 1;
+					};
+
+					std::vector<FreeBlock*> lists;
+					for( const Batch& batch : d.batches ) {
+						lists.push_back(batch.head);
+					}
+					lists.push_back(cache.head);
+					cache.head = nullptr;
+					cache.count = 0;
+					d.batches.clear();
+
+					std::vector<size_t> num_free(d.slabs.size(), 0);
+					for( FreeBlock* head : lists ) {
+						for( FreeBlock* block = head; block != nullptr; block = block->next ) {
+							++num_free[slabIndex(block)];
+						}
+					}
+
+					// blocks of slabs that stay are collected again in batches
+					Batch batch{ nullptr, 0 };
+					for( FreeBlock* head : lists ) {
+						FreeBlock* block = head;
+						while( block != nullptr ) {
+							FreeBlock* next = block->next;
+							if( num_free[slabIndex(block)] < BLOCKS_PER_SLAB ) {
+								block->next = batch.head;
+								batch.head = block;
+								if( ++batch.count == BATCH_SIZE ) {
+									d.batches.push_back(batch);
+									batch = Batch{ nullptr, 0 };
+								}
+							}
+							block = next;
+						}
+					}
+					if( batch.count > 0 ) {
+						d.batches.push_back(batch);
+					}
+
+					size_t num_released = 0;
+					for( size_t i = 0; i < d.slabs.size(); ++i ) {
+						if( num_free[i] == BLOCKS_PER_SLAB ) {
+							::operator delete(d.slabs[i]);
+							d.slabs[i] = nullptr;
+							++num_released;
+						}
+					}
+					d.slabs.erase(std::remove(d.slabs.begin(), d.slabs.end(), nullptr), d.slabs.end());
+					return num_released * BLOCK_SIZE * BLOCKS_PER_SLAB;
+				}
+			};
 		}
 
 		// The half-edge structure proper (Edge) is maintained by Face
@@ -240,6 +441,21 @@ namespace carve {
 			Edge(vertex_t* _vert, vertex_t* _uv, face_t* _face);
 
 			~Edge();
+
+#if CARVE_USE_MESH_POOL
+			static void* operator new(size_t size) {
+				return size == sizeof(Edge) ? detail::PoolAllocator<sizeof(Edge)>::allocate() : ::operator new(size);
+			}
+
+			static void operator delete(void* p, size_t size) {
+				if( size == sizeof(Edge) ) {
+					detail::PoolAllocator<sizeof(Edge)>::deallocate(p);
+				}
+				else {
+					::operator delete(p);
+				}
+			}
+#endif
 		};
 
 		// A Face contains a pointer to the beginning of the half-edge
@@ -487,8 +703,35 @@ namespace carve {
 			void canonicalize();
 
 			~Face() { clearEdges(); }
+
+#if CARVE_USE_MESH_POOL
+			static void* operator new(size_t size) {
+				return size == sizeof(Face) ? detail::PoolAllocator<sizeof(Face)>::allocate() : ::operator new(size);
+			}
+
+			static void operator delete(void* p, size_t size) {
+				if( size == sizeof(Face) ) {
+					detail::PoolAllocator<sizeof(Face)>::deallocate(p);
+				}
+				else {
+					::operator delete(p);
+				}
+			}
+#endif
 		};
 
+		// Returns unused memory of the Edge and Face allocators to the system, for example after meshes have been
+		// deleted at the end of a conversion. Other threads may create or delete meshes meanwhile, but the free
+		// blocks that they keep for their next meshes are not returned.
+		template <unsigned ndim>
+		inline size_t releaseUnusedMeshMemory() {
+#if CARVE_USE_MESH_POOL
+			return detail::PoolAllocator<sizeof(Edge<ndim>)>::releaseUnusedSlabs() + detail::PoolAllocator<sizeof(Face<ndim>)>::releaseUnusedSlabs();
+#else
+			return 0;
+#endif
+		}
+
 		struct MeshOptions {
 			bool opt_avoid_cavities;
 
@@ -710,6 +953,9 @@ namespace carve {
 					faces[i]->recalc(CARVE_EPSILON);
 				}
 				calcOrientation();
+				if( meshset != nullptr ) {
+					meshset->touch();
+				}
 			}
 
 			void invert() {
@@ -719,6 +965,9 @@ namespace carve {
 				if( isClosed() ) {
 					is_negative = !is_negative;
 				}
+				if( meshset != nullptr ) {
+					meshset->touch();
+				}
 			}
 
 			Mesh* clone(const vertex_t* old_base, vertex_t* new_base) const;
@@ -747,6 +996,19 @@ namespace carve {
 			std::vector<vertex_t> uv_storage;
 			std::vector<mesh_t*> meshes;
 
+			// Unique stamp of the current state. Renewed by touch(), which has to be called after modifying
+			// vertices, faces or meshes from outside of the MeshSet and Mesh methods. Allows callers to cache
+			// results that are computed from the meshset.
+			size_t modification_stamp = detail::nextModificationStamp();
+
+			// Stamp of the meshset this one was cloned from, while this one is unmodified. 0 otherwise
+			size_t clone_source_stamp = 0;
+
+			void touch() {
+				modification_stamp = detail::nextModificationStamp();
+				clone_source_stamp = 0;
+			}
+
 		public:
 			template <typename face_type>
 			struct FaceIter {
@@ -841,6 +1103,7 @@ namespace carve {
 				for( size_t i = 0; i < meshes.size(); ++i ) {
 					meshes[i]->recalc();
 				}
+				touch();
 			}
 
 			MeshSet(const std::vector<typename vertex_t::vector_t>& points, size_t n_faces, const std::vector<int>& face_indices, double CARVE_EPSILON, const MeshOptions& opts = MeshOptions());
@@ -875,6 +1138,7 @@ namespace carve {
 				for( size_t i = 0; i < meshes.size(); ++i ) {
 					meshes[i]->invert();
 				}
+				touch();
 			}
 
 			void collectVertices();
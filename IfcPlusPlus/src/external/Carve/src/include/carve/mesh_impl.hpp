@@ -1152,7 +1152,9 @@ MeshSet<ndim>* MeshSet<ndim>::clone() const {
         meshes[i]->clone(&vertex_storage[0], &r_vertex_storage[0]));
   }
 
-  return new MeshSet(r_vertex_storage, r_meshes);
+  MeshSet* r = new MeshSet(r_vertex_storage, r_meshes);
+  r->clone_source_stamp = modification_stamp;
+  return r;
 }
 
 template <unsigned ndim>
@@ -1284,6 +1286,7 @@ void MeshSet<ndim>::collectVertices() {
   }
 
   std::swap(vertex_storage, new_vertex_storage);
+  touch();
 }
 
 template <unsigned ndim>
@@ -1317,6 +1320,7 @@ void MeshSet<ndim>::canonicalize() {
   }
 
   vertex_storage.swap(vout);
+  touch();
 }
 
 template <unsigned ndim>
@@ -1354,6 +1358,7 @@ void MeshSet<ndim>::separateMeshes() {
   }
 
   vertex_storage.swap(vout);
+  touch();
 }
 }  // namespace mesh
 }  // namespace carve
@@ -64,7 +64,12 @@ namespace carve {
 					const carve::mesh::MeshSet<3>* _src_b)
 					: CSG::Collector(), src_a(_src_a), src_b(_src_b) {}
 
-				~BaseCollector() override {}
+				~BaseCollector() override {
+					// faces that were not handed over by done(), because the computation was interrupted
+					for( std::list<face_data_t>::iterator i = faces.begin(); i != faces.end(); ++i ) {
+						delete (*i).face;
+					}
+				}
 
 				void FWD(const carve::mesh::MeshSet<3>::face_t* orig_face,
 					const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
@@ -238,6 +243,8 @@ namespace carve {
 						}
 					}
 
+					// the faces belong to the meshset now
+					faces.clear();
 					return p;
 				}
 			};
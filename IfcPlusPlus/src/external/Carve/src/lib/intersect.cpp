@@ -710,7 +710,24 @@ void carve::csg::CSG::intersectingFacePairs(detail::Data& data)
 	}
 }
 
-void carve::csg::CSG::_generateVertexVertexIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb)
+namespace {
+	// face pairs per task in the test stages of CSG::generateIntersections()
+	const size_t FACE_PAIRS_PER_TASK = 64;
+
+	// pairs of sub trees, into which the traversal of the face trees in CSG::generateIntersections() is split
+	const size_t MIN_RTREE_NODE_PAIRS = 64;
+
+	struct RTreeNodePair {
+		const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* a_node;
+		const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* b_node;
+		bool descend_a;
+
+		RTreeNodePair(const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* _a_node, const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* _b_node, bool _descend_a)
+			: a_node(_a_node), b_node(_b_node), descend_a(_descend_a) {}
+	};
+}  // namespace
+
+void carve::csg::CSG::_generateVertexVertexIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb, intersection_hits_t& hits)
 {
 	if( intersections.intersects(va, eb->v1()) ) {
 		return;
@@ -720,12 +737,12 @@ void carve::csg::CSG::_generateVertexVertexIntersections(meshset_t::vertex_t* va
 
 	if( d_v1 < CARVE_EPSILON * CARVE_EPSILON )
 	{
-		intersections.record(va, eb->v1(), va);
+		hits.push_back(IntersectionHit(IntersectionHit::VERTEX_VERTEX, va, eb, nullptr, nullptr, va->v));
 	}
 }
 
 void carve::csg::CSG::generateVertexVertexIntersections(
-	meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b) {
+	meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b, intersection_hits_t& hits) {
 	meshset_t::edge_t* ea, * eb;
 
 	ea = a->edge;
@@ -734,7 +751,7 @@ void carve::csg::CSG::generateVertexVertexIntersections(
 			meshset_t::face_t* t = b[i];
 			eb = t->edge;
 			do {
-				_generateVertexVertexIntersections(ea->v1(), eb);
+				_generateVertexVertexIntersections(ea->v1(), eb, hits);
 				eb = eb->next;
 			} while( eb != t->edge );
 		}
@@ -742,7 +759,7 @@ void carve::csg::CSG::generateVertexVertexIntersections(
 	} while( ea != a->edge );
 }
 
-void carve::csg::CSG::_generateVertexEdgeIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb) {
+void carve::csg::CSG::_generateVertexEdgeIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb, intersection_hits_t& hits) {
 	if( intersections.intersects(va, eb) ) {
 		return;
 	}
@@ -758,15 +775,12 @@ void carve::csg::CSG::_generateVertexEdgeIntersections(meshset_t::vertex_t* va,
 
 	if( a < b * CARVE_EPSILON*CARVE_EPSILON ) {
 		// vertex-edge intersection
-		intersections.record(eb, va, va);
-		if( eb->rev ) {
-			intersections.record(eb->rev, va, va);
-		}
+		hits.push_back(IntersectionHit(IntersectionHit::VERTEX_EDGE, va, eb, nullptr, nullptr, va->v));
 	}
 }
 
 void carve::csg::CSG::generateVertexEdgeIntersections(
-	meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b) {
+	meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b, intersection_hits_t& hits) {
 	meshset_t::edge_t* ea, * eb;
 
 	ea = a->edge;
@@ -775,7 +789,7 @@ void carve::csg::CSG::generateVertexEdgeIntersections(
 			meshset_t::face_t* t = b[i];
 			eb = t->edge;
 			do {
-				_generateVertexEdgeIntersections(ea->v1(), eb);
+				_generateVertexEdgeIntersections(ea->v1(), eb, hits);
 				eb = eb->next;
 			} while( eb != t->edge );
 		}
@@ -783,7 +797,7 @@ void carve::csg::CSG::generateVertexEdgeIntersections(
 	} while( ea != a->edge );
 }
 
-void carve::csg::CSG::_generateEdgeEdgeIntersections(meshset_t::edge_t* ea, meshset_t::edge_t* eb)
+void carve::csg::CSG::_generateEdgeEdgeIntersections(meshset_t::edge_t* ea, meshset_t::edge_t* eb, intersection_hits_t& hits)
 {
 	if( intersections.intersects(ea, eb) ) {
 		return;
@@ -807,17 +821,7 @@ void carve::csg::CSG::_generateEdgeEdgeIntersections(meshset_t::edge_t* ea, mesh
 	case carve::RR_INTERSECTION: {
 		// edges intersect
 		if( mu1 >= 0.0 && mu1 <= 1.0 && mu2 >= 0.0 && mu2 <= 1.0 ) {
-			meshset_t::vertex_t* p = vertex_pool.get((p1 + p2) / 2.0);
-			intersections.record(ea, eb, p);
-			if( ea->rev ) {
-				intersections.record(ea->rev, eb, p);
-			}
-			if( eb->rev ) {
-				intersections.record(ea, eb->rev, p);
-			}
-			if( ea->rev && eb->rev ) {
-				intersections.record(ea->rev, eb->rev, p);
-			}
+			hits.push_back(IntersectionHit(IntersectionHit::EDGE_EDGE, nullptr, ea, eb, nullptr, (p1 + p2) / 2.0));
 		}
 		break;
 	}
@@ -827,7 +831,8 @@ void carve::csg::CSG::_generateEdgeEdgeIntersections(meshset_t::edge_t* ea, mesh
 		break;
 	}
 	case carve::RR_DEGENERATE: {
-		throw carve::exception("degenerate edge");
+		// thrown by recordIntersectionHits(), unless the edges intersect by then
+		hits.push_back(IntersectionHit(IntersectionHit::EDGE_EDGE_DEGENERATE, nullptr, ea, eb, nullptr, p1));
 		break;
 	}
 	case carve::RR_NO_INTERSECTION: {
@@ -836,7 +841,7 @@ void carve::csg::CSG::_generateEdgeEdgeIntersections(meshset_t::edge_t* ea, mesh
 	}
 }
 
-void carve::csg::CSG::generateEdgeEdgeIntersections( meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b)
+void carve::csg::CSG::generateEdgeEdgeIntersections( meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b, intersection_hits_t& hits)
 {
 	meshset_t::edge_t* ea, * eb;
 
@@ -846,7 +851,7 @@ void carve::csg::CSG::generateEdgeEdgeIntersections( meshset_t::face_t* a, const
 			meshset_t::face_t* t = b[i];
 			eb = t->edge;
 			do {
-				_generateEdgeEdgeIntersections(ea, eb);
+				_generateEdgeEdgeIntersections(ea, eb, hits);
 				eb = eb->next;
 			} while( eb != t->edge );
 		}
@@ -854,7 +859,7 @@ void carve::csg::CSG::generateEdgeEdgeIntersections( meshset_t::face_t* a, const
 	} while( ea != a->edge );
 }
 
-void carve::csg::CSG::_generateVertexFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb)
+void carve::csg::CSG::_generateVertexFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb, intersection_hits_t& hits)
 {
 	if( intersections.intersects(eb->v1(), fa) )
 	{
@@ -865,25 +870,25 @@ void carve::csg::CSG::_generateVertexFaceIntersections(meshset_t::face_t* fa, me
 
 	if( fabs(d1) < CARVE_EPSILON && fa->containsPoint(eb->v1()->v, CARVE_EPSILON) )
 	{
-		intersections.record(eb->v1(), fa, eb->v1());
+		hits.push_back(IntersectionHit(IntersectionHit::VERTEX_FACE, eb->v1(), eb, nullptr, fa, eb->v1()->v));
 	}
 }
 
 void carve::csg::CSG::generateVertexFaceIntersections(
-	meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b) {
+	meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b, intersection_hits_t& hits) {
 	meshset_t::edge_t* eb;
 
 	for( size_t i = 0; i < b.size(); ++i ) {
 		meshset_t::face_t* t = b[i];
 		eb = t->edge;
 		do {
-			_generateVertexFaceIntersections(a, eb);
+			_generateVertexFaceIntersections(a, eb, hits);
 			eb = eb->next;
 		} while( eb != t->edge );
 	}
 }
 
-void carve::csg::CSG::_generateEdgeFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb)
+void carve::csg::CSG::_generateEdgeFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb, intersection_hits_t& hits)
 {
 	if( intersections.intersects(eb, fa) )
 	{
@@ -893,15 +898,11 @@ void carve::csg::CSG::_generateEdgeFaceIntersections(meshset_t::face_t* fa, mesh
 	meshset_t::vertex_t::vector_t _p;
 	if( fa->simpleLineSegmentIntersection( carve::geom3d::LineSegment(eb->v1()->v, eb->v2()->v), _p, CARVE_EPSILON) )
 	{
-		meshset_t::vertex_t* p = vertex_pool.get(_p);
-		intersections.record(eb, fa, p);
-		if( eb->rev ) {
-			intersections.record(eb->rev, fa, p);
-		}
+		hits.push_back(IntersectionHit(IntersectionHit::EDGE_FACE, nullptr, eb, nullptr, fa, _p));
 	}
 }
 
-void carve::csg::CSG::generateEdgeFaceIntersections( meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b)
+void carve::csg::CSG::generateEdgeFaceIntersections( meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b, intersection_hits_t& hits)
 {
 	meshset_t::edge_t* eb;
 
@@ -910,13 +911,96 @@ void carve::csg::CSG::generateEdgeFaceIntersections( meshset_t::face_t* a, const
 		meshset_t::face_t* t = b[i];
 		eb = t->edge;
 		do {
-			_generateEdgeFaceIntersections(a, eb);
+			_generateEdgeFaceIntersections(a, eb, hits);
 			eb = eb->next;
 		} while( eb != t->edge );
 	}
 }
 
-void carve::csg::CSG::generateIntersectionCandidates( meshset_t* a, const face_rtree_t* a_node, meshset_t* b, const face_rtree_t* b_node, face_pairs_t& face_pairs, bool descend_a)
+void carve::csg::CSG::recordIntersectionHits(const intersection_hits_t& hits)
+{
+	// a hit is skipped if an earlier hit of the same stage already connected the objects, like the sequential tests would have skipped it
+	for( size_t i = 0; i < hits.size(); ++i )
+	{
+		const IntersectionHit& hit = hits[i];
+		meshset_t::edge_t* ea = hit.edge_a;
+		meshset_t::edge_t* eb = hit.edge_b;
+
+		switch( hit.hit_type ) {
+		case IntersectionHit::VERTEX_VERTEX: {
+			if( !intersections.intersects(hit.vertex, ea->v1()) ) {
+				intersections.record(hit.vertex, ea->v1(), hit.vertex);
+			}
+			break;
+		}
+		case IntersectionHit::VERTEX_EDGE: {
+			if( !intersections.intersects(hit.vertex, ea) ) {
+				intersections.record(ea, hit.vertex, hit.vertex);
+				if( ea->rev ) {
+					intersections.record(ea->rev, hit.vertex, hit.vertex);
+				}
+			}
+			break;
+		}
+		case IntersectionHit::EDGE_EDGE: {
+			if( !intersections.intersects(ea, eb) ) {
+				meshset_t::vertex_t* p = vertex_pool.get(hit.point);
+				intersections.record(ea, eb, p);
+				if( ea->rev ) {
+					intersections.record(ea->rev, eb, p);
+				}
+				if( eb->rev ) {
+					intersections.record(ea, eb->rev, p);
+				}
+				if( ea->rev && eb->rev ) {
+					intersections.record(ea->rev, eb->rev, p);
+				}
+			}
+			break;
+		}
+		case IntersectionHit::EDGE_EDGE_DEGENERATE: {
+			if( !intersections.intersects(ea, eb) ) {
+				throw carve::exception("degenerate edge");
+			}
+			break;
+		}
+		case IntersectionHit::VERTEX_FACE: {
+			if( !intersections.intersects(hit.vertex, hit.face) ) {
+				intersections.record(hit.vertex, hit.face, hit.vertex);
+			}
+			break;
+		}
+		case IntersectionHit::EDGE_FACE: {
+			if( !intersections.intersects(ea, hit.face) ) {
+				meshset_t::vertex_t* p = vertex_pool.get(hit.point);
+				intersections.record(ea, hit.face, p);
+				if( ea->rev ) {
+					intersections.record(ea->rev, hit.face, p);
+				}
+			}
+			break;
+		}
+		}
+	}
+}
+
+void carve::csg::CSG::generateIntersectionHits(const std::vector<const face_pairs_t::value_type*>& face_pairs, face_pair_test_t test)
+{
+	// the tests only read the intersections of previous stages, hits are buffered per range of face pairs
+	std::vector<intersection_hits_t> range_hits((face_pairs.size() + FACE_PAIRS_PER_TASK - 1) / FACE_PAIRS_PER_TASK);
+	forEachRangeAsTask(face_pairs.size(), FACE_PAIRS_PER_TASK, [&](size_t range_index, size_t begin, size_t end) {
+		checkInterrupt();
+		for( size_t i = begin; i < end; ++i ) {
+			(this->*test)(face_pairs[i]->first, face_pairs[i]->second, range_hits[range_index]);
+		}
+	});
+
+	for( size_t i = 0; i < range_hits.size(); ++i ) {
+		recordIntersectionHits(range_hits[i]);
+	}
+}
+
+void carve::csg::CSG::generateIntersectionCandidates( const face_rtree_t* a_node, const face_rtree_t* b_node, face_pair_candidates_t& candidates, bool descend_a)
 {
 	if( !a_node->bbox.intersects(b_node->bbox) ) {
 		return;
@@ -924,12 +1008,12 @@ void carve::csg::CSG::generateIntersectionCandidates( meshset_t* a, const face_r
 
 	if( a_node->child && (descend_a || !b_node->child) ) {
 		for( face_rtree_t* node = a_node->child; node; node = node->sibling ) {
-			generateIntersectionCandidates(a, node, b, b_node, face_pairs, false);
+			generateIntersectionCandidates(node, b_node, candidates, false);
 		}
 	}
 	else if( b_node->child ) {
 		for( face_rtree_t* node = b_node->child; node; node = node->sibling ) {
-			generateIntersectionCandidates(a, a_node, b, node, face_pairs, true);
+			generateIntersectionCandidates(a_node, node, candidates, true);
 		}
 	}
 	else {
@@ -969,21 +1053,71 @@ void carve::csg::CSG::generateIntersectionCandidates( meshset_t* a, const face_r
 
 				if( !facesAreCoplanar(fa, fb, CARVE_EPSILON) )
 				{
-					face_pairs[fa].push_back(fb);
-					face_pairs[fb].push_back(fa);
+					candidates.push_back(std::make_pair(fa, fb));
 				}
 			}
 		}
 	}
 }
 
-void carve::csg::CSG::generateIntersections(meshset_t* a, const face_rtree_t* a_rtree, meshset_t* b, const face_rtree_t* b_rtree, detail::Data& data)
+void carve::csg::CSG::generateIntersections(const face_rtree_t* a_rtree, const face_rtree_t* b_rtree, detail::Data& data)
 {
+	// split the traversal of the face trees into pairs of sub trees. Children replace their parent in place,
+	// so the concatenated candidates of all node pairs are in the order of a traversal from the roots
+	std::vector<RTreeNodePair> node_pairs(1, RTreeNodePair(a_rtree, b_rtree, true));
+	while( node_pairs.size() < MIN_RTREE_NODE_PAIRS ) {
+		std::vector<RTreeNodePair> split_node_pairs;
+		bool split = false;
+		for( size_t i = 0; i < node_pairs.size(); ++i ) {
+			const RTreeNodePair& node_pair = node_pairs[i];
+			if( !node_pair.a_node->bbox.intersects(node_pair.b_node->bbox) ) {
+				continue;
+			}
+
+			if( node_pair.a_node->child && (node_pair.descend_a || !node_pair.b_node->child) ) {
+				for( face_rtree_t* node = node_pair.a_node->child; node; node = node->sibling ) {
+					split_node_pairs.push_back(RTreeNodePair(node, node_pair.b_node, false));
+				}
+				split = true;
+			}
+			else if( node_pair.b_node->child ) {
+				for( face_rtree_t* node = node_pair.b_node->child; node; node = node->sibling ) {
+					split_node_pairs.push_back(RTreeNodePair(node_pair.a_node, node, true));
+				}
+				split = true;
+			}
+			else {
+				split_node_pairs.push_back(node_pair);
+			}
+		}
+		node_pairs.swap(split_node_pairs);
+		if( !split ) {
+			break;
+		}
+	}
+
+	std::vector<face_pair_candidates_t> node_pair_candidates(node_pairs.size());
+	forEachRangeAsTask(node_pairs.size(), 1, [&](size_t range_index, size_t /* begin */, size_t /* end */) {
+		checkInterrupt();
+		const RTreeNodePair& node_pair = node_pairs[range_index];
+		generateIntersectionCandidates(node_pair.a_node, node_pair.b_node, node_pair_candidates[range_index], node_pair.descend_a);
+	});
+
 	face_pairs_t face_pairs;
-	generateIntersectionCandidates(a, a_rtree, b, b_rtree, face_pairs);
+	for( size_t i = 0; i < node_pair_candidates.size(); ++i ) {
+		const face_pair_candidates_t& candidates = node_pair_candidates[i];
+		for( size_t j = 0; j < candidates.size(); ++j ) {
+			face_pairs[candidates[j].first].push_back(candidates[j].second);
+			face_pairs[candidates[j].second].push_back(candidates[j].first);
+		}
+	}
 
+	std::vector<const face_pairs_t::value_type*> face_pair_list;
+	face_pair_list.reserve(face_pairs.size());
 	for( face_pairs_t::const_iterator i = face_pairs.begin(); i != face_pairs.end(); ++i )
 	{
+		face_pair_list.push_back(&(*i));
+
 		meshset_t::face_t* f = (*i).first;
 		meshset_t::edge_t* e = f->edge;
 		do {
@@ -992,30 +1126,11 @@ void carve::csg::CSG::generateIntersections(meshset_t* a, const face_rtree_t* a_
 		} while( e != f->edge );
 	}
 
-	for( face_pairs_t::const_iterator i = face_pairs.begin(); i != face_pairs.end(); ++i )
-	{
-		generateVertexVertexIntersections((*i).first, (*i).second);
-	}
-
-	for( face_pairs_t::const_iterator i = face_pairs.begin(); i != face_pairs.end(); ++i )
-	{
-		generateVertexEdgeIntersections((*i).first, (*i).second);
-	}
-
-	for( face_pairs_t::const_iterator i = face_pairs.begin(); i != face_pairs.end(); ++i )
-	{
-		generateEdgeEdgeIntersections((*i).first, (*i).second);
-	}
-
-	for( face_pairs_t::const_iterator i = face_pairs.begin(); i != face_pairs.end(); ++i )
-	{
-		generateVertexFaceIntersections((*i).first, (*i).second);
-	}
-
-	for( face_pairs_t::const_iterator i = face_pairs.begin(); i != face_pairs.end(); ++i )
-	{
-		generateEdgeFaceIntersections((*i).first, (*i).second);
-	}
+	generateIntersectionHits(face_pair_list, &CSG::generateVertexVertexIntersections);
+	generateIntersectionHits(face_pair_list, &CSG::generateVertexEdgeIntersections);
+	generateIntersectionHits(face_pair_list, &CSG::generateEdgeEdgeIntersections);
+	generateIntersectionHits(face_pair_list, &CSG::generateVertexFaceIntersections);
+	generateIntersectionHits(face_pair_list, &CSG::generateEdgeFaceIntersections);
 
 #if defined(CARVE_DEBUG)
 	std::cerr << "makeVertexIntersections" << std::endl;
@@ -1338,7 +1453,8 @@ void carve::csg::CSG::calc(meshset_t* a, const face_rtree_t* a_rtree, meshset_t*
 #endif
 	init();
 
-	generateIntersections(a, a_rtree, b, b_rtree, data);
+	generateIntersections(a_rtree, b_rtree, data);
+	checkInterrupt();
 
 #if defined(CARVE_DEBUG)
 	std::cerr << "intersectingFacePairs" << std::endl;
@@ -1372,12 +1488,14 @@ void carve::csg::CSG::calc(meshset_t* a, const face_rtree_t* a_rtree, meshset_t*
 #endif
 	// makeFaceEdges(data.face_split_edges, eclass, data.fmap, data.fmap_rev);
 	makeFaceEdges(eclass, data);
+	checkInterrupt();
 
 #if defined(CARVE_DEBUG)
 	std::cerr << "generateFaceLoops" << std::endl;
 #endif
 	a_edge_count = generateFaceLoops(a, data, a_face_loops);
 	b_edge_count = generateFaceLoops(b, data, b_face_loops);
+	checkInterrupt();
 
 #if defined(CARVE_DEBUG)
 	std::cerr << "generated " << a_edge_count << " edges for poly a" << std::endl;
@@ -1536,6 +1654,7 @@ carve::mesh::MeshSet<3>* carve::csg::CSG::compute( meshset_t* a, meshset_t* b, c
 		carve::TimingBlock block(FUNC_NAME);
 		groupFaceLoops(a, a_face_loops, a_edge_map, shared_edges, a_loops_grouped);
 		groupFaceLoops(b, b_face_loops, b_edge_map, shared_edges, b_loops_grouped);
+		checkInterrupt();
 #if defined(CARVE_DEBUG)
 		std::cerr << "*** a_loops_grouped.size(): " << a_loops_grouped.size()
 			<< std::endl;
@@ -1587,6 +1706,7 @@ carve::mesh::MeshSet<3>* carve::csg::CSG::compute( meshset_t* a, meshset_t* b, c
 			b_loops_grouped, b_edge_map, collector);
 		break;
 	}
+	checkInterrupt();
 
 	meshset_t* result = collector.done(hooks);
 	if( result != nullptr && shared_edges_ptr != nullptr ) {
@@ -1616,11 +1736,9 @@ carve::mesh::MeshSet<3>* carve::csg::CSG::compute( meshset_t* a, meshset_t* b, c
 		return nullptr;
 	}
 
-	meshset_t* result = compute(a, b, *coll, shared_edges, classify_type);
-
-	delete coll;
-
-	return result;
+	// the collector is also released if the computation is interrupted
+	std::unique_ptr<Collector> coll_owner(coll);
+	return compute(a, b, *coll, shared_edges, classify_type);
 }
 
 /**
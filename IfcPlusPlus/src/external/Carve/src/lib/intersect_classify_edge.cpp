@@ -553,6 +553,79 @@ namespace carve {
 					}
 				}
 			}
+
+			// groups per task in classifyNonIntersectingGroups()
+			const size_t GROUPS_PER_TASK = 4;
+
+			/**
+			 * \brief Classify the groups of one polyhedron that do not intersect the other polyhedron, by testing
+			 * their vertices against the other polyhedron.
+			 *
+			 * The point tests of different groups run in parallel and only read \a vclass. The computed point classes
+			 * and the group classifications are recorded afterwards, in the order of the groups.
+			 *
+			 * @param[in,out] groups The groups of one polyhedron.
+			 * @param[in,out] vclass Vertex classification, \a other_index selects the class with respect to \a other_poly.
+			 */
+			static void classifyNonIntersectingGroups( FLGroupList& groups, VertexClassification& vclass, size_t other_index,
+				carve::mesh::MeshSet<3>* other_poly, const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* other_rtree,
+				const char* error_message, double CARVE_EPSILON)
+			{
+				struct GroupPointTests {
+					std::vector<std::pair<carve::mesh::MeshSet<3>::vertex_t*, PointClass> > computed;
+					FaceClass face_class = FACE_UNCLASSIFIED;
+				};
+
+				std::vector<FaceLoopGroup*> unclassified_groups;
+				for( FLGroupList::iterator i = groups.begin(); i != groups.end(); ++i ) {
+					if( (*i).classification.size() == 0 ) {
+						unclassified_groups.push_back(&(*i));
+					}
+				}
+
+				std::vector<GroupPointTests> group_tests(unclassified_groups.size());
+				forEachRangeAsTask(unclassified_groups.size(), GROUPS_PER_TASK, [&](size_t /* range_index */, size_t begin, size_t end) {
+					for( size_t ii = begin; ii < end; ++ii ) {
+						GroupPointTests& tests = group_tests[ii];
+						for( FaceLoop* fl = unclassified_groups[ii]->face_loops.head; tests.face_class == FACE_UNCLASSIFIED && fl != nullptr; fl = fl->next )
+						{
+							for( size_t fli = 0; tests.face_class == FACE_UNCLASSIFIED && fli < fl->vertices.size(); ++fli )
+							{
+								carve::mesh::MeshSet<3>::vertex_t* v = fl->vertices[fli];
+								PointClass point_class = POINT_UNK;
+								VertexClassification::const_iterator it_vclass = vclass.find(v);
+								if( it_vclass != vclass.end() ) {
+									point_class = (*it_vclass).second.cls[other_index];
+								}
+								if( point_class == POINT_UNK ) {
+									point_class = carve::mesh::classifyPoint(other_poly, other_rtree, v->v, CARVE_EPSILON);
+									tests.computed.push_back(std::make_pair(v, point_class));
+								}
+								if( point_class == POINT_IN ) {
+									tests.face_class = FACE_IN;
+								}
+								else if( point_class == POINT_OUT ) {
+									tests.face_class = FACE_OUT;
+								}
+							}
+						}
+					}
+				});
+
+				for( size_t ii = 0; ii < unclassified_groups.size(); ++ii ) {
+#if defined(CARVE_DEBUG)
+					std::cerr << " non intersecting group: " << unclassified_groups[ii] << std::endl;
+#endif
+					const GroupPointTests& tests = group_tests[ii];
+					for( size_t jj = 0; jj < tests.computed.size(); ++jj ) {
+						vclass[tests.computed[jj].first].cls[other_index] = tests.computed[jj].second;
+					}
+					if( tests.face_class == FACE_UNCLASSIFIED ) {
+						throw carve::exception(error_message);
+					}
+					unclassified_groups[ii]->classification.push_back(ClassificationInfo(nullptr, tests.face_class));
+				}
+			}
 		}  // namespace
 
 		static inline std::string CODE(const FaceLoopGroup* grp) {
@@ -841,82 +914,8 @@ namespace carve {
 				}
 			}
 
-			for( FLGroupList::iterator i = a_loops_grouped.begin();
-				i != a_loops_grouped.end(); ++i ) {
-				if( (*i).classification.size() == 0 ) {
-#if defined(CARVE_DEBUG)
-					std::cerr << " non intersecting group (poly a): " << &(*i) << std::endl;
-#endif
-					bool classified = false;
-					for( FaceLoop* fl = (*i).face_loops.head; !classified && fl != nullptr; fl = fl->next )
-					{
-						for( size_t fli = 0; !classified && fli < fl->vertices.size(); ++fli )
-						{
-							if( vclass[fl->vertices[fli]].cls[1] == POINT_UNK )
-							{
-								vclass[fl->vertices[fli]].cls[1] = carve::mesh::classifyPoint( poly_b, poly_b_rtree, fl->vertices[fli]->v, CARVE_EPSILON);
-							}
-							switch( vclass[fl->vertices[fli]].cls[1] ) {
-							case POINT_IN:
-								(*i).classification.push_back(
-									ClassificationInfo(nullptr, FACE_IN));
-								classified = true;
-								break;
-							case POINT_OUT:
-								(*i).classification.push_back(
-									ClassificationInfo(nullptr, FACE_OUT));
-								classified = true;
-								break;
-							default:
-								break;
-							}
-						}
-					}
-					if( !classified ) {
-						throw carve::exception(
-							"non intersecting group is not IN or OUT! (poly_a)");
-					}
-				}
-			}
-
-			for( FLGroupList::iterator i = b_loops_grouped.begin(); i != b_loops_grouped.end(); ++i )
-			{
-				if( (*i).classification.size() == 0 )
-				{
-#if defined(CARVE_DEBUG)
-					std::cerr << " non intersecting group (poly b): " << &(*i) << std::endl;
-#endif
-					bool classified = false;
-					for( FaceLoop* fl = (*i).face_loops.head; !classified && fl != nullptr; fl = fl->next )
-					{
-						for( size_t fli = 0; !classified && fli < fl->vertices.size(); ++fli )
-						{
-							if( vclass[fl->vertices[fli]].cls[0] == POINT_UNK )
-							{
-								vclass[fl->vertices[fli]].cls[0] = carve::mesh::classifyPoint( poly_a, poly_a_rtree, fl->vertices[fli]->v, CARVE_EPSILON);
-							}
-							switch( vclass[fl->vertices[fli]].cls[0] ) {
-							case POINT_IN:
-								(*i).classification.push_back(
-									ClassificationInfo(nullptr, FACE_IN));
-								classified = true;
-								break;
-							case POINT_OUT:
-								(*i).classification.push_back(
-									ClassificationInfo(nullptr, FACE_OUT));
-								classified = true;
-								break;
-							default:
-								break;
-							}
-						}
-					}
-					if( !classified )
-					{
-						throw carve::exception( "non intersecting group is not IN or OUT! (poly_b)");
-					}
-				}
-			}
+			classifyNonIntersectingGroups(a_loops_grouped, vclass, 1, poly_b, poly_b_rtree, "non intersecting group is not IN or OUT! (poly_a)", CARVE_EPSILON);
+			classifyNonIntersectingGroups(b_loops_grouped, vclass, 0, poly_a, poly_a_rtree, "non intersecting group is not IN or OUT! (poly_b)", CARVE_EPSILON);
 
 #if defined(DISPLAY_GRP_GRAPH)
 #define POLY(grp)                                                      \
@@ -24,6 +24,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <exception>
+#include <vector>
+
 static inline bool facesAreCoplanar(const carve::mesh::MeshSet<3>::face_t* a, const carve::mesh::MeshSet<3>::face_t* b, double CARVE_EPSILON)
 {
   carve::geom3d::Ray temp;
@@ -41,6 +45,39 @@ static inline bool facesAreCoplanar(const carve::mesh::MeshSet<3>::face_t* a, co
 namespace carve {
 namespace csg {
 
+/**
+ * \brief Calls \a func(range_index, begin, end) for consecutive ranges of
+ * [0, count) with at most \a range_size elements each. Within an OpenMP
+ * parallel region, the ranges are processed as tasks. The ranges do not
+ * depend on the number of threads, so results that are collected per range
+ * and merged in range order are deterministic. An exception thrown for a
+ * range is rethrown after all tasks have finished (the one of the first
+ * range, if several fail).
+ */
+template <typename func_t>
+static inline void forEachRangeAsTask(size_t count, size_t range_size, func_t func)
+{
+  const size_t num_ranges = (count + range_size - 1) / range_size;
+  std::vector<std::exception_ptr> range_errors(num_ranges);
+  for (size_t range_index = 0; range_index < num_ranges; ++range_index) {
+#pragma omp task firstprivate(range_index) shared(func, range_errors) if(num_ranges > 1)
+    {
+      try {
+        const size_t begin = range_index * range_size;
+        func(range_index, begin, std::min(begin + range_size, count));
+      } catch (...) {
+        range_errors[range_index] = std::current_exception();
+      }
+    }
+  }
+#pragma omp taskwait
+  for (size_t range_index = 0; range_index < num_ranges; ++range_index) {
+    if (range_errors[range_index]) {
+      std::rethrow_exception(range_errors[range_index]);
+    }
+  }
+}
+
 static inline carve::mesh::MeshSet<3>::vertex_t* map_vertex( const VVMap& vmap, carve::mesh::MeshSet<3>::vertex_t* v)
 {
   VVMap::const_iterator i = vmap.find(v);
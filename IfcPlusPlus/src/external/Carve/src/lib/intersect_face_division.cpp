@@ -49,6 +49,8 @@ void writePLY(const std::string& out_file,
 #endif
 
 namespace {
+	// faces per task in CSG::generateFaceLoops()
+	const size_t FACES_PER_TASK = 256;
 
 #if defined(CARVE_DEBUG_WRITE_PLY_DATA)
 	template <typename iter_t>
@@ -1767,11 +1769,21 @@ size_t carve::csg::CSG::generateFaceLoops(carve::mesh::MeshSet<3>* poly, const d
 	carve::TimingBlock block(FUNC_NAME);
 	size_t generated_edges = 0;
 	std::vector<carve::mesh::MeshSet<3>::vertex_t*> base_loop;
-	std::list<std::vector<carve::mesh::MeshSet<3>::vertex_t*> > face_loops;
 
-	for( carve::mesh::MeshSet<3>::face_iter i = poly->faceBegin();
-		i != poly->faceEnd(); ++i ) {
-		carve::mesh::MeshSet<3>::face_t* face = (*i);
+	// the faces are divided in parallel, unless a hook has to be called for each divided edge. The loops are recorded in the order of the faces
+	std::vector<carve::mesh::MeshSet<3>::face_t*> faces(poly->faceBegin(), poly->faceEnd());
+	std::vector<std::list<std::vector<carve::mesh::MeshSet<3>::vertex_t*> > > loops_per_face(faces.size());
+	const size_t faces_per_task = hooks.hasHook(Hooks::EDGE_DIVISION_HOOK) ? std::max(faces.size(), size_t(1)) : FACES_PER_TASK;
+	forEachRangeAsTask(faces.size(), faces_per_task, [&](size_t /* range_index */, size_t begin, size_t end) {
+		checkInterrupt();
+		for( size_t i = begin; i < end; ++i ) {
+			generateOneFaceLoop(faces[i], data, vertex_intersections, hooks, loops_per_face[i], CARVE_EPSILON);
+		}
+	});
+
+	for( size_t i = 0; i < faces.size(); ++i ) {
+		carve::mesh::MeshSet<3>::face_t* face = faces[i];
+		std::list<std::vector<carve::mesh::MeshSet<3>::vertex_t*> >& face_loops = loops_per_face[i];
 
 #if defined(CARVE_DEBUG)
 		double in_area = 0.0, out_area = 0.0;
@@ -1793,8 +1805,6 @@ size_t carve::csg::CSG::generateFaceLoops(carve::mesh::MeshSet<3>* poly, const d
 		}
 #endif
 
-		generateOneFaceLoop(face, data, vertex_intersections, hooks, face_loops, CARVE_EPSILON);
-
 #if defined(CARVE_DEBUG)
 		{
 			V2Set face_edges;
@@ -1871,6 +1881,7 @@ size_t carve::csg::CSG::generateFaceLoops(carve::mesh::MeshSet<3>* poly, const d
 			face_loops_out.append(new FaceLoop(face, *f));
 			generated_edges += (*f).size();
 		}
+		face_loops.clear();
 #if defined(CARVE_DEBUG)
 		std::cerr << "### ======" << std::endl;
 #endif
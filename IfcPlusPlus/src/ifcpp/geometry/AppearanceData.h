@@ -31,6 +31,7 @@ public:
 	vec4  m_color_diffuse;
 	vec4  m_color_specular;
 	int m_step_style_id;
+	int m_palette_id = -1;		// index in AppearancePalette, equal for appearances with equal content
 	double m_shininess = 10.0;
 	double m_transparency = 1.0;
 	double m_specular_exponent = 0.0;
@@ -42,4 +43,14 @@ public:
 
 	std::string m_imgdata;
 	std::string m_format;
+
+	//\brief Appearances from the same palette are compared by palette id, others by the id of the style entity
+	static bool isSameAppearance( const AppearanceData& a, const AppearanceData& b )
+	{
+		if( a.m_palette_id >= 0 && b.m_palette_id >= 0 )
+		{
+			return a.m_palette_id == b.m_palette_id;
+		}
+		return a.m_step_style_id == b.m_step_style_id;
+	}
 };
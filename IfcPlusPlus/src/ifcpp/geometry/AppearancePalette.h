@@ -0,0 +1,133 @@
+/* -*-c++-*- IfcQuery www.ifcquery.com
+*
+MIT License
+
+Copyright (c) 2017 Fabian Gerold
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <array>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <ifcpp/model/BasicTypes.h>
+#include <ifcpp/model/OpenMPIncludes.h>
+#include "AppearanceData.h"
+
+//\brief Set of distinct appearances. Appearances with equal content, for example equal colours of different IfcSurfaceStyle entities, are replaced by one shared
+// AppearanceData object, which is identified by its index in the palette (AppearanceData::m_palette_id)
+class AppearancePalette
+{
+public:
+	struct AppearanceKey
+	{
+		std::array<double, 16>	m_values{};
+		int						m_geometry_type = AppearanceData::GEOM_TYPE_UNDEFINED;
+		bool					m_set_transparent = false;
+		bool					m_complete = false;
+		const void*				m_text_style = nullptr;
+		std::string				m_imgdata;
+		std::string				m_format;
+
+		bool operator<( const AppearanceKey& other ) const
+		{
+			return std::tie( m_values, m_geometry_type, m_set_transparent, m_complete, m_text_style, m_imgdata, m_format )
+				< std::tie( other.m_values, other.m_geometry_type, other.m_set_transparent, other.m_complete, other.m_text_style, other.m_imgdata, other.m_format );
+		}
+	};
+
+protected:
+	std::map<AppearanceKey, int>					m_map_key_to_id;
+	std::vector<shared_ptr<AppearanceData> >		m_vec_appearances;
+
+#ifdef _OPENMP
+	Mutex m_writelock_palette;
+#endif
+
+public:
+	AppearancePalette()
+	{
+	}
+
+	virtual ~AppearancePalette()
+	{
+	}
+
+	void clearPalette()
+	{
+#ifdef _OPENMP
+		ScopedLock lock( m_writelock_palette );
+#endif
+		m_map_key_to_id.clear();
+		m_vec_appearances.clear();
+	}
+
+	static AppearanceKey computeAppearanceKey( const AppearanceData& appearance )
+	{
+		AppearanceKey key;
+		const vec4* colors[3] = { &appearance.m_color_ambient, &appearance.m_color_diffuse, &appearance.m_color_specular };
+		for( size_t ii = 0; ii < 3; ++ii )
+		{
+			key.m_values[ii * 4] = colors[ii]->r();
+			key.m_values[ii * 4 + 1] = colors[ii]->g();
+			key.m_values[ii * 4 + 2] = colors[ii]->b();
+			key.m_values[ii * 4 + 3] = colors[ii]->a();
+		}
+		key.m_values[12] = appearance.m_shininess;
+		key.m_values[13] = appearance.m_transparency;
+		key.m_values[14] = appearance.m_specular_exponent;
+		key.m_values[15] = appearance.m_specular_roughness;
+		key.m_geometry_type = appearance.m_apply_to_geometry_type;
+		key.m_set_transparent = appearance.m_set_transparent;
+		key.m_complete = appearance.m_complete;
+		key.m_text_style = appearance.m_text_style.get();
+		key.m_imgdata = appearance.m_imgdata;
+		key.m_format = appearance.m_format;
+		return key;
+	}
+
+	/** Returns the palette entry with the content of the given appearance. If there is none yet, the given appearance becomes the entry.
+	Appearances must not be modified after they have been added */
+	shared_ptr<AppearanceData> addAppearance( const shared_ptr<AppearanceData>& appearance )
+	{
+		if( !appearance )
+		{
+			return appearance;
+		}
+
+		const AppearanceKey key = computeAppearanceKey( *appearance );
+
+#ifdef _OPENMP
+		ScopedLock lock( m_writelock_palette );
+#endif
+		if( appearance->m_palette_id >= 0 && appearance->m_palette_id < (int)m_vec_appearances.size() && m_vec_appearances[appearance->m_palette_id] == appearance )
+		{
+			return appearance;
+		}
+
+		auto it_inserted = m_map_key_to_id.insert( { key, (int)m_vec_appearances.size() } );
+		if( it_inserted.second )
+		{
+			appearance->m_palette_id = it_inserted.first->second;
+			m_vec_appearances.push_back( appearance );
+		}
+		return m_vec_appearances[it_inserted.first->second];
+	}
+
+	//\brief Palette entries, indexed by AppearanceData::m_palette_id. Must not be called while appearances are added
+	const std::vector<shared_ptr<AppearanceData> >& getAppearances() const { return m_vec_appearances; }
+
+	size_t getNumAppearances() const { return m_vec_appearances.size(); }
+};
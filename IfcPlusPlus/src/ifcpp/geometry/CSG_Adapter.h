@@ -25,6 +25,7 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OU
 #include <ifcpp/model/StatusCallback.h>
 
 #include "IncludeCarveHeaders.h"
+#include "ConversionBudget.h"
 #include "MeshOps.h"
 #include "GeometryInputData.h"
 
@@ -70,23 +71,156 @@ namespace CSG_Adapter
 		return intersects;
 	}
 
+	//\brief Creates a meshset that takes ownership of the meshes, with a copy of the vertices they reference.
+	// Vertices are stored in the order of their first use, so that the result does not depend on the memory addresses of the vertices
+	inline shared_ptr<carve::mesh::MeshSet<3> > createMeshSetFromMeshes(std::vector<carve::mesh::Mesh<3>* >& meshes)
+	{
+		std::vector<carve::mesh::MeshSet<3>::vertex_t> vertex_storage;
+		std::unordered_map<const carve::mesh::MeshSet<3>::vertex_t*, size_t> map_vertex_index;
+		for( carve::mesh::Mesh<3>* mesh : meshes )
+		{
+			for( carve::mesh::Face<3>* face : mesh->faces )
+			{
+				carve::mesh::Edge<3>* edge = face->edge;
+				do
+				{
+					if( map_vertex_index.insert({ edge->vert, vertex_storage.size() }).second )
+					{
+						vertex_storage.push_back(*edge->vert);
+					}
+					edge = edge->next;
+				} while( edge != face->edge );
+			}
+		}
+
+		for( carve::mesh::Mesh<3>* mesh : meshes )
+		{
+			for( carve::mesh::Face<3>* face : mesh->faces )
+			{
+				carve::mesh::Edge<3>* edge = face->edge;
+				do
+				{
+					edge->vert = &vertex_storage[map_vertex_index[edge->vert]];
+					edge = edge->next;
+				} while( edge != face->edge );
+			}
+		}
+		return shared_ptr<carve::mesh::MeshSet<3> >(new carve::mesh::MeshSet<3>(vertex_storage, meshes));
+	}
+
+	//\brief Copies the meshes of several meshsets into one meshset
+	inline shared_ptr<carve::mesh::MeshSet<3> > mergeMeshSets(const std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& meshsets)
+	{
+		std::vector<shared_ptr<carve::mesh::MeshSet<3> > > copies;
+		std::vector<carve::mesh::Mesh<3>* > meshes;
+		for( const shared_ptr<carve::mesh::MeshSet<3> >& meshset : meshsets )
+		{
+			shared_ptr<carve::mesh::MeshSet<3> > copy(meshset->clone());
+			for( carve::mesh::Mesh<3>* mesh : copy->meshes )
+			{
+				mesh->meshset = nullptr;
+				meshes.push_back(mesh);
+			}
+			copy->meshes.clear();
+
+			// the copied meshes reference the vertices of the copy until they are moved into the merged meshset
+			copies.push_back(copy);
+		}
+		return createMeshSetFromMeshes(meshes);
+	}
+
+	//\brief Splits a meshset into the meshes that overlap bbox and the others. Returns false if all or none of the meshes overlap
+	inline bool splitMeshSetByBoundingBox(const shared_ptr<carve::mesh::MeshSet<3> >& meshset, const carve::geom::aabb<3>& bbox, double eps,
+		shared_ptr<carve::mesh::MeshSet<3> >& meshsetOverlapping, shared_ptr<carve::mesh::MeshSet<3> >& meshsetOther)
+	{
+		if( meshset->meshes.size() < 2 )
+		{
+			return false;
+		}
+
+		std::vector<bool> overlapping;
+		size_t numOverlapping = 0;
+		for( const carve::mesh::Mesh<3>* mesh : meshset->meshes )
+		{
+			const bool meshOverlaps = mesh->getAABB().maxAxisSeparation(bbox) <= eps;
+			overlapping.push_back(meshOverlaps);
+			if( meshOverlaps )
+			{
+				++numOverlapping;
+			}
+		}
+		if( numOverlapping == 0 || numOverlapping == meshset->meshes.size() )
+		{
+			return false;
+		}
+
+		shared_ptr<carve::mesh::MeshSet<3> > copy(meshset->clone());
+		std::vector<carve::mesh::Mesh<3>* > meshesOverlapping;
+		std::vector<carve::mesh::Mesh<3>* > meshesOther;
+		for( size_t ii = 0; ii < copy->meshes.size(); ++ii )
+		{
+			carve::mesh::Mesh<3>* mesh = copy->meshes[ii];
+			mesh->meshset = nullptr;
+			if( overlapping[ii] )
+			{
+				meshesOverlapping.push_back(mesh);
+			}
+			else
+			{
+				meshesOther.push_back(mesh);
+			}
+		}
+		copy->meshes.clear();
+		meshsetOverlapping = createMeshSetFromMeshes(meshesOverlapping);
+		meshsetOther = createMeshSetFromMeshes(meshesOther);
+		return true;
+	}
+
 	inline bool computeCSG_Carve(const shared_ptr<carve::mesh::MeshSet<3> >& op1Orig, const shared_ptr<carve::mesh::MeshSet<3> >& op2Orig, const carve::csg::CSG::OP operation, shared_ptr<carve::mesh::MeshSet<3> >& result,  
 		shared_ptr<GeometrySettings>& geomSettingsDefault, StatusCallback* report_callback, const shared_ptr<BuildingEntity>& entity, bool normalizeCoords)
 	{
-		if( !op1Orig || !op2Orig )
+		if( !op1Orig || !op2Orig || ConversionBudget::current().exceeded() )
 		{
 			assignResultOnFail(op1Orig, op2Orig, operation, result);
 			return false;
 		}
 
-		if( op1Orig->vertex_storage.size() > 4000 )
+		if( operation == carve::csg::CSG::A_MINUS_B )
 		{
-			assignResultOnFail(op1Orig, op2Orig, operation, result);
-			return false;
+			// meshes of the first operand that are apart from the second operand are not affected, and don't need to go through the boolean operation
+			const double epsOverlap = geomSettingsDefault->getEpsilonMergePoints();
+			shared_ptr<carve::mesh::MeshSet<3> > op1Overlapping, op1Other;
+			if( splitMeshSetByBoundingBox(op1Orig, op2Orig->getAABB(), epsOverlap, op1Overlapping, op1Other) )
+			{
+				shared_ptr<carve::mesh::MeshSet<3> > resultOverlapping;
+				bool success = computeCSG_Carve(op1Overlapping, op2Orig, operation, resultOverlapping, geomSettingsDefault, report_callback, entity, normalizeCoords);
+				if( !success )
+				{
+					assignResultOnFail(op1Orig, op2Orig, operation, result);
+					return false;
+				}
+				result = mergeMeshSets({ resultOverlapping, op1Other });
+				return true;
+			}
+
+			// meshes of the second operand that are apart from the first operand can be skipped
+			shared_ptr<carve::mesh::MeshSet<3> > op2Overlapping, op2Other;
+			if( splitMeshSetByBoundingBox(op2Orig, op1Orig->getAABB(), epsOverlap, op2Overlapping, op2Other) )
+			{
+				return computeCSG_Carve(op1Orig, op2Overlapping, operation, result, geomSettingsDefault, report_callback, entity, normalizeCoords);
+			}
 		}
-		
-		if( op2Orig->vertex_storage.size() > 4000 )
+
+		const size_t maxNumVertices = geomSettingsDefault->getCsgMaxNumVertices();
+		if( op1Orig->vertex_storage.size() > maxNumVertices || op2Orig->vertex_storage.size() > maxNumVertices )
 		{
+			// the retry without normalized coordinates fails the same way, so the warning is reported with the first attempt only
+			if( report_callback && normalizeCoords )
+			{
+				std::stringstream strs;
+				strs << "CSG operand exceeds the vertex limit of " << maxNumVertices << " (first operand: " << op1Orig->vertex_storage.size() << ", second operand: " << op2Orig->vertex_storage.size() << " vertices), operation skipped";
+				report_callback->messageCallback(strs.str(), StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, entity.get());
+			}
 			assignResultOnFail(op1Orig, op2Orig, operation, result);
 			return false;
 		}
@@ -330,7 +464,16 @@ namespace CSG_Adapter
 			if (infoMesh2.degenerateEdges.size() > 0) { paramsScaled.allowDegenerateEdges = true; }
 
 			////////////////////// compute carve csg operation   /////////////////////////////////////////////
+			// carve checks the budget between its stages and throws when it is exceeded
+			std::function<bool()> interruptCheck;
+			if( ConversionBudget::current().isLimited() )
+			{
+				const ConversionBudget budget = ConversionBudget::current();
+				interruptCheck = [budget]() { return budget.exceeded(); };
+			}
+
 			carve::csg::CSG csg(epsDefault);
+			csg.interrupt_check = interruptCheck;
 			result = shared_ptr<carve::mesh::MeshSet<3> >(csg.compute(op1.get(), op2.get(), operation, nullptr, carve::csg::CSG::CLASSIFY_EDGE));
 
 			MeshSetInfo infoResult( report_callback, entity.get() );
@@ -371,6 +514,7 @@ namespace CSG_Adapter
 			if (!result_meshset_ok)
 			{
 				carve::csg::CSG csg(epsDefault);
+				csg.interrupt_check = interruptCheck;
 				result = shared_ptr<carve::mesh::MeshSet<3> >(csg.compute(op1.get(), op2.get(), operation, nullptr, carve::csg::CSG::CLASSIFY_NORMAL));
 				result_meshset_ok = MeshOps::checkMeshSetValidAndClosed(result, infoResult, paramsScaled);
 
@@ -455,93 +599,230 @@ namespace CSG_Adapter
 		return result_meshset_ok;
 	}
 
-	inline void computeCSG(shared_ptr<carve::mesh::MeshSet<3> >& op1, const std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& operands2, const carve::csg::CSG::OP operation,
-		shared_ptr<GeometrySettings>& geomSettings, StatusCallback* report_callback, const shared_ptr<BuildingEntity>& entity)
+	//\brief Groups operands with disjoint bounding boxes. Operands of one group do not intersect each other, so they can be merged into one meshset without CSG
+	inline void clusterDisjointOperands(const std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& operands, std::vector<std::vector<shared_ptr<carve::mesh::MeshSet<3> > > >& groups, double eps, size_t maxNumVerticesPerGroup)
 	{
-		if( !op1 || operands2.size() == 0 )
+		std::vector<std::vector<carve::geom::aabb<3> > > groupBoundingBoxes;
+		std::vector<size_t> groupNumVertices;
+		for( const shared_ptr<carve::mesh::MeshSet<3> >& operand : operands )
 		{
-			return;
+			carve::geom::aabb<3> bbox = operand->getAABB();
+			const size_t numVertices = operand->vertex_storage.size();
+
+			size_t groupIndex = 0;
+			for( ; groupIndex < groups.size(); ++groupIndex )
+			{
+				if( groupNumVertices[groupIndex] + numVertices > maxNumVerticesPerGroup )
+				{
+					continue;
+				}
+
+				bool disjoint = true;
+				for( const carve::geom::aabb<3>& groupBBox : groupBoundingBoxes[groupIndex] )
+				{
+					if( groupBBox.maxAxisSeparation(bbox) <= eps )
+					{
+						disjoint = false;
+						break;
+					}
+				}
+				if( disjoint )
+				{
+					break;
+				}
+			}
+
+			if( groupIndex == groups.size() )
+			{
+				groups.resize(groupIndex + 1);
+				groupBoundingBoxes.resize(groupIndex + 1);
+				groupNumVertices.push_back(0);
+			}
+			groups[groupIndex].push_back(operand);
+			groupBoundingBoxes[groupIndex].push_back(bbox);
+			groupNumVertices[groupIndex] += numVertices;
 		}
+	}
 
-		// TODO: scale here, then do all the bool ops, then unscale
+	inline void computeCSG_Operand(shared_ptr<carve::mesh::MeshSet<3> >& op1, const shared_ptr<carve::mesh::MeshSet<3> >& mesh2, const carve::csg::CSG::OP operation,
+		shared_ptr<GeometrySettings>& geomSettings, StatusCallback* report_callback, const shared_ptr<BuildingEntity>& entity)
+	{
 		bool success = false;
-		std::multimap<double, shared_ptr<carve::mesh::MeshSet<3> > > mapVolumeMeshes;
-		for (const shared_ptr<carve::mesh::MeshSet<3> >&meshset2 : operands2)
+#ifdef _DEBUG
+
+		MeshSetInfo infoMesh1(report_callback, entity.get());
+		bool allowFinEdges = false;
+		GeomProcessingParams params(geomSettings, false);
+		params.allowZeroAreaFaces = true; // will be removed later
+		bool operand1valid = MeshOps::checkMeshSetValidAndClosed(op1, infoMesh1, params);
+
+		if (!operand1valid)
 		{
-			double volume = MeshOps::computeMeshsetVolume(meshset2.get());
-			mapVolumeMeshes.insert({ volume, meshset2 });
+			std::cout << "!operand1valid" << std::endl;
 		}
+#endif
+
+		ScopedConversionBudget scopedBudget(geomSettings->getMaxTimePerCsgOperation());
+		bool normalizeCoords = true;
+		shared_ptr<carve::mesh::MeshSet<3> > result;
+		success = computeCSG_Carve(op1, mesh2, operation, result, geomSettings, report_callback, entity, normalizeCoords);
 
-		size_t ii = 0;
-		for( auto it = mapVolumeMeshes.rbegin(); it != mapVolumeMeshes.rend(); ++it, ++ii )
+		if( success )
 		{
-			double volume = it->first;
-			shared_ptr<carve::mesh::MeshSet<3> >& mesh2 = it->second;
+			if( operation == carve::csg::CSG::A_MINUS_B || operation == carve::csg::CSG::UNION )
+			{
+				op1 = result;
+			}
 
 #ifdef _DEBUG
 
-			MeshSetInfo infoMesh1(report_callback, entity.get());
+			MeshSetInfo infoMesh1_2(report_callback, entity.get());
 			bool allowFinEdges = false;
 			GeomProcessingParams params(geomSettings, false);
-			params.allowZeroAreaFaces = true; // will be removed later
-			bool operand1valid = MeshOps::checkMeshSetValidAndClosed(op1, infoMesh1, params);
+			bool operand1valid_2 = MeshOps::checkMeshSetValidAndClosed(op1, infoMesh1_2, params);
 
-			if (!operand1valid)
+			if (!operand1valid_2)
 			{
-				std::cout << "!operand1valid" << std::endl;
+				std::cout << "!operand1valid after computeCSG_Carve" << std::endl;
+				GeomDebugDump::DumpSettingsStruct dumpSet;
+				GeomDebugDump::dumpWithLabel("computeCSG_Carve:result:op1 ", op1, dumpSet, params, true, true);
 			}
 #endif
+			return;
+		}
 
-			bool normalizeCoords = true;
-			shared_ptr<carve::mesh::MeshSet<3> > result;
-			success = computeCSG_Carve(op1, mesh2, operation, result, geomSettings, report_callback, entity, normalizeCoords);
+		if( ConversionBudget::current().exceeded() )
+		{
+			// a retry would not finish either, keep op1 as it is
+			if( report_callback )
+			{
+				report_callback->messageCallback("CSG operation exceeded time budget, operand not applied", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, entity.get());
+			}
+			return;
+		}
 
-			if( success )
+		normalizeCoords = false;
+		success = computeCSG_Carve(op1, mesh2, operation, result, geomSettings, report_callback, entity, normalizeCoords);
+		if( success )
+		{
+			if (operation == carve::csg::CSG::A_MINUS_B || operation == carve::csg::CSG::UNION)
 			{
-				if( operation == carve::csg::CSG::A_MINUS_B || operation == carve::csg::CSG::UNION )
-				{
-					op1 = result;
-				}
+				op1 = result;
+			}
+		}
 
 #ifdef _DEBUG
+		{
+			MeshSetInfo infoMesh1(report_callback, entity.get());
+			bool allowFinEdges = false;
+			GeomProcessingParams params(geomSettings, false);
+			bool operand1valid_3 = MeshOps::checkMeshSetValidAndClosed(op1, infoMesh1, params);
 
-				MeshSetInfo infoMesh1_2(report_callback, entity.get());
-				bool allowFinEdges = false;
-				GeomProcessingParams params(geomSettings, false);
-				bool operand1valid_2 = MeshOps::checkMeshSetValidAndClosed(op1, infoMesh1_2, params);
+			if (!operand1valid_3)
+			{
+				std::cout << "!operand1valid_3 computeCSG_Carve" << std::endl;
+			}
+		}
+#endif
+	}
+
+	inline bool checkProductBudget(StatusCallback* report_callback, const shared_ptr<BuildingEntity>& entity)
+	{
+		if( !ConversionBudget::current().exceeded() )
+		{
+			return true;
+		}
 
-				if (!operand1valid_2)
+		if( report_callback )
+		{
+			report_callback->messageCallback("Product exceeded time budget, remaining CSG operations skipped", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, entity.get());
+		}
+		return false;
+	}
+
+	inline void computeCSG(shared_ptr<carve::mesh::MeshSet<3> >& op1, const std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& operands2, const carve::csg::CSG::OP operation,
+		shared_ptr<GeometrySettings>& geomSettings, StatusCallback* report_callback, const shared_ptr<BuildingEntity>& entity)
+	{
+		if( !op1 || operands2.size() == 0 )
+		{
+			return;
+		}
+
+		// TODO: scale here, then do all the bool ops, then unscale
+		std::multimap<double, shared_ptr<carve::mesh::MeshSet<3> > > mapVolumeMeshes;
+		for (const shared_ptr<carve::mesh::MeshSet<3> >&meshset2 : operands2)
+		{
+			double volume = MeshOps::computeMeshsetVolume(meshset2.get());
+			mapVolumeMeshes.insert({ volume, meshset2 });
+		}
+
+		std::vector<shared_ptr<carve::mesh::MeshSet<3> > > operandsSorted;
+		for( auto it = mapVolumeMeshes.rbegin(); it != mapVolumeMeshes.rend(); ++it )
+		{
+			operandsSorted.push_back(it->second);
+		}
+
+		if( operation != carve::csg::CSG::A_MINUS_B || !geomSettings->batchCsgOperands() || operandsSorted.size() < 2 )
+		{
+			for( const shared_ptr<carve::mesh::MeshSet<3> >& mesh2 : operandsSorted )
+			{
+				if( !checkProductBudget(report_callback, entity) )
 				{
-					std::cout << "!operand1valid after computeCSG_Carve" << std::endl;
-					GeomDebugDump::DumpSettingsStruct dumpSet;
-					GeomDebugDump::dumpWithLabel("computeCSG_Carve:result:op1 ", op1, dumpSet, params, true, true);
+					return;
 				}
-#endif
+				computeCSG_Operand(op1, mesh2, operation, geomSettings, report_callback, entity);
+			}
+			return;
+		}
+
+		// validation, normalization and face trees of the host are computed once per group instead of once per operand
+		std::vector<std::vector<shared_ptr<carve::mesh::MeshSet<3> > > > groups;
+		const double epsDisjoint = EPS_M4;
+		const size_t maxNumVerticesPerGroup = geomSettings->getCsgMaxNumVertices();	// larger operands are skipped in computeCSG_Carve
+		clusterDisjointOperands(operandsSorted, groups, epsDisjoint, maxNumVerticesPerGroup);
+
+		for( const std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& group : groups )
+		{
+			if( !checkProductBudget(report_callback, entity) )
+			{
+				return;
+			}
+
+			if( group.size() == 1 )
+			{
+				computeCSG_Operand(op1, group[0], operation, geomSettings, report_callback, entity);
 				continue;
 			}
-			normalizeCoords = false;
-			success = computeCSG_Carve(op1, mesh2, operation, result, geomSettings, report_callback, entity, normalizeCoords);
-			if( success )
+
+			shared_ptr<carve::mesh::MeshSet<3> > mergedOperands = mergeMeshSets(group);
+			shared_ptr<carve::mesh::MeshSet<3> > result;
+			bool success = false;
 			{
-				if (operation == carve::csg::CSG::A_MINUS_B || operation == carve::csg::CSG::UNION)
+				ScopedConversionBudget scopedBudget(geomSettings->getMaxTimePerCsgOperation());
+				bool normalizeCoords = true;
+				success = computeCSG_Carve(op1, mergedOperands, operation, result, geomSettings, report_callback, entity, normalizeCoords);
+				if( !success && !ConversionBudget::current().exceeded() )
 				{
-					op1 = result;
+					normalizeCoords = false;
+					success = computeCSG_Carve(op1, mergedOperands, operation, result, geomSettings, report_callback, entity, normalizeCoords);
 				}
 			}
 
-#ifdef _DEBUG
+			if( success )
 			{
-				MeshSetInfo infoMesh1(report_callback, entity.get());
-				bool allowFinEdges = false;
-				GeomProcessingParams params(geomSettings, false);
-				bool operand1valid_3 = MeshOps::checkMeshSetValidAndClosed(op1, infoMesh1, params);
+				op1 = result;
+				continue;
+			}
 
-				if (!operand1valid_3)
+			// fall back to one operation per operand
+			for( const shared_ptr<carve::mesh::MeshSet<3> >& mesh2 : group )
+			{
+				if( !checkProductBudget(report_callback, entity) )
 				{
-					std::cout << "!operand1valid_3 computeCSG_Carve" << std::endl;
+					return;
 				}
+				computeCSG_Operand(op1, mesh2, operation, geomSettings, report_callback, entity);
 			}
-#endif
 		}
 	}
 };
@@ -0,0 +1,840 @@
+/* -*-c++-*- IfcQuery www.ifcquery.com
+*
+MIT License
+
+Copyright (c) 2017 Fabian Gerold
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <ifcpp/model/BasicTypes.h>
+#include <ifcpp/model/OpenMPIncludes.h>
+#include <ifcpp/model/StatusCallback.h>
+#include <ifcpp/IFC4X3/include/IfcFeatureElementSubtraction.h>
+#include <ifcpp/IFC4X3/include/IfcProduct.h>
+#include <carve/triangle_intersection.hpp>
+#include "GeometryInputData.h"
+#include "GeometrySettings.h"
+#include "IncludeCarveHeaders.h"
+#include "ProductBVH.h"
+#include "TriangleMeshData.h"
+
+/**
+*\brief Class ClashDetector: finds intersecting products, or products closer than a clearance distance, between two sets of converted products.
+*
+* Broad phase: ProductBVH over the world bounding boxes of the second set. Narrow phase, in parallel over the candidate pairs: the triangles of
+* both products within the overlap of their boxes are tested with carve::geom::triangle_intersection_exact. The triangles reference the vertices
+* of the triangle meshes of the items and are transformed to world coordinates per pair. Items without triangle meshes are triangulated once per product,
+* with triangles that reference the vertices of the meshsets.
+* Coplanar or touching faces are not a clash. A product completely inside a closed product is a clash without intersecting faces.
+*/
+class ClashDetector : public StatusCallback
+{
+public:
+	enum ClashType { CLASH_HARD, CLASH_CLEARANCE };
+
+	struct ClashResult
+	{
+		shared_ptr<ProductShapeData>	m_product1;
+		shared_ptr<ProductShapeData>	m_product2;
+		std::string						m_guid1;
+		std::string						m_guid2;
+		ClashType						m_type = CLASH_HARD;
+		double							m_penetration = 0;		// estimated penetration depth of hard clashes
+		double							m_distance = 0;			// minimum distance of clearance clashes, 0 if the products touch
+		bool							m_contained = false;	// one product is completely inside the other
+	};
+
+protected:
+	struct TriangleRef
+	{
+		const double* m_vertices[3];		// x, y, z of the vertices in product coordinates
+	};
+
+	struct ProductTriangles
+	{
+		std::vector<TriangleRef>					m_triangles;
+		std::vector<shared_ptr<std::vector<double> > >	m_converted_positions;		// positions of single precision triangle meshes
+		carve::math::Matrix							m_transform;
+		vec3										m_min;
+		vec3										m_max;
+		bool										m_closed = true;
+		bool										m_mirrored = false;
+	};
+
+	struct WorldTriangle
+	{
+		vec3 m_vertices[3];
+		vec3 m_normal;
+		vec3 m_min;
+		vec3 m_max;
+	};
+
+	shared_ptr<GeometrySettings>	m_geom_settings;
+	double							m_tolerance = 0.001;
+	double							m_clearance = 0;
+	bool							m_check_containment = true;
+
+public:
+	ClashDetector( shared_ptr<GeometrySettings>& geom_settings ) : m_geom_settings( geom_settings )
+	{
+	}
+
+	//\brief Hard clashes with a penetration up to this depth are ignored
+	void setTolerance( double tolerance ) { m_tolerance = tolerance; }
+
+	//\brief If > 0, products closer than this distance are reported as clearance clashes
+	void setClearance( double clearance ) { m_clearance = std::max( 0.0, clearance ); }
+
+	//\brief Report products that are completely inside another closed product, without intersecting faces
+	void setCheckContainment( bool check_containment ) { m_check_containment = check_containment; }
+
+	/**
+	*\brief Selects products of map_shape_data (result of GeometryConverter::getShapeInputData) for clash detection. Openings are skipped.
+	*\param filter		Optional, returns true for products to select
+	*/
+	static std::vector<shared_ptr<ProductShapeData> > selectProducts( const std::map<std::string, shared_ptr<ProductShapeData> >& map_shape_data,
+		const std::function<bool( const shared_ptr<IFC4X3::IfcProduct>& )>& filter = nullptr )
+	{
+		std::vector<shared_ptr<ProductShapeData> > vec_products;
+		for( auto it = map_shape_data.begin(); it != map_shape_data.end(); ++it )
+		{
+			const shared_ptr<ProductShapeData>& product_shape = it->second;
+			if( !product_shape || product_shape->m_ifc_object_definition.expired() )
+			{
+				continue;
+			}
+			shared_ptr<IFC4X3::IfcObjectDefinition> ifc_object_def( product_shape->m_ifc_object_definition );
+			shared_ptr<IFC4X3::IfcProduct> ifc_product = dynamic_pointer_cast<IFC4X3::IfcProduct>( ifc_object_def );
+			if( !ifc_product || dynamic_pointer_cast<IFC4X3::IfcFeatureElementSubtraction>( ifc_object_def ) )
+			{
+				continue;
+			}
+			if( filter && !filter( ifc_product ) )
+			{
+				continue;
+			}
+			vec_products.push_back( product_shape );
+		}
+		return vec_products;
+	}
+
+	//\brief Selects products by their exact class, for example IFC4X3::IFCWALL
+	static std::vector<shared_ptr<ProductShapeData> > selectProductsByClass( const std::map<std::string, shared_ptr<ProductShapeData> >& map_shape_data, const std::set<uint32_t>& class_ids )
+	{
+		return selectProducts( map_shape_data, [&]( const shared_ptr<IFC4X3::IfcProduct>& ifc_product ) { return class_ids.find( ifc_product->classID() ) != class_ids.end(); } );
+	}
+
+	//\brief Selects products by GUID
+	static std::vector<shared_ptr<ProductShapeData> > selectProductsByGuid( const std::map<std::string, shared_ptr<ProductShapeData> >& map_shape_data, const std::vector<std::string>& guids )
+	{
+		std::map<std::string, shared_ptr<ProductShapeData> > map_selected;
+		for( const std::string& guid : guids )
+		{
+			auto it_find = map_shape_data.find( guid );
+			if( it_find != map_shape_data.end() )
+			{
+				map_selected.insert( *it_find );
+			}
+		}
+		return selectProducts( map_selected );
+	}
+
+	//\brief Checks all products of the model against each other
+	void detectClashes( const std::map<std::string, shared_ptr<ProductShapeData> >& map_shape_data, std::vector<ClashResult>& vec_clashes )
+	{
+		std::vector<shared_ptr<ProductShapeData> > vec_products = selectProducts( map_shape_data );
+		detectClashes( vec_products, vec_products, vec_clashes );
+	}
+
+	/**
+	*\brief Checks the products of set1 against the products of set2. The sets may overlap, each pair is reported once.
+	* Products in a decomposition relation (for example a stair and its flights) are not checked against each other.
+	*\param vec_clashes		Result, sorted by GUID
+	*/
+	void detectClashes( const std::vector<shared_ptr<ProductShapeData> >& set1, const std::vector<shared_ptr<ProductShapeData> >& set2, std::vector<ClashResult>& vec_clashes )
+	{
+		vec_clashes.clear();
+
+		// broad phase
+		std::vector<ProductBVH::Element> vec_elements1 = computeElements( set1 );
+		std::vector<ProductBVH::Element> vec_elements2 = computeElements( set2 );
+		if( vec_elements1.size() == 0 || vec_elements2.size() == 0 )
+		{
+			return;
+		}
+
+		std::unordered_set<const ProductShapeData*> set_products1;
+		for( const ProductBVH::Element& element : vec_elements1 )
+		{
+			set_products1.insert( element.m_product.get() );
+		}
+		std::unordered_set<const ProductShapeData*> set_products2;
+		for( const ProductBVH::Element& element : vec_elements2 )
+		{
+			set_products2.insert( element.m_product.get() );
+		}
+
+		ProductBVH bvh;
+		bvh.build( vec_elements2 );
+
+		const int num_elements1 = (int)vec_elements1.size();
+		std::vector<std::vector<size_t> > vec_candidates( num_elements1 );
+		const vec3 expand = carve::geom::VECTOR( m_clearance, m_clearance, m_clearance );
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,64)
+#endif
+		for( int i = 0; i < num_elements1; ++i )
+		{
+			const ProductBVH::Element& element1 = vec_elements1[i];
+			const ProductShapeData* product1 = element1.m_product.get();
+			std::vector<size_t> vec_found;
+			bvh.queryBox( element1.m_min - expand, element1.m_max + expand, vec_found );
+			for( size_t element_index2 : vec_found )
+			{
+				const ProductShapeData* product2 = bvh.getElement( element_index2 ).m_product.get();
+				if( product1 == product2 )
+				{
+					continue;
+				}
+				if( isOrderedAfter( product1, product2 ) && set_products1.find( product2 ) != set_products1.end() && set_products2.find( product1 ) != set_products2.end() )
+				{
+					// the pair is also found the other way round
+					continue;
+				}
+				if( isDecomposition( product1, product2 ) || isDecomposition( product2, product1 ) )
+				{
+					continue;
+				}
+				vec_candidates[i].push_back( element_index2 );
+			}
+		}
+
+		std::vector<std::pair<size_t, size_t> > vec_pairs;
+		for( size_t ii = 0; ii < vec_candidates.size(); ++ii )
+		{
+			for( size_t element_index2 : vec_candidates[ii] )
+			{
+				vec_pairs.push_back( { ii, element_index2 } );
+			}
+		}
+
+		// index the triangles of all products in candidate pairs
+		std::unordered_map<const ProductShapeData*, size_t> map_product_triangles;
+		std::vector<shared_ptr<ProductShapeData> > vec_pair_products;
+		for( const std::pair<size_t, size_t>& pair : vec_pairs )
+		{
+			const shared_ptr<ProductShapeData>& product1 = vec_elements1[pair.first].m_product;
+			const shared_ptr<ProductShapeData>& product2 = bvh.getElement( pair.second ).m_product;
+			if( map_product_triangles.insert( { product1.get(), vec_pair_products.size() } ).second )
+			{
+				vec_pair_products.push_back( product1 );
+			}
+			if( map_product_triangles.insert( { product2.get(), vec_pair_products.size() } ).second )
+			{
+				vec_pair_products.push_back( product2 );
+			}
+		}
+
+		const int num_pair_products = (int)vec_pair_products.size();
+		std::vector<ProductTriangles> vec_product_triangles( num_pair_products );
+		const double eps = m_geom_settings->getEpsilonMergePoints();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16)
+#endif
+		for( int i = 0; i < num_pair_products; ++i )
+		{
+			collectTriangles( vec_pair_products[i], vec_product_triangles[i], eps );
+		}
+
+		// narrow phase
+		const int num_pairs = (int)vec_pairs.size();
+		std::vector<ClashResult> vec_pair_results( num_pairs );
+		std::vector<char> vec_pair_clash( num_pairs, 0 );
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,8)
+#endif
+		for( int i = 0; i < num_pairs; ++i )
+		{
+			const shared_ptr<ProductShapeData>& product1 = vec_elements1[vec_pairs[i].first].m_product;
+			const shared_ptr<ProductShapeData>& product2 = bvh.getElement( vec_pairs[i].second ).m_product;
+			const ProductTriangles& triangles1 = vec_product_triangles[map_product_triangles.find( product1.get() )->second];
+			const ProductTriangles& triangles2 = vec_product_triangles[map_product_triangles.find( product2.get() )->second];
+
+			ClashResult& clash = vec_pair_results[i];
+			if( checkPair( triangles1, triangles2, clash ) )
+			{
+				clash.m_product1 = product1;
+				clash.m_product2 = product2;
+				clash.m_guid1 = product1->m_entity_guid;
+				clash.m_guid2 = product2->m_entity_guid;
+				vec_pair_clash[i] = 1;
+			}
+		}
+
+		size_t num_hard = 0;
+		for( int i = 0; i < num_pairs; ++i )
+		{
+			if( vec_pair_clash[i] )
+			{
+				vec_clashes.push_back( vec_pair_results[i] );
+				if( vec_pair_results[i].m_type == CLASH_HARD )
+				{
+					++num_hard;
+				}
+			}
+		}
+		std::sort( vec_clashes.begin(), vec_clashes.end(), []( const ClashResult& a, const ClashResult& b ) { return a.m_guid1 < b.m_guid1 || ( a.m_guid1 == b.m_guid1 && a.m_guid2 < b.m_guid2 ); } );
+
+		std::stringstream strs;
+		strs << "Clash detection: " << vec_elements1.size() << " x " << vec_elements2.size() << " products, " << vec_pairs.size() << " candidate pairs, "
+			<< num_hard << " hard clashes, " << vec_clashes.size() - num_hard << " clearance clashes";
+		messageCallback( strs.str(), StatusCallback::MESSAGE_TYPE_GENERAL_MESSAGE, "" );
+	}
+
+protected:
+	static std::vector<ProductBVH::Element> computeElements( const std::vector<shared_ptr<ProductShapeData> >& vec_products )
+	{
+		std::set<const ProductShapeData*> set_added;
+		std::vector<ProductBVH::Element> vec_elements;
+		for( const shared_ptr<ProductShapeData>& product_shape : vec_products )
+		{
+			if( !product_shape || !set_added.insert( product_shape.get() ).second )
+			{
+				continue;
+			}
+			ProductBVH::Element element;
+			element.m_product = product_shape;
+			if( ProductBVH::computeElementBoundingBox( element ) )
+			{
+				vec_elements.push_back( element );
+			}
+		}
+		return vec_elements;
+	}
+
+	//\brief Order of the products in a pair that is found both ways. By GUID, so that the result does not depend on memory addresses
+	static bool isOrderedAfter( const ProductShapeData* product1, const ProductShapeData* product2 )
+	{
+		if( product1->m_entity_guid != product2->m_entity_guid )
+		{
+			return product1->m_entity_guid > product2->m_entity_guid;
+		}
+		return product1 > product2;
+	}
+
+	//\brief true if product is a part of possible_parent, directly or indirectly
+	static bool isDecomposition( const ProductShapeData* product, const ProductShapeData* possible_parent )
+	{
+		shared_ptr<ProductShapeData> parent = product->m_parent.lock();
+		while( parent )
+		{
+			if( parent.get() == possible_parent )
+			{
+				return true;
+			}
+			parent = parent->m_parent.lock();
+		}
+		return false;
+	}
+
+	static void collectTriangles( const shared_ptr<ProductShapeData>& product_shape, ProductTriangles& product_triangles, double eps )
+	{
+		product_triangles.m_transform = product_shape->getTransform();
+		const carve::math::Matrix& mat = product_triangles.m_transform;
+		const double det = mat.m[0][0] * ( mat.m[1][1] * mat.m[2][2] - mat.m[2][1] * mat.m[1][2] )
+			- mat.m[1][0] * ( mat.m[0][1] * mat.m[2][2] - mat.m[2][1] * mat.m[0][2] )
+			+ mat.m[2][0] * ( mat.m[0][1] * mat.m[1][2] - mat.m[1][1] * mat.m[0][2] );
+		product_triangles.m_mirrored = det < 0;
+
+		std::vector<ItemShapeData*> vec_items;
+		for( const shared_ptr<ItemShapeData>& item : product_shape->m_geometric_items )
+		{
+			collectItems( item.get(), vec_items );
+		}
+
+		for( ItemShapeData* item : vec_items )
+		{
+			if( item->m_triangle_meshes.size() == 0 )
+			{
+				// meshsets are triangulated like in GeometryConverter::createTriangleMeshes
+				if( item->m_meshsets_open.size() > 0 )
+				{
+					product_triangles.m_closed = false;
+				}
+				for( size_t i_meshsets = 0; i_meshsets < item->m_meshsets.size() + item->m_meshsets_open.size(); ++i_meshsets )
+				{
+					const bool closed = i_meshsets < item->m_meshsets.size();
+					const shared_ptr<carve::mesh::MeshSet<3> >& meshset = closed ? item->m_meshsets[i_meshsets] : item->m_meshsets_open[i_meshsets - item->m_meshsets.size()];
+					TriangleMeshData::triangulateMeshSet( meshset.get(), 0.0, eps, [&]( const carve::mesh::Face<3>*, const carve::mesh::Vertex<3>* v0, const carve::mesh::Vertex<3>* v1, const carve::mesh::Vertex<3>* v2 )
+					{
+						TriangleRef triangle;
+						triangle.m_vertices[0] = v0->v.v;
+						triangle.m_vertices[1] = v1->v.v;
+						triangle.m_vertices[2] = v2->v.v;
+						product_triangles.m_triangles.push_back( triangle );
+					} );
+				}
+				continue;
+			}
+
+			for( const shared_ptr<TriangleMeshData>& triangle_mesh : item->m_triangle_meshes )
+			{
+				if( !triangle_mesh || triangle_mesh->getNumTriangles() == 0 )
+				{
+					continue;
+				}
+				const double* positions = triangle_mesh->m_positions_double.data();
+				if( triangle_mesh->m_single_precision )
+				{
+					shared_ptr<std::vector<double> > converted( new std::vector<double>( triangle_mesh->m_positions_float.begin(), triangle_mesh->m_positions_float.end() ) );
+					product_triangles.m_converted_positions.push_back( converted );
+					positions = converted->data();
+				}
+				for( size_t ii = 0; ii + 2 < triangle_mesh->m_indices.size(); ii += 3 )
+				{
+					TriangleRef triangle;
+					for( size_t jj = 0; jj < 3; ++jj )
+					{
+						triangle.m_vertices[jj] = positions + 3 * triangle_mesh->m_indices[ii + jj];
+					}
+					product_triangles.m_triangles.push_back( triangle );
+				}
+				if( !triangle_mesh->m_closed )
+				{
+					product_triangles.m_closed = false;
+				}
+			}
+		}
+
+		if( product_triangles.m_triangles.size() == 0 )
+		{
+			product_triangles.m_closed = false;
+			return;
+		}
+		for( size_t ii = 0; ii < product_triangles.m_triangles.size(); ++ii )
+		{
+			WorldTriangle world_triangle;
+			toWorld( product_triangles, product_triangles.m_triangles[ii], world_triangle );
+			if( ii == 0 )
+			{
+				product_triangles.m_min = world_triangle.m_min;
+				product_triangles.m_max = world_triangle.m_max;
+				continue;
+			}
+			product_triangles.m_min = carve::geom::VECTOR( std::min( product_triangles.m_min.x, world_triangle.m_min.x ), std::min( product_triangles.m_min.y, world_triangle.m_min.y ), std::min( product_triangles.m_min.z, world_triangle.m_min.z ) );
+			product_triangles.m_max = carve::geom::VECTOR( std::max( product_triangles.m_max.x, world_triangle.m_max.x ), std::max( product_triangles.m_max.y, world_triangle.m_max.y ), std::max( product_triangles.m_max.z, world_triangle.m_max.z ) );
+		}
+	}
+
+	static void collectItems( ItemShapeData* item, std::vector<ItemShapeData*>& vec_items )
+	{
+		if( !item )
+		{
+			return;
+		}
+		vec_items.push_back( item );
+		for( const shared_ptr<ItemShapeData>& child_item : item->m_child_items )
+		{
+			collectItems( child_item.get(), vec_items );
+		}
+	}
+
+	static void toWorld( const ProductTriangles& product_triangles, const TriangleRef& triangle, WorldTriangle& world_triangle )
+	{
+		for( size_t jj = 0; jj < 3; ++jj )
+		{
+			const double* v = triangle.m_vertices[jj];
+			world_triangle.m_vertices[jj] = product_triangles.m_transform*carve::geom::VECTOR( v[0], v[1], v[2] );
+		}
+		const vec3& v0 = world_triangle.m_vertices[0];
+		const vec3& v1 = world_triangle.m_vertices[1];
+		const vec3& v2 = world_triangle.m_vertices[2];
+		world_triangle.m_min = carve::geom::VECTOR( std::min( v0.x, std::min( v1.x, v2.x ) ), std::min( v0.y, std::min( v1.y, v2.y ) ), std::min( v0.z, std::min( v1.z, v2.z ) ) );
+		world_triangle.m_max = carve::geom::VECTOR( std::max( v0.x, std::max( v1.x, v2.x ) ), std::max( v0.y, std::max( v1.y, v2.y ) ), std::max( v0.z, std::max( v1.z, v2.z ) ) );
+		world_triangle.m_normal = carve::geom::cross( v1 - v0, v2 - v0 );
+		const double length = world_triangle.m_normal.length();
+		if( length > 0 )
+		{
+			world_triangle.m_normal = world_triangle.m_normal*( ( product_triangles.m_mirrored ? -1.0 : 1.0 ) / length );
+		}
+	}
+
+	//\brief World triangles of a product that overlap the given box
+	static void collectWorldTriangles( const ProductTriangles& product_triangles, const vec3& box_min, const vec3& box_max, std::vector<WorldTriangle>& vec_world_triangles )
+	{
+		vec_world_triangles.clear();
+		WorldTriangle world_triangle;
+		for( const TriangleRef& triangle : product_triangles.m_triangles )
+		{
+			toWorld( product_triangles, triangle, world_triangle );
+			if( world_triangle.m_normal.length2() == 0 )
+			{
+				continue;
+			}
+			if( world_triangle.m_min.x <= box_max.x && box_min.x <= world_triangle.m_max.x && world_triangle.m_min.y <= box_max.y && box_min.y <= world_triangle.m_max.y
+				&& world_triangle.m_min.z <= box_max.z && box_min.z <= world_triangle.m_max.z )
+			{
+				vec_world_triangles.push_back( world_triangle );
+			}
+		}
+		std::sort( vec_world_triangles.begin(), vec_world_triangles.end(), []( const WorldTriangle& a, const WorldTriangle& b ) { return a.m_min.x < b.m_min.x; } );
+	}
+
+	bool checkPair( const ProductTriangles& triangles1, const ProductTriangles& triangles2, ClashResult& clash ) const
+	{
+		if( triangles1.m_triangles.size() == 0 || triangles2.m_triangles.size() == 0 )
+		{
+			return false;
+		}
+		const double c = m_clearance;
+		const vec3 overlap_min = carve::geom::VECTOR( std::max( triangles1.m_min.x, triangles2.m_min.x ), std::max( triangles1.m_min.y, triangles2.m_min.y ), std::max( triangles1.m_min.z, triangles2.m_min.z ) );
+		const vec3 overlap_max = carve::geom::VECTOR( std::min( triangles1.m_max.x, triangles2.m_max.x ), std::min( triangles1.m_max.y, triangles2.m_max.y ), std::min( triangles1.m_max.z, triangles2.m_max.z ) );
+		if( overlap_min.x > overlap_max.x + c || overlap_min.y > overlap_max.y + c || overlap_min.z > overlap_max.z + c )
+		{
+			return false;
+		}
+		const vec3 expand = carve::geom::VECTOR( c, c, c );
+
+		std::vector<WorldTriangle> vec_world1;
+		std::vector<WorldTriangle> vec_world2;
+		collectWorldTriangles( triangles1, overlap_min - expand, overlap_max + expand, vec_world1 );
+		collectWorldTriangles( triangles2, overlap_min - expand, overlap_max + expand, vec_world2 );
+
+		double max_width2 = 0;
+		for( const WorldTriangle& triangle2 : vec_world2 )
+		{
+			max_width2 = std::max( max_width2, triangle2.m_max.x - triangle2.m_min.x );
+		}
+
+		// sweep along x over the triangles sorted by their minimum x. Triangles farther apart than the closest distance found so far are skipped
+		const bool oriented = triangles1.m_closed && triangles2.m_closed;
+		bool intersecting = false;
+		double max_depth = 0;
+		double min_distance = std::numeric_limits<double>::max();
+		double reach = c;
+		for( const WorldTriangle& triangle1 : vec_world1 )
+		{
+			WorldTriangle search;
+			search.m_min.x = triangle1.m_min.x - reach - max_width2;
+			auto it_begin = std::lower_bound( vec_world2.begin(), vec_world2.end(), search, []( const WorldTriangle& a, const WorldTriangle& b ) { return a.m_min.x < b.m_min.x; } );
+			for( auto it = it_begin; it != vec_world2.end() && it->m_min.x <= triangle1.m_max.x + reach; ++it )
+			{
+				const WorldTriangle& triangle2 = *it;
+				if( triangle2.m_max.x + reach < triangle1.m_min.x || triangle2.m_max.y + reach < triangle1.m_min.y || triangle1.m_max.y + reach < triangle2.m_min.y
+					|| triangle2.m_max.z + reach < triangle1.m_min.z || triangle1.m_max.z + reach < triangle2.m_min.z )
+				{
+					continue;
+				}
+
+				carve::geom::TriangleIntType intersection_type = carve::geom::TR_TYPE_NONE;
+				const bool boxes_overlap = triangle2.m_max.x >= triangle1.m_min.x && triangle1.m_max.x >= triangle2.m_min.x && triangle2.m_max.y >= triangle1.m_min.y
+					&& triangle1.m_max.y >= triangle2.m_min.y && triangle2.m_max.z >= triangle1.m_min.z && triangle1.m_max.z >= triangle2.m_min.z;
+				if( boxes_overlap )
+				{
+					try
+					{
+						intersection_type = carve::geom::triangle_intersection_exact( triangle1.m_vertices, triangle2.m_vertices );
+					}
+					catch( carve::exception& )
+					{
+						intersection_type = carve::geom::TR_TYPE_TOUCH;
+					}
+				}
+
+				if( intersection_type == carve::geom::TR_TYPE_INT )
+				{
+					intersecting = true;
+					reach = 0;
+					const double depth = std::min( penetrationDepth( triangle1, triangle2, oriented ), penetrationDepth( triangle2, triangle1, oriented ) );
+					max_depth = std::max( max_depth, depth );
+				}
+				else if( c > 0 && !intersecting )
+				{
+					const double distance = intersection_type == carve::geom::TR_TYPE_TOUCH ? 0 : triangleDistance( triangle1, triangle2 );
+					if( distance < min_distance )
+					{
+						min_distance = distance;
+						reach = std::min( c, min_distance );
+					}
+				}
+			}
+		}
+
+		// the depth can not exceed the overlap of the products
+		const double overlap_extent = std::min( overlap_max.x - overlap_min.x, std::min( overlap_max.y - overlap_min.y, overlap_max.z - overlap_min.z ) );
+		if( intersecting )
+		{
+			clash.m_penetration = std::max( 0.0, std::min( max_depth, overlap_extent ) );
+			if( clash.m_penetration > m_tolerance )
+			{
+				clash.m_type = CLASH_HARD;
+				return true;
+			}
+			min_distance = 0;
+		}
+		else if( triangles1.m_closed && triangles2.m_closed )
+		{
+			// no crossing faces: one product can be inside the other, or both share a volume that is bounded by coplanar faces
+			if( m_check_containment )
+			{
+				const bool inside1 = isInside( triangles1, triangles2 );
+				if( inside1 || isInside( triangles2, triangles1 ) )
+				{
+					const ProductTriangles& inner = inside1 ? triangles1 : triangles2;
+					clash.m_penetration = std::min( inner.m_max.x - inner.m_min.x, std::min( inner.m_max.y - inner.m_min.y, inner.m_max.z - inner.m_min.z ) );
+					if( clash.m_penetration > m_tolerance )
+					{
+						clash.m_type = CLASH_HARD;
+						clash.m_contained = true;
+						return true;
+					}
+					min_distance = 0;
+				}
+			}
+
+			if( overlap_extent > m_tolerance )
+			{
+				const vec3 center = ( overlap_min + overlap_max )*0.5;
+				if( isPointInside( center, triangles1 ) && isPointInside( center, triangles2 ) )
+				{
+					clash.m_type = CLASH_HARD;
+					clash.m_penetration = overlap_extent;
+					return true;
+				}
+			}
+		}
+
+		if( c > 0 && min_distance < c )
+		{
+			clash.m_type = CLASH_CLEARANCE;
+			clash.m_penetration = 0;
+			clash.m_distance = min_distance;
+			return true;
+		}
+		return false;
+	}
+
+	//\brief Distance of the vertices of other behind the plane of triangle. Without consistent orientation, the smaller of both sides
+	static double penetrationDepth( const WorldTriangle& triangle, const WorldTriangle& other, bool oriented )
+	{
+		double min_d = 0;
+		double max_d = 0;
+		for( size_t jj = 0; jj < 3; ++jj )
+		{
+			const double d = dot( triangle.m_normal, other.m_vertices[jj] - triangle.m_vertices[0] );
+			min_d = std::min( min_d, d );
+			max_d = std::max( max_d, d );
+		}
+		if( oriented )
+		{
+			return -min_d;
+		}
+		return std::min( -min_d, max_d );
+	}
+
+	//\brief true if the triangles of inner are completely inside the closed product outer. Call only if no faces intersect
+	static bool isInside( const ProductTriangles& inner, const ProductTriangles& outer )
+	{
+		if( inner.m_triangles.size() == 0 )
+		{
+			return false;
+		}
+		if( inner.m_min.x < outer.m_min.x || inner.m_min.y < outer.m_min.y || inner.m_min.z < outer.m_min.z
+			|| inner.m_max.x > outer.m_max.x || inner.m_max.y > outer.m_max.y || inner.m_max.z > outer.m_max.z )
+		{
+			return false;
+		}
+		WorldTriangle triangle;
+		toWorld( inner, inner.m_triangles[0], triangle );
+		return isPointInside( ( triangle.m_vertices[0] + triangle.m_vertices[1] + triangle.m_vertices[2] )*( 1.0 / 3.0 ), outer );
+	}
+
+	//\brief Ray parity test against a closed product, with three directions to be robust against rays through edges
+	static bool isPointInside( const vec3& point, const ProductTriangles& product_triangles )
+	{
+		if( !product_triangles.m_closed )
+		{
+			return false;
+		}
+		if( point.x < product_triangles.m_min.x || point.y < product_triangles.m_min.y || point.z < product_triangles.m_min.z
+			|| point.x > product_triangles.m_max.x || point.y > product_triangles.m_max.y || point.z > product_triangles.m_max.z )
+		{
+			return false;
+		}
+		const vec3 directions[3] = { carve::geom::VECTOR( 0.8506508, 0.5257311, 0.0131246 ), carve::geom::VECTOR( -0.0236152, 0.7071068, 0.7067124 ), carve::geom::VECTOR( 0.4472136, -0.0317432, -0.8939016 ) };
+		int num_hits[3] = { 0, 0, 0 };
+		WorldTriangle triangle;
+		for( const TriangleRef& triangle_ref : product_triangles.m_triangles )
+		{
+			toWorld( product_triangles, triangle_ref, triangle );
+			for( size_t jj = 0; jj < 3; ++jj )
+			{
+				if( rayHitsTriangle( point, directions[jj], triangle ) )
+				{
+					++num_hits[jj];
+				}
+			}
+		}
+		const int num_inside = num_hits[0] % 2 + num_hits[1] % 2 + num_hits[2] % 2;
+		return num_inside >= 2;
+	}
+
+	static bool rayHitsTriangle( const vec3& origin, const vec3& direction, const WorldTriangle& triangle )
+	{
+		const vec3 edge1 = triangle.m_vertices[1] - triangle.m_vertices[0];
+		const vec3 edge2 = triangle.m_vertices[2] - triangle.m_vertices[0];
+		const vec3 p = carve::geom::cross( direction, edge2 );
+		const double det = dot( edge1, p );
+		if( std::abs( det ) < 1e-15 )
+		{
+			return false;
+		}
+		const double inv_det = 1.0 / det;
+		const vec3 t = origin - triangle.m_vertices[0];
+		const double u = dot( t, p )*inv_det;
+		if( u < 0 || u > 1 )
+		{
+			return false;
+		}
+		const vec3 q = carve::geom::cross( t, edge1 );
+		const double v = dot( direction, q )*inv_det;
+		if( v < 0 || u + v > 1 )
+		{
+			return false;
+		}
+		return dot( edge2, q )*inv_det > 0;
+	}
+
+	//\brief Minimum distance of two triangles that do not intersect
+	static double triangleDistance( const WorldTriangle& triangle1, const WorldTriangle& triangle2 )
+	{
+		double min_distance2 = std::numeric_limits<double>::max();
+		for( size_t ii = 0; ii < 3; ++ii )
+		{
+			min_distance2 = std::min( min_distance2, ( closestPointOnTriangle( triangle1.m_vertices[ii], triangle2 ) - triangle1.m_vertices[ii] ).length2() );
+			min_distance2 = std::min( min_distance2, ( closestPointOnTriangle( triangle2.m_vertices[ii], triangle1 ) - triangle2.m_vertices[ii] ).length2() );
+			for( size_t jj = 0; jj < 3; ++jj )
+			{
+				min_distance2 = std::min( min_distance2, segmentDistance2( triangle1.m_vertices[ii], triangle1.m_vertices[( ii + 1 ) % 3], triangle2.m_vertices[jj], triangle2.m_vertices[( jj + 1 ) % 3] ) );
+			}
+		}
+		return std::sqrt( min_distance2 );
+	}
+
+	static vec3 closestPointOnTriangle( const vec3& p, const WorldTriangle& triangle )
+	{
+		const vec3& a = triangle.m_vertices[0];
+		const vec3& b = triangle.m_vertices[1];
+		const vec3& c = triangle.m_vertices[2];
+		const vec3 ab = b - a;
+		const vec3 ac = c - a;
+		const vec3 ap = p - a;
+		const double d1 = dot( ab, ap );
+		const double d2 = dot( ac, ap );
+		if( d1 <= 0 && d2 <= 0 )
+		{
+			return a;
+		}
+		const vec3 bp = p - b;
+		const double d3 = dot( ab, bp );
+		const double d4 = dot( ac, bp );
+		if( d3 >= 0 && d4 <= d3 )
+		{
+			return b;
+		}
+		const double vc = d1*d4 - d3*d2;
+		if( vc <= 0 && d1 >= 0 && d3 <= 0 )
+		{
+			return a + ab*( d1 / ( d1 - d3 ) );
+		}
+		const vec3 cp = p - c;
+		const double d5 = dot( ab, cp );
+		const double d6 = dot( ac, cp );
+		if( d6 >= 0 && d5 <= d6 )
+		{
+			return c;
+		}
+		const double vb = d5*d2 - d1*d6;
+		if( vb <= 0 && d2 >= 0 && d6 <= 0 )
+		{
+			return a + ac*( d2 / ( d2 - d6 ) );
+		}
+		const double va = d3*d6 - d5*d4;
+		if( va <= 0 && ( d4 - d3 ) >= 0 && ( d5 - d6 ) >= 0 )
+		{
+			return b + ( c - b )*( ( d4 - d3 ) / ( ( d4 - d3 ) + ( d5 - d6 ) ) );
+		}
+		const double denom = 1.0 / ( va + vb + vc );
+		return a + ab*( vb*denom ) + ac*( vc*denom );
+	}
+
+	//\brief Squared minimum distance of the segments p1-q1 and p2-q2
+	static double segmentDistance2( const vec3& p1, const vec3& q1, const vec3& p2, const vec3& q2 )
+	{
+		const vec3 d1 = q1 - p1;
+		const vec3 d2 = q2 - p2;
+		const vec3 r = p1 - p2;
+		const double a = dot( d1, d1 );
+		const double e = dot( d2, d2 );
+		const double f = dot( d2, r );
+		double s = 0;
+		double t = 0;
+		if( a <= 1e-30 && e <= 1e-30 )
+		{
+			return dot( r, r );
+		}
+		if( a <= 1e-30 )
+		{
+			t = std::clamp( f / e, 0.0, 1.0 );
+		}
+		else
+		{
+			const double c = dot( d1, r );
+			if( e <= 1e-30 )
+			{
+				s = std::clamp( -c / a, 0.0, 1.0 );
+			}
+			else
+			{
+				const double b = dot( d1, d2 );
+				const double denom = a*e - b*b;
+				s = denom != 0 ? std::clamp( ( b*f - c*e ) / denom, 0.0, 1.0 ) : 0.0;
+				t = ( b*s + f ) / e;
+				if( t < 0 )
+				{
+					t = 0;
+					s = std::clamp( -c / a, 0.0, 1.0 );
+				}
+				else if( t > 1 )
+				{
+					t = 1;
+					s = std::clamp( ( b - c ) / a, 0.0, 1.0 );
+				}
+			}
+		}
+		const vec3 closest = p1 + d1*s - ( p2 + d2*t );
+		return dot( closest, closest );
+	}
+};
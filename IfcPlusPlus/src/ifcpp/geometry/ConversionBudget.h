@@ -0,0 +1,84 @@
+/* -*-c++-*- IfcQuery www.ifcquery.com
+*
+MIT License
+
+Copyright (c) 2017 Fabian Gerold
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+/**
+*\brief Class ConversionBudget: deadline for the conversion of one product, see GeometrySettings::setMaxTimePerProduct and setMaxTimePerCsgOperation.
+*
+* The budget of the product that is converted by a thread is stored thread local, so that long running loops deep in the conversion
+* can check it cooperatively. OpenMP tasks that are created while converting a product run with the budget of the creating thread,
+* see ScopedConversionBudget.
+*/
+class ConversionBudget
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+protected:
+	Clock::time_point m_deadline = Clock::time_point::max();
+
+public:
+	//\brief Budget of the current thread, unlimited if no product is converted
+	static ConversionBudget& current()
+	{
+		static thread_local ConversionBudget budget;
+		return budget;
+	}
+
+	bool isLimited() const { return m_deadline != Clock::time_point::max(); }
+	bool exceeded() const { return isLimited() && Clock::now() > m_deadline; }
+	const Clock::time_point& getDeadline() const { return m_deadline; }
+
+	//\brief Moves the deadline to the given number of seconds from now, if that is earlier. A value <= 0 does not limit the budget
+	void limit( double seconds )
+	{
+		if( seconds > 0 )
+		{
+			const Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( seconds ) );
+			m_deadline = std::min( m_deadline, deadline );
+		}
+	}
+};
+
+//\brief Sets the budget of the current thread for the lifetime of the object, and restores the previous budget afterwards
+class ScopedConversionBudget
+{
+protected:
+	ConversionBudget m_previous;
+
+public:
+	//\brief Replaces the budget, for example at the start of an OpenMP task with the budget of the thread that created the task
+	ScopedConversionBudget( const ConversionBudget& budget ) : m_previous( ConversionBudget::current() )
+	{
+		ConversionBudget::current() = budget;
+	}
+
+	//\brief Restricts the current budget to the given number of seconds from now
+	ScopedConversionBudget( double seconds ) : m_previous( ConversionBudget::current() )
+	{
+		ConversionBudget::current().limit( seconds );
+	}
+
+	~ScopedConversionBudget()
+	{
+		ConversionBudget::current() = m_previous;
+	}
+};
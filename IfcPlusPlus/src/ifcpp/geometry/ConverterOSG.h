@@ -17,6 +17,9 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OU
 
 #pragma once
 
+#include <array>
+#include <tuple>
+#include <unordered_map>
 #include <osg/CullFace>
 #include <osg/Geode>
 #include <osg/Hint>
@@ -50,7 +53,46 @@ using namespace IFC4X3;
 
 class ConverterOSG : public StatusCallback
 {
+public:
+	//\brief Palette id or content of an AppearanceData object that is used in convertToOSGStateSet. Appearances with equal keys share one osg::StateSet
+	struct StateSetKey
+	{
+		int						m_palette_id = -1;
+		std::array<double, 9>	m_colors{};
+		double					m_shininess = 0;
+		double					m_transparency = 0;
+		float					m_transparency_override = -1.f;
+		bool					m_set_transparent = false;
+
+		bool operator<(const StateSetKey& other) const
+		{
+			return std::tie(m_palette_id, m_colors, m_shininess, m_transparency, m_transparency_override, m_set_transparent)
+				< std::tie(other.m_palette_id, other.m_colors, other.m_shininess, other.m_transparency, other.m_transparency_override, other.m_set_transparent);
+		}
+	};
+
+	//\brief Geometry and surface appearances of an item. Items with equal keys, for example items that share meshes through ItemShapeCache, share one osg::Geode
+	struct ItemGeodeKey
+	{
+		std::vector<const void*>	m_geometry;
+		std::vector<StateSetKey>	m_appearances;
+		float						m_transparency_override = -1.f;
+
+		bool operator<(const ItemGeodeKey& other) const
+		{
+			return std::tie(m_geometry, m_appearances, m_transparency_override) < std::tie(other.m_geometry, other.m_appearances, other.m_transparency_override);
+		}
+	};
+
 protected:
+	//\brief Item that is placed below a product transform. The geodes are created in convertItemInstances, after the product structure is complete
+	struct ItemInstance
+	{
+		osg::ref_ptr<osg::Group>	m_parent;
+		shared_ptr<ItemShapeData>	m_item;
+		float						m_transparency_override = -1.f;
+	};
+
 	shared_ptr<GeometrySettings>						m_geom_settings;
 	std::map<std::string, osg::ref_ptr<osg::Switch> >	m_map_entity_guid_to_switch;
 	std::map<int, osg::ref_ptr<osg::Switch> >			m_map_representation_id_to_switch;
@@ -63,6 +105,12 @@ protected:
 	bool												m_draw_bounding_box = false;
 	size_t m_numConvertedProducts = 0;
 	size_t m_numProductsInModel = 0;
+	std::vector<ItemInstance>							m_vec_item_instances;
+	std::map<StateSetKey, osg::ref_ptr<osg::StateSet> >	m_map_appearance_to_stateset;
+
+#ifdef _OPENMP
+	Mutex m_writelock_cull_face;
+#endif
 
 public:
 	ConverterOSG(shared_ptr<GeometrySettings>& geom_settings) : m_geom_settings(geom_settings)
@@ -85,6 +133,8 @@ public:
 	{
 		m_map_entity_guid_to_switch.clear();
 		m_map_representation_id_to_switch.clear();
+		m_vec_item_instances.clear();
+		m_map_appearance_to_stateset.clear();
 
 		m_numConvertedProducts = 0;
 		m_numProductsInModel = 0;
@@ -470,6 +520,10 @@ public:
 			// disable back face culling for open meshes
 			if (disableBackFaceCulling)
 			{
+				// the attribute is shared by all geometries, and registering a parent is not thread safe
+#ifdef _OPENMP
+				ScopedLock lock(m_writelock_cull_face);
+#endif
 				geometry->getOrCreateStateSet()->setAttributeAndModes(m_cull_back_off.get(), osg::StateAttribute::OFF);
 			}
 
@@ -673,6 +727,46 @@ public:
 		}
 	}
 
+	static StateSetKey computeStateSetKey(const shared_ptr<AppearanceData>& appearance, float transparencyOverride)
+	{
+		StateSetKey key;
+		if (transparencyOverride > 0)
+		{
+			key.m_transparency_override = transparencyOverride;
+		}
+
+		if (appearance->m_palette_id >= 0)
+		{
+			// appearances with equal content have equal palette ids, see AppearancePalette
+			key.m_palette_id = appearance->m_palette_id;
+			return key;
+		}
+
+		key.m_colors = { appearance->m_color_ambient.r(), appearance->m_color_ambient.g(), appearance->m_color_ambient.b(),
+			appearance->m_color_diffuse.r(), appearance->m_color_diffuse.g(), appearance->m_color_diffuse.b(),
+			appearance->m_color_specular.r(), appearance->m_color_specular.g(), appearance->m_color_specular.b() };
+		key.m_shininess = appearance->m_shininess;
+		key.m_transparency = appearance->m_transparency;
+		key.m_set_transparent = appearance->m_set_transparent;
+		return key;
+	}
+
+	//\brief returns the stateset of the appearance. Statesets are created once per appearance content and shared by all groups with that appearance
+	osg::StateSet* getAppearanceStateSet(const shared_ptr<AppearanceData>& appearance, float transparencyOverride)
+	{
+		const StateSetKey key = computeStateSetKey(appearance, transparencyOverride);
+		auto it_find = m_map_appearance_to_stateset.find(key);
+		if (it_find != m_map_appearance_to_stateset.end())
+		{
+			return it_find->second.get();
+		}
+
+		osg::ref_ptr<osg::StateSet> stateset;
+		convertToOSGStateSet(appearance, stateset, transparencyOverride);
+		m_map_appearance_to_stateset[key] = stateset;
+		return stateset.get();
+	}
+
 	void applyAppearancesToGroup(const std::vector<shared_ptr<AppearanceData> >& vec_product_appearances, osg::Group* grp, float transparencyOverride)
 	{
 		for (size_t ii = 0; ii < vec_product_appearances.size(); ++ii)
@@ -685,8 +779,7 @@ public:
 
 			if (appearance->m_apply_to_geometry_type == AppearanceData::GEOM_TYPE_SURFACE || appearance->m_apply_to_geometry_type == AppearanceData::GEOM_TYPE_ANY)
 			{
-				osg::ref_ptr<osg::StateSet> item_stateset;
-				convertToOSGStateSet(appearance, item_stateset, transparencyOverride);
+				osg::StateSet* item_stateset = getAppearanceStateSet(appearance, transparencyOverride);
 				if (item_stateset)
 				{
 					osg::StateSet* existing_item_stateset = grp->getStateSet();
@@ -694,7 +787,10 @@ public:
 					{
 						if (existing_item_stateset != item_stateset)
 						{
-							existing_item_stateset->merge(*item_stateset);
+							// the existing stateset can be shared with other groups, so merge into a copy
+							osg::ref_ptr<osg::StateSet> merged_stateset = new osg::StateSet(*existing_item_stateset, osg::CopyOp::SHALLOW_COPY);
+							merged_stateset->merge(*item_stateset);
+							grp->setStateSet(merged_stateset);
 						}
 					}
 					else
@@ -718,20 +814,14 @@ public:
 			mat_in.m[3][0], mat_in.m[3][1], mat_in.m[3][2], mat_in.m[3][3]);
 	}
 
-	void convertMeshSets(std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& vecMeshSets, osg::Geode* geode, size_t ii_item, bool disableBackfaceCulling)
+	void convertMeshSets(std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& vecMeshSets, osg::Geode* geode, bool disableBackfaceCulling)
 	{
+		// meshsets are triangulated in convertItemInstances
 		double min_triangle_area = m_geom_settings->getMinTriangleArea();
-		double eps = m_geom_settings->getEpsilonMergePoints();
 		double crease_angle = m_faces_crease_angle;
 		for (size_t ii = 0; ii < vecMeshSets.size(); ++ii)
 		{
 			shared_ptr<carve::mesh::MeshSet<3> >& item_meshset = vecMeshSets[ii];
-
-			double epsCoplanarFacesAngle = eps;
-			double minFaceArea = eps;
-			bool dumpMeshes = false;
-			GeomProcessingParams params( m_geom_settings, dumpMeshes);
-			MeshOps::retriangulateMeshSetForExport(item_meshset, params);
 			drawMeshSet(item_meshset, geode, crease_angle, min_triangle_area, false, disableBackfaceCulling);
 
 			if (m_render_crease_edges)
@@ -749,162 +839,397 @@ public:
 		}
 	}
 
-	void convertGeometricItem(const shared_ptr<ItemShapeData>& item_data, shared_ptr<IfcProduct>& ifc_product, size_t ii_representation, size_t ii_item, osg::Group* parentNode, float transparencyOverride)
+	void drawTriangleMesh(const shared_ptr<TriangleMeshData>& triangle_mesh, osg::Geode* geode)
+	{
+		const size_t num_vertices = triangle_mesh->getNumVertices();
+		if (num_vertices == 0 || triangle_mesh->getNumTriangles() == 0)
+		{
+			return;
+		}
+
+		osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array();
+		osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array();
+		vertices->reserve(num_vertices);
+		normals->reserve(num_vertices);
+		for (size_t ii = 0; ii < num_vertices; ++ii)
+		{
+			const vec3 point = triangle_mesh->getPosition(ii);
+			vertices->push_back(osg::Vec3(point.x, point.y, point.z));
+			normals->push_back(osg::Vec3(triangle_mesh->m_normals[ii * 3], triangle_mesh->m_normals[ii * 3 + 1], triangle_mesh->m_normals[ii * 3 + 2]));
+		}
+
+		osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry();
+		geometry->setVertexArray(vertices);
+		geometry->setNormalArray(normals);
+		normals->setBinding(osg::Array::BIND_PER_VERTEX);
+		geometry->addPrimitiveSet(new osg::DrawElementsUInt(osg::PrimitiveSet::TRIANGLES, triangle_mesh->m_indices.begin(), triangle_mesh->m_indices.end()));
+		geode->addDrawable(geometry);
+
+		// disable back face culling for open meshes
+		if (!triangle_mesh->m_closed)
+		{
+#ifdef _OPENMP
+			ScopedLock lock(m_writelock_cull_face);
+#endif
+			geometry->getOrCreateStateSet()->setAttributeAndModes(m_cull_back_off.get(), osg::StateAttribute::OFF);
+		}
+	}
+
+	//\brief method collectItemInstances: remembers the item and its child items, the geodes are created later in convertItemInstances
+	void collectItemInstances(const shared_ptr<ItemShapeData>& item_data, osg::Group* parentNode, float transparencyOverride)
 	{
 		bool includeChildren = false;
 		if (item_data->hasGeometricRepresentation(includeChildren))
 		{
-			osg::ref_ptr<osg::Geode> item_geode = new osg::Geode();
+			ItemInstance instance;
+			instance.m_parent = parentNode;
+			instance.m_item = item_data;
+			instance.m_transparency_override = transparencyOverride;
+			m_vec_item_instances.push_back(instance);
+		}
 
-			std::string product_guid;
-			if (ifc_product->m_GlobalId)
+		for (size_t i_item = 0; i_item < item_data->m_child_items.size(); ++i_item)
+		{
+			const shared_ptr<ItemShapeData>& child = item_data->m_child_items[i_item];
+			collectItemInstances(child, parentNode, transparencyOverride);
+		}
+	}
+
+	static ItemGeodeKey computeItemGeodeKey(const ItemInstance& instance)
+	{
+		ItemGeodeKey key;
+		const shared_ptr<ItemShapeData>& item_data = instance.m_item;
+
+		// null pointers separate the kinds of geometry, since they are drawn differently
+		for (const shared_ptr<carve::mesh::MeshSet<3> >& meshset : item_data->m_meshsets_open) { key.m_geometry.push_back(meshset.get()); }
+		key.m_geometry.push_back(nullptr);
+		for (const shared_ptr<carve::mesh::MeshSet<3> >& meshset : item_data->m_meshsets) { key.m_geometry.push_back(meshset.get()); }
+		key.m_geometry.push_back(nullptr);
+		for (const shared_ptr<TriangleMeshData>& triangle_mesh : item_data->m_triangle_meshes) { key.m_geometry.push_back(triangle_mesh.get()); }
+		key.m_geometry.push_back(nullptr);
+		for (const shared_ptr<carve::input::VertexData>& vertex_data : item_data->m_vertex_points) { key.m_geometry.push_back(vertex_data.get()); }
+		key.m_geometry.push_back(nullptr);
+		for (const shared_ptr<carve::input::PolylineSetData>& polyline_data : item_data->m_polylines) { key.m_geometry.push_back(polyline_data.get()); }
+		key.m_geometry.push_back(nullptr);
+		for (const shared_ptr<TextItemData>& text_data : item_data->m_vec_text_literals) { key.m_geometry.push_back(text_data.get()); }
+
+		for (const shared_ptr<AppearanceData>& appearance : item_data->m_vec_item_appearances)
+		{
+			if (!appearance)
 			{
-				product_guid = ifc_product->m_GlobalId->m_value;
+				continue;
 			}
-
-			std::string ifc_entity_type = EntityFactory::getStringForClassID(ifc_product->classID());
-			std::stringstream strs_product_switch_name;
-			strs_product_switch_name << product_guid << ":" << ifc_entity_type << " group";
-			std::string product_switch_name = strs_product_switch_name.str();
-
-#ifdef _DEBUG
-			int tag = ifc_product->m_tag;
-			if (product_guid.compare("3WMG3ehJnBiu4F_L5ltNmO") == 0 || ifc_product->classID() == IFC4X3::IFCWINDOW)
+			if (appearance->m_apply_to_geometry_type == AppearanceData::GEOM_TYPE_SURFACE || appearance->m_apply_to_geometry_type == AppearanceData::GEOM_TYPE_ANY)
 			{
-				int wait = 0;
+				key.m_appearances.push_back(computeStateSetKey(appearance, instance.m_transparency_override));
 			}
-#endif
+		}
+
+		if (instance.m_transparency_override > 0)
+		{
+			key.m_transparency_override = instance.m_transparency_override;
+		}
+		return key;
+	}
+
+	//\brief method convertItemMeshes: draws the meshes of an item. Does not modify shared osg objects, so it can be called in parallel for different geodes
+	void convertItemMeshes(const shared_ptr<ItemShapeData>& item_data, osg::Geode* item_geode)
+	{
+		if (item_data->m_meshsets_open.size() > 0)
+		{
+			// disable back face culling for open meshes
+			convertMeshSets(item_data->m_meshsets_open, item_geode, true);
+		}
 
-			if (item_data->m_meshsets_open.size() > 0)
+		// create shape for closed meshes
+		convertMeshSets(item_data->m_meshsets, item_geode, false);
+
+		if (item_data->m_meshsets.size() == 0 && item_data->m_meshsets_open.size() == 0)
+		{
+			// carve meshes have been released after creating triangle meshes, see GeometrySettings::setReleaseCarveMeshes
+			for (const shared_ptr<TriangleMeshData>& triangle_mesh : item_data->m_triangle_meshes)
 			{
-				// disable back face culling for open meshes
-				convertMeshSets(item_data->m_meshsets_open, item_geode, ii_item, true);
+				if (triangle_mesh)
+				{
+					drawTriangleMesh(triangle_mesh, item_geode);
+				}
 			}
+		}
+	}
 
-			// create shape for closed meshes
-			convertMeshSets(item_data->m_meshsets, item_geode, ii_item, false);
-
-			// create shape for points
-			const std::vector<shared_ptr<carve::input::VertexData> >& vertex_points = item_data->getVertexPoints();
-			for (size_t ii = 0; ii < vertex_points.size(); ++ii)
+	//\brief method convertItemPointsAndCurves: draws points, polylines and text literals of an item
+	void convertItemPointsAndCurves(const shared_ptr<ItemShapeData>& item_data, osg::Geode* item_geode)
+	{
+		// create shape for points
+		const std::vector<shared_ptr<carve::input::VertexData> >& vertex_points = item_data->getVertexPoints();
+		for (size_t ii = 0; ii < vertex_points.size(); ++ii)
+		{
+			const shared_ptr<carve::input::VertexData>& pointset_data = vertex_points[ii];
+			if (pointset_data)
 			{
-				const shared_ptr<carve::input::VertexData>& pointset_data = vertex_points[ii];
-				if (pointset_data)
+				if (pointset_data->points.size() > 0)
 				{
-					if (pointset_data->points.size() > 0)
-					{
-						osg::ref_ptr<osg::Geode> geode = new osg::Geode();
+					osg::ref_ptr<osg::Geode> geode = new osg::Geode();
 
-						osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array();
-						for (size_t i_pointset_point = 0; i_pointset_point < pointset_data->points.size(); ++i_pointset_point)
-						{
-							vec3& carve_point = pointset_data->points[i_pointset_point];
-							vertices->push_back(osg::Vec3d(carve_point.x, carve_point.y, carve_point.z));
-						}
+					osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array();
+					for (size_t i_pointset_point = 0; i_pointset_point < pointset_data->points.size(); ++i_pointset_point)
+					{
+						vec3& carve_point = pointset_data->points[i_pointset_point];
+						vertices->push_back(osg::Vec3d(carve_point.x, carve_point.y, carve_point.z));
+					}
 
-						osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry();
-						geometry->setVertexArray(vertices);
-						geometry->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::POINTS, 0, vertices->size()));
-						geode->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
-						geode->getOrCreateStateSet()->setAttribute(new osg::Point(3.0f), osg::StateAttribute::ON);
-						geode->addDrawable(geometry);
-						geode->setCullingActive(false);
-						item_geode->addChild(geode);
+					osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry();
+					geometry->setVertexArray(vertices);
+					geometry->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::POINTS, 0, vertices->size()));
+					geode->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+					geode->getOrCreateStateSet()->setAttribute(new osg::Point(3.0f), osg::StateAttribute::ON);
+					geode->addDrawable(geometry);
+					geode->setCullingActive(false);
+					item_geode->addChild(geode);
 
 #ifdef _DEBUG
-						std::stringstream strs_item_meshset_name;
-						strs_item_meshset_name << " vertex_point " << ii;
-						geode->setName(strs_item_meshset_name.str().c_str());
+					std::stringstream strs_item_meshset_name;
+					strs_item_meshset_name << " vertex_point " << ii;
+					geode->setName(strs_item_meshset_name.str().c_str());
 #endif
-					}
 				}
 			}
+		}
 
-			// create shape for polylines
-			for (size_t ii = 0; ii < item_data->m_polylines.size(); ++ii)
-			{
-				shared_ptr<carve::input::PolylineSetData>& polyline_data = item_data->m_polylines[ii];
-				osg::ref_ptr<osg::Geode> geode = new osg::Geode();
-				geode->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
-				drawPolyline(polyline_data.get(), geode);
-				item_geode->addChild(geode);
+		// create shape for polylines
+		for (size_t ii = 0; ii < item_data->m_polylines.size(); ++ii)
+		{
+			shared_ptr<carve::input::PolylineSetData>& polyline_data = item_data->m_polylines[ii];
+			osg::ref_ptr<osg::Geode> geode = new osg::Geode();
+			geode->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+			drawPolyline(polyline_data.get(), geode);
+			item_geode->addChild(geode);
 
 #ifdef _DEBUG
-				std::stringstream strs_item_meshset_name;
-				strs_item_meshset_name << " polylines " << ii;
-				geode->setName(strs_item_meshset_name.str().c_str());
+			std::stringstream strs_item_meshset_name;
+			strs_item_meshset_name << " polylines " << ii;
+			geode->setName(strs_item_meshset_name.str().c_str());
 #endif
-			}
+		}
 
-			if (m_geom_settings->isShowTextLiterals())
+		if (m_geom_settings->isShowTextLiterals())
+		{
+			for (size_t ii = 0; ii < item_data->m_vec_text_literals.size(); ++ii)
 			{
-				for (size_t ii = 0; ii < item_data->m_vec_text_literals.size(); ++ii)
+				shared_ptr<TextItemData>& text_data = item_data->m_vec_text_literals[ii];
+				if (!text_data)
 				{
-					shared_ptr<TextItemData>& text_data = item_data->m_vec_text_literals[ii];
-					if (!text_data)
-					{
-						continue;
-					}
-					carve::math::Matrix& text_pos = text_data->m_text_position;
-					// TODO: handle rotation
-
-					std::string text_str;
-					text_str.assign(text_data->m_text.begin(), text_data->m_text.end());
-
-					osg::Vec3 pos2(text_pos._41, text_pos._42, text_pos._43);
-
-					osg::ref_ptr<osgText::Text> txt = new osgText::Text();
-					txt->setFont("fonts/arial.ttf");
-					txt->setColor(osg::Vec4f(0, 0, 0, 1));
-					txt->setCharacterSize(0.1f);
-					txt->setAutoRotateToScreen(true);
-					txt->setPosition(pos2);
-					txt->setText(text_str.c_str());
-					txt->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
-
-					osg::ref_ptr<osg::Geode> geodeText = new osg::Geode();
-					geodeText->addDrawable(txt);
-					item_geode->addChild(geodeText);
+					continue;
 				}
+				carve::math::Matrix& text_pos = text_data->m_text_position;
+				// TODO: handle rotation
+
+				std::string text_str;
+				text_str.assign(text_data->m_text.begin(), text_data->m_text.end());
+
+				osg::Vec3 pos2(text_pos._41, text_pos._42, text_pos._43);
+
+				osg::ref_ptr<osgText::Text> txt = new osgText::Text();
+				txt->setFont("fonts/arial.ttf");
+				txt->setColor(osg::Vec4f(0, 0, 0, 1));
+				txt->setCharacterSize(0.1f);
+				txt->setAutoRotateToScreen(true);
+				txt->setPosition(pos2);
+				txt->setText(text_str.c_str());
+				txt->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+
+				osg::ref_ptr<osg::Geode> geodeText = new osg::Geode();
+				geodeText->addDrawable(txt);
+				item_geode->addChild(geodeText);
 			}
+		}
+	}
 
-			// If anything has been created, add it to the product group
-			if (item_geode->getNumChildren() > 0)
+	//\brief method convertItemInstances: creates the geodes of the items collected in convertProductShapeToOSG and adds them to the product transforms.
+	// Meshes are triangulated and drawn in parallel. Items with equal geometry and appearance, for example items that share meshes through ItemShapeCache, share one geode
+	void convertItemInstances(std::stringstream& errorStream)
+	{
+		// triangulate each meshset only once, also if it is shared by several items
+		std::vector<shared_ptr<carve::mesh::MeshSet<3> > > vec_meshsets;
+		std::unordered_map<const carve::mesh::MeshSet<3>*, size_t> map_meshset_index;
+		for (const ItemInstance& instance : m_vec_item_instances)
+		{
+			for (const shared_ptr<carve::mesh::MeshSet<3> >& meshset : instance.m_item->m_meshsets_open)
 			{
-#ifdef _DEBUG
-				if (item_geode->getNumParents() > 0)
+				if (meshset && map_meshset_index.insert({ meshset.get(), vec_meshsets.size() }).second)
+				{
+					vec_meshsets.push_back(meshset);
+				}
+			}
+			for (const shared_ptr<carve::mesh::MeshSet<3> >& meshset : instance.m_item->m_meshsets)
+			{
+				if (meshset && map_meshset_index.insert({ meshset.get(), vec_meshsets.size() }).second)
 				{
-					std::cout << __FUNC__ << ": product_representation_switch->getNumParents() > 0" << std::endl;
+					vec_meshsets.push_back(meshset);
 				}
+			}
+		}
+
+		const int num_meshsets = (int)vec_meshsets.size();
+#ifdef _OPENMP
+		Mutex writelock_error;
+#pragma omp parallel for schedule(dynamic,16)
+#endif
+		for (int i = 0; i < num_meshsets; ++i)
+		{
+			try
+			{
+				bool dumpMeshes = false;
+				GeomProcessingParams params(m_geom_settings, dumpMeshes);
+				MeshOps::retriangulateMeshSetForExport(vec_meshsets[i], params);
+			}
+			catch (carve::exception& e)
+			{
+#ifdef _OPENMP
+				ScopedLock lock(writelock_error);
+#endif
+				errorStream << e.str();
+			}
+			catch (std::exception& e)
+			{
+#ifdef _OPENMP
+				ScopedLock lock(writelock_error);
 #endif
+				errorStream << e.what();
+			}
+		}
 
-				// apply statesets if there are any
-				if (item_data->m_vec_item_appearances.size() > 0)
+		for (ItemInstance& instance : m_vec_item_instances)
+		{
+			for (shared_ptr<carve::mesh::MeshSet<3> >& meshset : instance.m_item->m_meshsets_open)
+			{
+				auto it_find = map_meshset_index.find(meshset.get());
+				if (it_find != map_meshset_index.end())
 				{
-					applyAppearancesToGroup(item_data->m_vec_item_appearances, item_geode, transparencyOverride);
+					meshset = vec_meshsets[it_find->second];
 				}
+			}
+			for (shared_ptr<carve::mesh::MeshSet<3> >& meshset : instance.m_item->m_meshsets)
+			{
+				auto it_find = map_meshset_index.find(meshset.get());
+				if (it_find != map_meshset_index.end())
+				{
+					meshset = vec_meshsets[it_find->second];
+				}
+			}
+		}
 
-				if (transparencyOverride > 0)
+		// one geode per distinct item geometry and appearance
+		std::map<ItemGeodeKey, size_t> map_key_to_geode;
+		std::vector<size_t> vec_instance_geode(m_vec_item_instances.size());
+		std::vector<const ItemInstance*> vec_geode_items;
+		for (size_t ii = 0; ii < m_vec_item_instances.size(); ++ii)
+		{
+			auto it_inserted = map_key_to_geode.insert({ computeItemGeodeKey(m_vec_item_instances[ii]), vec_geode_items.size() });
+			if (it_inserted.second)
+			{
+				vec_geode_items.push_back(&m_vec_item_instances[ii]);
+			}
+			vec_instance_geode[ii] = it_inserted.first->second;
+		}
+
+		// draw the meshes in parallel. Each geode is created by one thread, shared statesets are applied afterwards
+		m_recent_progress = 0;
+		const int num_geodes = (int)vec_geode_items.size();
+		std::vector<osg::ref_ptr<osg::Geode> > vec_geodes(num_geodes);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+		for (int i = 0; i < num_geodes; ++i)
+		{
+			osg::ref_ptr<osg::Geode> item_geode = new osg::Geode();
+			try
+			{
+				convertItemMeshes(vec_geode_items[i]->m_item, item_geode);
+			}
+			catch (carve::exception& e)
+			{
+#ifdef _OPENMP
+				ScopedLock lock(writelock_error);
+#endif
+				errorStream << e.str();
+			}
+			catch (std::exception& e)
+			{
+#ifdef _OPENMP
+				ScopedLock lock(writelock_error);
+#endif
+				errorStream << e.what();
+			}
+			vec_geodes[i] = item_geode;
+
+			// progress callback
+			double progress = (double)i / (double)num_geodes;
+			if (progress - m_recent_progress > 0.02)
+			{
+#ifdef _OPENMP
+				if (omp_get_thread_num() == 0)
+#endif
 				{
-					bool hasTriangles = SceneGraphUtils::hasTrianglesWithMaterial(item_geode);
-					bool createMaterialIfNotExisting = false;
+					// the product structure has been created before, leave 10% of progress to openscenegraph internals
+					progressValueCallback(0.2 + progress * 0.7, "scenegraph");
+					m_recent_progress = progress;
+				}
+			}
+		}
 
-					if (!hasTriangles)
-					{
-						createMaterialIfNotExisting = true;
-					}
-					SceneGraphUtils::setMaterialAlpha(item_geode, transparencyOverride, createMaterialIfNotExisting );
+		for (int i = 0; i < num_geodes; ++i)
+		{
+			const ItemInstance* instance = vec_geode_items[i];
+			osg::Geode* item_geode = vec_geodes[i].get();
+			convertItemPointsAndCurves(instance->m_item, item_geode);
+			if (item_geode->getNumChildren() == 0)
+			{
+				continue;
+			}
+
+			// apply statesets if there are any
+			if (instance->m_item->m_vec_item_appearances.size() > 0)
+			{
+				applyAppearancesToGroup(instance->m_item->m_vec_item_appearances, item_geode, instance->m_transparency_override);
+			}
+
+			if (instance->m_transparency_override > 0)
+			{
+				bool hasTriangles = SceneGraphUtils::hasTrianglesWithMaterial(item_geode);
+				bool createMaterialIfNotExisting = false;
+
+				if (!hasTriangles)
+				{
+					createMaterialIfNotExisting = true;
 				}
+				SceneGraphUtils::setMaterialAlpha(item_geode, instance->m_transparency_override, createMaterialIfNotExisting);
+			}
+		}
 
-				parentNode->addChild(item_geode);
+		// If anything has been created, add it to the product transforms
+		size_t num_shared_geodes = 0;
+		for (size_t ii = 0; ii < m_vec_item_instances.size(); ++ii)
+		{
+			osg::Geode* item_geode = vec_geodes[vec_instance_geode[ii]].get();
+			if (item_geode->getNumChildren() == 0)
+			{
+				continue;
 			}
+			if (item_geode->getNumParents() > 0)
+			{
+				++num_shared_geodes;
+			}
+			m_vec_item_instances[ii].m_parent->addChild(item_geode);
 		}
 
-		for (size_t i_item = 0; i_item < item_data->m_child_items.size(); ++i_item)
+		if (num_shared_geodes > 0)
 		{
-			const shared_ptr<ItemShapeData>& child = item_data->m_child_items[i_item];
-			convertGeometricItem(child, ifc_product, ii_representation, i_item, parentNode, transparencyOverride);
+			std::stringstream strs;
+			strs << "Scenegraph: " << num_geodes << " item geodes, " << num_shared_geodes << " instances of shared geodes, " << m_map_appearance_to_stateset.size() << " statesets";
+			messageCallback(strs.str(), StatusCallback::MESSAGE_TYPE_GENERAL_MESSAGE, "");
 		}
+		m_vec_item_instances.clear();
 	}
 
 	//\brief method convertProductShapeToOSG: creates geometry objects from an IfcProduct object
@@ -985,11 +1310,12 @@ public:
 					}
 #endif
 
+					// geodes of the items are created in convertItemInstances
 					for (size_t ii_representation = 0; ii_representation < product_shape->m_geometric_items.size(); ++ii_representation)
 					{
 						const shared_ptr<ItemShapeData>& geom_item = product_shape->m_geometric_items[ii_representation];
 						osg::Group* grp = product_transform.get();
-						convertGeometricItem(geom_item, ifc_product, ii_representation, 0, grp, transparencyOverride);
+						collectItemInstances(geom_item, grp, transparencyOverride);
 					}
 				}
 			}
@@ -1016,8 +1342,8 @@ public:
 			double progress = (double)m_numConvertedProducts / (double)m_numProductsInModel;
 			if (progress - m_recent_progress > 0.02)
 			{
-				// leave 10% of progress to openscenegraph internals
-				progressValueCallback(progress * 0.9, "scenegraph");
+				// most of the work is done afterwards in convertItemInstances
+				progressValueCallback(progress * 0.2, "scenegraph");
 				m_recent_progress = progress;
 			}
 		}
@@ -1157,6 +1483,8 @@ public:
 			parent_group->addChild(sw_objects_outside_spatial_structure);
 		}
 
+		convertItemInstances(errorStream);
+
 		if (errorStream.tellp() > 0)
 		{
 			messageCallback(errorStream.str().c_str(), StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__);
@@ -1200,7 +1528,6 @@ public:
 		osg::Vec4f diffuseColor(color_diffuse_r, color_diffuse_g, color_diffuse_b, transparency);
 		osg::Vec4f specularColor(color_specular_r, color_specular_g, color_specular_b, transparency);
 
-		// TODO: material caching and re-use
 		osg::ref_ptr<osg::Material> mat = new osg::Material();
 		mat->setAmbient(osg::Material::FRONT, ambientColor);
 		mat->setDiffuse(osg::Material::FRONT, diffuseColor);
@@ -344,6 +344,10 @@ public:
 											{
 												n = m_geom_settings->getMinNumVerticesPerArc();
 											}
+											if( m_geom_settings->isAdaptiveTessellation() )
+											{
+												n = m_geom_settings->getNumSegmentsAdaptive(center_p0.length(), openingAngle) + 1;
+											}
 
 											const double deltaAngle = openingAngle / (double)(n - 1);
 											double angle = 0;
@@ -462,6 +466,11 @@ public:
 
 			int num_segments = m_geom_settings->getNumVerticesPerCircleWithRadius(circle_radius) * (std::abs(openingAngle) / (2.0 * M_PI));
 			if( num_segments < m_geom_settings->getMinNumVerticesPerArc() ) num_segments = m_geom_settings->getMinNumVerticesPerArc();
+			if( m_geom_settings->isAdaptiveTessellation() )
+			{
+				// number of points, the error is bounded by the larger radius of an ellipse
+				num_segments = m_geom_settings->getNumSegmentsAdaptive(maxRadius, openingAngle) + 1;
+			}
 			const double circle_center_x = 0.0;
 			const double circle_center_y = 0.0;
 			std::vector<vec3> circle_segment_points3D;
@@ -86,18 +86,12 @@ public:
 			// ENTITY IfcBoundedSurface ABSTRACT SUPERTYPE OF(ONEOF(IfcBSplineSurface, IfcCurveBoundedPlane, IfcCurveBoundedSurface, IfcRectangularTrimmedSurface))
 			if( dynamic_pointer_cast<IfcBSplineSurface>( bounded_surface ) )
 			{
-				if( dynamic_pointer_cast<IfcRationalBSplineSurfaceWithKnots>( bounded_surface ) )
+				shared_ptr<IfcBSplineSurface> bspline_surface = dynamic_pointer_cast<IfcBSplineSurface>( bounded_surface );
+				shared_ptr<carve::input::PolylineSetData> polyline_data( new carve::input::PolylineSetData() );
+				m_spline_converter->convertIfcBSplineSurface( bspline_surface, polyline_data );
+				if( polyline_data->getVertexCount() > 1 )
 				{
-					shared_ptr<IfcRationalBSplineSurfaceWithKnots> nurbs_surface = dynamic_pointer_cast<IfcRationalBSplineSurfaceWithKnots>( bounded_surface );
-					if( nurbs_surface )
-					{
-						shared_ptr<carve::input::PolylineSetData> polyline_data( new carve::input::PolylineSetData() );
-						m_spline_converter->convertIfcBSplineSurface( nurbs_surface, polyline_data );
-						if( polyline_data->getVertexCount() > 1 )
-						{
-							item_data->m_polylines.push_back( polyline_data );
-						}
-					}
+					item_data->m_polylines.push_back( polyline_data );
 				}
 			}
 			else if( dynamic_pointer_cast<IfcCurveBoundedPlane>( bounded_surface ) )
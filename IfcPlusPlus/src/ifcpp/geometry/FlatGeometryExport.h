@@ -0,0 +1,403 @@
+/* -*-c++-*- IfcQuery www.ifcquery.com
+*
+MIT License
+
+Copyright (c) 2017 Fabian Gerold
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <ifcpp/model/BasicTypes.h>
+#include <ifcpp/model/OpenMPIncludes.h>
+#include <ifcpp/IFC4X3/include/IfcFeatureElementSubtraction.h>
+#include <ifcpp/IFC4X3/include/IfcProduct.h>
+#include "AppearanceData.h"
+#include "GeometryInputData.h"
+#include "GeometrySettings.h"
+#include "TriangleMeshData.h"
+
+//\brief Counts of the elements of FlatGeometryBuffers, to allocate the buffers before FlatGeometryExporter::fill
+struct FlatGeometrySizes
+{
+	size_t m_num_products = 0;
+	size_t m_num_meshes = 0;
+	size_t m_num_vertices = 0;
+	size_t m_num_indices = 0;
+};
+
+//\brief Triangles of one item of a product, with one appearance
+struct FlatMeshRange
+{
+	size_t m_product_index = 0;
+	int m_appearance_id = -1;		// index in FlatGeometryExporter::getAppearances, -1 if the item has no surface style
+	bool m_closed = false;
+	size_t m_vertex_offset = 0;
+	size_t m_vertex_count = 0;
+	size_t m_index_offset = 0;
+	size_t m_index_count = 0;
+};
+
+//\brief All triangles of one product. The meshes, vertices and indices of a product are contiguous
+struct FlatProductRange
+{
+	size_t m_first_mesh = 0;
+	size_t m_num_meshes = 0;
+	size_t m_vertex_offset = 0;
+	size_t m_vertex_count = 0;
+	size_t m_index_offset = 0;
+	size_t m_index_count = 0;
+};
+
+//\brief Caller-provided buffers, sized with FlatGeometrySizes. Buffers that are nullptr are not filled.
+struct FlatGeometryBuffers
+{
+	float* m_positions = nullptr;				// x, y, z per vertex
+	float* m_normals = nullptr;					// x, y, z per vertex
+	uint32_t* m_indices = nullptr;				// three per triangle, counter-clockwise, referring to the whole vertex buffer
+	FlatProductRange* m_product_ranges = nullptr;
+	FlatMeshRange* m_mesh_ranges = nullptr;
+	double* m_transforms = nullptr;				// 16 per product, column-major with translation at 12, 13, 14
+};
+
+/**
+*\brief Class FlatGeometryExporter: writes the triangles of a converted model into contiguous buffers, for renderers and exporters.
+*
+* prepare selects the products and computes the sizes, then the caller allocates the buffers and calls fill:
+*	FlatGeometryExporter exporter( geometry_converter->getGeomSettings() );
+*	exporter.prepare( geometry_converter->getShapeInputData(), guids );
+*	const FlatGeometrySizes& sizes = exporter.getSizes();
+*	std::vector<float> positions( sizes.m_num_vertices * 3 );
+*	...
+*	exporter.fill( buffers );
+*
+* Positions are in product coordinates, with the world transform of each product in m_transforms, unless setWorldCoordinates is used.
+* Items with triangle meshes (GeometrySettings::setCreateTriangleMeshes) are copied directly, other meshsets are triangulated in prepare.
+*/
+class FlatGeometryExporter
+{
+protected:
+	shared_ptr<GeometrySettings>						m_geom_settings;
+	bool												m_world_coordinates = false;
+	FlatGeometrySizes									m_sizes;
+	std::vector<shared_ptr<ProductShapeData> >			m_products;
+	std::vector<FlatProductRange>						m_product_ranges;
+	std::vector<FlatMeshRange>							m_mesh_ranges;
+	std::vector<shared_ptr<TriangleMeshData> >			m_meshes;		// one per mesh range
+	std::vector<shared_ptr<AppearanceData> >			m_appearances;
+
+public:
+	FlatGeometryExporter( shared_ptr<GeometrySettings>& geom_settings ) : m_geom_settings( geom_settings )
+	{
+	}
+
+	//\brief If true, positions and normals are transformed to world coordinates, and m_transforms are identity matrices
+	void setWorldCoordinates( bool world_coordinates ) { m_world_coordinates = world_coordinates; }
+	bool worldCoordinates() const { return m_world_coordinates; }
+
+	const FlatGeometrySizes& getSizes() const { return m_sizes; }
+	const std::vector<shared_ptr<ProductShapeData> >& getProducts() const { return m_products; }
+	const std::vector<shared_ptr<AppearanceData> >& getAppearances() const { return m_appearances; }
+	const std::vector<FlatProductRange>& getProductRanges() const { return m_product_ranges; }
+	const std::vector<FlatMeshRange>& getMeshRanges() const { return m_mesh_ranges; }
+	const shared_ptr<TriangleMeshData>& getMesh( size_t mesh_index ) const { return m_meshes[mesh_index]; }
+
+	/**
+	*\brief First phase: selects the products and computes the buffer sizes.
+	*\param map_shape_data		Result of GeometryConverter::getShapeInputData
+	*\param guids				Products to export, all products with geometry if empty
+	*\return false if the model has too many vertices for 32 bit indices
+	*/
+	bool prepare( const std::map<std::string, shared_ptr<ProductShapeData> >& map_shape_data, const std::vector<std::string>& guids = std::vector<std::string>() )
+	{
+		clear();
+
+		std::vector<shared_ptr<ProductShapeData> > vec_candidates;
+		if( guids.empty() )
+		{
+			for( auto it = map_shape_data.begin(); it != map_shape_data.end(); ++it )
+			{
+				vec_candidates.push_back( it->second );
+			}
+		}
+		else
+		{
+			for( const std::string& guid : guids )
+			{
+				auto it_find = map_shape_data.find( guid );
+				if( it_find != map_shape_data.end() )
+				{
+					vec_candidates.push_back( it_find->second );
+				}
+			}
+		}
+
+		// meshsets without triangle meshes are triangulated once, also if shared between items
+		std::vector<std::pair<const carve::mesh::MeshSet<3>*, bool> > vec_meshsets_to_triangulate;
+		std::unordered_map<const carve::mesh::MeshSet<3>*, size_t> map_meshset_index;
+		std::vector<size_t> vec_mesh_meshset_index;
+		std::unordered_map<AppearanceData*, int> map_appearance_id;
+
+		for( const shared_ptr<ProductShapeData>& product_shape : vec_candidates )
+		{
+			if( !product_shape || product_shape->m_ifc_object_definition.expired() )
+			{
+				continue;
+			}
+			shared_ptr<IFC4X3::IfcObjectDefinition> ifc_object_def( product_shape->m_ifc_object_definition );
+			if( !dynamic_pointer_cast<IFC4X3::IfcProduct>( ifc_object_def ) || dynamic_pointer_cast<IFC4X3::IfcFeatureElementSubtraction>( ifc_object_def ) )
+			{
+				// openings are already subtracted from their building elements
+				continue;
+			}
+
+			const int product_appearance_id = getSurfaceAppearanceId( product_shape->m_vec_product_appearances, map_appearance_id );
+			FlatProductRange product_range;
+			product_range.m_first_mesh = m_mesh_ranges.size();
+
+			std::vector<ItemShapeData*> vec_items;
+			for( const shared_ptr<ItemShapeData>& item : product_shape->m_geometric_items )
+			{
+				collectItems( item.get(), vec_items );
+			}
+
+			for( ItemShapeData* item : vec_items )
+			{
+				int appearance_id = getSurfaceAppearanceId( item->m_vec_item_appearances, map_appearance_id );
+				if( appearance_id < 0 )
+				{
+					appearance_id = product_appearance_id;
+				}
+
+				FlatMeshRange mesh_range;
+				mesh_range.m_product_index = m_products.size();
+				mesh_range.m_appearance_id = appearance_id;
+
+				if( item->m_triangle_meshes.size() > 0 )
+				{
+					for( const shared_ptr<TriangleMeshData>& triangle_mesh : item->m_triangle_meshes )
+					{
+						if( triangle_mesh && triangle_mesh->getNumTriangles() > 0 )
+						{
+							mesh_range.m_closed = triangle_mesh->m_closed;
+							m_mesh_ranges.push_back( mesh_range );
+							m_meshes.push_back( triangle_mesh );
+							vec_mesh_meshset_index.push_back( SIZE_MAX );
+						}
+					}
+					continue;
+				}
+
+				for( int ii_closed = 0; ii_closed < 2; ++ii_closed )
+				{
+					const bool closed = ii_closed == 0;
+					for( const shared_ptr<carve::mesh::MeshSet<3> >& meshset : closed ? item->m_meshsets : item->m_meshsets_open )
+					{
+						if( !meshset )
+						{
+							continue;
+						}
+						auto it_inserted = map_meshset_index.insert( { meshset.get(), vec_meshsets_to_triangulate.size() } );
+						if( it_inserted.second )
+						{
+							vec_meshsets_to_triangulate.push_back( { meshset.get(), closed } );
+						}
+						mesh_range.m_closed = closed;
+						m_mesh_ranges.push_back( mesh_range );
+						m_meshes.push_back( shared_ptr<TriangleMeshData>() );
+						vec_mesh_meshset_index.push_back( it_inserted.first->second );
+					}
+				}
+			}
+
+			product_range.m_num_meshes = m_mesh_ranges.size() - product_range.m_first_mesh;
+			if( product_range.m_num_meshes > 0 )
+			{
+				m_products.push_back( product_shape );
+				m_product_ranges.push_back( product_range );
+			}
+		}
+
+		const double min_triangle_area = m_geom_settings->getMinTriangleArea();
+		const double eps = m_geom_settings->getEpsilonMergePoints();
+		const int num_meshsets = (int)vec_meshsets_to_triangulate.size();
+		std::vector<shared_ptr<TriangleMeshData> > vec_triangulated( num_meshsets );
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16)
+#endif
+		for( int i = 0; i < num_meshsets; ++i )
+		{
+			vec_triangulated[i] = TriangleMeshData::createFromMeshSet( vec_meshsets_to_triangulate[i].first, vec_meshsets_to_triangulate[i].second, false, min_triangle_area, eps );
+		}
+
+		for( size_t ii = 0; ii < m_meshes.size(); ++ii )
+		{
+			if( vec_mesh_meshset_index[ii] != SIZE_MAX )
+			{
+				m_meshes[ii] = vec_triangulated[vec_mesh_meshset_index[ii]];
+			}
+		}
+		removeEmptyMeshes();
+
+		// offsets, products are contiguous
+		for( FlatProductRange& product_range : m_product_ranges )
+		{
+			product_range.m_vertex_offset = m_sizes.m_num_vertices;
+			product_range.m_index_offset = m_sizes.m_num_indices;
+			for( size_t ii = product_range.m_first_mesh; ii < product_range.m_first_mesh + product_range.m_num_meshes; ++ii )
+			{
+				FlatMeshRange& mesh_range = m_mesh_ranges[ii];
+				mesh_range.m_vertex_offset = m_sizes.m_num_vertices;
+				mesh_range.m_vertex_count = m_meshes[ii]->getNumVertices();
+				mesh_range.m_index_offset = m_sizes.m_num_indices;
+				mesh_range.m_index_count = m_meshes[ii]->m_indices.size();
+				m_sizes.m_num_vertices += mesh_range.m_vertex_count;
+				m_sizes.m_num_indices += mesh_range.m_index_count;
+			}
+			product_range.m_vertex_count = m_sizes.m_num_vertices - product_range.m_vertex_offset;
+			product_range.m_index_count = m_sizes.m_num_indices - product_range.m_index_offset;
+		}
+		m_sizes.m_num_products = m_product_ranges.size();
+		m_sizes.m_num_meshes = m_mesh_ranges.size();
+
+		return m_sizes.m_num_vertices <= UINT32_MAX;
+	}
+
+	/**
+	*\brief Second phase: fills the buffers, in parallel over products and without allocating memory.
+	* The buffers must be sized according to getSizes.
+	*/
+	void fill( const FlatGeometryBuffers& buffers ) const
+	{
+		const int num_products = (int)m_product_ranges.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,4)
+#endif
+		for( int i = 0; i < num_products; ++i )
+		{
+			const FlatProductRange& product_range = m_product_ranges[i];
+			const carve::math::Matrix transform = m_products[i]->getTransform();
+			const carve::math::Matrix* vertex_transform = m_world_coordinates ? &transform : nullptr;
+
+			if( buffers.m_product_ranges )
+			{
+				buffers.m_product_ranges[i] = product_range;
+			}
+
+			if( buffers.m_transforms )
+			{
+				const carve::math::Matrix identity;
+				const carve::math::Matrix& product_transform = m_world_coordinates ? identity : transform;
+				std::memcpy( buffers.m_transforms + size_t( i ) * 16, product_transform.v, 16 * sizeof( double ) );
+			}
+
+			for( size_t ii = product_range.m_first_mesh; ii < product_range.m_first_mesh + product_range.m_num_meshes; ++ii )
+			{
+				const FlatMeshRange& mesh_range = m_mesh_ranges[ii];
+				if( buffers.m_mesh_ranges )
+				{
+					buffers.m_mesh_ranges[ii] = mesh_range;
+				}
+
+				float* positions = buffers.m_positions ? buffers.m_positions + mesh_range.m_vertex_offset * 3 : nullptr;
+				float* normals = buffers.m_normals ? buffers.m_normals + mesh_range.m_vertex_offset * 3 : nullptr;
+				uint32_t* indices = buffers.m_indices ? buffers.m_indices + mesh_range.m_index_offset : nullptr;
+				m_meshes[ii]->copyToBuffers( positions, normals, indices, (uint32_t)mesh_range.m_vertex_offset, vertex_transform );
+			}
+		}
+	}
+
+	void clear()
+	{
+		m_sizes = FlatGeometrySizes();
+		m_products.clear();
+		m_product_ranges.clear();
+		m_mesh_ranges.clear();
+		m_meshes.clear();
+		m_appearances.clear();
+	}
+
+protected:
+	//\brief Removes meshes without triangles, and products without meshes
+	void removeEmptyMeshes()
+	{
+		size_t num_products = 0;
+		size_t num_meshes = 0;
+		for( size_t ii_product = 0; ii_product < m_product_ranges.size(); ++ii_product )
+		{
+			FlatProductRange product_range = m_product_ranges[ii_product];
+			const size_t first_mesh = num_meshes;
+			for( size_t ii = product_range.m_first_mesh; ii < product_range.m_first_mesh + product_range.m_num_meshes; ++ii )
+			{
+				if( m_meshes[ii] && m_meshes[ii]->getNumTriangles() > 0 )
+				{
+					m_mesh_ranges[num_meshes] = m_mesh_ranges[ii];
+					m_mesh_ranges[num_meshes].m_product_index = num_products;
+					m_meshes[num_meshes] = m_meshes[ii];
+					++num_meshes;
+				}
+			}
+			if( num_meshes > first_mesh )
+			{
+				product_range.m_first_mesh = first_mesh;
+				product_range.m_num_meshes = num_meshes - first_mesh;
+				m_product_ranges[num_products] = product_range;
+				m_products[num_products] = m_products[ii_product];
+				++num_products;
+			}
+		}
+		m_mesh_ranges.resize( num_meshes );
+		m_meshes.resize( num_meshes );
+		m_product_ranges.resize( num_products );
+		m_products.resize( num_products );
+	}
+
+	static void collectItems( ItemShapeData* item, std::vector<ItemShapeData*>& vec_items )
+	{
+		if( !item )
+		{
+			return;
+		}
+		vec_items.push_back( item );
+		for( const shared_ptr<ItemShapeData>& child_item : item->m_child_items )
+		{
+			collectItems( child_item.get(), vec_items );
+		}
+	}
+
+	int getSurfaceAppearanceId( const std::vector<shared_ptr<AppearanceData> >& vec_appearances, std::unordered_map<AppearanceData*, int>& map_appearance_id )
+	{
+		for( const shared_ptr<AppearanceData>& appearance : vec_appearances )
+		{
+			if( !appearance )
+			{
+				continue;
+			}
+			if( appearance->m_apply_to_geometry_type == AppearanceData::GEOM_TYPE_SURFACE || appearance->m_apply_to_geometry_type == AppearanceData::GEOM_TYPE_ANY )
+			{
+				auto it_inserted = map_appearance_id.insert( { appearance.get(), (int)m_appearances.size() } );
+				if( it_inserted.second )
+				{
+					m_appearances.push_back( appearance );
+				}
+				return it_inserted.first->second;
+			}
+		}
+		return -1;
+	}
+};
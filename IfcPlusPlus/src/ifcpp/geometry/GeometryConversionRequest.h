@@ -0,0 +1,592 @@
+/* -*-c++-*- IfcQuery www.ifcquery.com
+*
+MIT License
+
+Copyright (c) 2017 Fabian Gerold
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <ifcpp/model/AttributeObject.h>
+#include <ifcpp/model/BasicTypes.h>
+#include <ifcpp/model/BuildingObject.h>
+#include <ifcpp/model/OpenMPIncludes.h>
+#include <ifcpp/IFC4X3/include/IfcCartesianPoint.h>
+#include <ifcpp/IFC4X3/include/IfcCartesianPointList2D.h>
+#include <ifcpp/IFC4X3/include/IfcCartesianPointList3D.h>
+#include <ifcpp/IFC4X3/include/IfcCartesianTransformationOperator.h>
+#include <ifcpp/IFC4X3/include/IfcCartesianTransformationOperator2DnonUniform.h>
+#include <ifcpp/IFC4X3/include/IfcCartesianTransformationOperator3DnonUniform.h>
+#include <ifcpp/IFC4X3/include/IfcDirection.h>
+#include <ifcpp/IFC4X3/include/IfcDistributionElement.h>
+#include <ifcpp/IFC4X3/include/IfcElement.h>
+#include <ifcpp/IFC4X3/include/IfcFeatureElementSubtraction.h>
+#include <ifcpp/IFC4X3/include/IfcGloballyUniqueId.h>
+#include <ifcpp/IFC4X3/include/IfcGroup.h>
+#include <ifcpp/IFC4X3/include/IfcLengthMeasure.h>
+#include <ifcpp/IFC4X3/include/IfcMappedItem.h>
+#include <ifcpp/IFC4X3/include/IfcPolyLoop.h>
+#include <ifcpp/IFC4X3/include/IfcPort.h>
+#include <ifcpp/IFC4X3/include/IfcProduct.h>
+#include <ifcpp/IFC4X3/include/IfcProductRepresentation.h>
+#include <ifcpp/IFC4X3/include/IfcProfileDef.h>
+#include <ifcpp/IFC4X3/include/IfcReal.h>
+#include <ifcpp/IFC4X3/include/IfcRelAggregates.h>
+#include <ifcpp/IFC4X3/include/IfcRelAssignsToGroup.h>
+#include <ifcpp/IFC4X3/include/IfcRelConnectsPortToElement.h>
+#include <ifcpp/IFC4X3/include/IfcRelContainedInSpatialStructure.h>
+#include <ifcpp/IFC4X3/include/IfcRelNests.h>
+#include <ifcpp/IFC4X3/include/IfcRelReferencedInSpatialStructure.h>
+#include <ifcpp/IFC4X3/include/IfcRelVoidsElement.h>
+#include <ifcpp/IFC4X3/include/IfcRepresentation.h>
+#include <ifcpp/IFC4X3/include/IfcRepresentationItem.h>
+#include <ifcpp/IFC4X3/include/IfcRepresentationMap.h>
+#include <ifcpp/IFC4X3/include/IfcSpatialElement.h>
+#include <ifcpp/IFC4X3/include/IfcTessellatedFaceSet.h>
+#include "IncludeCarveHeaders.h"
+#include "GeometryInputData.h"
+#include "PlacementConverter.h"
+
+/**\brief Restricts GeometryConverter::convertGeometry and convertGeometryStreaming to a part of the model, see GeometryConverter::setConversionRequest.
+  Products can be requested by GUID: for spatial elements (IfcSite, IfcBuildingStorey, IfcSpace, ...) and groups (IfcZone, IfcSystem, ...), everything that they contain,
+  reference, aggregate, nest or group is requested as well. Parts of aggregated elements and openings of requested elements are always included.
+  With a bounding region, only products that intersect the region are converted. The products are pre-selected by an estimated bounding box, which is computed
+  from the object placement and the coordinates and lengths in the representation without converting it. Converted products outside the region are removed afterwards.
+  If GUIDs and a bounding region are set, products need to match both. The objects of the spatial structure above the selected products are added without their
+  representation, so that getShapeInputData() contains the path from IfcProject to each product. */
+class GeometryConversionRequest
+{
+protected:
+	std::set<std::string>	m_guids;
+	bool					m_use_bounding_region = false;
+	carve::geom::aabb<3>	m_bounding_region;
+
+public:
+	typedef std::unordered_map<const BuildingEntity*, double> ExtentCache;
+
+	void addGuid( const std::string& guid ) { m_guids.insert( guid ); }
+	void setGuids( const std::set<std::string>& guids ) { m_guids = guids; }
+	const std::set<std::string>& getGuids() const { return m_guids; }
+
+	//\brief Sets the region in world coordinates, in meter like the converted geometry
+	void setBoundingRegion( const vec3& region_min, const vec3& region_max )
+	{
+		m_bounding_region.fit( region_min, region_max );
+		m_use_bounding_region = true;
+	}
+	void clearBoundingRegion() { m_use_bounding_region = false; }
+	bool hasBoundingRegion() const { return m_use_bounding_region; }
+	const carve::geom::aabb<3>& getBoundingRegion() const { return m_bounding_region; }
+
+	bool isEmpty() const { return m_guids.empty() && !m_use_bounding_region; }
+
+	//\brief Returns true if there is no bounding region, or if bbox intersects it. Touching boxes intersect
+	bool intersectsBoundingRegion( const carve::geom::aabb<3>& bbox ) const
+	{
+		if( !m_use_bounding_region )
+		{
+			return true;
+		}
+		if( bbox.isEmpty() )
+		{
+			return false;
+		}
+		const vec3 bbox_min = bbox.min();
+		const vec3 bbox_max = bbox.max();
+		const vec3 region_min = m_bounding_region.min();
+		const vec3 region_max = m_bounding_region.max();
+		for( size_t ii = 0; ii < 3; ++ii )
+		{
+			if( bbox_max[ii] < region_min[ii] || bbox_min[ii] > region_max[ii] )
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/*\brief Selects the object definitions to convert from vec_object_definitions, keeping their order. set_structure_only receives the selected objects
+	  that are only needed to connect the requested products to the spatial structure, so their representation is not converted. */
+	void selectObjectDefinitions( std::vector<shared_ptr<IfcObjectDefinition> >& vec_object_definitions, const shared_ptr<PlacementConverter>& placement_converter, double length_in_meter,
+		std::unordered_set<IfcObjectDefinition*>& set_structure_only ) const
+	{
+		set_structure_only.clear();
+		if( isEmpty() )
+		{
+			return;
+		}
+
+		std::unordered_set<IfcObjectDefinition*> set_selected;
+		std::vector<shared_ptr<IfcObjectDefinition> > vec_candidates;
+		if( m_guids.size() > 0 )
+		{
+			for( const shared_ptr<IfcObjectDefinition>& object_def : vec_object_definitions )
+			{
+				if( object_def->m_GlobalId && m_guids.find( object_def->m_GlobalId->m_value ) != m_guids.end() )
+				{
+					collectContainedObjects( object_def, set_selected, vec_candidates );
+				}
+			}
+		}
+		else
+		{
+			vec_candidates = vec_object_definitions;
+		}
+
+		if( m_use_bounding_region )
+		{
+			// openings are selected together with their element
+			vec_candidates.erase( std::remove_if( vec_candidates.begin(), vec_candidates.end(), []( const shared_ptr<IfcObjectDefinition>& object_def ) {
+				shared_ptr<IfcFeatureElementSubtraction> opening = dynamic_pointer_cast<IfcFeatureElementSubtraction>( object_def );
+				return opening && !opening->m_VoidsElements_inverse.expired(); } ), vec_candidates.end() );
+
+			const int num_candidates = (int)vec_candidates.size();
+			std::vector<char> vec_in_region( num_candidates, 0 );
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+			{
+				ExtentCache extent_cache;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic,100)
+#endif
+				for( int i = 0; i < num_candidates; ++i )
+				{
+					carve::geom::aabb<3> bbox;
+					if( estimateBoundingBox( dynamic_pointer_cast<IfcProduct>( vec_candidates[i] ), placement_converter, length_in_meter, extent_cache, bbox ) )
+					{
+						vec_in_region[i] = intersectsBoundingRegion( bbox ) ? 1 : 0;
+					}
+				}
+			}
+
+			set_selected.clear();
+			std::vector<shared_ptr<IfcObjectDefinition> > vec_in_region_candidates;
+			for( int i = 0; i < num_candidates; ++i )
+			{
+				if( vec_in_region[i] )
+				{
+					set_selected.insert( vec_candidates[i].get() );
+					vec_in_region_candidates.push_back( vec_candidates[i] );
+				}
+			}
+			vec_candidates.swap( vec_in_region_candidates );
+		}
+
+		for( const shared_ptr<IfcObjectDefinition>& object_def : vec_candidates )
+		{
+			shared_ptr<IfcElement> ifc_element = dynamic_pointer_cast<IfcElement>( object_def );
+			if( ifc_element )
+			{
+				for( const weak_ptr<IfcRelVoidsElement>& rel_voids_weak : ifc_element->m_HasOpenings_inverse )
+				{
+					shared_ptr<IfcRelVoidsElement> rel_voids = rel_voids_weak.lock();
+					if( rel_voids && rel_voids->m_RelatedOpeningElement )
+					{
+						set_selected.insert( rel_voids->m_RelatedOpeningElement.get() );
+					}
+				}
+			}
+		}
+
+		for( const shared_ptr<IfcObjectDefinition>& object_def : vec_candidates )
+		{
+			collectSpatialParents( object_def, set_selected, set_structure_only );
+		}
+
+		vec_object_definitions.erase( std::remove_if( vec_object_definitions.begin(), vec_object_definitions.end(), [&]( const shared_ptr<IfcObjectDefinition>& object_def ) {
+			return set_selected.find( object_def.get() ) == set_selected.end() && set_structure_only.find( object_def.get() ) == set_structure_only.end(); } ), vec_object_definitions.end() );
+	}
+
+	/*\brief Estimates the bounding box of the product in world coordinates, without converting its representation. The box contains a sphere around the origin
+	  of the object placement, with a radius of twice the estimated extent of the representation items. Returns false if the product has no representation items */
+	static bool estimateBoundingBox( const shared_ptr<IfcProduct>& ifc_product, const shared_ptr<PlacementConverter>& placement_converter, double length_in_meter, ExtentCache& cache, carve::geom::aabb<3>& bbox )
+	{
+		if( !ifc_product || !ifc_product->m_Representation )
+		{
+			return false;
+		}
+
+		bool has_items = false;
+		double extent = 0;
+		for( const shared_ptr<IfcRepresentation>& representation : ifc_product->m_Representation->m_Representations )
+		{
+			if( !representation )
+			{
+				continue;
+			}
+			for( const shared_ptr<IfcRepresentationItem>& item : representation->m_Items )
+			{
+				if( item )
+				{
+					extent = std::max( extent, estimateExtent( item, cache ) );
+					has_items = true;
+				}
+			}
+		}
+		if( !has_items )
+		{
+			return false;
+		}
+
+		vec3 origin = carve::geom::VECTOR( 0, 0, 0 );
+		if( ifc_product->m_ObjectPlacement )
+		{
+			shared_ptr<ProductShapeData> placement_data( new ProductShapeData( "" ) );
+			std::unordered_set<IfcObjectPlacement*> placement_already_applied;
+			placement_converter->convertIfcObjectPlacement( ifc_product->m_ObjectPlacement, placement_data, placement_already_applied, false );
+			origin = placement_data->getTransform() * origin;
+		}
+
+		// the extent is an upper bound for most items, the factor covers rotations around points other than the origin, like in IfcRevolvedAreaSolid
+		const double radius = 2.0 * extent * length_in_meter;
+		bbox = carve::geom::aabb<3>( origin, carve::geom::VECTOR( radius, radius, radius ) );
+		return true;
+	}
+
+	/*\brief Estimates the maximum distance of the geometry of obj from the origin of its coordinate system, in model units. Lengths and distances of points
+	  are added for nested entities (placement + profile + depth for an extrusion), and the maximum is used for lists (points of a polyline, faces of a brep) */
+	static double estimateExtent( const shared_ptr<BuildingObject>& obj, ExtentCache& cache, int depth = 0 )
+	{
+		if( !obj || depth > 50 )
+		{
+			return 0;
+		}
+
+		shared_ptr<AttributeObjectVector> attribute_vector = dynamic_pointer_cast<AttributeObjectVector>( obj );
+		if( attribute_vector )
+		{
+			double extent = 0;
+			for( const shared_ptr<BuildingObject>& element : attribute_vector->m_vec )
+			{
+				extent = std::max( extent, estimateExtent( element, cache, depth + 1 ) );
+			}
+			return extent;
+		}
+
+		shared_ptr<IfcLengthMeasure> length_measure = dynamic_pointer_cast<IfcLengthMeasure>( obj );
+		if( length_measure )
+		{
+			return std::abs( length_measure->m_value );
+		}
+
+		shared_ptr<BuildingEntity> entity = dynamic_pointer_cast<BuildingEntity>( obj );
+		if( !entity )
+		{
+			return 0;
+		}
+
+		shared_ptr<IfcCartesianPoint> cartesian_point = dynamic_pointer_cast<IfcCartesianPoint>( entity );
+		if( cartesian_point )
+		{
+			double length2 = 0;
+			for( int ii = 0; ii < cartesian_point->m_size && ii < 3; ++ii )
+			{
+				length2 += cartesian_point->m_Coordinates[ii] * cartesian_point->m_Coordinates[ii];
+			}
+			return std::sqrt( length2 );
+		}
+
+		if( dynamic_pointer_cast<IfcDirection>( entity ) )
+		{
+			return 0;
+		}
+
+		shared_ptr<IfcPolyLoop> poly_loop = dynamic_pointer_cast<IfcPolyLoop>( entity );
+		if( poly_loop )
+		{
+			double extent = 0;
+			for( const shared_ptr<IfcCartesianPoint>& point : poly_loop->m_Polygon )
+			{
+				extent = std::max( extent, estimateExtent( point, cache, depth + 1 ) );
+			}
+			return extent;
+		}
+
+		shared_ptr<IfcCartesianPointList3D> point_list_3d = dynamic_pointer_cast<IfcCartesianPointList3D>( entity );
+		if( point_list_3d )
+		{
+			return estimateExtent( point_list_3d->m_CoordList );
+		}
+
+		shared_ptr<IfcCartesianPointList2D> point_list_2d = dynamic_pointer_cast<IfcCartesianPointList2D>( entity );
+		if( point_list_2d )
+		{
+			return estimateExtent( point_list_2d->m_CoordList );
+		}
+
+		shared_ptr<IfcTessellatedFaceSet> tessellated_face_set = dynamic_pointer_cast<IfcTessellatedFaceSet>( entity );
+		if( tessellated_face_set )
+		{
+			return estimateExtent( tessellated_face_set->m_Coordinates, cache, depth + 1 );
+		}
+
+		// items, profiles and mapped representations are often shared
+		const bool cached = dynamic_pointer_cast<IfcRepresentationItem>( entity ) || dynamic_pointer_cast<IfcProfileDef>( entity ) || dynamic_pointer_cast<IfcRepresentationMap>( entity );
+		if( cached )
+		{
+			auto it_cache = cache.find( entity.get() );
+			if( it_cache != cache.end() )
+			{
+				return it_cache->second;
+			}
+		}
+
+		double extent = 0;
+		shared_ptr<IfcMappedItem> mapped_item = dynamic_pointer_cast<IfcMappedItem>( entity );
+		if( mapped_item )
+		{
+			double scale = 1.0;
+			if( mapped_item->m_MappingTarget )
+			{
+				scale = getMaxScale( mapped_item->m_MappingTarget );
+				extent += estimateExtent( mapped_item->m_MappingTarget->m_LocalOrigin, cache, depth + 1 );
+			}
+			extent += scale*estimateExtent( mapped_item->m_MappingSource, cache, depth + 1 );
+		}
+		else
+		{
+			shared_ptr<IfcRepresentationMap> representation_map = dynamic_pointer_cast<IfcRepresentationMap>( entity );
+			if( representation_map )
+			{
+				double items_extent = 0;
+				if( representation_map->m_MappedRepresentation )
+				{
+					for( const shared_ptr<IfcRepresentationItem>& item : representation_map->m_MappedRepresentation->m_Items )
+					{
+						items_extent = std::max( items_extent, estimateExtent( item, cache, depth + 1 ) );
+					}
+				}
+				extent = items_extent + estimateExtent( representation_map->m_MappingOrigin, cache, depth + 1 );
+			}
+			else
+			{
+				std::vector<std::pair<std::string, shared_ptr<BuildingObject> > > vec_attributes;
+				entity->getAttributes( vec_attributes );
+				for( auto& attribute : vec_attributes )
+				{
+					extent += estimateExtent( attribute.second, cache, depth + 1 );
+				}
+			}
+		}
+
+		if( cached )
+		{
+			cache[entity.get()] = extent;
+		}
+		return extent;
+	}
+
+protected:
+	static double estimateExtent( const std::vector<std::vector<shared_ptr<IfcLengthMeasure> > >& coord_list )
+	{
+		double max_length2 = 0;
+		for( const std::vector<shared_ptr<IfcLengthMeasure> >& coords : coord_list )
+		{
+			double length2 = 0;
+			for( const shared_ptr<IfcLengthMeasure>& coord : coords )
+			{
+				if( coord )
+				{
+					length2 += coord->m_value * coord->m_value;
+				}
+			}
+			max_length2 = std::max( max_length2, length2 );
+		}
+		return std::sqrt( max_length2 );
+	}
+
+	static double getMaxScale( const shared_ptr<IfcCartesianTransformationOperator>& transform_operator )
+	{
+		double scale = 1.0;
+		if( transform_operator->m_Scale )
+		{
+			scale = std::abs( transform_operator->m_Scale->m_value );
+		}
+
+		shared_ptr<IfcCartesianTransformationOperator3DnonUniform> non_uniform_3d = dynamic_pointer_cast<IfcCartesianTransformationOperator3DnonUniform>( transform_operator );
+		if( non_uniform_3d )
+		{
+			if( non_uniform_3d->m_Scale2 ) scale = std::max( scale, std::abs( non_uniform_3d->m_Scale2->m_value ) );
+			if( non_uniform_3d->m_Scale3 ) scale = std::max( scale, std::abs( non_uniform_3d->m_Scale3->m_value ) );
+		}
+
+		shared_ptr<IfcCartesianTransformationOperator2DnonUniform> non_uniform_2d = dynamic_pointer_cast<IfcCartesianTransformationOperator2DnonUniform>( transform_operator );
+		if( non_uniform_2d && non_uniform_2d->m_Scale2 )
+		{
+			scale = std::max( scale, std::abs( non_uniform_2d->m_Scale2->m_value ) );
+		}
+		return scale;
+	}
+
+	//\brief Adds object_def and everything it contains, references, aggregates, nests or groups to set_objects, recursively
+	static void collectContainedObjects( const shared_ptr<IfcObjectDefinition>& object_def, std::unordered_set<IfcObjectDefinition*>& set_objects, std::vector<shared_ptr<IfcObjectDefinition> >& vec_objects )
+	{
+		std::vector<shared_ptr<IfcObjectDefinition> > vec_stack;
+		vec_stack.push_back( object_def );
+		while( !vec_stack.empty() )
+		{
+			shared_ptr<IfcObjectDefinition> current = vec_stack.back();
+			vec_stack.pop_back();
+			if( !current || !set_objects.insert( current.get() ).second )
+			{
+				continue;
+			}
+			vec_objects.push_back( current );
+
+			for( const weak_ptr<IfcRelAggregates>& rel_aggregates_weak : current->m_IsDecomposedBy_inverse )
+			{
+				shared_ptr<IfcRelAggregates> rel_aggregates = rel_aggregates_weak.lock();
+				if( rel_aggregates )
+				{
+					std::copy( rel_aggregates->m_RelatedObjects.begin(), rel_aggregates->m_RelatedObjects.end(), std::back_inserter( vec_stack ) );
+				}
+			}
+
+			for( const weak_ptr<IfcRelNests>& rel_nests_weak : current->m_IsNestedBy_inverse )
+			{
+				shared_ptr<IfcRelNests> rel_nests = rel_nests_weak.lock();
+				if( rel_nests )
+				{
+					std::copy( rel_nests->m_RelatedObjects.begin(), rel_nests->m_RelatedObjects.end(), std::back_inserter( vec_stack ) );
+				}
+			}
+
+			shared_ptr<IfcSpatialElement> spatial_element = dynamic_pointer_cast<IfcSpatialElement>( current );
+			if( spatial_element )
+			{
+				for( const weak_ptr<IfcRelContainedInSpatialStructure>& rel_contained_weak : spatial_element->m_ContainsElements_inverse )
+				{
+					shared_ptr<IfcRelContainedInSpatialStructure> rel_contained = rel_contained_weak.lock();
+					if( rel_contained )
+					{
+						std::copy( rel_contained->m_RelatedElements.begin(), rel_contained->m_RelatedElements.end(), std::back_inserter( vec_stack ) );
+					}
+				}
+
+				for( const weak_ptr<IfcRelReferencedInSpatialStructure>& rel_referenced_weak : spatial_element->m_ReferencesElements_inverse )
+				{
+					shared_ptr<IfcRelReferencedInSpatialStructure> rel_referenced = rel_referenced_weak.lock();
+					if( rel_referenced )
+					{
+						for( const shared_ptr<IfcSpatialReferenceSelect>& related_element : rel_referenced->m_RelatedElements )
+						{
+							vec_stack.push_back( dynamic_pointer_cast<IfcObjectDefinition>( related_element ) );
+						}
+					}
+				}
+			}
+
+			shared_ptr<IfcGroup> group = dynamic_pointer_cast<IfcGroup>( current );
+			if( group )
+			{
+				for( const weak_ptr<IfcRelAssignsToGroup>& rel_grouped_weak : group->m_IsGroupedBy_inverse )
+				{
+					shared_ptr<IfcRelAssignsToGroup> rel_grouped = rel_grouped_weak.lock();
+					if( rel_grouped )
+					{
+						std::copy( rel_grouped->m_RelatedObjects.begin(), rel_grouped->m_RelatedObjects.end(), std::back_inserter( vec_stack ) );
+					}
+				}
+			}
+
+			shared_ptr<IfcDistributionElement> distribution_element = dynamic_pointer_cast<IfcDistributionElement>( current );
+			if( distribution_element )
+			{
+				for( const weak_ptr<IfcRelConnectsPortToElement>& rel_connects_weak : distribution_element->m_HasPorts_inverse )
+				{
+					shared_ptr<IfcRelConnectsPortToElement> rel_connects = rel_connects_weak.lock();
+					if( rel_connects )
+					{
+						vec_stack.push_back( rel_connects->m_RelatingPort );
+					}
+				}
+			}
+		}
+	}
+
+	//\brief Adds the objects above object_def in the spatial structure (IfcRelAggregates, IfcRelNests, IfcRelContainedInSpatialStructure, ports) to set_parents, if they are not in set_selected
+	static void collectSpatialParents( const shared_ptr<IfcObjectDefinition>& object_def, const std::unordered_set<IfcObjectDefinition*>& set_selected, std::unordered_set<IfcObjectDefinition*>& set_parents )
+	{
+		std::vector<shared_ptr<IfcObjectDefinition> > vec_stack;
+		vec_stack.push_back( object_def );
+		while( !vec_stack.empty() )
+		{
+			shared_ptr<IfcObjectDefinition> current = vec_stack.back();
+			vec_stack.pop_back();
+
+			std::vector<shared_ptr<IfcObjectDefinition> > vec_parents;
+			for( const weak_ptr<IfcRelAggregates>& rel_aggregates_weak : current->m_Decomposes_inverse )
+			{
+				shared_ptr<IfcRelAggregates> rel_aggregates = rel_aggregates_weak.lock();
+				if( rel_aggregates )
+				{
+					vec_parents.push_back( rel_aggregates->m_RelatingObject );
+				}
+			}
+
+			for( const weak_ptr<IfcRelNests>& rel_nests_weak : current->m_Nests_inverse )
+			{
+				shared_ptr<IfcRelNests> rel_nests = rel_nests_weak.lock();
+				if( rel_nests )
+				{
+					vec_parents.push_back( rel_nests->m_RelatingObject );
+				}
+			}
+
+			shared_ptr<IfcElement> ifc_element = dynamic_pointer_cast<IfcElement>( current );
+			if( ifc_element )
+			{
+				for( const weak_ptr<IfcRelContainedInSpatialStructure>& rel_contained_weak : ifc_element->m_ContainedInStructure_inverse )
+				{
+					shared_ptr<IfcRelContainedInSpatialStructure> rel_contained = rel_contained_weak.lock();
+					if( rel_contained )
+					{
+						vec_parents.push_back( rel_contained->m_RelatingStructure );
+					}
+				}
+			}
+
+			shared_ptr<IfcPort> ifc_port = dynamic_pointer_cast<IfcPort>( current );
+			if( ifc_port )
+			{
+				for( const weak_ptr<IfcRelConnectsPortToElement>& rel_connects_weak : ifc_port->m_ContainedIn_inverse )
+				{
+					shared_ptr<IfcRelConnectsPortToElement> rel_connects = rel_connects_weak.lock();
+					if( rel_connects )
+					{
+						vec_parents.push_back( rel_connects->m_RelatedElement );
+					}
+				}
+			}
+
+			for( const shared_ptr<IfcObjectDefinition>& parent : vec_parents )
+			{
+				if( !parent || set_selected.find( parent.get() ) != set_selected.end() )
+				{
+					continue;
+				}
+				if( set_parents.insert( parent.get() ).second )
+				{
+					vec_stack.push_back( parent );
+				}
+			}
+		}
+	}
+};
@@ -17,16 +17,24 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OU
 
 #pragma once
 
+#include <functional>
+#include <unordered_map>
 #include <unordered_set>
 #include <ifcpp/model/BasicTypes.h>
 #include <ifcpp/model/BuildingModel.h>
 #include <ifcpp/model/OpenMPIncludes.h>
 #include <ifcpp/model/StatusCallback.h>
 #include <ifcpp/reader/ReaderUtil.h>
+#include <ifcpp/IFC4X3/include/IfcAdvancedBrep.h>
+#include <ifcpp/IFC4X3/include/IfcBooleanResult.h>
 #include <ifcpp/IFC4X3/include/IfcBuilding.h>
+#include <ifcpp/IFC4X3/include/IfcClosedShell.h>
 #include <ifcpp/IFC4X3/include/IfcCurtainWall.h>
 #include <ifcpp/IFC4X3/include/IfcDistributionElement.h>
 #include <ifcpp/IFC4X3/include/IfcGloballyUniqueId.h>
+#include <ifcpp/IFC4X3/include/IfcManifoldSolidBrep.h>
+#include <ifcpp/IFC4X3/include/IfcMappedItem.h>
+#include <ifcpp/IFC4X3/include/IfcPolygonalFaceSet.h>
 #include <ifcpp/IFC4X3/include/IfcDistributionPort.h>
 #include <ifcpp/IFC4X3/include/IfcPropertySetDefinitionSet.h>
 #include <ifcpp/IFC4X3/include/IfcRelAggregates.h>
@@ -35,10 +43,13 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OU
 #include <ifcpp/IFC4X3/include/IfcRelConnectsPortToElement.h>
 #include <ifcpp/IFC4X3/include/IfcRelContainedInSpatialStructure.h>
 #include <ifcpp/IFC4X3/include/IfcRelDefinesByProperties.h>
+#include <ifcpp/IFC4X3/include/IfcRelVoidsElement.h>
+#include <ifcpp/IFC4X3/include/IfcRepresentationMap.h>
 #include <ifcpp/IFC4X3/include/IfcRelServicesBuildings.h>
 #include <ifcpp/IFC4X3/include/IfcSite.h>
 #include <ifcpp/IFC4X3/include/IfcSpace.h>
 #include <ifcpp/IFC4X3/include/IfcSystem.h>
+#include <ifcpp/IFC4X3/include/IfcTriangulatedFaceSet.h>
 #include <ifcpp/IFC4X3/include/IfcWindow.h>
 #include <ifcpp/IFC4X3/EntityFactory.h>
 
@@ -46,9 +57,21 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OU
 #include "GeometryInputData.h"
 #include "RepresentationConverter.h"
 #include "CSG_Adapter.h"
+#include "ConversionBudget.h"
+#include "MeshSimplifier.h"
+#include "GeometryDependencies.h"
+#include "GeometryConversionRequest.h"
 
 //#undef _OPENMP   // temp
 
+//\brief Products that have been modified by GeometryConverter::updateGeometry
+struct GeometryUpdate
+{
+	std::vector<shared_ptr<ProductShapeData> >	m_converted_products;	// new products, and products with changed shape
+	std::vector<shared_ptr<ProductShapeData> >	m_moved_products;		// products with changed placement only, their m_vec_transforms are updated
+	std::vector<std::string>					m_removed_products;		// GUIDs of products that have been removed from getShapeInputData()
+};
+
 class GeometryConverter : public StatusCallback
 {
 protected:
@@ -61,11 +84,14 @@ protected:
 	std::set<int> m_setResolvedProjectStructure;
 	vec3 m_siteOffset;
 	double m_recent_progress = 0;
+	size_t m_num_item_shape_cache_hits = 0;
+	GeometryDependencies m_dependencies;
+	bool m_dependencies_tracked = false;
+	shared_ptr<GeometryConversionRequest>	m_conversion_request;
 	std::map<int, std::vector<shared_ptr<StatusCallback::Message> > > m_messages;
 
 #ifdef _OPENMP
 	Mutex m_writelock_messages;
-	Mutex m_writelock_item_cache;
 #endif
 
 public:
@@ -75,6 +101,11 @@ public:
 	shared_ptr<GeometrySettings>&						getGeomSettings() { return m_geom_settings; }
 	std::map<std::string, shared_ptr<ProductShapeData> >&	getShapeInputData() { return m_product_shape_data; }
 	std::map<std::string, shared_ptr<BuildingObject> >&		getObjectsOutsideSpatialStructure() { return m_map_outside_spatial_structure; }
+	//\brief Number of representation item conversions that have been saved in the recent convertGeometry call, because an item with equal content was converted before
+	size_t getNumItemConversionsSaved() const { return m_num_item_shape_cache_hits; }
+	//\brief Restricts the following conversions to a part of the model, see GeometryConversionRequest. Without request, or with an empty request, the whole model is converted
+	void setConversionRequest( const shared_ptr<GeometryConversionRequest>& request ) { m_conversion_request = request; }
+	const shared_ptr<GeometryConversionRequest>& getConversionRequest() const { return m_conversion_request; }
 	bool m_clear_memory_immedeately = true;
 	bool m_set_model_to_origin = false;
 
@@ -129,6 +160,8 @@ public:
 		m_setResolvedProjectStructure.clear();
 		m_representation_converter->clearCache();
 		m_messages.clear();
+		m_dependencies.clear();
+		m_dependencies_tracked = false;
 	}
 
 	void resetNumVerticesPerCircle()
@@ -205,13 +238,41 @@ public:
 		}
 	}
 
-	void resolveProjectStructure(shared_ptr<ProductShapeData>& product_data, bool resolveSecondaryStructure )
+	//\brief Looks up the shape data of a related object. Objects without shape data are added with an empty pointer, so that they are marked as resolved too
+	void addRelatedProduct( const shared_ptr<IfcObjectDefinition>& related_obj_def, std::vector<std::pair<int, shared_ptr<ProductShapeData> > >& vec_related_products )
+	{
+		if( !related_obj_def )
+		{
+			return;
+		}
+
+		int tag = related_obj_def->m_tag;
+		if( tag < 0 )
+		{
+			std::cout << "invalid tag: " << tag << std::endl;
+			return;
+		}
+
+		shared_ptr<ProductShapeData> related_product_shape;
+		if( related_obj_def->m_GlobalId )
+		{
+			std::string guid = related_obj_def->m_GlobalId->m_value;
+			auto it_product_map = m_product_shape_data.find(guid);
+			if( it_product_map != m_product_shape_data.end() )
+			{
+				related_product_shape = it_product_map->second;
+			}
+		}
+		vec_related_products.push_back( std::make_pair( tag, related_product_shape ) );
+	}
+
+	//\brief Collects the objects that are attached to product_data in the spatial structure, in the order of the relationships. Does not modify any data, so it can run in parallel
+	void collectRelatedProducts( const shared_ptr<ProductShapeData>& product_data, bool resolveSecondaryStructure, std::vector<std::pair<int, shared_ptr<ProductShapeData> > >& vec_related_products )
 	{
 		if( !product_data )
 		{
 			return;
 		}
-		product_data->m_added_to_spatial_structure = true;
 
 		if( product_data->m_ifc_object_definition.expired() )
 		{
@@ -224,10 +285,6 @@ public:
 			return;
 		}
 
-#ifdef _DEBUG
-		std::string className = IFC4X3::EntityFactory::getStringForClassID(ifc_object_def->classID());
-#endif
-
 		for( const weak_ptr<IfcRelAggregates>& relAggregates_weak_ptr : ifc_object_def->m_IsDecomposedBy_inverse )
 		{
 			if( relAggregates_weak_ptr.expired() )
@@ -237,40 +294,9 @@ public:
 			shared_ptr<IfcRelAggregates> relAggregates(relAggregates_weak_ptr);
 			if( relAggregates )
 			{
-				const std::vector<shared_ptr<IfcObjectDefinition> >& vec_related_objects = relAggregates->m_RelatedObjects;
-				for( size_t jj = 0; jj < vec_related_objects.size(); ++jj )
+				for( const shared_ptr<IfcObjectDefinition>& related_obj_def : relAggregates->m_RelatedObjects )
 				{
-					const shared_ptr<IfcObjectDefinition>& related_obj_def = vec_related_objects[jj];
-					if( related_obj_def )
-					{
-						int tag = related_obj_def->m_tag;
-						if( tag < 0 )
-						{
-							std::cout << "invalid tag: " << tag << std::endl;
-							continue;
-						}
-
-						if( m_setResolvedProjectStructure.find(tag) != m_setResolvedProjectStructure.end() )
-						{
-							continue;
-						}
-						m_setResolvedProjectStructure.insert(tag);
-
-						if( related_obj_def->m_GlobalId )
-						{
-							std::string guid = related_obj_def->m_GlobalId->m_value;
-							auto it_product_map = m_product_shape_data.find(guid);
-							if( it_product_map != m_product_shape_data.end() )
-							{
-								shared_ptr<ProductShapeData>& related_product_shape = it_product_map->second;
-								if( related_product_shape )
-								{
-									product_data->addChildProduct(related_product_shape, product_data);
-									resolveProjectStructure(related_product_shape, resolveSecondaryStructure);
-								}
-							}
-						}
-					}
+					addRelatedProduct( related_obj_def, vec_related_products );
 				}
 			}
 		}
@@ -278,10 +304,8 @@ public:
 		shared_ptr<IfcSpatialStructureElement> spatial_ele = dynamic_pointer_cast<IfcSpatialStructureElement>(ifc_object_def);
 		if( spatial_ele )
 		{
-			const std::vector<weak_ptr<IfcRelContainedInSpatialStructure> >& vec_contains = spatial_ele->m_ContainsElements_inverse;
-			for( size_t ii = 0; ii < vec_contains.size(); ++ii )
+			for( const weak_ptr<IfcRelContainedInSpatialStructure>& rel_contained_weak_ptr : spatial_ele->m_ContainsElements_inverse )
 			{
-				const weak_ptr<IfcRelContainedInSpatialStructure>& rel_contained_weak_ptr = vec_contains[ii];
 				if( rel_contained_weak_ptr.expired() )
 				{
 					continue;
@@ -289,42 +313,9 @@ public:
 				shared_ptr<IfcRelContainedInSpatialStructure> rel_contained(rel_contained_weak_ptr);
 				if( rel_contained )
 				{
-					const std::vector<shared_ptr<IfcProduct> >& vec_related_elements = rel_contained->m_RelatedElements;
-
-					for( size_t jj = 0; jj < vec_related_elements.size(); ++jj )
+					for( const shared_ptr<IfcProduct>& related_product : rel_contained->m_RelatedElements )
 					{
-						const shared_ptr<IfcProduct>& related_product = vec_related_elements[jj];
-						if( related_product )
-						{
-							int tag = related_product->m_tag;
-							if( tag < 0 )
-							{
-								std::cout << "tag invalid: " << tag << std::endl;
-								continue;
-							}
-
-							if( m_setResolvedProjectStructure.find(tag) != m_setResolvedProjectStructure.end() )
-							{
-								continue;
-							}
-							m_setResolvedProjectStructure.insert(tag);
-
-							if( related_product->m_GlobalId )
-							{
-								std::string related_guid = related_product->m_GlobalId->m_value;
-
-								auto it_product_map = m_product_shape_data.find(related_guid);
-								if( it_product_map != m_product_shape_data.end() )
-								{
-									shared_ptr<ProductShapeData>& related_product_shape = it_product_map->second;
-									if( related_product_shape )
-									{
-										product_data->addChildProduct(related_product_shape, product_data);
-										resolveProjectStructure(related_product_shape, resolveSecondaryStructure);
-									}
-								}
-							}
-						}
+						addRelatedProduct( related_product, vec_related_products );
 					}
 				}
 			}
@@ -333,15 +324,11 @@ public:
 		if( resolveSecondaryStructure )
 		{
 			// handle IfcRelAssigns
-			shared_ptr<IfcSpatialStructureElement> ifcSpatial = dynamic_pointer_cast<IfcSpatialStructureElement>(ifc_object_def);
-			if( ifcSpatial )
+			if( spatial_ele )
 			{
-				//std::cout << "ifcSpatial: " << ifcSpatial->m_tag << std::endl;
-
 				//ServicedBySystems	 : 	SET OF IfcRelServicesBuildings FOR RelatedBuildings;
-				for( auto servicedBy_weak_ptr : ifcSpatial->m_ServicedBySystems_inverse )
+				for( auto servicedBy_weak_ptr : spatial_ele->m_ServicedBySystems_inverse )
 				{
-
 					if( servicedBy_weak_ptr.expired() )
 					{
 						continue;
@@ -349,56 +336,20 @@ public:
 					shared_ptr<IfcRelServicesBuildings> servicedBy(servicedBy_weak_ptr);
 					if( servicedBy )
 					{
-						//shared_ptr<IfcSystem>						m_RelatingSystem;
-						//std::vector<shared_ptr<IfcSpatialElement> >	m_RelatedBuildings;
 						shared_ptr<IfcSystem> sys = servicedBy->m_RelatingSystem;
-						//std::cout << "m_ServicesBuildings_inverse: " << sys->m_ServicesBuildings_inverse.size() << std::endl;
-						//std::cout << "m_ServicesFacilities_inverse: " << sys->m_ServicesFacilities_inverse.size() << std::endl;
-
+						if( !sys )
+						{
+							continue;
+						}
 
 						for( auto groupedBy_weak : sys->m_IsGroupedBy_inverse )
 						{
 							if( groupedBy_weak.expired() ) { continue; }
 							shared_ptr<IfcRelAssignsToGroup> groupedBy(groupedBy_weak);
 
-							//  std::vector<shared_ptr<IfcObjectDefinition> >	m_RelatedObjects;
-							//  shared_ptr<IfcObjectTypeEnum>					m_RelatedObjectsType;		//optional
-
-							// IfcRelAssignsToGroup -----------------------------------------------------------
-							// attributes:
-							shared_ptr<IfcGroup>& group = groupedBy->m_RelatingGroup;
-
 							for( auto related_object : groupedBy->m_RelatedObjects )
 							{
-								int tag = related_object->m_tag;
-								if( tag < 0 )
-								{
-									std::cout << "tag invalid: " << tag << std::endl;
-									continue;
-								}
-
-								if( m_setResolvedProjectStructure.find(tag) != m_setResolvedProjectStructure.end() )
-								{
-									// std::cout << "duplicate guid in model tree: " << related_guid << std::endl;
-									continue;
-								}
-								m_setResolvedProjectStructure.insert(tag);
-
-								if( related_object->m_GlobalId )
-								{
-									std::string related_guid = related_object->m_GlobalId->m_value;
-
-									auto it_product_map = m_product_shape_data.find(related_guid);
-									if( it_product_map != m_product_shape_data.end() )
-									{
-										shared_ptr<ProductShapeData>& related_product_shape = it_product_map->second;
-										if( related_product_shape )
-										{
-											product_data->addChildProduct(related_product_shape, product_data);
-											resolveProjectStructure(related_product_shape, resolveSecondaryStructure);
-										}
-									}
-								}
+								addRelatedProduct( related_object, vec_related_products );
 							}
 						}
 					}
@@ -413,9 +364,6 @@ public:
 				//#4542544= IFCDISTRIBUTIONPORT('0$K3Bu1NXCwviGJbnhv$tO',#41,'name','description',$,#4542542,$,.SOURCEANDSINK.);  
 				//#4542546= IFCRELCONNECTSPORTTOELEMENT('0dih3rwKj6FhUYiBG4sVkO',#41,'name','description',#4542544,#971193);
 
-				std::string className = IFC4X3::EntityFactory::getStringForClassID(distributionElement->classID());
-				//std::cout << "#" <<  distributionElement->m_tag << "=" << className << " " << std::endl;
-
 				for( auto RelConnectsPortToElement_weak_ptr : distributionElement->m_HasPorts_inverse )
 				{
 					if( RelConnectsPortToElement_weak_ptr.expired() )
@@ -425,46 +373,82 @@ public:
 					shared_ptr<IfcRelConnectsPortToElement> RelConnectsPortToElement(RelConnectsPortToElement_weak_ptr);
 					if( RelConnectsPortToElement )
 					{
-						shared_ptr<IfcPort> related_object = RelConnectsPortToElement->m_RelatingPort;
-						if( related_object )
-						{
-							//shared_ptr<IfcPort>					m_RelatingPort;
-							//shared_ptr<IfcDistributionElement>	m_RelatedElement;
+						addRelatedProduct( RelConnectsPortToElement->m_RelatingPort, vec_related_products );
+					}
+				}
+			}
+		}
+	}
 
-							int tag = related_object->m_tag;
+	void linkProjectStructure( shared_ptr<ProductShapeData>& product_data, std::unordered_map<ProductShapeData*, std::vector<std::pair<int, shared_ptr<ProductShapeData> > > >& map_related_products )
+	{
+		product_data->m_added_to_spatial_structure = true;
 
-							if( tag < 0 )
-							{
-								std::cout << "tag invalid: " << tag << std::endl;
-								continue;
-							}
+		auto it_related = map_related_products.find( product_data.get() );
+		if( it_related == map_related_products.end() )
+		{
+			return;
+		}
 
-							if( m_setResolvedProjectStructure.find(tag) != m_setResolvedProjectStructure.end() )
-							{
-								// std::cout << "duplicate guid in model tree: " << related_guid << std::endl;
-								continue;
-							}
-							m_setResolvedProjectStructure.insert(tag);
+		for( auto& related : it_related->second )
+		{
+			const int tag = related.first;
+			if( m_setResolvedProjectStructure.find(tag) != m_setResolvedProjectStructure.end() )
+			{
+				continue;
+			}
+			m_setResolvedProjectStructure.insert(tag);
 
-							if( related_object->m_GlobalId )
-							{
-								std::string related_guid = related_object->m_GlobalId->m_value;
-								auto it_product_map = m_product_shape_data.find(related_guid);
-								if( it_product_map != m_product_shape_data.end() )
-								{
-									shared_ptr<ProductShapeData>& related_product_shape = it_product_map->second;
-									if( related_product_shape )
-									{
-										product_data->addChildProduct(related_product_shape, product_data);
-										resolveProjectStructure(related_product_shape, resolveSecondaryStructure);
-									}
-								}
-							}
-						}
-					}
-				}
+			shared_ptr<ProductShapeData>& related_product_shape = related.second;
+			if( related_product_shape )
+			{
+				product_data->addChildProduct(related_product_shape, product_data);
+				linkProjectStructure(related_product_shape, map_related_products);
+			}
+		}
+	}
+
+	//\brief Builds the tree of products below product_data. The relationships of all products are collected in parallel first, then the tree is linked
+	// in the same order as a recursive traversal, so every object is attached to the first parent that it is found under
+	void resolveProjectStructure(shared_ptr<ProductShapeData>& product_data, bool resolveSecondaryStructure )
+	{
+		if( !product_data )
+		{
+			return;
+		}
+
+		std::vector<shared_ptr<ProductShapeData> > vec_product_shapes;
+		vec_product_shapes.reserve( m_product_shape_data.size() + 1 );
+		vec_product_shapes.push_back( product_data );
+		for( auto& it : m_product_shape_data )
+		{
+			if( it.second && it.second != product_data )
+			{
+				vec_product_shapes.push_back( it.second );
+			}
+		}
+
+		const int num_product_shapes = (int)vec_product_shapes.size();
+		std::vector<std::vector<std::pair<int, shared_ptr<ProductShapeData> > > > vec_related_products( num_product_shapes );
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,100)
+#endif
+		for( int i = 0; i < num_product_shapes; ++i )
+		{
+			collectRelatedProducts( vec_product_shapes[i], resolveSecondaryStructure, vec_related_products[i] );
+		}
+
+		std::unordered_map<ProductShapeData*, std::vector<std::pair<int, shared_ptr<ProductShapeData> > > > map_related_products;
+		for( int i = 0; i < num_product_shapes; ++i )
+		{
+			if( vec_related_products[i].size() > 0 )
+			{
+				map_related_products[vec_product_shapes[i].get()].swap( vec_related_products[i] );
 			}
 		}
+
+		linkProjectStructure( product_data, map_related_products );
 	}
 
 	void fixModelHierarchy()
@@ -629,31 +613,31 @@ public:
 					appearance_data->m_color_diffuse.setColor( vec_color );
 					appearance_data->m_color_specular.setColor( vec_color );
 					appearance_data->m_shininess = 35.f;
+					appearance_data = m_representation_converter->getStylesConverter()->getAppearancePalette()->addAppearance( appearance_data );
 					product_shape->addAppearance( appearance_data );
 				}
 			}
 		}
 	}
 
-	/*\brief method convertGeometry: Creates geometry for Carve from previously loaded BuildingModel model.
-	**/
-	void convertGeometry()
+	//\brief Resets the caches and the precision settings for a new conversion, and collects all object definitions of the model. Returns false if there is no model
+	bool prepareConversion( std::vector<shared_ptr<IfcObjectDefinition> >& vec_object_definitions )
 	{
-		progressTextCallback( "Creating geometry..." );
-		progressValueCallback( 0, "geometry" );
 		m_product_shape_data.clear();
 		m_map_outside_spatial_structure.clear();
 		m_setResolvedProjectStructure.clear();
 		m_representation_converter->clearCache();
+		m_num_item_shape_cache_hits = 0;
+		m_dependencies.clear();
+		m_dependencies_tracked = false;
+		MeshOps::resetMeshSetCheckCounters();
 		m_clear_memory_immedeately = false;
 
 		if( !m_ifc_model )
 		{
-			return;
+			return false;
 		}
 
-		shared_ptr<ProductShapeData> ifc_project_data;
-		std::vector<shared_ptr<IfcObjectDefinition> > vec_object_definitions;
 		const double length_in_meter = m_representation_converter->getUnitConverter()->getLengthInMeterFactor();
 		setCsgEps(1.5e-08 * length_in_meter);
 		if( std::abs(length_in_meter) > EPS_M14 )
@@ -664,6 +648,11 @@ public:
 			m_geom_settings->setEpsilonCoplanarAngle(eps * 0.1);
 		}
 
+		shared_ptr<GeometryDiskCache>& disk_cache = m_representation_converter->getGeometryDiskCache();
+		disk_cache->setCacheDirectory( m_geom_settings->getGeometryCacheDirectory(), m_geom_settings->getGeometryCacheMaxSize() );
+		disk_cache->setSettingsKey( m_geom_settings, m_representation_converter->getUnitConverter() );
+		disk_cache->resetStatistics();
+
 		const std::map<int, shared_ptr<BuildingEntity> >& map_entities = m_ifc_model->getMapIfcEntities();
 		if( map_entities.size() > 0 )
 		{
@@ -692,12 +681,34 @@ public:
 				}
 			}
 		}
+		return true;
+	}
+
+	/*\brief method convertGeometry: Creates geometry for Carve from previously loaded BuildingModel model.
+	**/
+	void convertGeometry()
+	{
+		progressTextCallback( "Creating geometry..." );
+		progressValueCallback( 0, "geometry" );
+
+		shared_ptr<ProductShapeData> ifc_project_data;
+		std::vector<shared_ptr<IfcObjectDefinition> > vec_object_definitions;
+		if( !prepareConversion( vec_object_definitions ) )
+		{
+			return;
+		}
+
+		std::unordered_set<IfcObjectDefinition*> set_structure_only;
+		selectRequestedObjects( vec_object_definitions, set_structure_only );
 
 		if( m_clear_memory_immedeately )
 		{
 			//m_ifc_model->getMapIfcEntities().clear();
 		}
 
+		// convert expensive products first, so that a big product at the end does not leave the other threads idle
+		sortByEstimatedCost( vec_object_definitions );
+
 		// create geometry for for each IfcProduct independently, spatial structure will be resolved later
 		std::map<std::string, shared_ptr<ProductShapeData> >* map_products_ptr = &m_product_shape_data;
 		const int num_object_definitions = (int)vec_object_definitions.size();
@@ -710,8 +721,8 @@ public:
 		//omp_set_num_threads(2); // Use 2 threads for all consecutive parallel regions
 #pragma omp parallel firstprivate(num_object_definitions) shared(map_products_ptr)
 		{
-			// time for one product may vary significantly, so schedule not so many
-#pragma omp for schedule(dynamic,10)
+			// products are sorted by cost, so hand them out one by one. Idle threads also pick up the tasks for openings and boolean operands of other products
+#pragma omp for schedule(dynamic,1)
 #endif
 			for( int i = 0; i < num_object_definitions; ++i )
 			{
@@ -743,7 +754,24 @@ public:
 
 				try
 				{
-					convertIfcProductShape( product_geom_input_data );
+					if( set_structure_only.find( object_def.get() ) != set_structure_only.end() )
+					{
+						// only needed to connect the requested products to the spatial structure
+						convertIfcProductPlacement( product_geom_input_data );
+					}
+					else
+					{
+						// each product has its own time budget, see GeometrySettings::setMaxTimePerProduct
+						ConversionBudget product_budget;
+						product_budget.limit( m_geom_settings->getMaxTimePerProduct() );
+						ScopedConversionBudget scoped_budget( product_budget );
+
+						convertIfcProductShape( product_geom_input_data );
+						if( ConversionBudget::current().exceeded() )
+						{
+							applyExceededBudgetFallback( product_geom_input_data );
+						}
+					}
 				}
 				catch( BuildingException& e )
 				{
@@ -826,31 +854,8 @@ public:
 		} // implicit barrier
 #endif
 
-		  // subtract openings in related objects, such as IFCBUILDINGELEMENTPART connected to a window through IFCRELAGGREGATES
-		for( auto it = map_products_ptr->begin(); it != map_products_ptr->end(); ++it )
-		{
-			shared_ptr<ProductShapeData> product_geom_input_data = it->second;
-			try
-			{
-				subtractOpeningsInRelatedObjects(product_geom_input_data);
-			}
-			catch( BuildingException& e )
-			{
-				messageCallback(e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "");
-			}
-			catch( carve::exception& e )
-			{
-				messageCallback(e.str(), StatusCallback::MESSAGE_TYPE_ERROR, "");
-			}
-			catch( std::exception& e )
-			{
-				messageCallback(e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "");
-			}
-			catch( ... )
-			{
-				messageCallback("undefined error", StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__);
-			}
-		}
+		// subtract openings in related objects, such as IFCBUILDINGELEMENTPART connected to a window through IFCRELAGGREGATES
+		subtractOpeningsInRelatedObjects();
 
 		try
 		{
@@ -865,6 +870,8 @@ public:
 				resolveProjectStructure( ifc_project_data, true );
 			}
 
+			removeProductsOutsideBoundingRegion( set_structure_only );
+
 			// check if there are entities that are not in spatial structure
 			for( auto it_product_shapes = m_product_shape_data.begin(); it_product_shapes != m_product_shape_data.end(); ++it_product_shapes )
 			{
@@ -918,279 +925,1839 @@ public:
 		}
 
 		m_representation_converter->getProfileCache()->clearProfileCache();
-		progressTextCallback( "Loading file done" );
-		progressValueCallback( 1.0, "geometry" );
-	}
 
-	void addVector3D(const vec3& point, std::vector<float>& target_array)
-	{
-		bool m_roundCoords = false;
-		if (m_roundCoords)
+		shared_ptr<ItemShapeCache>& item_shape_cache = m_representation_converter->getItemShapeCache();
+		if( item_shape_cache->getNumCacheHits() > 0 )
 		{
-			target_array.push_back(round(point.x*10000)*0.0001);
-			target_array.push_back(round(point.y*10000)*0.0001);
-			target_array.push_back(round(point.z*10000)*0.0001);
+			std::stringstream strs;
+			strs << "Geometry of " << item_shape_cache->getNumCacheHits() << " representation items shared with " << item_shape_cache->getNumCachedItems() << " converted items";
+			messageCallback( strs.str(), StatusCallback::MESSAGE_TYPE_GENERAL_MESSAGE, "" );
 		}
-		else
+		m_num_item_shape_cache_hits = item_shape_cache->getNumCacheHits();
+		item_shape_cache->clearItemShapeCache();
+
+		shared_ptr<PrismaticOpenings>& prismatic_openings = m_representation_converter->getPrismaticOpenings();
+		if( prismatic_openings->getNumProductsHandled() > 0 )
 		{
-			target_array.push_back(point.x);
-			target_array.push_back(point.y);
-			target_array.push_back(point.z);
+			std::stringstream strs;
+			strs << "Openings of " << prismatic_openings->getNumProductsHandled() << " products subtracted without CSG";
+			messageCallback( strs.str(), StatusCallback::MESSAGE_TYPE_GENERAL_MESSAGE, "" );
 		}
-	}
+		prismatic_openings->resetNumProductsHandled();
 
-	//\brief method convertIfcProduct: Creates geometry objects (meshset with connected vertex-edge-face graph) from an IfcProduct object
-	// caution: when using OpenMP, this method runs in parallel threads, so every write access to member variables needs a write lock
-	void convertIfcProductShape( shared_ptr<ProductShapeData>& product_shape )
-	{
-		if( product_shape->m_ifc_object_definition.expired() )
+		finishGeometryDiskCache();
+
+		if( MeshOps::getNumMeshSetChecksAvoided() > 0 )
 		{
-			return;
+			std::stringstream strs;
+			strs << "Validity of meshsets checked " << MeshOps::getNumMeshSetChecks() << " times, " << MeshOps::getNumMeshSetChecksAvoided() << " repeated checks avoided";
+			messageCallback( strs.str(), StatusCallback::MESSAGE_TYPE_GENERAL_MESSAGE, "" );
 		}
+		MeshOps::resetMeshSetCheckCounters();
 
-		shared_ptr<IfcObjectDefinition> ifc_object_def(product_shape->m_ifc_object_definition);
-		shared_ptr<IfcProduct> ifc_product = dynamic_pointer_cast<IfcProduct>(ifc_object_def);
-		if (!ifc_product)
+		if( m_geom_settings->createTriangleMeshes() )
 		{
-			return;
+			createTriangleMeshes( m_geom_settings->releaseCarveMeshes() );
 		}
 
-		shared_ptr<IfcProductRepresentation>& product_representation = ifc_product->m_Representation;
-		if( !product_representation )
+		if( m_geom_settings->trackGeometryDependencies() )
+		{
+			collectGeometryDependencies();
+		}
+
+		progressTextCallback( "Loading file done" );
+		progressValueCallback( 1.0, "geometry" );
+	}
+
+	/*\brief Converts the model product by product with bounded memory, for models that do not fit into memory as a whole once tessellated.
+	  Products are converted in batches of GeometrySettings::getStreamingBatchSize in the order of the spatial structure. Each converted product is handed to
+	  m_callback_func_geometry_converted (sequentially, in spatial structure order), and released afterwards together with its IfcProductRepresentation
+	  and all entities of it that are not shared with other products. So the geometry and the representation entities are only valid within the callback.
+	  Placements, profiles and representation items that are shared between products (for example through IfcMappedItem) stay cached for the following batches.
+	  getShapeInputData() stays empty and the spatial structure is not resolved in ProductShapeData, the callback can use the IFC relationships instead.
+	**/
+	void convertGeometryStreaming()
+	{
+		progressTextCallback( "Creating geometry..." );
+		progressValueCallback( 0, "geometry" );
+
+		std::vector<shared_ptr<IfcObjectDefinition> > vec_object_definitions;
+		if( !prepareConversion( vec_object_definitions ) )
 		{
 			return;
 		}
 
-		// convert IFC geometry
-		std::vector<shared_ptr<IfcRepresentation> >& vec_representations = product_representation->m_Representations;
-		for( size_t i_representations = 0; i_representations < vec_representations.size(); ++i_representations )
+		sortBySpatialStructure( vec_object_definitions );
+
+		// the spatial structure is not resolved in streaming mode, so the objects above the requested products are not needed
+		std::unordered_set<IfcObjectDefinition*> set_structure_only;
+		selectRequestedObjects( vec_object_definitions, set_structure_only );
+		if( m_conversion_request && !m_conversion_request->isEmpty() )
 		{
-			const shared_ptr<IfcRepresentation>& representation = vec_representations[i_representations];
-			if( !representation )
-			{
-				continue;
-			}
+			vec_object_definitions.erase( std::remove_if( vec_object_definitions.begin(), vec_object_definitions.end(), [&]( const shared_ptr<IfcObjectDefinition>& object_def ) {
+				return set_structure_only.find( object_def.get() ) != set_structure_only.end(); } ), vec_object_definitions.end() );
 
-			try
-			{
-				shared_ptr<ItemShapeData> representation_data( new ItemShapeData() );
-				m_representation_converter->convertIfcRepresentation( representation, representation_data );
-				product_shape->addGeometricItem( representation_data, product_shape );
-			}
-			catch( BuildingException& e )
+			std::unordered_set<BuildingObject*> set_selected;
+			for( const shared_ptr<IfcObjectDefinition>& object_def : vec_object_definitions )
 			{
-				messageCallback( e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "" );
+				set_selected.insert( object_def.get() );
 			}
-			catch( std::exception& e )
+			for( auto it = m_map_outside_spatial_structure.begin(); it != m_map_outside_spatial_structure.end(); )
 			{
-				messageCallback( e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "" );
+				if( set_selected.find( it->second.get() ) == set_selected.end() )
+				{
+					it = m_map_outside_spatial_structure.erase( it );
+					continue;
+				}
+				++it;
 			}
 		}
 
-		// IfcProduct has an ObjectPlacement that can be local or global
-		product_shape->m_object_placement = ifc_product->m_ObjectPlacement;
-		if( ifc_product->m_ObjectPlacement )
-		{
-			// IfcPlacement2Matrix follows related placements in case of local coordinate systems
-			std::unordered_set<IfcObjectPlacement*> placement_already_applied;
-			m_representation_converter->getPlacementConverter()->convertIfcObjectPlacement( ifc_product->m_ObjectPlacement, product_shape, placement_already_applied, false );
-		}
+		const size_t num_object_definitions = vec_object_definitions.size();
+		const size_t batch_size = m_geom_settings->getStreamingBatchSize();
+		shared_ptr<ItemShapeCache>& item_shape_cache = m_representation_converter->getItemShapeCache();
+		size_t num_products_streamed = 0;
+		size_t num_entities_released = 0;
+		size_t num_item_shapes_evicted = 0;
+		std::unordered_set<IfcObjectDefinition*> set_outside_region;
 
-		std::vector<shared_ptr<ProductShapeData> > vec_opening_data;
-		const shared_ptr<IfcElement> ifc_element = dynamic_pointer_cast<IfcElement>(ifc_product);
-		if( ifc_element )
+		for( size_t batch_begin = 0; batch_begin < num_object_definitions; batch_begin += batch_size )
 		{
-			// handle openings
-			m_representation_converter->subtractOpenings(ifc_element, product_shape);
+			const size_t batch_end = std::min( num_object_definitions, batch_begin + batch_size );
+			std::vector<shared_ptr<IfcObjectDefinition> > vec_batch( vec_object_definitions.begin() + batch_begin, vec_object_definitions.begin() + batch_end );
+			std::vector<shared_ptr<ProductShapeData> > vec_batch_shapes( vec_batch.size() );
+
+			// convert expensive products first, but keep the spatial structure order for the callback
+			std::vector<std::pair<double, int> > vec_conversion_order;
+			vec_conversion_order.reserve( vec_batch.size() );
+			for( size_t ii = 0; ii < vec_batch.size(); ++ii )
+			{
+				vec_conversion_order.push_back( { estimateProductCost( vec_batch[ii] ), (int)ii } );
+			}
+			std::stable_sort( vec_conversion_order.begin(), vec_conversion_order.end(), []( const std::pair<double, int>& a, const std::pair<double, int>& b ) { return a.first > b.first; } );
+			const int num_batch_products = (int)vec_conversion_order.size();
 
-			// handle styles on IfcElement level
-			std::vector<shared_ptr<AppearanceData> > vec_apperances;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+			for( int i = 0; i < num_batch_products; ++i )
+			{
+				const int index_in_batch = vec_conversion_order[i].second;
+				const shared_ptr<IfcObjectDefinition>& object_def = vec_batch[index_in_batch];
+				if( m_geom_settings->skipRenderObject( object_def->classID() ) )
+				{
+					// geometry of openings is created in method subtractOpenings
+					continue;
+				}
+
+				std::string guid;
+				if( object_def->m_GlobalId )
+				{
+					guid = object_def->m_GlobalId->m_value;
+				}
+
+				shared_ptr<ProductShapeData> product_geom_input_data( new ProductShapeData(guid) );
+				product_geom_input_data->m_ifc_object_definition = object_def;
+
+				try
+				{
+					ConversionBudget product_budget;
+					product_budget.limit( m_geom_settings->getMaxTimePerProduct() );
+					ScopedConversionBudget scoped_budget( product_budget );
+
+					convertIfcProductShape( product_geom_input_data );
+
+					// the aggregated object is converted separately, so subtract the openings of the element that it belongs to here
+					subtractOpeningsOfAggregatingElement( product_geom_input_data );
+					if( ConversionBudget::current().exceeded() )
+					{
+						applyExceededBudgetFallback( product_geom_input_data );
+					}
+				}
+				catch( BuildingException& e )
+				{
+					messageCallback( e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "" );
+				}
+				catch( carve::exception& e )
+				{
+					messageCallback( e.str(), StatusCallback::MESSAGE_TYPE_ERROR, "" );
+				}
+				catch( std::exception& e )
+				{
+					messageCallback( e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "" );
+				}
+				catch( ... )
+				{
+					messageCallback( "undefined error", StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, object_def.get() );
+				}
+				vec_batch_shapes[index_in_batch] = product_geom_input_data;
+			}
+
+			if( m_geom_settings->createTriangleMeshes() )
+			{
+				createTriangleMeshes( vec_batch_shapes, m_geom_settings->releaseCarveMeshes(), false );
+			}
+
+			for( shared_ptr<ProductShapeData>& product_shape : vec_batch_shapes )
+			{
+				if( !product_shape )
+				{
+					continue;
+				}
+
+				if( m_conversion_request && m_conversion_request->hasBoundingRegion() )
+				{
+					// openings follow their element in the spatial structure order
+					shared_ptr<IfcFeatureElementSubtraction> opening = dynamic_pointer_cast<IfcFeatureElementSubtraction>( product_shape->m_ifc_object_definition.lock() );
+					shared_ptr<IfcRelVoidsElement> rel_voids = opening ? opening->m_VoidsElements_inverse.lock() : shared_ptr<IfcRelVoidsElement>();
+					if( rel_voids )
+					{
+						if( set_outside_region.find( rel_voids->m_RelatingBuildingElement.get() ) != set_outside_region.end() )
+						{
+							m_map_outside_spatial_structure.erase( product_shape->m_entity_guid );
+							continue;
+						}
+					}
+					else if( !m_conversion_request->intersectsBoundingRegion( computeWorldBoundingBox( product_shape ) ) )
+					{
+						set_outside_region.insert( product_shape->m_ifc_object_definition.lock().get() );
+						m_map_outside_spatial_structure.erase( product_shape->m_entity_guid );
+						continue;
+					}
+				}
+
+				if( m_callback_func_geometry_converted && m_callback_object_geometry_converted )
+				{
+					m_callback_func_geometry_converted( m_callback_object_geometry_converted, product_shape );
+				}
+				++num_products_streamed;
+			}
+			vec_batch_shapes.clear();
+
+			for( const shared_ptr<IfcObjectDefinition>& object_def : vec_batch )
+			{
+				num_entities_released += releaseRepresentationEntities( object_def );
+			}
+
+			// items that are shared between batches are kept, others are only kept up to the size of a few batches
+			num_item_shapes_evicted += item_shape_cache->evictUnusedItemShapes( 4 * batch_size );
+
+			progressValueCallback( 0.9 * (double)batch_end / (double)num_object_definitions, "geometry" );
+		}
+
+		m_num_item_shape_cache_hits = item_shape_cache->getNumCacheHits();
+		item_shape_cache->clearItemShapeCache();
+		m_representation_converter->getProfileCache()->clearProfileCache();
+		m_representation_converter->getPrismaticOpenings()->resetNumProductsHandled();
+		MeshOps::resetMeshSetCheckCounters();
+		finishGeometryDiskCache();
+
+		std::stringstream strs;
+		strs << num_products_streamed << " products converted in streaming mode, " << num_entities_released << " representation entities released";
+		if( m_num_item_shape_cache_hits > 0 )
+		{
+			strs << ", " << m_num_item_shape_cache_hits << " representation items shared, " << num_item_shapes_evicted << " unshared items removed from cache";
+		}
+		messageCallback( strs.str(), StatusCallback::MESSAGE_TYPE_GENERAL_MESSAGE, "" );
+
+		progressTextCallback( "Loading file done" );
+		progressValueCallback( 1.0, "geometry" );
+	}
+
+	/*\brief Updates the geometry after the model has been modified, by converting only the products that depend on the modified entities.
+	  changed_entity_ids are the ids of modified, added and removed entities. Products with a changed shape are converted again (in parallel), new products are converted
+	  and linked into the spatial structure, products of which only the placement has changed get new transforms, and removed products are removed from getShapeInputData().
+	  Existing ProductShapeData objects are updated in place. m_callback_func_geometry_converted is called for converted and moved products.
+	  Requires GeometrySettings::setTrackGeometryDependencies before convertGeometry, otherwise false is returned and convertGeometry is necessary.
+	**/
+	bool updateGeometry( const std::set<int>& changed_entity_ids, GeometryUpdate& update )
+	{
+		if( !m_dependencies_tracked )
+		{
+			messageCallback( "Geometry dependencies have not been tracked, convertGeometry is necessary", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__ );
+			return false;
+		}
+
+		const std::map<int, shared_ptr<BuildingEntity> >& map_entities = m_ifc_model->getMapIfcEntities();
+		std::unordered_set<ProductShapeData*> set_convert;
+		std::unordered_set<ProductShapeData*> set_move;
+		std::vector<shared_ptr<IfcObjectDefinition> > vec_new_objects;
+		std::set<std::string> set_new_guids;
+
+		for( int entity_id : changed_entity_ids )
+		{
+			m_dependencies.findShapeDependents( entity_id, set_convert );
+			m_dependencies.findPlacementDependents( entity_id, set_move );
+
+			auto it_entity = map_entities.find( entity_id );
+			if( it_entity == map_entities.end() || !it_entity->second )
+			{
+				continue;
+			}
+			const shared_ptr<BuildingEntity>& entity = it_entity->second;
+
+			// new openings are not among the dependencies of the element yet
+			shared_ptr<IfcRelVoidsElement> rel_voids = dynamic_pointer_cast<IfcRelVoidsElement>( entity );
+			if( rel_voids && rel_voids->m_RelatingBuildingElement )
+			{
+				findProductShapeAndParts( rel_voids->m_RelatingBuildingElement, set_convert );
+			}
+
+			shared_ptr<IfcObjectDefinition> object_def = dynamic_pointer_cast<IfcObjectDefinition>( entity );
+			if( object_def && object_def->m_GlobalId && !m_geom_settings->skipRenderObject( object_def->classID() ) )
+			{
+				const std::string& guid = object_def->m_GlobalId->m_value;
+				if( m_product_shape_data.find( guid ) == m_product_shape_data.end() && set_new_guids.insert( guid ).second )
+				{
+					vec_new_objects.push_back( object_def );
+				}
+			}
+		}
+
+		// products whose entity is not in the model anymore
+		std::vector<ProductShapeData*> vec_affected( set_convert.begin(), set_convert.end() );
+		std::copy( set_move.begin(), set_move.end(), std::back_inserter( vec_affected ) );
+		for( ProductShapeData* product_shape : vec_affected )
+		{
+			shared_ptr<IfcObjectDefinition> object_def = product_shape->m_ifc_object_definition.lock();
+			if( object_def )
+			{
+				auto it_entity = map_entities.find( object_def->m_tag );
+				if( it_entity != map_entities.end() && it_entity->second == object_def )
+				{
+					continue;
+				}
+			}
+
+			if( set_convert.erase( product_shape ) + set_move.erase( product_shape ) > 0 )
+			{
+				update.m_removed_products.push_back( product_shape->m_entity_guid );
+				removeProductShape( product_shape );
+			}
+		}
+
+		for( ProductShapeData* product_shape : set_convert )
+		{
+			set_move.erase( product_shape );
+		}
+
+		// styles are cached by entity id, and may have changed
+		m_representation_converter->getStylesConverter()->clearStylesCache();
+
+		std::vector<shared_ptr<ProductShapeData> > vec_existing_shapes;
+		std::vector<shared_ptr<IfcObjectDefinition> > vec_objects;
+		for( ProductShapeData* product_shape : set_convert )
+		{
+			vec_existing_shapes.push_back( findProductShape( product_shape ) );
+			vec_objects.push_back( product_shape->m_ifc_object_definition.lock() );
+		}
+		for( const shared_ptr<IfcObjectDefinition>& object_def : vec_new_objects )
+		{
+			vec_existing_shapes.push_back( shared_ptr<ProductShapeData>() );
+			vec_objects.push_back( object_def );
+		}
+
+		std::vector<std::pair<double, int> > vec_conversion_order;
+		for( size_t ii = 0; ii < vec_objects.size(); ++ii )
+		{
+			vec_conversion_order.push_back( { estimateProductCost( vec_objects[ii] ), (int)ii } );
+		}
+		std::stable_sort( vec_conversion_order.begin(), vec_conversion_order.end(), []( const std::pair<double, int>& a, const std::pair<double, int>& b ) { return a.first > b.first; } );
+		const int num_objects = (int)vec_conversion_order.size();
+		std::vector<shared_ptr<ProductShapeData> > vec_converted_shapes( vec_objects.size() );
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+		for( int i = 0; i < num_objects; ++i )
+		{
+			const int index = vec_conversion_order[i].second;
+			const shared_ptr<IfcObjectDefinition>& object_def = vec_objects[index];
+			if( !object_def )
+			{
+				continue;
+			}
+
+			std::string guid;
+			if( object_def->m_GlobalId )
+			{
+				guid = object_def->m_GlobalId->m_value;
+			}
+			shared_ptr<ProductShapeData> product_shape( new ProductShapeData( guid ) );
+			product_shape->m_ifc_object_definition = object_def;
+
+			try
+			{
+				ConversionBudget product_budget;
+				product_budget.limit( m_geom_settings->getMaxTimePerProduct() );
+				ScopedConversionBudget scoped_budget( product_budget );
+
+				convertIfcProductShape( product_shape );
+				subtractOpeningsOfAggregatingElement( product_shape );
+				if( ConversionBudget::current().exceeded() )
+				{
+					applyExceededBudgetFallback( product_shape );
+				}
+			}
+			catch( BuildingException& e )
+			{
+				messageCallback( e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "" );
+			}
+			catch( carve::exception& e )
+			{
+				messageCallback( e.str(), StatusCallback::MESSAGE_TYPE_ERROR, "" );
+			}
+			catch( std::exception& e )
+			{
+				messageCallback( e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "" );
+			}
+			catch( ... )
+			{
+				messageCallback( "undefined error", StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, object_def.get() );
+			}
+			vec_converted_shapes[index] = product_shape;
+		}
+
+		for( size_t ii = 0; ii < vec_converted_shapes.size(); ++ii )
+		{
+			shared_ptr<ProductShapeData>& converted_shape = vec_converted_shapes[ii];
+			if( !converted_shape )
+			{
+				continue;
+			}
+
+			shared_ptr<ProductShapeData>& existing_shape = vec_existing_shapes[ii];
+			if( existing_shape )
+			{
+				replaceProductGeometry( existing_shape, converted_shape );
+				update.m_converted_products.push_back( existing_shape );
+			}
+			else
+			{
+				m_product_shape_data[converted_shape->m_entity_guid] = converted_shape;
+				linkNewProductShape( converted_shape );
+				update.m_converted_products.push_back( converted_shape );
+			}
+		}
+
+		for( ProductShapeData* product_shape_ptr : set_move )
+		{
+			shared_ptr<ProductShapeData> product_shape = findProductShape( product_shape_ptr );
+			shared_ptr<IfcProduct> ifc_product = dynamic_pointer_cast<IfcProduct>( product_shape_ptr->m_ifc_object_definition.lock() );
+			if( !product_shape || !ifc_product )
+			{
+				continue;
+			}
+
+			product_shape->m_vec_transforms.clear();
+			product_shape->m_object_placement = ifc_product->m_ObjectPlacement;
+			if( ifc_product->m_ObjectPlacement )
+			{
+				std::unordered_set<IfcObjectPlacement*> placement_already_applied;
+				m_representation_converter->getPlacementConverter()->convertIfcObjectPlacement( ifc_product->m_ObjectPlacement, product_shape, placement_already_applied, false );
+			}
+			update.m_moved_products.push_back( product_shape );
+		}
+
+		if( m_geom_settings->createTriangleMeshes() )
+		{
+			createTriangleMeshes( update.m_converted_products, m_geom_settings->releaseCarveMeshes(), false );
+		}
+
+		// references between entities may have changed as well. Shape dependencies of moved products are unchanged, otherwise they would have been converted
+		std::vector<ProductShapeData*> vec_converted;
+		for( const shared_ptr<ProductShapeData>& product_shape : update.m_converted_products )
+		{
+			vec_converted.push_back( product_shape.get() );
+		}
+		updateGeometryDependencies( vec_converted, false );
+
+		std::vector<ProductShapeData*> vec_moved;
+		for( const shared_ptr<ProductShapeData>& product_shape : update.m_moved_products )
+		{
+			vec_moved.push_back( product_shape.get() );
+		}
+		updateGeometryDependencies( vec_moved, true );
+
+		m_representation_converter->getItemShapeCache()->clearItemShapeCache();
+		m_representation_converter->getProfileCache()->clearProfileCache();
+
+		if( m_callback_func_geometry_converted && m_callback_object_geometry_converted )
+		{
+			for( shared_ptr<ProductShapeData>& product_shape : update.m_converted_products )
+			{
+				m_callback_func_geometry_converted( m_callback_object_geometry_converted, product_shape );
+			}
+			for( shared_ptr<ProductShapeData>& product_shape : update.m_moved_products )
+			{
+				m_callback_func_geometry_converted( m_callback_object_geometry_converted, product_shape );
+			}
+		}
+
+		std::stringstream strs;
+		strs << "Geometry updated: " << update.m_converted_products.size() << " products converted, " << update.m_moved_products.size() << " moved, " << update.m_removed_products.size() << " removed";
+		messageCallback( strs.str(), StatusCallback::MESSAGE_TYPE_GENERAL_MESSAGE, "" );
+		return true;
+	}
+
+	//\brief Collects the dependencies of all products for updateGeometry
+	void collectGeometryDependencies()
+	{
+		m_dependencies.clear();
+		std::vector<ProductShapeData*> vec_products;
+		vec_products.reserve( m_product_shape_data.size() );
+		for( auto& it : m_product_shape_data )
+		{
+			if( it.second )
+			{
+				vec_products.push_back( it.second.get() );
+			}
+		}
+		updateGeometryDependencies( vec_products );
+		m_dependencies_tracked = true;
+	}
+
+	//\brief Collects the dependencies of the given products again. If placement_only is set, the shape dependencies are kept. The index is only modified for products with changed dependencies
+	void updateGeometryDependencies( const std::vector<ProductShapeData*>& vec_products, bool placement_only = false )
+	{
+		const int num_products = (int)vec_products.size();
+		std::vector<std::vector<int> > vec_previous_shape_ids( num_products );
+		std::vector<std::vector<int> > vec_previous_placement_ids( num_products );
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+		{
+			GeometryDependencies::SubgraphCache subgraph_cache;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic,100)
+#endif
+			for( int i = 0; i < num_products; ++i )
+			{
+				ProductShapeData* product_shape = vec_products[i];
+				vec_previous_placement_ids[i] = product_shape->m_placement_dependencies;
+				if( placement_only )
+				{
+					GeometryDependencies::collectPlacementDependencies( product_shape, subgraph_cache );
+				}
+				else
+				{
+					vec_previous_shape_ids[i] = product_shape->m_shape_dependencies;
+					GeometryDependencies::collectProductDependencies( product_shape, subgraph_cache );
+				}
+			}
+		}
+
+		std::vector<ProductShapeData*> vec_changed;
+		std::vector<int> vec_changed_index;
+		for( int i = 0; i < num_products; ++i )
+		{
+			ProductShapeData* product_shape = vec_products[i];
+			if( product_shape->m_placement_dependencies == vec_previous_placement_ids[i] && ( placement_only || product_shape->m_shape_dependencies == vec_previous_shape_ids[i] ) )
+			{
+				continue;
+			}
+			vec_changed.push_back( product_shape );
+			vec_changed_index.push_back( i );
+		}
+
+		// the previous dependencies are removed from the index, then the new ones are added
+		for( size_t ii = 0; ii < vec_changed.size(); ++ii )
+		{
+			vec_changed[ii]->m_placement_dependencies.swap( vec_previous_placement_ids[vec_changed_index[ii]] );
+			if( !placement_only )
+			{
+				vec_changed[ii]->m_shape_dependencies.swap( vec_previous_shape_ids[vec_changed_index[ii]] );
+			}
+		}
+		m_dependencies.removeProducts( vec_changed, placement_only );
+		for( size_t ii = 0; ii < vec_changed.size(); ++ii )
+		{
+			vec_changed[ii]->m_placement_dependencies.swap( vec_previous_placement_ids[vec_changed_index[ii]] );
+			if( !placement_only )
+			{
+				vec_changed[ii]->m_shape_dependencies.swap( vec_previous_shape_ids[vec_changed_index[ii]] );
+			}
+			m_dependencies.addProduct( vec_changed[ii], placement_only );
+		}
+	}
+
+	shared_ptr<ProductShapeData> findProductShape( ProductShapeData* product_shape )
+	{
+		auto it_find = m_product_shape_data.find( product_shape->m_entity_guid );
+		if( it_find != m_product_shape_data.end() && it_find->second.get() == product_shape )
+		{
+			return it_find->second;
+		}
+
+		// GUID has been made unique
+		for( auto& it : m_product_shape_data )
+		{
+			if( it.second.get() == product_shape )
+			{
+				return it.second;
+			}
+		}
+		return shared_ptr<ProductShapeData>();
+	}
+
+	void findProductShapeAndParts( const shared_ptr<IfcObjectDefinition>& object_def, std::unordered_set<ProductShapeData*>& set_products )
+	{
+		if( object_def->m_GlobalId )
+		{
+			auto it_find = m_product_shape_data.find( object_def->m_GlobalId->m_value );
+			if( it_find != m_product_shape_data.end() && it_find->second )
+			{
+				set_products.insert( it_find->second.get() );
+			}
+		}
+
+		// openings are also subtracted from the parts of the element
+		for( const weak_ptr<IfcRelAggregates>& rel_aggregates_weak : object_def->m_IsDecomposedBy_inverse )
+		{
+			shared_ptr<IfcRelAggregates> rel_aggregates = rel_aggregates_weak.lock();
+			if( !rel_aggregates )
+			{
+				continue;
+			}
+			for( const shared_ptr<IfcObjectDefinition>& related_object : rel_aggregates->m_RelatedObjects )
+			{
+				if( related_object && related_object->m_GlobalId )
+				{
+					auto it_find = m_product_shape_data.find( related_object->m_GlobalId->m_value );
+					if( it_find != m_product_shape_data.end() && it_find->second )
+					{
+						set_products.insert( it_find->second.get() );
+					}
+				}
+			}
+		}
+	}
+
+	void removeProductShape( ProductShapeData* product_shape_ptr )
+	{
+		shared_ptr<ProductShapeData> product_shape = findProductShape( product_shape_ptr );
+		if( !product_shape )
+		{
+			return;
+		}
+		m_dependencies.removeProducts( { product_shape_ptr } );
+
+		shared_ptr<ProductShapeData> parent_shape = product_shape->m_parent.lock();
+		if( parent_shape )
+		{
+			std::vector<shared_ptr<ProductShapeData> >& vec_siblings = parent_shape->m_vec_children;
+			vec_siblings.erase( std::remove( vec_siblings.begin(), vec_siblings.end(), product_shape ), vec_siblings.end() );
+		}
+		for( shared_ptr<ProductShapeData>& child_shape : product_shape->m_vec_children )
+		{
+			child_shape->m_parent.reset();
+		}
+
+		for( auto it = m_product_shape_data.begin(); it != m_product_shape_data.end(); ++it )
+		{
+			if( it->second == product_shape )
+			{
+				m_map_outside_spatial_structure.erase( it->first );
+				m_product_shape_data.erase( it );
+				break;
+			}
+		}
+	}
+
+	//\brief Moves the converted geometry into the existing ProductShapeData, so that its position in the spatial structure and references to it are kept
+	static void replaceProductGeometry( shared_ptr<ProductShapeData>& existing_shape, shared_ptr<ProductShapeData>& converted_shape )
+	{
+		existing_shape->m_geometric_items.swap( converted_shape->m_geometric_items );
+		for( shared_ptr<ItemShapeData>& item : existing_shape->m_geometric_items )
+		{
+			item->m_parent_product = existing_shape;
+		}
+		existing_shape->m_vec_representations.swap( converted_shape->m_vec_representations );
+		for( shared_ptr<RepresentationData>& representation : existing_shape->m_vec_representations )
+		{
+			representation->m_parent_product = existing_shape;
+		}
+		existing_shape->m_vec_transforms.swap( converted_shape->m_vec_transforms );
+		existing_shape->m_vec_product_appearances.swap( converted_shape->m_vec_product_appearances );
+		existing_shape->m_object_placement = converted_shape->m_object_placement;
+		existing_shape->m_ifc_representation = converted_shape->m_ifc_representation;
+	}
+
+	//\brief Adds a product that has been added to the model after convertGeometry to the spatial structure element or element it belongs to
+	void linkNewProductShape( shared_ptr<ProductShapeData>& product_shape )
+	{
+		shared_ptr<IfcObjectDefinition> object_def = product_shape->m_ifc_object_definition.lock();
+		if( !object_def )
+		{
+			return;
+		}
+
+		shared_ptr<IfcObjectDefinition> parent_object;
+		for( const weak_ptr<IfcRelAggregates>& rel_aggregates_weak : object_def->m_Decomposes_inverse )
+		{
+			shared_ptr<IfcRelAggregates> rel_aggregates = rel_aggregates_weak.lock();
+			if( rel_aggregates && rel_aggregates->m_RelatingObject )
+			{
+				parent_object = rel_aggregates->m_RelatingObject;
+				break;
+			}
+		}
+
+		shared_ptr<IfcElement> ifc_element = dynamic_pointer_cast<IfcElement>( object_def );
+		if( !parent_object && ifc_element )
+		{
+			for( const weak_ptr<IfcRelContainedInSpatialStructure>& rel_contained_weak : ifc_element->m_ContainedInStructure_inverse )
+			{
+				shared_ptr<IfcRelContainedInSpatialStructure> rel_contained = rel_contained_weak.lock();
+				if( rel_contained && rel_contained->m_RelatingStructure )
+				{
+					parent_object = rel_contained->m_RelatingStructure;
+					break;
+				}
+			}
+		}
+
+		if( parent_object && parent_object->m_GlobalId )
+		{
+			auto it_parent = m_product_shape_data.find( parent_object->m_GlobalId->m_value );
+			if( it_parent != m_product_shape_data.end() && it_parent->second )
+			{
+				it_parent->second->addChildProduct( product_shape, it_parent->second );
+				product_shape->m_added_to_spatial_structure = true;
+				return;
+			}
+		}
+		m_map_outside_spatial_structure[product_shape->m_entity_guid] = object_def;
+	}
+
+	//\brief Reports hits and misses of the geometry disk cache, and removes least recently used entries if the cache exceeds its maximum size
+	void finishGeometryDiskCache()
+	{
+		shared_ptr<GeometryDiskCache>& disk_cache = m_representation_converter->getGeometryDiskCache();
+		if( !disk_cache->isEnabled() )
+		{
+			return;
+		}
+
+		const size_t num_evicted = disk_cache->evictEntries();
+		std::stringstream strs;
+		strs << "Geometry cache: " << disk_cache->getNumLoadedItems() << " representation items loaded, " << disk_cache->getNumMissedItems() << " missed, "
+			<< disk_cache->getNumStoredItems() << " stored, " << num_evicted << " files evicted";
+		messageCallback( strs.str(), StatusCallback::MESSAGE_TYPE_GENERAL_MESSAGE, "" );
+	}
+
+	//\brief Creates indexed triangle buffers (ItemShapeData::m_triangle_meshes) for the meshsets of all products. Meshsets that are shared between items are converted once.
+	// If releaseCarveMeshes is true, the carve meshsets are released afterwards, so that only the triangles are kept. No boolean operations are possible on the geometry then.
+	void createTriangleMeshes( bool releaseCarveMeshes )
+	{
+		std::vector<shared_ptr<ProductShapeData> > vec_products;
+		vec_products.reserve( m_product_shape_data.size() );
+		for( auto it = m_product_shape_data.begin(); it != m_product_shape_data.end(); ++it )
+		{
+			vec_products.push_back( it->second );
+		}
+		createTriangleMeshes( vec_products, releaseCarveMeshes, true );
+	}
+
+	//\brief Creates the triangle meshes for the given products, see createTriangleMeshes( bool ). If report is set, the number of triangles is reported through messageCallback
+	void createTriangleMeshes( const std::vector<shared_ptr<ProductShapeData> >& vec_products, bool releaseCarveMeshes, bool report )
+	{
+		std::vector<ItemShapeData*> vec_items;
+		std::unordered_set<ItemShapeData*> set_visited;
+		std::function<void( const shared_ptr<ItemShapeData>& )> collectItem = [&]( const shared_ptr<ItemShapeData>& item )
+		{
+			if( !item || !set_visited.insert( item.get() ).second )
+			{
+				return;
+			}
+			vec_items.push_back( item.get() );
+			for( const shared_ptr<ItemShapeData>& child_item : item->m_child_items )
+			{
+				collectItem( child_item );
+			}
+		};
+		for( const shared_ptr<ProductShapeData>& product_shape : vec_products )
+		{
+			if( product_shape )
+			{
+				for( const shared_ptr<ItemShapeData>& item : product_shape->m_geometric_items )
+				{
+					collectItem( item );
+				}
+			}
+		}
+
+		std::vector<std::pair<const carve::mesh::MeshSet<3>*, bool> > vec_meshsets;
+		std::unordered_map<const carve::mesh::MeshSet<3>*, size_t> map_meshset_index;
+		for( ItemShapeData* item : vec_items )
+		{
+			for( const shared_ptr<carve::mesh::MeshSet<3> >& meshset : item->m_meshsets )
+			{
+				if( meshset && map_meshset_index.insert( { meshset.get(), vec_meshsets.size() } ).second )
+				{
+					vec_meshsets.push_back( { meshset.get(), true } );
+				}
+			}
+			for( const shared_ptr<carve::mesh::MeshSet<3> >& meshset : item->m_meshsets_open )
+			{
+				if( meshset && map_meshset_index.insert( { meshset.get(), vec_meshsets.size() } ).second )
+				{
+					vec_meshsets.push_back( { meshset.get(), false } );
+				}
+			}
+		}
+
+		const bool single_precision = m_geom_settings->triangleMeshesSinglePrecision();
+		const double min_triangle_area = m_geom_settings->getMinTriangleArea();
+		const double eps = m_geom_settings->getEpsilonMergePoints();
+		const int num_meshsets = (int)vec_meshsets.size();
+		std::vector<shared_ptr<TriangleMeshData> > vec_triangle_meshes( num_meshsets );
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16)
+#endif
+		for( int i = 0; i < num_meshsets; ++i )
+		{
+			vec_triangle_meshes[i] = TriangleMeshData::createFromMeshSet( vec_meshsets[i].first, vec_meshsets[i].second, single_precision, min_triangle_area, eps );
+		}
+
+		std::vector<ItemShapeData*> vec_items_for_lods;
+		for( ItemShapeData* item : vec_items )
+		{
+			if( item->m_meshsets.size() == 0 && item->m_meshsets_open.size() == 0 )
+			{
+				// keep the triangles of a previous call, if the meshsets have been released. Swept disks may have triangles without meshsets
+				if( item->m_triangle_meshes.size() > 0 && item->m_triangle_mesh_lods.size() == 0 )
+				{
+					vec_items_for_lods.push_back( item );
+				}
+				continue;
+			}
+
+			vec_items_for_lods.push_back( item );
+			item->m_triangle_meshes.clear();
+			for( const shared_ptr<carve::mesh::MeshSet<3> >& meshset : item->m_meshsets )
+			{
+				if( meshset )
+				{
+					item->m_triangle_meshes.push_back( vec_triangle_meshes[map_meshset_index[meshset.get()]] );
+				}
+			}
+			for( const shared_ptr<carve::mesh::MeshSet<3> >& meshset : item->m_meshsets_open )
+			{
+				if( meshset )
+				{
+					item->m_triangle_meshes.push_back( vec_triangle_meshes[map_meshset_index[meshset.get()]] );
+				}
+			}
+
+			if( releaseCarveMeshes )
+			{
+				std::vector<shared_ptr<carve::mesh::MeshSet<3> > >().swap( item->m_meshsets );
+				std::vector<shared_ptr<carve::mesh::MeshSet<3> > >().swap( item->m_meshsets_open );
+			}
+		}
+
+		if( m_geom_settings->getNumLevelsOfDetail() > 0 )
+		{
+			createLevelsOfDetail( vec_items_for_lods, report );
+		}
+
+		size_t num_triangles = 0;
+		size_t memory_size = 0;
+		for( const shared_ptr<TriangleMeshData>& triangle_mesh : vec_triangle_meshes )
+		{
+			num_triangles += triangle_mesh->getNumTriangles();
+			memory_size += triangle_mesh->getMemorySize();
+		}
+
+		if( num_meshsets > 0 && report )
+		{
+			std::stringstream strs;
+			strs << "Triangle meshes created for " << num_meshsets << " meshsets: " << num_triangles << " triangles, " << memory_size / 1024 << " kB";
+			messageCallback( strs.str(), StatusCallback::MESSAGE_TYPE_GENERAL_MESSAGE, "" );
+		}
+	}
+
+	//\brief Creates simplified levels of detail (ItemShapeData::m_triangle_mesh_lods) for the triangle meshes of the given items, by quadric error edge collapses.
+	// All levels of a mesh are snapshots of one sequence of collapses, so each additional level only costs the collapses beyond the previous level.
+	void createLevelsOfDetail( const std::vector<ItemShapeData*>& vec_items, bool report = true )
+	{
+		const int num_levels = m_geom_settings->getNumLevelsOfDetail();
+		const double triangle_ratio = m_geom_settings->getLevelOfDetailTriangleRatio();
+		const bool single_precision = m_geom_settings->triangleMeshesSinglePrecision();
+
+		std::vector<TriangleMeshData*> vec_meshes;
+		std::unordered_map<TriangleMeshData*, size_t> map_mesh_index;
+		for( ItemShapeData* item : vec_items )
+		{
+			for( const shared_ptr<TriangleMeshData>& triangle_mesh : item->m_triangle_meshes )
+			{
+				if( map_mesh_index.insert( { triangle_mesh.get(), vec_meshes.size() } ).second )
+				{
+					vec_meshes.push_back( triangle_mesh.get() );
+				}
+			}
+		}
+
+		const int num_meshes = (int)vec_meshes.size();
+		std::vector<std::vector<shared_ptr<TriangleMeshData> > > vec_mesh_lods( num_meshes );
+		std::vector<std::vector<double> > vec_mesh_errors( num_meshes );
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,4)
+#endif
+		for( int i = 0; i < num_meshes; ++i )
+		{
+			MeshSimplifier simplifier( *vec_meshes[i] );
+			double target_num_triangles = (double)simplifier.getNumTriangles();
+			for( int level = 0; level < num_levels; ++level )
+			{
+				target_num_triangles *= triangle_ratio;
+				simplifier.simplify( (size_t)target_num_triangles );
+				vec_mesh_lods[i].push_back( simplifier.createTriangleMesh( single_precision ) );
+				vec_mesh_errors[i].push_back( simplifier.getGeometricError() );
+			}
+		}
+
+		for( ItemShapeData* item : vec_items )
+		{
+			item->m_triangle_mesh_lods.clear();
+			for( int level = 0; level < num_levels; ++level )
+			{
+				shared_ptr<TriangleMeshLevelOfDetail> lod( new TriangleMeshLevelOfDetail() );
+				for( const shared_ptr<TriangleMeshData>& triangle_mesh : item->m_triangle_meshes )
+				{
+					const size_t mesh_index = map_mesh_index[triangle_mesh.get()];
+					lod->m_triangle_meshes.push_back( vec_mesh_lods[mesh_index][level] );
+					lod->m_geometric_error = std::max( lod->m_geometric_error, vec_mesh_errors[mesh_index][level] );
+				}
+				item->m_triangle_mesh_lods.push_back( lod );
+			}
+		}
+
+		if( num_meshes > 0 && report )
+		{
+			std::stringstream strs;
+			strs << "Levels of detail created for " << num_meshes << " triangle meshes:";
+			for( int level = 0; level < num_levels; ++level )
+			{
+				size_t num_triangles = 0;
+				double max_error = 0;
+				for( int i = 0; i < num_meshes; ++i )
+				{
+					num_triangles += vec_mesh_lods[i][level]->getNumTriangles();
+					max_error = std::max( max_error, vec_mesh_errors[i][level] );
+				}
+				strs << ( level > 0 ? "," : "" ) << " level " << level + 1 << ": " << num_triangles << " triangles, max. error " << max_error;
+			}
+			messageCallback( strs.str(), StatusCallback::MESSAGE_TYPE_GENERAL_MESSAGE, "" );
+		}
+	}
+
+	void addVector3D(const vec3& point, std::vector<float>& target_array)
+	{
+		bool m_roundCoords = false;
+		if (m_roundCoords)
+		{
+			target_array.push_back(round(point.x*10000)*0.0001);
+			target_array.push_back(round(point.y*10000)*0.0001);
+			target_array.push_back(round(point.z*10000)*0.0001);
+		}
+		else
+		{
+			target_array.push_back(point.x);
+			target_array.push_back(point.y);
+			target_array.push_back(point.z);
+		}
+	}
+
+	//\brief Rough estimate of the conversion time of a representation item. A simple extrusion has cost 1
+	static double estimateRepresentationItemCost( const shared_ptr<IfcRepresentationItem>& item, int depth = 0 )
+	{
+		if( !item || depth > 20 )
+		{
+			return 0;
+		}
+
+		shared_ptr<IfcBooleanResult> boolean_result = dynamic_pointer_cast<IfcBooleanResult>( item );
+		if( boolean_result )
+		{
+			double cost = 20.0;
+			cost += estimateRepresentationItemCost( dynamic_pointer_cast<IfcRepresentationItem>( boolean_result->m_FirstOperand ), depth + 1 );
+			cost += estimateRepresentationItemCost( dynamic_pointer_cast<IfcRepresentationItem>( boolean_result->m_SecondOperand ), depth + 1 );
+			return cost;
+		}
+
+		shared_ptr<IfcMappedItem> mapped_item = dynamic_pointer_cast<IfcMappedItem>( item );
+		if( mapped_item )
+		{
+			double cost = 0;
+			if( mapped_item->m_MappingSource )
+			{
+				shared_ptr<IfcRepresentation>& mapped_representation = mapped_item->m_MappingSource->m_MappedRepresentation;
+				if( mapped_representation )
+				{
+					for( const shared_ptr<IfcRepresentationItem>& mapped_rep_item : mapped_representation->m_Items )
+					{
+						cost += estimateRepresentationItemCost( mapped_rep_item, depth + 1 );
+					}
+				}
+			}
+			return cost;
+		}
+
+		shared_ptr<IfcManifoldSolidBrep> brep = dynamic_pointer_cast<IfcManifoldSolidBrep>( item );
+		if( brep )
+		{
+			double cost_per_face = 0.05;
+			if( dynamic_pointer_cast<IfcAdvancedBrep>( brep ) )
+			{
+				// faces with curved surfaces need to be tessellated
+				cost_per_face = 1.0;
+			}
+			if( brep->m_Outer )
+			{
+				return 1.0 + brep->m_Outer->m_CfsFaces.size()*cost_per_face;
+			}
+			return 1.0;
+		}
+
+		shared_ptr<IfcTriangulatedFaceSet> triangulated_face_set = dynamic_pointer_cast<IfcTriangulatedFaceSet>( item );
+		if( triangulated_face_set )
+		{
+			return 1.0 + triangulated_face_set->m_CoordIndex.size()*0.01;
+		}
+
+		shared_ptr<IfcPolygonalFaceSet> polygonal_face_set = dynamic_pointer_cast<IfcPolygonalFaceSet>( item );
+		if( polygonal_face_set )
+		{
+			return 1.0 + polygonal_face_set->m_Faces.size()*0.02;
+		}
+
+		return 1.0;
+	}
+
+	static double estimateProductCost( const shared_ptr<IfcObjectDefinition>& object_def )
+	{
+		shared_ptr<IfcProduct> ifc_product = dynamic_pointer_cast<IfcProduct>( object_def );
+		if( !ifc_product )
+		{
+			return 0;
+		}
+
+		double cost = 0;
+		if( ifc_product->m_Representation )
+		{
+			for( const shared_ptr<IfcRepresentation>& representation : ifc_product->m_Representation->m_Representations )
+			{
+				if( !representation )
+				{
+					continue;
+				}
+				for( const shared_ptr<IfcRepresentationItem>& item : representation->m_Items )
+				{
+					cost += estimateRepresentationItemCost( item );
+				}
+			}
+		}
+
+		shared_ptr<IfcElement> ifc_element = dynamic_pointer_cast<IfcElement>( ifc_product );
+		if( ifc_element )
+		{
+			// each opening needs to be converted and subtracted
+			for( const weak_ptr<IfcRelVoidsElement>& rel_voids_weak : ifc_element->m_HasOpenings_inverse )
+			{
+				if( rel_voids_weak.expired() )
+				{
+					continue;
+				}
+				shared_ptr<IfcRelVoidsElement> rel_voids( rel_voids_weak );
+				cost += 20.0 + estimateProductCost( rel_voids->m_RelatedOpeningElement );
+			}
+		}
+		return cost;
+	}
+
+	static void sortByEstimatedCost( std::vector<shared_ptr<IfcObjectDefinition> >& vec_object_definitions )
+	{
+		std::vector<std::pair<double, shared_ptr<IfcObjectDefinition> > > vec_cost;
+		vec_cost.reserve( vec_object_definitions.size() );
+		for( const shared_ptr<IfcObjectDefinition>& object_def : vec_object_definitions )
+		{
+			vec_cost.push_back( { estimateProductCost( object_def ), object_def } );
+		}
+
+		std::stable_sort( vec_cost.begin(), vec_cost.end(), []( const std::pair<double, shared_ptr<IfcObjectDefinition> >& a, const std::pair<double, shared_ptr<IfcObjectDefinition> >& b ) { return a.first > b.first; } );
+
+		for( size_t ii = 0; ii < vec_cost.size(); ++ii )
+		{
+			vec_object_definitions[ii] = vec_cost[ii].second;
+		}
+	}
+
+	//\brief method convertIfcProduct: Creates geometry objects (meshset with connected vertex-edge-face graph) from an IfcProduct object
+	// caution: when using OpenMP, this method runs in parallel threads, so every write access to member variables needs a write lock
+	void convertIfcProductShape( shared_ptr<ProductShapeData>& product_shape )
+	{
+		if( product_shape->m_ifc_object_definition.expired() )
+		{
+			return;
+		}
+
+		shared_ptr<IfcObjectDefinition> ifc_object_def(product_shape->m_ifc_object_definition);
+		shared_ptr<IfcProduct> ifc_product = dynamic_pointer_cast<IfcProduct>(ifc_object_def);
+		if (!ifc_product)
+		{
+			return;
+		}
+
+		shared_ptr<IfcProductRepresentation>& product_representation = ifc_product->m_Representation;
+		if( !product_representation )
+		{
+			return;
+		}
+
+		// convert IFC geometry
+		std::vector<shared_ptr<IfcRepresentation> >& vec_representations = product_representation->m_Representations;
+		for( size_t i_representations = 0; i_representations < vec_representations.size(); ++i_representations )
+		{
+			const shared_ptr<IfcRepresentation>& representation = vec_representations[i_representations];
+			if( !representation )
+			{
+				continue;
+			}
+
+			try
+			{
+				shared_ptr<ItemShapeData> representation_data( new ItemShapeData() );
+				m_representation_converter->convertIfcRepresentation( representation, representation_data );
+				product_shape->addGeometricItem( representation_data, product_shape );
+			}
+			catch( BuildingException& e )
+			{
+				messageCallback( e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "" );
+			}
+			catch( std::exception& e )
+			{
+				messageCallback( e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "" );
+			}
+		}
+
+		convertIfcProductPlacement( product_shape );
+
+		std::vector<shared_ptr<ProductShapeData> > vec_opening_data;
+		const shared_ptr<IfcElement> ifc_element = dynamic_pointer_cast<IfcElement>(ifc_product);
+		if( ifc_element )
+		{
+			// handle openings
+			m_representation_converter->subtractOpenings(ifc_element, product_shape);
+
+			// handle styles on IfcElement level
+			std::vector<shared_ptr<AppearanceData> > vec_apperances;
 			m_representation_converter->getStylesConverter()->convertElementStyle(ifc_element, vec_apperances);
 			for (auto appearance_data : vec_apperances)
 			{
-				product_shape->addAppearance(appearance_data);
+				product_shape->addAppearance(appearance_data);
+			}
+		}
+
+		// Fetch the IFCProduct relationships
+		if( ifc_product->m_IsDefinedBy_inverse.size() > 0 )
+		{
+			std::vector<weak_ptr<IfcRelDefinesByProperties> >& vec_IsDefinedBy_inverse = ifc_product->m_IsDefinedBy_inverse;
+			for( size_t i = 0; i < vec_IsDefinedBy_inverse.size(); ++i )
+			{
+				shared_ptr<IfcRelDefinesByProperties> rel_def( vec_IsDefinedBy_inverse[i] );
+				shared_ptr<IfcPropertySetDefinitionSelect> relating_property_definition_select = rel_def->m_RelatingPropertyDefinition;
+				if( relating_property_definition_select )
+				{
+					// TYPE IfcPropertySetDefinitionSelect = SELECT	(IfcPropertySetDefinition	,IfcPropertySetDefinitionSet);
+					shared_ptr<IfcPropertySetDefinition> property_set_def = dynamic_pointer_cast<IfcPropertySetDefinition>(relating_property_definition_select);
+					if( property_set_def )
+					{
+						shared_ptr<IfcPropertySet> property_set = dynamic_pointer_cast<IfcPropertySet>(property_set_def);
+						if( property_set )
+						{
+							readAppearanceFromPropertySet( property_set, product_shape );
+						}
+						continue;
+					}
+
+					shared_ptr<IfcPropertySetDefinitionSet> property_set_def_set = dynamic_pointer_cast<IfcPropertySetDefinitionSet>(relating_property_definition_select);
+					if( property_set_def_set )
+					{
+						std::vector<shared_ptr<IfcPropertySetDefinition> >& vec_propterty_set_def = property_set_def_set->m_vec;
+						std::vector<shared_ptr<IfcPropertySetDefinition> >::iterator it_property_set_def;
+						for( it_property_set_def = vec_propterty_set_def.begin(); it_property_set_def != vec_propterty_set_def.end(); ++it_property_set_def )
+						{
+							shared_ptr<IfcPropertySetDefinition> property_set_def2 = (*it_property_set_def);
+							if( property_set_def2 )
+							{
+								shared_ptr<IfcPropertySet> property_set = dynamic_pointer_cast<IfcPropertySet>(property_set_def2);
+								if( property_set )
+								{
+									readAppearanceFromPropertySet( property_set, product_shape );
+								}
+							}
+						}
+						continue;
+					}
+				}
+			}
+		}
+
+		if( m_clear_memory_immedeately )
+		{
+			ifc_product->m_Representation.reset();
+		}
+	}
+
+	//\brief Sets the object placement and the transforms of the product, without converting its representation
+	void convertIfcProductPlacement( shared_ptr<ProductShapeData>& product_shape )
+	{
+		shared_ptr<IfcProduct> ifc_product = dynamic_pointer_cast<IfcProduct>( product_shape->m_ifc_object_definition.lock() );
+		if( !ifc_product )
+		{
+			return;
+		}
+
+		// IfcProduct has an ObjectPlacement that can be local or global
+		product_shape->m_object_placement = ifc_product->m_ObjectPlacement;
+		if( ifc_product->m_ObjectPlacement )
+		{
+			// IfcPlacement2Matrix follows related placements in case of local coordinate systems
+			std::unordered_set<IfcObjectPlacement*> placement_already_applied;
+			m_representation_converter->getPlacementConverter()->convertIfcObjectPlacement( ifc_product->m_ObjectPlacement, product_shape, placement_already_applied, false );
+		}
+	}
+
+	bool hasRelatedOpenings(shared_ptr<ProductShapeData>& product_shape)
+	{
+		if (product_shape->m_ifc_object_definition.expired())
+		{
+			return false;
+		}
+
+		shared_ptr<IfcObjectDefinition> ifc_object_def(product_shape->m_ifc_object_definition);
+		shared_ptr<IfcProduct> ifc_product = dynamic_pointer_cast<IfcProduct>(ifc_object_def);
+		if (!ifc_product)
+		{
+			return false;
+		}
+
+		shared_ptr<IfcElement> ifc_element = dynamic_pointer_cast<IfcElement>(ifc_product);
+		if (!ifc_element)
+		{
+			return false;
+		}
+
+		if (ifc_element->m_HasOpenings_inverse.size() == 0)
+		{
+			return false;
+		}
+
+		// collect aggregated objects
+		const std::vector<weak_ptr<IfcRelAggregates> >& vec_decomposed_by = ifc_object_def->m_IsDecomposedBy_inverse;
+		if (vec_decomposed_by.size() > 0)
+		{
+			return true;
+		}
+
+		const std::vector<weak_ptr<IfcRelAggregates> >& vec_decomposes = ifc_object_def->m_Decomposes_inverse;
+		if (vec_decomposes.size() > 0)
+		{
+			return true;
+		}
+		return false;
+	}
+
+	//\brief Collects the objects that are aggregated into an element with openings, for example IFCBUILDINGELEMENTPART connected to a window through IFCRELAGGREGATES
+	void collectRelatedObjectsForOpenings( const shared_ptr<ProductShapeData>& product_shape, std::vector<std::pair<shared_ptr<IfcElement>, shared_ptr<ProductShapeData> > >& vec_related_shapes )
+	{
+		if( product_shape->m_ifc_object_definition.expired() )
+		{
+			return;
+		}
+
+		shared_ptr<IfcObjectDefinition> ifc_object_def(product_shape->m_ifc_object_definition);
+		shared_ptr<IfcElement> ifc_element = dynamic_pointer_cast<IfcElement>(ifc_object_def);
+		if( !ifc_element )
+		{
+			return;
+		}
+
+		if( ifc_element->m_HasOpenings_inverse.size() == 0 )
+		{
+			return;
+		}
+
+		// collect aggregated objects
+		const std::vector<weak_ptr<IfcRelAggregates> >& vec_decomposed_by = ifc_element->m_IsDecomposedBy_inverse;
+
+		for( auto& decomposed_by : vec_decomposed_by )
+		{
+			if( decomposed_by.expired() )
+			{
+				continue;
+			}
+			shared_ptr<IfcRelAggregates> decomposed_by_aggregates(decomposed_by);
+			std::vector<shared_ptr<IfcObjectDefinition> >& vec_related_objects = decomposed_by_aggregates->m_RelatedObjects;
+			for( auto& related_object : vec_related_objects )
+			{
+				if( !related_object )
+				{
+					continue;
+				}
+
+				if (related_object->m_GlobalId)
+				{
+					std::string guid = related_object->m_GlobalId->m_value;
+
+					auto it_find_related_shape = m_product_shape_data.find(guid);
+					if( it_find_related_shape != m_product_shape_data.end() )
+					{
+						vec_related_shapes.push_back( std::make_pair( ifc_element, it_find_related_shape->second ) );
+					}
+				}
+			}
+		}
+	}
+
+	static void collectItemAppearances( const shared_ptr<ItemShapeData>& item, std::vector<shared_ptr<AppearanceData> >& vec_appearances, std::set<ItemShapeData*>& set_visited )
+	{
+		if( !item || !set_visited.insert( item.get() ).second )
+		{
+			return;
+		}
+
+		for( const shared_ptr<AppearanceData>& appearance : item->m_vec_item_appearances )
+		{
+			if( std::find( vec_appearances.begin(), vec_appearances.end(), appearance ) == vec_appearances.end() )
+			{
+				vec_appearances.push_back( appearance );
+			}
+		}
+
+		for( const shared_ptr<ItemShapeData>& child : item->m_child_items )
+		{
+			collectItemAppearances( child, vec_appearances, set_visited );
+		}
+	}
+
+	//\brief Called when a product exceeded its time budget: the geometry that has been converted so far is kept, or replaced by its bounding box if GeometrySettings::getRenderBoundingBoxes is set
+	void applyExceededBudgetFallback( shared_ptr<ProductShapeData>& product_shape )
+	{
+		shared_ptr<IfcObjectDefinition> ifc_object_def = product_shape->m_ifc_object_definition.lock();
+		if( !m_geom_settings->getRenderBoundingBoxes() )
+		{
+			messageCallback( "Product exceeded time budget, geometry converted without remaining boolean operations", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, ifc_object_def.get() );
+			return;
+		}
+
+		carve::geom::aabb<3> bbox;
+		std::vector<shared_ptr<AppearanceData> > vec_appearances;
+		std::set<ItemShapeData*> set_visited_bbox;
+		std::set<ItemShapeData*> set_visited_appearances;
+		for( const shared_ptr<ItemShapeData>& item : product_shape->m_geometric_items )
+		{
+			carve::geom::aabb<3> item_bbox;
+			item->computeBoundingBox( item_bbox, set_visited_bbox );
+			if( bbox.isEmpty() )
+			{
+				bbox = item_bbox;
+			}
+			else if( !item_bbox.isEmpty() )
+			{
+				bbox.unionAABB( item_bbox );
+			}
+			collectItemAppearances( item, vec_appearances, set_visited_appearances );
+		}
+
+		if( bbox.isEmpty() )
+		{
+			messageCallback( "Product exceeded time budget, no geometry for bounding box", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, ifc_object_def.get() );
+			return;
+		}
+
+		shared_ptr<carve::mesh::MeshSet<3> > bbox_meshset;
+		MeshOps::boundingBox2Mesh( bbox, bbox_meshset, m_geom_settings->getEpsilonMergePoints() );
+
+		shared_ptr<ItemShapeData> bbox_item( new ItemShapeData() );
+		bbox_item->m_meshsets.push_back( bbox_meshset );
+		bbox_item->m_vec_item_appearances = vec_appearances;
+		product_shape->m_geometric_items.clear();
+		product_shape->addGeometricItem( bbox_item, product_shape );
+		messageCallback( "Product exceeded time budget, replaced by bounding box", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, ifc_object_def.get() );
+	}
+
+	void subtractOpeningsInRelatedObjects(shared_ptr<ProductShapeData>& product_shape)
+	{
+		std::vector<std::pair<shared_ptr<IfcElement>, shared_ptr<ProductShapeData> > > vec_related_shapes;
+		collectRelatedObjectsForOpenings( product_shape, vec_related_shapes );
+		for( auto& related : vec_related_shapes )
+		{
+			m_representation_converter->subtractOpenings(related.first, related.second);
+		}
+	}
+
+	//\brief Subtracts openings in related objects of all products. Subtractions that modify the same object run in sequence, different objects in parallel
+	void subtractOpeningsInRelatedObjects()
+	{
+		std::vector<std::vector<std::pair<shared_ptr<IfcElement>, shared_ptr<ProductShapeData> > > > vec_groups;
+		std::unordered_map<ProductShapeData*, size_t> map_group_index;
+		for( auto it = m_product_shape_data.begin(); it != m_product_shape_data.end(); ++it )
+		{
+			if( !it->second )
+			{
+				continue;
+			}
+
+			std::vector<std::pair<shared_ptr<IfcElement>, shared_ptr<ProductShapeData> > > vec_related_shapes;
+			collectRelatedObjectsForOpenings( it->second, vec_related_shapes );
+			for( auto& related : vec_related_shapes )
+			{
+				if( !related.second )
+				{
+					continue;
+				}
+				auto it_group = map_group_index.find( related.second.get() );
+				if( it_group == map_group_index.end() )
+				{
+					it_group = map_group_index.insert( std::make_pair( related.second.get(), vec_groups.size() ) ).first;
+					vec_groups.push_back( std::vector<std::pair<shared_ptr<IfcElement>, shared_ptr<ProductShapeData> > >() );
+				}
+				vec_groups[it_group->second].push_back( related );
 			}
 		}
 
-		// Fetch the IFCProduct relationships
-		if( ifc_product->m_IsDefinedBy_inverse.size() > 0 )
+		const int num_groups = (int)vec_groups.size();
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+		for( int i_group = 0; i_group < num_groups; ++i_group )
 		{
-			std::vector<weak_ptr<IfcRelDefinesByProperties> >& vec_IsDefinedBy_inverse = ifc_product->m_IsDefinedBy_inverse;
-			for( size_t i = 0; i < vec_IsDefinedBy_inverse.size(); ++i )
+			for( auto& related : vec_groups[i_group] )
 			{
-				shared_ptr<IfcRelDefinesByProperties> rel_def( vec_IsDefinedBy_inverse[i] );
-				shared_ptr<IfcPropertySetDefinitionSelect> relating_property_definition_select = rel_def->m_RelatingPropertyDefinition;
-				if( relating_property_definition_select )
+				try
 				{
-					// TYPE IfcPropertySetDefinitionSelect = SELECT	(IfcPropertySetDefinition	,IfcPropertySetDefinitionSet);
-					shared_ptr<IfcPropertySetDefinition> property_set_def = dynamic_pointer_cast<IfcPropertySetDefinition>(relating_property_definition_select);
-					if( property_set_def )
-					{
-						shared_ptr<IfcPropertySet> property_set = dynamic_pointer_cast<IfcPropertySet>(property_set_def);
-						if( property_set )
-						{
-							readAppearanceFromPropertySet( property_set, product_shape );
-						}
-						continue;
-					}
+					ConversionBudget product_budget;
+					product_budget.limit( m_geom_settings->getMaxTimePerProduct() );
+					ScopedConversionBudget scoped_budget( product_budget );
 
-					shared_ptr<IfcPropertySetDefinitionSet> property_set_def_set = dynamic_pointer_cast<IfcPropertySetDefinitionSet>(relating_property_definition_select);
-					if( property_set_def_set )
+					m_representation_converter->subtractOpenings(related.first, related.second);
+					if( ConversionBudget::current().exceeded() )
 					{
-						std::vector<shared_ptr<IfcPropertySetDefinition> >& vec_propterty_set_def = property_set_def_set->m_vec;
-						std::vector<shared_ptr<IfcPropertySetDefinition> >::iterator it_property_set_def;
-						for( it_property_set_def = vec_propterty_set_def.begin(); it_property_set_def != vec_propterty_set_def.end(); ++it_property_set_def )
-						{
-							shared_ptr<IfcPropertySetDefinition> property_set_def2 = (*it_property_set_def);
-							if( property_set_def2 )
-							{
-								shared_ptr<IfcPropertySet> property_set = dynamic_pointer_cast<IfcPropertySet>(property_set_def2);
-								if( property_set )
-								{
-									readAppearanceFromPropertySet( property_set, product_shape );
-								}
-							}
-						}
-						continue;
+						applyExceededBudgetFallback( related.second );
 					}
 				}
+				catch( BuildingException& e )
+				{
+					messageCallback(e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "");
+				}
+				catch( carve::exception& e )
+				{
+					messageCallback(e.str(), StatusCallback::MESSAGE_TYPE_ERROR, "");
+				}
+				catch( std::exception& e )
+				{
+					messageCallback(e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "");
+				}
+				catch( ... )
+				{
+					messageCallback("undefined error", StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__);
+				}
 			}
 		}
+	}
 
-		// check for existing meshes
-		// TODO: make sure that the meshes are not changed after here, for example with boolean operations
-		bool enableCaching = false;
-		if( enableCaching )
+	//\brief Restricts the object definitions to m_conversion_request, see GeometryConversionRequest::selectObjectDefinitions
+	void selectRequestedObjects( std::vector<shared_ptr<IfcObjectDefinition> >& vec_object_definitions, std::unordered_set<IfcObjectDefinition*>& set_structure_only )
+	{
+		set_structure_only.clear();
+		if( !m_conversion_request || m_conversion_request->isEmpty() )
 		{
-			bool equalItemFound = false;
+			return;
+		}
+
+		const size_t num_object_definitions = vec_object_definitions.size();
+		const double length_in_meter = m_representation_converter->getUnitConverter()->getLengthInMeterFactor();
+		m_conversion_request->selectObjectDefinitions( vec_object_definitions, m_representation_converter->getPlacementConverter(), length_in_meter, set_structure_only );
+
+		std::stringstream strs;
+		strs << "Conversion request: " << vec_object_definitions.size() - set_structure_only.size() << " of " << num_object_definitions << " objects selected, "
+			<< set_structure_only.size() << " objects of the spatial structure added without representation";
+		messageCallback( strs.str(), StatusCallback::MESSAGE_TYPE_GENERAL_MESSAGE, "" );
+	}
+
+	//\brief Returns true if the product is an opening that belongs to an element. Such openings are selected together with the element
+	static bool isOpeningOfElement( const shared_ptr<ProductShapeData>& product_shape )
+	{
+		shared_ptr<IfcFeatureElementSubtraction> opening = dynamic_pointer_cast<IfcFeatureElementSubtraction>( product_shape->m_ifc_object_definition.lock() );
+		return opening && !opening->m_VoidsElements_inverse.expired();
+	}
 
-			for( auto it : m_product_shape_data )
+	//\brief Bounding box of the geometric items of the product in world coordinates, without children
+	static carve::geom::aabb<3> computeWorldBoundingBox( const shared_ptr<ProductShapeData>& product_shape )
+	{
+		carve::geom::aabb<3> bbox;
+		std::set<ItemShapeData*> set_visited;
+		for( const shared_ptr<ItemShapeData>& item : product_shape->m_geometric_items )
+		{
+			carve::geom::aabb<3> item_bbox;
+			item->computeBoundingBox( item_bbox, set_visited );
+			if( bbox.isEmpty() )
 			{
-				const shared_ptr<ProductShapeData>& existingProductShape = it.second;
-				if( !existingProductShape )
-				{
-					continue;
-				}
-				for( auto item : existingProductShape->m_geometric_items)
-				{
-					for( auto childItem : item->m_child_items )
-					{
-						//bool itemIsEqual = isEqual(item, geom_item_data);
-						//if( itemIsEqual )
-						{
-							//representation_data->m_vec_item_data.push_back(existingItem);
-							equalItemFound = true;
-						}
-					}
-				}
+				bbox = item_bbox;
 			}
-			if( !equalItemFound )
+			else if( !item_bbox.isEmpty() )
 			{
-				//				representation_data->m_vec_item_data.push_back(geom_item_data);
-				//#ifdef _OPENMP
-				//				ScopedLock lock( m_writelock_item_cache );
-				//#endif
-				//				m_map_item_data_cache.push_back(geom_item_data);
+				bbox.unionAABB( item_bbox );
 			}
 		}
+		if( bbox.isEmpty() )
+		{
+			return bbox;
+		}
 
-		if( m_clear_memory_immedeately )
+		const carve::math::Matrix transform = product_shape->getTransform();
+		const vec3 bbox_min = bbox.min();
+		const vec3 bbox_max = bbox.max();
+		std::vector<vec3> vec_corners;
+		for( int ii = 0; ii < 8; ++ii )
 		{
-			ifc_product->m_Representation.reset();
+			vec3 corner = carve::geom::VECTOR( ( ii & 1 ) ? bbox_max.x : bbox_min.x, ( ii & 2 ) ? bbox_max.y : bbox_min.y, ( ii & 4 ) ? bbox_max.z : bbox_min.z );
+			vec_corners.push_back( transform * corner );
 		}
+		carve::geom::aabb<3> world_bbox;
+		world_bbox.fit( vec_corners.begin(), vec_corners.end() );
+		return world_bbox;
 	}
 
-	bool hasRelatedOpenings(shared_ptr<ProductShapeData>& product_shape)
+	/*\brief Removes the converted products that are outside the bounding region of m_conversion_request, since the selection before the conversion uses estimated bounding boxes.
+	  Products with children in the spatial structure are kept without geometry. Openings are removed together with their element.
+	  Removed products are also removed from m_map_outside_spatial_structure
+	**/
+	void removeProductsOutsideBoundingRegion( const std::unordered_set<IfcObjectDefinition*>& set_structure_only )
 	{
-		if (product_shape->m_ifc_object_definition.expired())
+		if( !m_conversion_request || !m_conversion_request->hasBoundingRegion() )
 		{
-			return false;
+			return;
 		}
 
-		shared_ptr<IfcObjectDefinition> ifc_object_def(product_shape->m_ifc_object_definition);
-		shared_ptr<IfcProduct> ifc_product = dynamic_pointer_cast<IfcProduct>(ifc_object_def);
-		if (!ifc_product)
+		for( auto it = m_product_shape_data.begin(); it != m_product_shape_data.end(); )
 		{
-			return false;
+			shared_ptr<ProductShapeData> product_shape = it->second;
+			shared_ptr<IfcObjectDefinition> object_def = product_shape ? product_shape->m_ifc_object_definition.lock() : shared_ptr<IfcObjectDefinition>();
+			if( !object_def || set_structure_only.find( object_def.get() ) != set_structure_only.end() || isOpeningOfElement( product_shape ) )
+			{
+				++it;
+				continue;
+			}
+
+			if( m_conversion_request->intersectsBoundingRegion( computeWorldBoundingBox( product_shape ) ) )
+			{
+				++it;
+				continue;
+			}
+
+			if( product_shape->m_vec_children.size() > 0 )
+			{
+				product_shape->m_geometric_items.clear();
+				product_shape->m_vec_representations.clear();
+				++it;
+				continue;
+			}
+
+			shared_ptr<ProductShapeData> parent = product_shape->m_parent.lock();
+			if( parent )
+			{
+				std::vector<shared_ptr<ProductShapeData> >& vec_siblings = parent->m_vec_children;
+				vec_siblings.erase( std::remove( vec_siblings.begin(), vec_siblings.end(), product_shape ), vec_siblings.end() );
+			}
+			m_map_outside_spatial_structure.erase( it->first );
+			it = m_product_shape_data.erase( it );
 		}
 
-		shared_ptr<IfcElement> ifc_element = dynamic_pointer_cast<IfcElement>(ifc_product);
-		if (!ifc_element)
+		for( auto it = m_product_shape_data.begin(); it != m_product_shape_data.end(); )
 		{
-			return false;
+			shared_ptr<IfcFeatureElementSubtraction> opening = it->second ? dynamic_pointer_cast<IfcFeatureElementSubtraction>( it->second->m_ifc_object_definition.lock() ) : shared_ptr<IfcFeatureElementSubtraction>();
+			shared_ptr<IfcRelVoidsElement> rel_voids = opening ? opening->m_VoidsElements_inverse.lock() : shared_ptr<IfcRelVoidsElement>();
+			if( rel_voids && rel_voids->m_RelatingBuildingElement && rel_voids->m_RelatingBuildingElement->m_GlobalId )
+			{
+				if( m_product_shape_data.find( rel_voids->m_RelatingBuildingElement->m_GlobalId->m_value ) == m_product_shape_data.end() )
+				{
+					m_map_outside_spatial_structure.erase( it->first );
+					it = m_product_shape_data.erase( it );
+					continue;
+				}
+			}
+			++it;
 		}
+	}
 
-		if (ifc_element->m_HasOpenings_inverse.size() == 0)
+	//\brief Orders the object definitions depth first along the spatial structure (IfcRelAggregates, IfcRelContainedInSpatialStructure, ports), starting at IfcProject,
+	// so that the products of one storey are converted together. Opening elements follow their element, after its aggregated parts.
+	// Objects that are not reached from IfcProject are appended with their own sub-structure, and listed in getObjectsOutsideSpatialStructure
+	void sortBySpatialStructure( std::vector<shared_ptr<IfcObjectDefinition> >& vec_object_definitions )
+	{
+		std::vector<shared_ptr<IfcObjectDefinition> > vec_sorted;
+		vec_sorted.reserve( vec_object_definitions.size() );
+		std::unordered_set<IfcObjectDefinition*> set_visited;
+		std::vector<std::pair<shared_ptr<IfcObjectDefinition>, bool> > vec_stack;
+		std::vector<std::pair<shared_ptr<IfcObjectDefinition>, bool> > vec_children;
+
+		auto addStructure = [&]( const shared_ptr<IfcObjectDefinition>& root, bool root_in_spatial_structure )
 		{
-			return false;
+			vec_stack.push_back( { root, root_in_spatial_structure } );
+			while( !vec_stack.empty() )
+			{
+				shared_ptr<IfcObjectDefinition> object_def = vec_stack.back().first;
+				const bool in_spatial_structure = vec_stack.back().second;
+				vec_stack.pop_back();
+				if( !set_visited.insert( object_def.get() ).second )
+				{
+					continue;
+				}
+				vec_sorted.push_back( object_def );
+
+				if( !in_spatial_structure && !m_geom_settings->skipRenderObject( object_def->classID() ) )
+				{
+					if( object_def->m_GlobalId && object_def->m_GlobalId->m_value.size() > 18 )
+					{
+						m_map_outside_spatial_structure[object_def->m_GlobalId->m_value] = object_def;
+					}
+				}
+
+				vec_children.clear();
+				for( const weak_ptr<IfcRelAggregates>& rel_aggregates_weak : object_def->m_IsDecomposedBy_inverse )
+				{
+					shared_ptr<IfcRelAggregates> rel_aggregates = rel_aggregates_weak.lock();
+					if( rel_aggregates )
+					{
+						for( const shared_ptr<IfcObjectDefinition>& related_object : rel_aggregates->m_RelatedObjects )
+						{
+							vec_children.push_back( { related_object, in_spatial_structure } );
+						}
+					}
+				}
+
+				shared_ptr<IfcSpatialStructureElement> spatial_ele = dynamic_pointer_cast<IfcSpatialStructureElement>( object_def );
+				if( spatial_ele )
+				{
+					for( const weak_ptr<IfcRelContainedInSpatialStructure>& rel_contained_weak : spatial_ele->m_ContainsElements_inverse )
+					{
+						shared_ptr<IfcRelContainedInSpatialStructure> rel_contained = rel_contained_weak.lock();
+						if( rel_contained )
+						{
+							for( const shared_ptr<IfcProduct>& related_product : rel_contained->m_RelatedElements )
+							{
+								vec_children.push_back( { related_product, in_spatial_structure } );
+							}
+						}
+					}
+				}
+
+				shared_ptr<IfcDistributionElement> distribution_element = dynamic_pointer_cast<IfcDistributionElement>( object_def );
+				if( distribution_element )
+				{
+					for( const weak_ptr<IfcRelConnectsPortToElement>& rel_connects_weak : distribution_element->m_HasPorts_inverse )
+					{
+						shared_ptr<IfcRelConnectsPortToElement> rel_connects = rel_connects_weak.lock();
+						if( rel_connects )
+						{
+							vec_children.push_back( { rel_connects->m_RelatingPort, in_spatial_structure } );
+						}
+					}
+				}
+
+				// the element needs the representation of its openings until it is converted
+				shared_ptr<IfcElement> ifc_element = dynamic_pointer_cast<IfcElement>( object_def );
+				if( ifc_element )
+				{
+					for( const weak_ptr<IfcRelVoidsElement>& rel_voids_weak : ifc_element->m_HasOpenings_inverse )
+					{
+						shared_ptr<IfcRelVoidsElement> rel_voids = rel_voids_weak.lock();
+						if( rel_voids )
+						{
+							vec_children.push_back( { rel_voids->m_RelatedOpeningElement, false } );
+						}
+					}
+				}
+
+				// reversed, so that the children are converted in the order of the relationships
+				for( auto it = vec_children.rbegin(); it != vec_children.rend(); ++it )
+				{
+					if( it->first )
+					{
+						vec_stack.push_back( *it );
+					}
+				}
+			}
+		};
+
+		for( const shared_ptr<IfcObjectDefinition>& object_def : vec_object_definitions )
+		{
+			if( object_def->classID() == IFC4X3::IFCPROJECT )
+			{
+				addStructure( object_def, true );
+			}
 		}
 
-		// collect aggregated objects
-		const std::vector<weak_ptr<IfcRelAggregates> >& vec_decomposed_by = ifc_object_def->m_IsDecomposedBy_inverse;
-		if (vec_decomposed_by.size() > 0)
+		for( const shared_ptr<IfcObjectDefinition>& object_def : vec_object_definitions )
 		{
-			return true;
+			if( set_visited.find( object_def.get() ) != set_visited.end() )
+			{
+				continue;
+			}
+
+			// openings are added after their element
+			shared_ptr<IfcFeatureElementSubtraction> opening = dynamic_pointer_cast<IfcFeatureElementSubtraction>( object_def );
+			if( opening && !opening->m_VoidsElements_inverse.expired() )
+			{
+				continue;
+			}
+			addStructure( object_def, false );
 		}
 
-		const std::vector<weak_ptr<IfcRelAggregates> >& vec_decomposes = ifc_object_def->m_Decomposes_inverse;
-		if (vec_decomposes.size() > 0)
+		for( const shared_ptr<IfcObjectDefinition>& object_def : vec_object_definitions )
 		{
-			return true;
+			if( set_visited.find( object_def.get() ) == set_visited.end() )
+			{
+				addStructure( object_def, false );
+			}
 		}
-		return false;
+
+		vec_object_definitions.swap( vec_sorted );
 	}
 
-	void subtractOpeningsInRelatedObjects(shared_ptr<ProductShapeData>& product_shape)
+	//\brief If the product is aggregated into an element with openings, for example an IFCBUILDINGELEMENTPART into a window, the openings of that element are subtracted from the product
+	void subtractOpeningsOfAggregatingElement( shared_ptr<ProductShapeData>& product_shape )
 	{
-		if( product_shape->m_ifc_object_definition.expired() )
+		shared_ptr<IfcObjectDefinition> ifc_object_def = product_shape->m_ifc_object_definition.lock();
+		if( !ifc_object_def )
 		{
 			return;
 		}
 
-		shared_ptr<IfcObjectDefinition> ifc_object_def(product_shape->m_ifc_object_definition);
-		shared_ptr<IfcElement> ifc_element = dynamic_pointer_cast<IfcElement>(ifc_object_def);
-		if( !ifc_element )
+		for( const weak_ptr<IfcRelAggregates>& rel_aggregates_weak : ifc_object_def->m_Decomposes_inverse )
 		{
-			return;
+			shared_ptr<IfcRelAggregates> rel_aggregates = rel_aggregates_weak.lock();
+			if( !rel_aggregates )
+			{
+				continue;
+			}
+
+			shared_ptr<IfcElement> aggregating_element = dynamic_pointer_cast<IfcElement>( rel_aggregates->m_RelatingObject );
+			if( aggregating_element && aggregating_element->m_HasOpenings_inverse.size() > 0 )
+			{
+				m_representation_converter->subtractOpenings( aggregating_element, product_shape );
+			}
 		}
+	}
 
-		if( ifc_element->m_HasOpenings_inverse.size() == 0 )
+	/*\brief Removes the IfcProductRepresentation of the product from the model, together with all entities of it that are not referenced elsewhere.
+	  Entities that are shared with other products, like IfcRepresentationMap, contexts and placements, are kept.
+	  Inverse attributes of the remaining entities may still contain expired references to removed entities. Returns the number of removed entities
+	**/
+	size_t releaseRepresentationEntities( const shared_ptr<IfcObjectDefinition>& object_def )
+	{
+		shared_ptr<IfcProduct> ifc_product = dynamic_pointer_cast<IfcProduct>( object_def );
+		if( !ifc_product || !ifc_product->m_Representation )
 		{
-			return;
+			return 0;
 		}
 
-		// collect aggregated objects
-		const std::vector<weak_ptr<IfcRelAggregates> >& vec_decomposed_by = ifc_element->m_IsDecomposedBy_inverse;
-
-		for( auto& decomposed_by : vec_decomposed_by )
+		std::vector<shared_ptr<BuildingEntity> > vec_release;
+		std::vector<shared_ptr<BuildingEntity> > vec_kept;
+		std::unordered_set<BuildingEntity*> set_queued;
+		std::function<void( const shared_ptr<BuildingObject>& )> queueObject = [&]( const shared_ptr<BuildingObject>& obj )
 		{
-			if( decomposed_by.expired() )
+			shared_ptr<BuildingEntity> entity = dynamic_pointer_cast<BuildingEntity>( obj );
+			if( entity )
 			{
-				continue;
+				if( set_queued.insert( entity.get() ).second )
+				{
+					vec_release.push_back( entity );
+				}
+				return;
 			}
-			shared_ptr<IfcRelAggregates> decomposed_by_aggregates(decomposed_by);
-			std::vector<shared_ptr<IfcObjectDefinition> >& vec_related_objects = decomposed_by_aggregates->m_RelatedObjects;
-			for( auto& related_object : vec_related_objects )
+
+			shared_ptr<AttributeObjectVector> attribute_vector = dynamic_pointer_cast<AttributeObjectVector>( obj );
+			if( attribute_vector )
 			{
-				if( !related_object )
+				for( const shared_ptr<BuildingObject>& element : attribute_vector->m_vec )
 				{
-					continue;
+					queueObject( element );
 				}
+			}
+		};
 
-				std::string guid;
-				if (related_object->m_GlobalId)
-				{
-					guid = related_object->m_GlobalId->m_value;
+		queueObject( ifc_product->m_Representation );
+		ifc_product->m_Representation.reset();
 
-					auto it_find_related_shape = m_product_shape_data.find(guid);
-					if( it_find_related_shape != m_product_shape_data.end() )
+		std::map<int, shared_ptr<BuildingEntity> >& map_entities = m_ifc_model->getMapIfcEntities();
+		size_t num_released = 0;
+		while( !vec_release.empty() )
+		{
+			const size_t num_released_before = num_released;
+			while( !vec_release.empty() )
+			{
+				shared_ptr<BuildingEntity> entity = vec_release.back();
+				vec_release.pop_back();
+
+				auto it_model = map_entities.find( entity->m_tag );
+				const bool in_model = it_model != map_entities.end() && it_model->second == entity;
+				const long num_owners = in_model ? 2 : 1;
+				if( entity.use_count() > num_owners )
+				{
+					// IfcStyledItem only references the item, so it is released together with it
+					IfcRepresentationItem* representation_item = dynamic_cast<IfcRepresentationItem*>( entity.get() );
+					if( representation_item )
 					{
-						shared_ptr<ProductShapeData>& related_product_shape = it_find_related_shape->second;
-						m_representation_converter->subtractOpenings(ifc_element, related_product_shape);
+						long num_styled_by = 0;
+						for( const weak_ptr<IfcStyledItem>& styled_item_weak : representation_item->m_StyledByItem_inverse )
+						{
+							num_styled_by += styled_item_weak.expired() ? 0 : 1;
+						}
+
+						if( num_styled_by > 0 && entity.use_count() <= num_owners + num_styled_by )
+						{
+							for( const weak_ptr<IfcStyledItem>& styled_item_weak : representation_item->m_StyledByItem_inverse )
+							{
+								queueObject( styled_item_weak.lock() );
+							}
+						}
 					}
+
+					// still referenced, maybe by an entity that is released later on
+					vec_kept.push_back( entity );
+					continue;
+				}
+
+				std::vector<std::pair<std::string, shared_ptr<BuildingObject> > > vec_attributes;
+				entity->getAttributes( vec_attributes );
+				for( auto& attribute : vec_attributes )
+				{
+					queueObject( attribute.second );
+				}
+
+				if( in_model )
+				{
+					map_entities.erase( it_model );
 				}
+				++num_released;
+			}
+
+			if( num_released == num_released_before )
+			{
+				break;
 			}
+			vec_release.swap( vec_kept );
 		}
+		return num_released;
 	}
 
 	virtual void messageTarget( void* ptr, shared_ptr<StatusCallback::Message> m )
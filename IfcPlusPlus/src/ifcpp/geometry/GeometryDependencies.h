@@ -0,0 +1,361 @@
+/* -*-c++-*- IfcQuery www.ifcquery.com
+*
+MIT License
+
+Copyright (c) 2017 Fabian Gerold
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <ifcpp/model/AttributeObject.h>
+#include <ifcpp/model/BasicTypes.h>
+#include <ifcpp/model/BuildingObject.h>
+#include <ifcpp/IFC4X3/include/IfcElement.h>
+#include <ifcpp/IFC4X3/include/IfcFeatureElementSubtraction.h>
+#include <ifcpp/IFC4X3/include/IfcLocalPlacement.h>
+#include <ifcpp/IFC4X3/include/IfcProduct.h>
+#include <ifcpp/IFC4X3/include/IfcProductRepresentation.h>
+#include <ifcpp/IFC4X3/include/IfcRelAggregates.h>
+#include <ifcpp/IFC4X3/include/IfcRelAssociates.h>
+#include <ifcpp/IFC4X3/include/IfcRelAssociatesMaterial.h>
+#include <ifcpp/IFC4X3/include/IfcRelVoidsElement.h>
+#include <ifcpp/IFC4X3/include/IfcRepresentationContext.h>
+#include <ifcpp/IFC4X3/include/IfcRepresentationItem.h>
+#include <ifcpp/IFC4X3/include/IfcRepresentationMap.h>
+#include <ifcpp/IFC4X3/include/IfcStyledItem.h>
+#include "GeometryInputData.h"
+
+/**\brief Index from entity ids to the products whose geometry has been created from these entities.
+  Shape dependencies are the entities of the product representation (including styles), openings, materials, and the placements of openings relative to the product.
+  If one of them changes, the product needs to be converted again. Placement dependencies are the entities of the object placement, including all placements it is relative to.
+  If only those change, it is sufficient to update the transforms of the product. */
+class GeometryDependencies
+{
+protected:
+	std::unordered_map<int, std::vector<ProductShapeData*> >	m_map_shape_dependents;
+	std::unordered_map<int, std::vector<ProductShapeData*> >	m_map_placement_dependents;
+
+public:
+	void clear()
+	{
+		m_map_shape_dependents.clear();
+		m_map_placement_dependents.clear();
+	}
+
+	bool isEmpty() const { return m_map_shape_dependents.empty() && m_map_placement_dependents.empty(); }
+
+	//\brief Adds the product with its current ProductShapeData::m_shape_dependencies and m_placement_dependencies to the index. Not thread safe
+	void addProduct( ProductShapeData* product_shape, bool placement_only = false )
+	{
+		if( !placement_only )
+		{
+			for( int entity_id : product_shape->m_shape_dependencies )
+			{
+				m_map_shape_dependents[entity_id].push_back( product_shape );
+			}
+		}
+		for( int entity_id : product_shape->m_placement_dependencies )
+		{
+			m_map_placement_dependents[entity_id].push_back( product_shape );
+		}
+	}
+
+	void removeProducts( const std::vector<ProductShapeData*>& vec_products, bool placement_only = false )
+	{
+		// entities like the placement of a building storey have many dependent products, so each list is filtered once
+		std::unordered_set<ProductShapeData*> set_products( vec_products.begin(), vec_products.end() );
+		std::unordered_set<int> set_shape_ids;
+		std::unordered_set<int> set_placement_ids;
+		for( ProductShapeData* product_shape : vec_products )
+		{
+			set_shape_ids.insert( product_shape->m_shape_dependencies.begin(), product_shape->m_shape_dependencies.end() );
+			set_placement_ids.insert( product_shape->m_placement_dependencies.begin(), product_shape->m_placement_dependencies.end() );
+		}
+		if( !placement_only )
+		{
+			removeFromIndex( m_map_shape_dependents, set_shape_ids, set_products );
+		}
+		removeFromIndex( m_map_placement_dependents, set_placement_ids, set_products );
+	}
+
+	void findShapeDependents( int entity_id, std::unordered_set<ProductShapeData*>& set_products ) const
+	{
+		auto it_find = m_map_shape_dependents.find( entity_id );
+		if( it_find != m_map_shape_dependents.end() )
+		{
+			set_products.insert( it_find->second.begin(), it_find->second.end() );
+		}
+	}
+
+	void findPlacementDependents( int entity_id, std::unordered_set<ProductShapeData*>& set_products ) const
+	{
+		auto it_find = m_map_placement_dependents.find( entity_id );
+		if( it_find != m_map_placement_dependents.end() )
+		{
+			set_products.insert( it_find->second.begin(), it_find->second.end() );
+		}
+	}
+
+	//\brief Entity ids of shared sub-graphs (contexts, representation maps, placements), so that they are traversed once per thread and not once per product
+	typedef std::unordered_map<const BuildingEntity*, std::vector<int> > SubgraphCache;
+
+	//\brief Collects the ids of the entities that the geometry of the product depends on into ProductShapeData::m_shape_dependencies and m_placement_dependencies
+	static void collectProductDependencies( ProductShapeData* product_shape, SubgraphCache& cache )
+	{
+		product_shape->m_shape_dependencies.clear();
+		product_shape->m_placement_dependencies.clear();
+
+		shared_ptr<IFC4X3::IfcObjectDefinition> object_def = product_shape->m_ifc_object_definition.lock();
+		if( !object_def )
+		{
+			return;
+		}
+
+		std::vector<int>& shape_ids = product_shape->m_shape_dependencies;
+		shape_ids.push_back( object_def->m_tag );
+
+		shared_ptr<IFC4X3::IfcProduct> ifc_product = dynamic_pointer_cast<IFC4X3::IfcProduct>( object_def );
+		if( !ifc_product )
+		{
+			return;
+		}
+
+		collectEntityIds( ifc_product->m_Representation, shape_ids, cache );
+
+		shared_ptr<IFC4X3::IfcElement> ifc_element = dynamic_pointer_cast<IFC4X3::IfcElement>( ifc_product );
+		if( ifc_element )
+		{
+			collectOpeningDependencies( ifc_element, ifc_product->m_ObjectPlacement, shape_ids, cache );
+
+			// openings of the element that this element is part of, see GeometryConverter::subtractOpeningsInRelatedObjects
+			for( const weak_ptr<IFC4X3::IfcRelAggregates>& rel_aggregates_weak : ifc_element->m_Decomposes_inverse )
+			{
+				shared_ptr<IFC4X3::IfcRelAggregates> rel_aggregates = rel_aggregates_weak.lock();
+				if( rel_aggregates )
+				{
+					shape_ids.push_back( rel_aggregates->m_tag );
+					shared_ptr<IFC4X3::IfcElement> aggregating_element = dynamic_pointer_cast<IFC4X3::IfcElement>( rel_aggregates->m_RelatingObject );
+					if( aggregating_element )
+					{
+						shape_ids.push_back( aggregating_element->m_tag );
+						collectOpeningDependencies( aggregating_element, ifc_product->m_ObjectPlacement, shape_ids, cache );
+					}
+				}
+			}
+
+			// materials, see StylesConverter::convertElementStyle
+			for( const weak_ptr<IFC4X3::IfcRelAssociates>& rel_associates_weak : ifc_element->m_HasAssociations_inverse )
+			{
+				shared_ptr<IFC4X3::IfcRelAssociatesMaterial> rel_material = dynamic_pointer_cast<IFC4X3::IfcRelAssociatesMaterial>( rel_associates_weak.lock() );
+				if( rel_material )
+				{
+					shape_ids.push_back( rel_material->m_tag );
+					collectEntityIds( rel_material->m_RelatingMaterial, shape_ids, cache );
+				}
+			}
+		}
+
+		std::sort( shape_ids.begin(), shape_ids.end() );
+		shape_ids.erase( std::unique( shape_ids.begin(), shape_ids.end() ), shape_ids.end() );
+
+		collectPlacementDependencies( product_shape, cache );
+	}
+
+	//\brief Collects only ProductShapeData::m_placement_dependencies, for products whose shape has not changed
+	static void collectPlacementDependencies( ProductShapeData* product_shape, SubgraphCache& cache )
+	{
+		std::vector<int>& placement_ids = product_shape->m_placement_dependencies;
+		placement_ids.clear();
+		shared_ptr<IFC4X3::IfcProduct> ifc_product = dynamic_pointer_cast<IFC4X3::IfcProduct>( product_shape->m_ifc_object_definition.lock() );
+		if( !ifc_product )
+		{
+			return;
+		}
+
+		collectPlacementIds( ifc_product->m_ObjectPlacement, nullptr, placement_ids, cache );
+		std::sort( placement_ids.begin(), placement_ids.end() );
+		placement_ids.erase( std::unique( placement_ids.begin(), placement_ids.end() ), placement_ids.end() );
+	}
+
+	//\brief Collects the ids of all entities that are directly or indirectly referenced by obj, and the styles of representation items. Ids may be added more than once
+	static void collectEntityIds( const shared_ptr<BuildingObject>& obj, std::vector<int>& entity_ids, SubgraphCache& cache )
+	{
+		std::unordered_set<const BuildingEntity*> visited;
+		std::vector<shared_ptr<BuildingObject> > stack;
+		stack.push_back( obj );
+		std::vector<std::pair<std::string, shared_ptr<BuildingObject> > > vec_attributes;
+
+		while( !stack.empty() )
+		{
+			shared_ptr<BuildingObject> current = stack.back();
+			stack.pop_back();
+			if( !current )
+			{
+				continue;
+			}
+
+			shared_ptr<AttributeObjectVector> attribute_vector = dynamic_pointer_cast<AttributeObjectVector>( current );
+			if( attribute_vector )
+			{
+				std::copy( attribute_vector->m_vec.begin(), attribute_vector->m_vec.end(), std::back_inserter( stack ) );
+				continue;
+			}
+
+			shared_ptr<BuildingEntity> entity = dynamic_pointer_cast<BuildingEntity>( current );
+			if( !entity || !visited.insert( entity.get() ).second )
+			{
+				continue;
+			}
+
+			if( entity.get() != obj.get() && isSharedSubgraph( entity ) )
+			{
+				auto it_cache = cache.find( entity.get() );
+				if( it_cache == cache.end() )
+				{
+					std::vector<int> subgraph_ids;
+					collectEntityIds( entity, subgraph_ids, cache );
+					it_cache = cache.insert( { entity.get(), subgraph_ids } ).first;
+				}
+				std::copy( it_cache->second.begin(), it_cache->second.end(), std::back_inserter( entity_ids ) );
+				continue;
+			}
+			entity_ids.push_back( entity->m_tag );
+
+			// styles refer to the item, so they are not among its attributes
+			shared_ptr<IFC4X3::IfcRepresentationItem> representation_item = dynamic_pointer_cast<IFC4X3::IfcRepresentationItem>( entity );
+			if( representation_item )
+			{
+				for( const weak_ptr<IFC4X3::IfcStyledItem>& styled_item_weak : representation_item->m_StyledByItem_inverse )
+				{
+					shared_ptr<IFC4X3::IfcStyledItem> styled_item = styled_item_weak.lock();
+					if( styled_item )
+					{
+						stack.push_back( styled_item );
+					}
+				}
+			}
+
+			vec_attributes.clear();
+			entity->getAttributes( vec_attributes );
+			for( auto& attribute : vec_attributes )
+			{
+				if( attribute.second )
+				{
+					stack.push_back( attribute.second );
+				}
+			}
+		}
+	}
+
+protected:
+	static bool isSharedSubgraph( const shared_ptr<BuildingEntity>& entity )
+	{
+		return dynamic_cast<IFC4X3::IfcRepresentationContext*>( entity.get() ) || dynamic_cast<IFC4X3::IfcRepresentationMap*>( entity.get() ) || dynamic_cast<IFC4X3::IfcProductRepresentation*>( entity.get() );
+	}
+
+	//\brief Ids of the placement and the placements it is relative to, up to (excluding) stop_placement
+	static void collectPlacementIds( shared_ptr<IFC4X3::IfcObjectPlacement> placement, const IFC4X3::IfcObjectPlacement* stop_placement, std::vector<int>& entity_ids, SubgraphCache& cache )
+	{
+		std::unordered_set<const IFC4X3::IfcObjectPlacement*> set_visited;
+		while( placement && placement.get() != stop_placement && set_visited.insert( placement.get() ).second )
+		{
+			shared_ptr<IFC4X3::IfcLocalPlacement> local_placement = dynamic_pointer_cast<IFC4X3::IfcLocalPlacement>( placement );
+			if( !local_placement )
+			{
+				collectEntityIds( placement, entity_ids, cache );
+				return;
+			}
+
+			// the relative placement of each placement in the chain is cached, since many products share the placements of the spatial structure
+			auto it_cache = cache.find( local_placement.get() );
+			if( it_cache == cache.end() )
+			{
+				std::vector<int> placement_ids;
+				placement_ids.push_back( local_placement->m_tag );
+				collectEntityIds( local_placement->m_RelativePlacement, placement_ids, cache );
+				it_cache = cache.insert( { local_placement.get(), placement_ids } ).first;
+			}
+			std::copy( it_cache->second.begin(), it_cache->second.end(), std::back_inserter( entity_ids ) );
+			placement = local_placement->m_PlacementRelTo;
+		}
+	}
+
+	/** Openings are subtracted relative to the placement of the product. Placements that the product and the opening have in common (for example of the building storey)
+	  do not change the shape, so only the placements below the common one are shape dependencies */
+	static void collectOpeningDependencies( const shared_ptr<IFC4X3::IfcElement>& ifc_element, const shared_ptr<IFC4X3::IfcObjectPlacement>& product_placement, std::vector<int>& shape_ids, SubgraphCache& cache )
+	{
+		std::unordered_set<const IFC4X3::IfcObjectPlacement*> set_product_placements;
+		for( shared_ptr<IFC4X3::IfcObjectPlacement> placement = product_placement; placement && set_product_placements.insert( placement.get() ).second; )
+		{
+			shared_ptr<IFC4X3::IfcLocalPlacement> local_placement = dynamic_pointer_cast<IFC4X3::IfcLocalPlacement>( placement );
+			placement = local_placement ? local_placement->m_PlacementRelTo : shared_ptr<IFC4X3::IfcObjectPlacement>();
+		}
+
+		for( const weak_ptr<IFC4X3::IfcRelVoidsElement>& rel_voids_weak : ifc_element->m_HasOpenings_inverse )
+		{
+			shared_ptr<IFC4X3::IfcRelVoidsElement> rel_voids = rel_voids_weak.lock();
+			if( !rel_voids )
+			{
+				continue;
+			}
+			shape_ids.push_back( rel_voids->m_tag );
+
+			shared_ptr<IFC4X3::IfcFeatureElementSubtraction> opening = rel_voids->m_RelatedOpeningElement;
+			if( !opening )
+			{
+				continue;
+			}
+			shape_ids.push_back( opening->m_tag );
+			collectEntityIds( opening->m_Representation, shape_ids, cache );
+
+			// first placement of the opening that the product placement is also relative to
+			const IFC4X3::IfcObjectPlacement* common_placement = nullptr;
+			std::unordered_set<const IFC4X3::IfcObjectPlacement*> set_opening_placements;
+			for( shared_ptr<IFC4X3::IfcObjectPlacement> placement = opening->m_ObjectPlacement; placement && set_opening_placements.insert( placement.get() ).second; )
+			{
+				if( set_product_placements.find( placement.get() ) != set_product_placements.end() )
+				{
+					common_placement = placement.get();
+					break;
+				}
+				shared_ptr<IFC4X3::IfcLocalPlacement> local_placement = dynamic_pointer_cast<IFC4X3::IfcLocalPlacement>( placement );
+				placement = local_placement ? local_placement->m_PlacementRelTo : shared_ptr<IFC4X3::IfcObjectPlacement>();
+			}
+
+			collectPlacementIds( product_placement, common_placement, shape_ids, cache );
+			collectPlacementIds( opening->m_ObjectPlacement, common_placement, shape_ids, cache );
+		}
+	}
+
+	static void removeFromIndex( std::unordered_map<int, std::vector<ProductShapeData*> >& map_dependents, const std::unordered_set<int>& entity_ids, const std::unordered_set<ProductShapeData*>& set_products )
+	{
+		for( int entity_id : entity_ids )
+		{
+			auto it_find = map_dependents.find( entity_id );
+			if( it_find == map_dependents.end() )
+			{
+				continue;
+			}
+			std::vector<ProductShapeData*>& vec_products = it_find->second;
+			vec_products.erase( std::remove_if( vec_products.begin(), vec_products.end(), [&]( ProductShapeData* product_shape ) { return set_products.count( product_shape ) > 0; } ), vec_products.end() );
+			if( vec_products.empty() )
+			{
+				map_dependents.erase( it_find );
+			}
+		}
+	}
+};
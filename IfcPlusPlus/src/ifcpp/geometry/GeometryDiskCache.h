@@ -0,0 +1,434 @@
+/* -*-c++-*- IfcQuery www.ifcquery.com
+*
+MIT License
+
+Copyright (c) 2017 Fabian Gerold
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <ifcpp/model/BasicTypes.h>
+#include <ifcpp/model/OpenMPIncludes.h>
+#include <ifcpp/model/StatusCallback.h>
+#include <ifcpp/model/UnitConverter.h>
+#include "IncludeCarveHeaders.h"
+#include "GeometryInputData.h"
+#include "GeometrySettings.h"
+#include "ItemShapeCache.h"
+
+/**\brief Persistent cache for converted representation items.
+  Meshsets of an item are stored in a file in the cache directory. The file name is the content key of the item (see ItemShapeCache::computeContentKey),
+  combined with a key of the units and all settings that influence the geometry, so that the cached meshes are valid for every model that contains an item with the same content.
+  Unlike ItemShapeCache, entries are identified by the 128 bit hash alone, the item content is not compared.
+  Files are written in native byte order. Files with a different byte order, version or unexpected size are ignored and removed. */
+class GeometryDiskCache : public StatusCallback
+{
+protected:
+	struct FileHeader
+	{
+		char		m_magic[4] = { 'I', 'G', 'C', '1' };
+		uint32_t	m_version = 1;
+		uint32_t	m_byte_order = 0x01020304;
+		uint32_t	m_num_meshsets = 0;
+	};
+
+	struct MeshSetHeader
+	{
+		uint32_t	m_closed = 1;
+		uint32_t	m_num_vertices = 0;
+		uint32_t	m_num_faces = 0;
+		uint32_t	m_num_face_indices = 0;
+	};
+
+	std::filesystem::path		m_directory;
+	size_t						m_max_size_bytes = 0;
+	ItemContentKey				m_settings_key;
+	std::atomic<size_t>			m_num_loaded{ 0 };
+	std::atomic<size_t>			m_num_missed{ 0 };
+	std::atomic<size_t>			m_num_stored{ 0 };
+	std::atomic<size_t>			m_num_temp_files{ 0 };
+
+public:
+	GeometryDiskCache()
+	{
+	}
+
+	virtual ~GeometryDiskCache()
+	{
+	}
+
+	//\brief Empty directory disables the cache
+	void setCacheDirectory( const std::string& directory, size_t max_size_bytes )
+	{
+		m_directory = directory;
+		m_max_size_bytes = max_size_bytes;
+	}
+
+	bool isEnabled() const { return !m_directory.empty(); }
+	size_t getNumLoadedItems() const { return m_num_loaded; }
+	size_t getNumMissedItems() const { return m_num_missed; }
+	size_t getNumStoredItems() const { return m_num_stored; }
+	void resetStatistics()
+	{
+		m_num_loaded = 0;
+		m_num_missed = 0;
+		m_num_stored = 0;
+	}
+
+	//\brief Settings and units that influence the converted geometry. Must be called before items are loaded or stored
+	void setSettingsKey( shared_ptr<GeometrySettings>& geom_settings, const shared_ptr<UnitConverter>& unit_converter )
+	{
+		const double length_in_meter = unit_converter->getLengthInMeterFactor();
+		ItemContentKey key;
+		key.addValue( FileHeader().m_version );
+		key.addValue( length_in_meter );
+		key.addValue( unit_converter->getCustomLengthFactor() );
+
+		// plane angles are converted with the angle factor. Without a unit definition, it is guessed from the values
+		key.addValue( (int)unit_converter->getAngularUnit() );
+		if( unit_converter->getAngularUnit() != UnitConverter::UNDEFINED )
+		{
+			key.addValue( unit_converter->getAngleInRadiantFactor() );
+		}
+		key.addValue( geom_settings->getNumVerticesPerCircle() );
+		key.addValue( geom_settings->getMinNumVerticesPerArc() );
+		key.addValue( geom_settings->getNumVerticesPerControlPoint() );
+		key.addValue( geom_settings->getMaxChordalDeviation() );
+		key.addValue( geom_settings->getMaxSegmentAngle() );
+		key.addValue( geom_settings->isIgnoreProfileRadius() );
+		key.addValue( geom_settings->batchCsgOperands() );
+		key.addValue( geom_settings->getCsgMaxNumVertices() );
+		key.addValue( geom_settings->getEpsilonMergePoints() );
+		key.addValue( geom_settings->getEpsilonCoplanarDistance() );
+		key.addValue( geom_settings->getEpsilonCoplanarAngle() );
+		key.addValue( geom_settings->getMinTriangleArea() );
+
+		// the number of vertices per circle can be a user defined function of the radius
+		for( double radius : { 0.001, 0.01, 0.1, 0.5, 1.0, 10.0, 100.0 } )
+		{
+			key.addValue( geom_settings->getNumVerticesPerCircleWithRadius( radius / length_in_meter ) );
+		}
+		m_settings_key = key;
+	}
+
+	std::filesystem::path getFilePath( const ItemContentKey& item_key ) const
+	{
+		ItemContentKey key = m_settings_key;
+		key.addKey( item_key );
+
+		std::stringstream strs;
+		strs << std::hex << std::setfill( '0' ) << std::setw( 16 ) << key.m_hash1 << std::setw( 16 ) << key.m_hash2;
+		const std::string name = strs.str();
+		return m_directory / name.substr( 0, 2 ) / ( name + ".igc" );
+	}
+
+	/** If the item has been stored before, its meshsets are added to item_data, and true is returned. */
+	bool loadItemShape( const ItemContentKey& item_key, shared_ptr<ItemShapeData>& item_data, double eps )
+	{
+		if( !isEnabled() )
+		{
+			return false;
+		}
+
+		const std::filesystem::path path = getFilePath( item_key );
+		std::ifstream infile( path, std::ios::binary );
+		if( !infile.is_open() )
+		{
+			++m_num_missed;
+			return false;
+		}
+
+		std::vector<shared_ptr<carve::mesh::MeshSet<3> > > vec_meshsets;
+		std::vector<shared_ptr<carve::mesh::MeshSet<3> > > vec_meshsets_open;
+		bool valid = readMeshSets( infile, vec_meshsets, vec_meshsets_open, eps );
+		infile.close();
+
+		std::error_code ec;
+		if( !valid )
+		{
+			std::filesystem::remove( path, ec );
+			++m_num_missed;
+			return false;
+		}
+
+		// the modification time is used for eviction of least recently used files
+		std::filesystem::last_write_time( path, std::filesystem::file_time_type::clock::now(), ec );
+
+		std::copy( vec_meshsets.begin(), vec_meshsets.end(), std::back_inserter( item_data->m_meshsets ) );
+		std::copy( vec_meshsets_open.begin(), vec_meshsets_open.end(), std::back_inserter( item_data->m_meshsets_open ) );
+		++m_num_loaded;
+		return true;
+	}
+
+	/** Stores the meshsets of item_data. Items with other geometry (points, curves, text, triangle meshes) are not stored, because they could not be restored completely. Returns true if the item was stored */
+	bool storeItemShape( const ItemContentKey& item_key, const shared_ptr<ItemShapeData>& item_data )
+	{
+		if( !isEnabled() )
+		{
+			return false;
+		}
+
+		if( item_data->m_vertex_points.size() > 0 || item_data->m_polylines.size() > 0 || item_data->m_triangle_meshes.size() > 0 || item_data->m_vec_text_literals.size() > 0 || item_data->m_child_items.size() > 0 )
+		{
+			return false;
+		}
+		if( item_data->m_meshsets.size() + item_data->m_meshsets_open.size() == 0 )
+		{
+			return false;
+		}
+
+		const std::filesystem::path path = getFilePath( item_key );
+		std::error_code ec;
+		std::filesystem::create_directories( path.parent_path(), ec );
+
+		// write to a temporary file first, so that concurrent conversions never read incomplete files
+		std::stringstream strs_temp;
+		strs_temp << path.string() << "." << std::hash<std::thread::id>()( std::this_thread::get_id() ) << "." << m_num_temp_files++ << ".tmp";
+		const std::filesystem::path path_temp = strs_temp.str();
+		{
+			std::ofstream outfile( path_temp, std::ios::binary | std::ios::trunc );
+			if( !outfile.is_open() )
+			{
+				return false;
+			}
+
+			if( !writeMeshSets( outfile, item_data->m_meshsets, item_data->m_meshsets_open ) )
+			{
+				outfile.close();
+				std::filesystem::remove( path_temp, ec );
+				return false;
+			}
+		}
+
+		std::filesystem::rename( path_temp, path, ec );
+		if( ec )
+		{
+			std::filesystem::remove( path_temp, ec );
+			return false;
+		}
+		++m_num_stored;
+		return true;
+	}
+
+	/** Removes least recently used files until the size of the cache directory is below the maximum size. Returns the number of removed files */
+	size_t evictEntries()
+	{
+		if( !isEnabled() )
+		{
+			return 0;
+		}
+
+		struct CacheFile
+		{
+			std::filesystem::path				m_path;
+			std::filesystem::file_time_type	m_time;
+			uintmax_t							m_size;
+		};
+		std::vector<CacheFile> vec_files;
+		uintmax_t total_size = 0;
+
+		std::error_code ec;
+		for( std::filesystem::recursive_directory_iterator it( m_directory, ec ), it_end; !ec && it != it_end; it.increment( ec ) )
+		{
+			if( !it->is_regular_file( ec ) || it->path().extension() != ".igc" )
+			{
+				continue;
+			}
+			CacheFile cache_file{ it->path(), it->last_write_time( ec ), it->file_size( ec ) };
+			if( ec )
+			{
+				ec.clear();
+				continue;
+			}
+			total_size += cache_file.m_size;
+			vec_files.push_back( cache_file );
+		}
+
+		if( total_size <= m_max_size_bytes )
+		{
+			return 0;
+		}
+
+		std::sort( vec_files.begin(), vec_files.end(), []( const CacheFile& a, const CacheFile& b ) { return a.m_time < b.m_time; } );
+		size_t num_removed = 0;
+		for( const CacheFile& cache_file : vec_files )
+		{
+			if( total_size <= m_max_size_bytes )
+			{
+				break;
+			}
+			if( std::filesystem::remove( cache_file.m_path, ec ) )
+			{
+				total_size -= cache_file.m_size;
+				++num_removed;
+			}
+		}
+		return num_removed;
+	}
+
+protected:
+	static bool writeMeshSets( std::ofstream& outfile, const std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& vec_meshsets, const std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& vec_meshsets_open )
+	{
+		FileHeader file_header;
+		file_header.m_num_meshsets = (uint32_t)( vec_meshsets.size() + vec_meshsets_open.size() );
+		outfile.write( (const char*)&file_header, sizeof( FileHeader ) );
+
+		for( size_t ii = 0; ii < vec_meshsets.size() + vec_meshsets_open.size(); ++ii )
+		{
+			const bool closed = ii < vec_meshsets.size();
+			const shared_ptr<carve::mesh::MeshSet<3> >& meshset = closed ? vec_meshsets[ii] : vec_meshsets_open[ii - vec_meshsets.size()];
+			if( !meshset )
+			{
+				return false;
+			}
+
+			std::vector<double> vec_coords;
+			vec_coords.reserve( meshset->vertex_storage.size() * 3 );
+			for( const carve::mesh::Vertex<3>& vertex : meshset->vertex_storage )
+			{
+				vec_coords.push_back( vertex.v.x );
+				vec_coords.push_back( vertex.v.y );
+				vec_coords.push_back( vertex.v.z );
+			}
+
+			std::vector<uint32_t> vec_face_sizes;
+			std::vector<uint32_t> vec_face_indices;
+			const carve::mesh::Vertex<3>* first_vertex = meshset->vertex_storage.data();
+			for( const carve::mesh::Mesh<3>* mesh : meshset->meshes )
+			{
+				for( const carve::mesh::Face<3>* face : mesh->faces )
+				{
+					const carve::mesh::Edge<3>* edge = face->edge;
+					for( size_t jj = 0; jj < face->n_edges; ++jj )
+					{
+						const size_t vertex_index = edge->vert - first_vertex;
+						if( vertex_index >= meshset->vertex_storage.size() )
+						{
+							return false;
+						}
+						vec_face_indices.push_back( (uint32_t)vertex_index );
+						edge = edge->next;
+					}
+					vec_face_sizes.push_back( (uint32_t)face->n_edges );
+				}
+			}
+
+			MeshSetHeader meshset_header;
+			meshset_header.m_closed = closed ? 1 : 0;
+			meshset_header.m_num_vertices = (uint32_t)meshset->vertex_storage.size();
+			meshset_header.m_num_faces = (uint32_t)vec_face_sizes.size();
+			meshset_header.m_num_face_indices = (uint32_t)vec_face_indices.size();
+			outfile.write( (const char*)&meshset_header, sizeof( MeshSetHeader ) );
+			outfile.write( (const char*)vec_coords.data(), vec_coords.size() * sizeof( double ) );
+			outfile.write( (const char*)vec_face_sizes.data(), vec_face_sizes.size() * sizeof( uint32_t ) );
+			outfile.write( (const char*)vec_face_indices.data(), vec_face_indices.size() * sizeof( uint32_t ) );
+		}
+		return outfile.good();
+	}
+
+	static bool readMeshSets( std::ifstream& infile, std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& vec_meshsets, std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& vec_meshsets_open, double eps )
+	{
+		infile.seekg( 0, std::ios::end );
+		const size_t file_size = (size_t)infile.tellg();
+		infile.seekg( 0, std::ios::beg );
+
+		FileHeader expected_header;
+		FileHeader file_header;
+		if( file_size < sizeof( FileHeader ) || !infile.read( (char*)&file_header, sizeof( FileHeader ) ) )
+		{
+			return false;
+		}
+		if( std::memcmp( file_header.m_magic, expected_header.m_magic, 4 ) != 0 || file_header.m_version != expected_header.m_version || file_header.m_byte_order != expected_header.m_byte_order )
+		{
+			return false;
+		}
+
+		size_t remaining_size = file_size - sizeof( FileHeader );
+		for( uint32_t ii = 0; ii < file_header.m_num_meshsets; ++ii )
+		{
+			MeshSetHeader meshset_header;
+			if( remaining_size < sizeof( MeshSetHeader ) || !infile.read( (char*)&meshset_header, sizeof( MeshSetHeader ) ) )
+			{
+				return false;
+			}
+			remaining_size -= sizeof( MeshSetHeader );
+
+			const size_t data_size = size_t( meshset_header.m_num_vertices ) * 3 * sizeof( double ) + ( size_t( meshset_header.m_num_faces ) + meshset_header.m_num_face_indices ) * sizeof( uint32_t );
+			if( data_size > remaining_size )
+			{
+				return false;
+			}
+			remaining_size -= data_size;
+
+			std::vector<double> vec_coords( size_t( meshset_header.m_num_vertices ) * 3 );
+			std::vector<uint32_t> vec_face_sizes( meshset_header.m_num_faces );
+			std::vector<uint32_t> vec_face_indices( meshset_header.m_num_face_indices );
+			infile.read( (char*)vec_coords.data(), vec_coords.size() * sizeof( double ) );
+			infile.read( (char*)vec_face_sizes.data(), vec_face_sizes.size() * sizeof( uint32_t ) );
+			infile.read( (char*)vec_face_indices.data(), vec_face_indices.size() * sizeof( uint32_t ) );
+			if( !infile )
+			{
+				return false;
+			}
+
+			carve::input::PolyhedronData poly_data;
+			for( size_t jj = 0; jj + 2 < vec_coords.size(); jj += 3 )
+			{
+				poly_data.addVertex( carve::geom::VECTOR( vec_coords[jj], vec_coords[jj + 1], vec_coords[jj + 2] ) );
+			}
+
+			size_t face_begin = 0;
+			for( uint32_t face_size : vec_face_sizes )
+			{
+				if( face_size < 3 || face_begin + face_size > vec_face_indices.size() )
+				{
+					return false;
+				}
+				for( size_t jj = face_begin; jj < face_begin + face_size; ++jj )
+				{
+					if( vec_face_indices[jj] >= meshset_header.m_num_vertices )
+					{
+						return false;
+					}
+				}
+				poly_data.addFace( vec_face_indices.begin() + face_begin, vec_face_indices.begin() + face_begin + face_size );
+				face_begin += face_size;
+			}
+
+			if( poly_data.getVertexCount() == 0 || face_begin == 0 )
+			{
+				continue;
+			}
+
+			shared_ptr<carve::mesh::MeshSet<3> > meshset( poly_data.createMesh( carve::input::opts(), eps ) );
+			if( meshset_header.m_closed )
+			{
+				vec_meshsets.push_back( meshset );
+			}
+			else
+			{
+				vec_meshsets_open.push_back( meshset );
+			}
+		}
+		return true;
+	}
+};
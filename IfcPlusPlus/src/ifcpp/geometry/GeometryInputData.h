@@ -28,6 +28,7 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OU
 #include <ifcpp/IFC4X3/include/IfcTextStyle.h>
 #include "IncludeCarveHeaders.h"
 #include "GeomUtils.h"
+#include "TriangleMeshData.h"
 
 struct MeshSetInfo
 {
@@ -704,6 +705,8 @@ public:
 	std::vector<shared_ptr<carve::input::PolylineSetData> > m_polylines;
 	std::vector<shared_ptr<carve::mesh::MeshSet<3> > >		m_meshsets;
 	std::vector<shared_ptr<carve::mesh::MeshSet<3> > >		m_meshsets_open;
+	std::vector<shared_ptr<TriangleMeshData> >				m_triangle_meshes;		// triangles of m_meshsets and m_meshsets_open, see GeometryConverter::createTriangleMeshes
+	std::vector<shared_ptr<TriangleMeshLevelOfDetail> >		m_triangle_mesh_lods;	// coarser versions of m_triangle_meshes, from fine to coarse, see GeometryConverter::createLevelsOfDetail
 	std::vector<shared_ptr<AppearanceData> >				m_vec_item_appearances;
 	std::vector<shared_ptr<TextItemData> >					m_vec_text_literals;
 	weak_ptr<RepresentationData>							m_parent_representation;  // Pointer to representation object that this item belongs to
@@ -723,6 +726,7 @@ public:
 		if( m_polylines.size() > 0 )				{ return false; }
 		if( m_meshsets.size() > 0 )					{ return false; }
 		if( m_meshsets_open.size() > 0 )			{ return false; }
+		if( m_triangle_meshes.size() > 0 )			{ return false; }
 		if( m_vec_item_appearances.size() > 0 )		{ return false; }
 		if( m_vec_text_literals.size() > 0 )		{ return false; }
 
@@ -805,6 +809,76 @@ public:
 		applyTransformToItem( transform->m_matrix, true );
 	}
 
+	/** replaces geometry that is referenced also by other items with a copy */
+	void detachSharedGeometry()
+	{
+		for( auto& vertex_data : m_vertex_points )
+		{
+			if( vertex_data.use_count() > 1 )
+			{
+				vertex_data = shared_ptr<carve::input::VertexData>( new carve::input::VertexData( *( vertex_data.get() ) ) );
+			}
+		}
+
+		for( auto& polyline_data : m_polylines )
+		{
+			if( polyline_data.use_count() > 1 )
+			{
+				polyline_data = shared_ptr<carve::input::PolylineSetData>( new carve::input::PolylineSetData( *( polyline_data.get() ) ) );
+			}
+		}
+
+		for( auto& item_meshset : m_meshsets_open )
+		{
+			if( item_meshset.use_count() > 1 )
+			{
+				item_meshset = shared_ptr<carve::mesh::MeshSet<3> >( item_meshset->clone() );
+			}
+		}
+
+		for( auto& item_meshset : m_meshsets )
+		{
+			if( item_meshset.use_count() > 1 )
+			{
+				item_meshset = shared_ptr<carve::mesh::MeshSet<3> >( item_meshset->clone() );
+			}
+		}
+
+		for( auto& triangle_mesh : m_triangle_meshes )
+		{
+			if( triangle_mesh.use_count() > 1 )
+			{
+				triangle_mesh = shared_ptr<TriangleMeshData>( new TriangleMeshData( *( triangle_mesh.get() ) ) );
+			}
+		}
+
+		for( auto& lod : m_triangle_mesh_lods )
+		{
+			if( lod.use_count() > 1 )
+			{
+				lod = shared_ptr<TriangleMeshLevelOfDetail>( new TriangleMeshLevelOfDetail( *( lod.get() ) ) );
+			}
+			for( auto& triangle_mesh : lod->m_triangle_meshes )
+			{
+				if( triangle_mesh.use_count() > 1 )
+				{
+					triangle_mesh = shared_ptr<TriangleMeshData>( new TriangleMeshData( *( triangle_mesh.get() ) ) );
+				}
+			}
+		}
+
+		for( auto& text_data : m_vec_text_literals )
+		{
+			if( text_data.use_count() > 1 )
+			{
+				shared_ptr<TextItemData> text_data_copy( new TextItemData() );
+				text_data_copy->m_text = text_data->m_text.c_str();
+				text_data_copy->m_text_position = text_data->m_text_position;
+				text_data = text_data_copy;
+			}
+		}
+	}
+
 	void applyTransformToItem( const carve::math::Matrix& mat, double CARVE_EPSILON, bool matrix_identity_checked = false )
 	{
 		if( !matrix_identity_checked )
@@ -815,6 +889,9 @@ public:
 			}
 		}
 
+		// geometry can be shared with other items (see ItemShapeCache), so copy it before modifying
+		detachSharedGeometry();
+
 		for( size_t ii = 0; ii < m_vertex_points.size(); ++ii )
 		{
 			shared_ptr<carve::input::VertexData>& vertex_data = m_vertex_points[ii];
@@ -891,6 +968,19 @@ public:
 			}
 		}
 
+		for( size_t i_triangle_mesh = 0; i_triangle_mesh < m_triangle_meshes.size(); ++i_triangle_mesh )
+		{
+			m_triangle_meshes[i_triangle_mesh]->applyTransform( mat );
+		}
+
+		for( const shared_ptr<TriangleMeshLevelOfDetail>& lod : m_triangle_mesh_lods )
+		{
+			for( const shared_ptr<TriangleMeshData>& triangle_mesh : lod->m_triangle_meshes )
+			{
+				triangle_mesh->applyTransform( mat );
+			}
+		}
+
 		for( size_t text_i = 0; text_i < m_vec_text_literals.size(); ++text_i )
 		{
 			shared_ptr<TextItemData>& text_literals = m_vec_text_literals[text_i];
@@ -931,6 +1021,22 @@ public:
 			copy_item->m_meshsets.push_back( shared_ptr<carve::mesh::MeshSet<3> >( item_meshset->clone() ) );
 		}
 
+		for( const shared_ptr<TriangleMeshData>& triangle_mesh : m_triangle_meshes )
+		{
+			copy_item->m_triangle_meshes.push_back( shared_ptr<TriangleMeshData>( new TriangleMeshData( *( triangle_mesh.get() ) ) ) );
+		}
+
+		for( const shared_ptr<TriangleMeshLevelOfDetail>& lod : m_triangle_mesh_lods )
+		{
+			shared_ptr<TriangleMeshLevelOfDetail> lod_copy( new TriangleMeshLevelOfDetail() );
+			lod_copy->m_geometric_error = lod->m_geometric_error;
+			for( const shared_ptr<TriangleMeshData>& triangle_mesh : lod->m_triangle_meshes )
+			{
+				lod_copy->m_triangle_meshes.push_back( shared_ptr<TriangleMeshData>( new TriangleMeshData( *( triangle_mesh.get() ) ) ) );
+			}
+			copy_item->m_triangle_mesh_lods.push_back( lod_copy );
+		}
+
 		for( size_t ii = 0; ii < m_vec_text_literals.size(); ++ii )
 		{
 			shared_ptr<TextItemData>& text_data = m_vec_text_literals[ii];
@@ -953,10 +1059,60 @@ public:
 		std::copy( other->m_polylines.begin(), other->m_polylines.end(), std::back_inserter( m_polylines ) );
 		std::copy( other->m_meshsets.begin(), other->m_meshsets.end(), std::back_inserter( m_meshsets ) );
 		std::copy( other->m_meshsets_open.begin(), other->m_meshsets_open.end(), std::back_inserter( m_meshsets_open ) );
+		if( m_triangle_meshes.size() == 0 )
+		{
+			m_triangle_mesh_lods = other->m_triangle_mesh_lods;
+		}
+		else if( other->m_triangle_meshes.size() > 0 )
+		{
+			if( m_triangle_mesh_lods.size() == other->m_triangle_mesh_lods.size() )
+			{
+				for( size_t ii = 0; ii < m_triangle_mesh_lods.size(); ++ii )
+				{
+					// copy, the levels may be shared with other items
+					const shared_ptr<TriangleMeshLevelOfDetail>& other_lod = other->m_triangle_mesh_lods[ii];
+					shared_ptr<TriangleMeshLevelOfDetail> lod( new TriangleMeshLevelOfDetail( *( m_triangle_mesh_lods[ii].get() ) ) );
+					std::copy( other_lod->m_triangle_meshes.begin(), other_lod->m_triangle_meshes.end(), std::back_inserter( lod->m_triangle_meshes ) );
+					lod->m_geometric_error = std::max( lod->m_geometric_error, other_lod->m_geometric_error );
+					m_triangle_mesh_lods[ii] = lod;
+				}
+			}
+			else
+			{
+				// the levels would not correspond to m_triangle_meshes anymore
+				m_triangle_mesh_lods.clear();
+			}
+		}
+		std::copy( other->m_triangle_meshes.begin(), other->m_triangle_meshes.end(), std::back_inserter( m_triangle_meshes ) );
 		std::copy( other->m_vec_item_appearances.begin(), other->m_vec_item_appearances.end(), std::back_inserter( m_vec_item_appearances ) );
 		std::copy( other->m_vec_text_literals.begin(), other->m_vec_text_literals.end(), std::back_inserter( m_vec_text_literals ) );
 	}
 
+	/** Creates carve meshsets from triangle meshes that have been created without them (see GeometrySettings::createSweptDiskTriangleMeshes), for boolean operations.
+	The triangle meshes are removed, they are created again from the meshsets after the conversion */
+	void createMeshSetsFromTriangleMeshes( double CARVE_EPSILON )
+	{
+		if( m_triangle_meshes.size() == 0 || m_meshsets.size() > 0 || m_meshsets_open.size() > 0 )
+		{
+			return;
+		}
+
+		for( const shared_ptr<TriangleMeshData>& triangle_mesh : m_triangle_meshes )
+		{
+			shared_ptr<carve::mesh::MeshSet<3> > meshset( triangle_mesh->createMeshSet( CARVE_EPSILON ) );
+			if( triangle_mesh->m_closed && meshset->isClosed() )
+			{
+				m_meshsets.push_back( meshset );
+			}
+			else
+			{
+				m_meshsets_open.push_back( meshset );
+			}
+		}
+		m_triangle_meshes.clear();
+		m_triangle_mesh_lods.clear();
+	}
+
 	const std::vector<shared_ptr<carve::input::VertexData> >& getVertexPoints() { return m_vertex_points; }
 
 	void computeBoundingBox( carve::geom::aabb<3>& bbox, std::set<ItemShapeData*>& setVisited ) const
@@ -1037,6 +1193,11 @@ public:
 			}
 		}
 
+		for( size_t i_triangle_mesh = 0; i_triangle_mesh < m_triangle_meshes.size(); ++i_triangle_mesh )
+		{
+			m_triangle_meshes[i_triangle_mesh]->computeBoundingBox( bbox );
+		}
+
 		for( size_t text_i = 0; text_i < m_vec_text_literals.size(); ++text_i )
 		{
 			const shared_ptr<TextItemData>& text_literals = m_vec_text_literals[text_i];
@@ -1080,6 +1241,7 @@ public:
 	{
 		if (m_meshsets.size() > 0) return true;
 		if (m_meshsets_open.size() > 0) return true;
+		if (m_triangle_meshes.size() > 0) return true;
 		if (m_vec_text_literals.size() > 0) return true;
 		if (m_vertex_points.size() > 0) return true;
 		if (m_polylines.size() > 0) return true;
@@ -1101,6 +1263,8 @@ public:
 	{
 		m_meshsets.clear();
 		m_meshsets_open.clear();
+		m_triangle_meshes.clear();
+		m_triangle_mesh_lods.clear();
 		m_vec_text_literals.clear();
 		m_vec_item_appearances.clear();
 		m_vertex_points.clear();
@@ -1170,11 +1334,9 @@ public:
 		{
 			return;
 		}
-		int append_id = appearance->m_step_style_id;
 		for (size_t ii = 0; ii < m_vec_representation_appearances.size(); ++ii)
 		{
-			shared_ptr<AppearanceData>& appearance = m_vec_representation_appearances[ii];
-			if (appearance->m_step_style_id == append_id)
+			if (AppearanceData::isSameAppearance(*m_vec_representation_appearances[ii], *appearance))
 			{
 				return;
 			}
@@ -1237,6 +1399,8 @@ public:
 
 	std::vector<shared_ptr<ItemShapeData> >			m_geometric_items;
 	weak_ptr<IFC4X3::IfcRepresentation>				m_ifc_representation;
+	std::vector<int>								m_shape_dependencies;		// ids of the entities that the geometry is created from, see GeometryDependencies
+	std::vector<int>								m_placement_dependencies;	// ids of the entities of the object placement
 
 	ProductShapeData() {}
 	ProductShapeData( std::string entity_guid ) : m_entity_guid(entity_guid) { }
@@ -1288,11 +1452,9 @@ public:
 		{
 			return;
 		}
-		int append_id = appearance->m_step_style_id;
 		for( size_t ii = 0; ii < m_vec_product_appearances.size(); ++ii )
 		{
-			shared_ptr<AppearanceData>& appearance = m_vec_product_appearances[ii];
-			if( appearance->m_step_style_id == append_id )
+			if( AppearanceData::isSameAppearance( *m_vec_product_appearances[ii], *appearance ) )
 			{
 				return;
 			}
@@ -18,9 +18,11 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OU
 #pragma once
 
 #define _USE_MATH_DEFINES 
+#include <algorithm>
 #include <cmath>
 #include <functional>
 #include <set>
+#include <string>
 #include <ifcpp/model/BasicTypes.h>
 #include <ifcpp/model/BuildingObject.h>
 
@@ -54,10 +56,28 @@ public:
 		m_min_num_vertices_per_arc = other->m_min_num_vertices_per_arc;
 		m_num_vertices_per_control_point = other->m_num_vertices_per_control_point;
 		m_num_vertices_per_control_point_default = other->m_num_vertices_per_control_point_default;
+		m_max_chordal_deviation = other->m_max_chordal_deviation;
+		m_max_segment_angle = other->m_max_segment_angle;
 		m_show_text_literals = other->m_show_text_literals;
 		m_ignore_profile_radius = other->m_ignore_profile_radius;
 		m_handle_styled_items = other->m_handle_styled_items;
 		m_handle_layer_assignments = other->m_handle_layer_assignments;
+		m_cache_item_shapes = other->m_cache_item_shapes;
+		m_batch_csg_operands = other->m_batch_csg_operands;
+		m_use_prismatic_openings = other->m_use_prismatic_openings;
+		m_csg_max_num_vertices = other->m_csg_max_num_vertices;
+		m_max_time_per_product = other->m_max_time_per_product;
+		m_max_time_per_csg_operation = other->m_max_time_per_csg_operation;
+		m_create_triangle_meshes = other->m_create_triangle_meshes;
+		m_triangle_meshes_single_precision = other->m_triangle_meshes_single_precision;
+		m_release_carve_meshes = other->m_release_carve_meshes;
+		m_create_swept_disk_triangle_meshes = other->m_create_swept_disk_triangle_meshes;
+		m_num_levels_of_detail = other->m_num_levels_of_detail;
+		m_level_of_detail_triangle_ratio = other->m_level_of_detail_triangle_ratio;
+		m_streaming_batch_size = other->m_streaming_batch_size;
+		m_geometry_cache_directory = other->m_geometry_cache_directory;
+		m_geometry_cache_max_size = other->m_geometry_cache_max_size;
+		m_track_geometry_dependencies = other->m_track_geometry_dependencies;
 		m_render_bounding_box = other->m_render_bounding_box;
 		m_min_triangle_area = other->m_min_triangle_area;
 		m_epsilonMergePoints = other->m_epsilonMergePoints;
@@ -65,7 +85,14 @@ public:
 	}
 
 	// Number of discretization points per circle
-	int getNumVerticesPerCircleWithRadius(double radius) { return m_num_vertices_per_circle_given_radius(radius); }
+	int getNumVerticesPerCircleWithRadius(double radius)
+	{
+		if( isAdaptiveTessellation() )
+		{
+			return getNumSegmentsAdaptive(radius, 2.0*M_PI);
+		}
+		return m_num_vertices_per_circle_given_radius(radius);
+	}
 	int getNumVerticesPerCircle() { return m_num_vertices_per_circle; }
 	void setNumVerticesPerCircle(int num) { m_num_vertices_per_circle = num; }
 	void resetNumVerticesPerCircle() { m_num_vertices_per_circle = m_num_vertices_per_circle_default; }
@@ -79,6 +106,29 @@ public:
 	int getNumVerticesPerControlPoint() { return m_num_vertices_per_control_point; }
 	void setNumVerticesPerControlPoint(int num) { m_num_vertices_per_control_point = num; }
 	void resetNumVerticesPerControlPoint() { m_num_vertices_per_control_point = m_num_vertices_per_control_point_default; }
+	/**\brief Adaptive tessellation: maximum distance in meters between a curved edge and its approximating segments. If > 0, the number of segments of circles, arcs,
+	swept disks, revolutions and B-splines is derived from the radius (or the curvature) and this tolerance, instead of the fixed vertex counts above. 0 disables adaptive tessellation */
+	void setMaxChordalDeviation(double deviation) { m_max_chordal_deviation = deviation; }
+	double getMaxChordalDeviation() { return m_max_chordal_deviation; }
+	/**\brief Adaptive tessellation: maximum angle in radians between two consecutive segments, so that small curved objects keep their shape */
+	void setMaxSegmentAngle(double angle) { m_max_segment_angle = angle; }
+	double getMaxSegmentAngle() { return m_max_segment_angle; }
+	bool isAdaptiveTessellation() { return m_max_chordal_deviation > 0; }
+	/**\brief Number of segments to approximate an arc within the chordal deviation and segment angle. At least 6 segments per full circle, at most 1000 */
+	int getNumSegmentsAdaptive(double radius, double openingAngle)
+	{
+		const double angle = std::min(std::abs(openingAngle), 2.0*M_PI);
+		double max_angle_per_segment = std::max(m_max_segment_angle, 1e-3);
+		if( radius > m_max_chordal_deviation )
+		{
+			// deviation of a chord with angle a: radius*(1 - cos(a/2))
+			max_angle_per_segment = std::min(max_angle_per_segment, 2.0*std::acos(1.0 - m_max_chordal_deviation/radius));
+		}
+		max_angle_per_segment = std::min(max_angle_per_segment, M_PI/3.0);
+		const double max_segments = std::ceil(1000.0*angle/(2.0*M_PI));
+		const double num_segments = std::min(std::ceil(angle/max_angle_per_segment - 1e-9), max_segments);
+		return std::max(1, (int)num_segments);
+	}
 
 	void setHandleLayerAssignments(bool handle) { m_handle_layer_assignments = handle; }
 	bool handleLayerAssignments() { return m_handle_layer_assignments; }
@@ -86,6 +136,71 @@ public:
 	void setHandleStyledItems(bool handle) { m_handle_styled_items = handle; }
 	bool handleStyledItems() { return m_handle_styled_items; }
 
+	/**\brief Convert representation items with equal content only once, and share the meshes between them */
+	void setCacheItemShapes(bool cache) { m_cache_item_shapes = cache; }
+	bool cacheItemShapes() { return m_cache_item_shapes; }
+
+	/**\brief Subtract openings with disjoint bounding boxes in one CSG operation, instead of one operation per opening */
+	void setBatchCsgOperands(bool batch) { m_batch_csg_operands = batch; }
+	bool batchCsgOperands() { return m_batch_csg_operands; }
+
+	/**\brief Subtract openings that are extruded parallel to an extruded element from its profile in 2D, without CSG. If the 2D subtraction is not possible, CSG is used */
+	void setUsePrismaticOpenings(bool use) { m_use_prismatic_openings = use; }
+	bool usePrismaticOpenings() { return m_use_prismatic_openings; }
+
+	/**\brief Meshes with more vertices (after excluding meshes that do not overlap the other operand) are not processed in boolean operations. The operation is skipped, and a warning is reported */
+	void setCsgMaxNumVertices(size_t num_vertices) { m_csg_max_num_vertices = num_vertices; }
+	size_t getCsgMaxNumVertices() { return m_csg_max_num_vertices; }
+	/**\brief Maximum time in seconds for converting one product, 0 means unlimited. When exceeded, remaining boolean operations are skipped and the
+	geometry converted so far is kept, or replaced by its bounding box if getRenderBoundingBoxes() is set */
+	void setMaxTimePerProduct(double seconds) { m_max_time_per_product = seconds; }
+	double getMaxTimePerProduct() { return m_max_time_per_product; }
+	/**\brief Maximum time in seconds for one boolean operation, 0 means unlimited. When exceeded, the operand is not applied */
+	void setMaxTimePerCsgOperation(double seconds) { m_max_time_per_csg_operation = seconds; }
+	double getMaxTimePerCsgOperation() { return m_max_time_per_csg_operation; }
+
+	/**\brief After conversion, create indexed triangle buffers (ItemShapeData::m_triangle_meshes) for all meshsets */
+	void setCreateTriangleMeshes(bool create) { m_create_triangle_meshes = create; }
+	bool createTriangleMeshes() { return m_create_triangle_meshes; }
+
+	/**\brief Store the positions of triangle meshes as float instead of double */
+	void setTriangleMeshesSinglePrecision(bool single_precision) { m_triangle_meshes_single_precision = single_precision; }
+	bool triangleMeshesSinglePrecision() { return m_triangle_meshes_single_precision; }
+
+	/**\brief Release the carve meshsets once the triangle meshes are created. No boolean operations are possible on the geometry afterwards.
+	The edges and faces stay in the pool allocator of carve, until the application calls carve::mesh::releaseUnusedMeshMemory<3>() after the conversion */
+	void setReleaseCarveMeshes(bool release) { m_release_carve_meshes = release; }
+	bool releaseCarveMeshes() { return m_release_carve_meshes; }
+
+	/**\brief Convert IfcSweptDiskSolid items, like reinforcing bars, directly into triangle meshes (ItemShapeData::m_triangle_meshes) instead of carve meshsets.
+	Carve meshsets are created from them only if openings are subtracted. Swept disks in boolean operations are not affected */
+	void setCreateSweptDiskTriangleMeshes(bool create) { m_create_swept_disk_triangle_meshes = create; }
+	bool createSweptDiskTriangleMeshes() { return m_create_swept_disk_triangle_meshes; }
+
+	/**\brief Number of simplified levels of detail created per item in addition to the triangle meshes (ItemShapeData::m_triangle_mesh_lods), 0 means none.
+	Only used if createTriangleMeshes() is set */
+	void setNumLevelsOfDetail(int num_levels) { m_num_levels_of_detail = std::max(0, num_levels); }
+	int getNumLevelsOfDetail() { return m_num_levels_of_detail; }
+	/**\brief Each level of detail has at most this fraction of the triangles of the previous level */
+	void setLevelOfDetailTriangleRatio(double ratio) { m_level_of_detail_triangle_ratio = std::min(std::max(ratio, 0.0), 1.0); }
+	double getLevelOfDetailTriangleRatio() { return m_level_of_detail_triangle_ratio; }
+
+	/**\brief Number of products that GeometryConverter::convertGeometryStreaming converts in parallel, before they are handed to the callback and released */
+	void setStreamingBatchSize(size_t num_products) { m_streaming_batch_size = std::max(size_t(1), num_products); }
+	size_t getStreamingBatchSize() { return m_streaming_batch_size; }
+
+	/**\brief Directory where converted representation items are stored, so that later conversions of the same content with the same settings can load them instead of converting again.
+	Empty string (default) disables the cache, see GeometryDiskCache */
+	void setGeometryCacheDirectory(const std::string& directory) { m_geometry_cache_directory = directory; }
+	const std::string& getGeometryCacheDirectory() { return m_geometry_cache_directory; }
+	/**\brief Maximum size in bytes of the geometry cache directory. Least recently used entries are removed after each conversion if it is exceeded */
+	void setGeometryCacheMaxSize(size_t max_size_bytes) { m_geometry_cache_max_size = max_size_bytes; }
+	size_t getGeometryCacheMaxSize() { return m_geometry_cache_max_size; }
+
+	/**\brief Record which entities the geometry of each product is created from, so that GeometryConverter::updateGeometry can convert only the products affected by model changes */
+	void setTrackGeometryDependencies(bool track) { m_track_geometry_dependencies = track; }
+	bool trackGeometryDependencies() { return m_track_geometry_dependencies; }
+
 	bool isShowTextLiterals() { return m_show_text_literals; }
 	bool isIgnoreProfileRadius() { return m_ignore_profile_radius; }
 	void setIgnoreProfileRadius(bool ignore_radius) { m_ignore_profile_radius = ignore_radius; }
@@ -150,10 +265,28 @@ protected:
 	int m_min_num_vertices_per_arc = 5;
 	int m_num_vertices_per_control_point = 1;
 	int m_num_vertices_per_control_point_default = 1;
+	double m_max_chordal_deviation = 0;
+	double m_max_segment_angle = M_PI/4.0;
 	bool m_show_text_literals = false;
 	bool m_ignore_profile_radius = false;
 	bool m_handle_styled_items = true;
 	bool m_handle_layer_assignments = true;
+	bool m_cache_item_shapes = true;
+	bool m_batch_csg_operands = true;
+	bool m_use_prismatic_openings = true;
+	size_t m_csg_max_num_vertices = 250000;
+	double m_max_time_per_product = 0;
+	double m_max_time_per_csg_operation = 0;
+	bool m_create_triangle_meshes = false;
+	bool m_triangle_meshes_single_precision = false;
+	bool m_release_carve_meshes = false;
+	bool m_create_swept_disk_triangle_meshes = false;
+	int m_num_levels_of_detail = 0;
+	double m_level_of_detail_triangle_ratio = 0.5;
+	size_t m_streaming_batch_size = 500;
+	std::string m_geometry_cache_directory;
+	size_t m_geometry_cache_max_size = size_t(1024) * 1024 * 1024;
+	bool m_track_geometry_dependencies = false;
 	bool m_render_bounding_box = false;
 	double m_min_triangle_area = 1e-9;
 	double m_epsilonMergePoints = 1.5e-8;
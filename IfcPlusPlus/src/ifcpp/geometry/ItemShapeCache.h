@@ -0,0 +1,419 @@
+/* -*-c++-*- IfcQuery www.ifcquery.com
+*
+MIT License
+
+Copyright (c) 2017 Fabian Gerold
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+#include <ifcpp/model/AttributeObject.h>
+#include <ifcpp/model/BasicTypes.h>
+#include <ifcpp/model/BuildingObject.h>
+#include <ifcpp/model/OpenMPIncludes.h>
+#include <ifcpp/model/StatusCallback.h>
+#include "GeometryInputData.h"
+
+//\brief Hash of the attribute sub-graph of an entity. Two entities with equal content have equal keys, regardless of their STEP ids.
+struct ItemContentKey
+{
+	uint64_t m_hash1 = 14695981039346656037ULL;
+	uint64_t m_hash2 = 0;
+
+	void addBytes( const void* data, size_t length )
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for( size_t ii = 0; ii < length; ++ii )
+		{
+			m_hash1 = ( m_hash1 ^ bytes[ii] ) * 1099511628211ULL;
+		}
+		m_hash2 = m_hash2 * 31 + length;
+		m_hash2 ^= m_hash1 + 0x9e3779b97f4a7c15ULL + ( m_hash2 << 6 ) + ( m_hash2 >> 2 );
+	}
+
+	void addKey( const ItemContentKey& other )
+	{
+		addBytes( &other.m_hash1, sizeof( uint64_t ) );
+		addBytes( &other.m_hash2, sizeof( uint64_t ) );
+	}
+
+	template<typename T>
+	void addValue( const T& value )
+	{
+		addBytes( &value, sizeof( T ) );
+	}
+
+	bool operator<( const ItemContentKey& other ) const
+	{
+		if( m_hash1 != other.m_hash1 )
+		{
+			return m_hash1 < other.m_hash1;
+		}
+		return m_hash2 < other.m_hash2;
+	}
+};
+
+/**\brief Cache for converted geometric representation items.
+  Many products reference representation items with identical content (same profile, depth, direction...), but different entity ids.
+  The geometry of such items is converted once, and the meshes are shared by all items with equal content.
+  Placements are applied in ProductShapeData, so the cached geometry is in item coordinates. ItemShapeData::applyTransformToItem copies shared meshes before modifying them.
+  Placements inside an item (for example IfcExtrudedAreaSolid.Position) are part of its content, so items that differ only in such a placement are not shared.
+  Entries are found by their content key. On a hit, the attribute sub-graphs of both entities are compared, so a hash collision is not taken as a match. */
+class ItemShapeCache : public StatusCallback
+{
+protected:
+	struct CachedItemShape
+	{
+		shared_ptr<ItemShapeData>	m_item;
+		weak_ptr<BuildingEntity>	m_entity;
+		size_t						m_num_hits = 0;
+	};
+	std::map<ItemContentKey, CachedItemShape>				m_map_item_shapes;
+	std::atomic<size_t>										m_num_cache_hits{ 0 };
+
+#ifdef _OPENMP
+	Mutex m_writelock_item_cache;
+#endif
+
+public:
+	ItemShapeCache()
+	{
+	}
+
+	virtual ~ItemShapeCache()
+	{
+	}
+
+	void clearItemShapeCache()
+	{
+#ifdef _OPENMP
+		ScopedLock lock( m_writelock_item_cache );
+#endif
+		m_map_item_shapes.clear();
+		m_num_cache_hits = 0;
+	}
+
+	/** Number of item conversions that have been replaced by shared geometry since the last clearItemShapeCache */
+	size_t getNumCacheHits() const { return m_num_cache_hits; }
+	size_t getNumCachedItems() const { return m_map_item_shapes.size(); }
+
+	static void computeContentKey( const shared_ptr<BuildingObject>& obj, ItemContentKey& key, std::unordered_map<const BuildingEntity*, ItemContentKey>& map_visited )
+	{
+		if( !obj )
+		{
+			key.addValue( uint32_t( 0 ) );
+			return;
+		}
+
+		const uint32_t class_id = obj->classID();
+		key.addValue( class_id );
+
+		shared_ptr<BuildingEntity> entity = dynamic_pointer_cast<BuildingEntity>( obj );
+		if( entity )
+		{
+			auto it_visited = map_visited.find( entity.get() );
+			if( it_visited != map_visited.end() )
+			{
+				key.addKey( it_visited->second );
+				return;
+			}
+
+			// placeholder, in case of cyclic references
+			map_visited[entity.get()] = ItemContentKey();
+
+			ItemContentKey entity_key;
+			entity_key.addValue( class_id );
+			std::vector<std::pair<std::string, shared_ptr<BuildingObject> > > vec_attributes;
+			entity->getAttributes( vec_attributes );
+			for( auto& attribute : vec_attributes )
+			{
+				computeContentKey( attribute.second, entity_key, map_visited );
+			}
+			map_visited[entity.get()] = entity_key;
+			key.addKey( entity_key );
+			return;
+		}
+
+		shared_ptr<AttributeObjectVector> attribute_vector = dynamic_pointer_cast<AttributeObjectVector>( obj );
+		if( attribute_vector )
+		{
+			key.addValue( attribute_vector->m_vec.size() );
+			for( auto& element : attribute_vector->m_vec )
+			{
+				computeContentKey( element, key, map_visited );
+			}
+			return;
+		}
+
+		shared_ptr<RealAttribute> real_attribute = dynamic_pointer_cast<RealAttribute>( obj );
+		if( real_attribute )
+		{
+			key.addValue( real_attribute->m_value );
+			return;
+		}
+		shared_ptr<IntegerAttribute> int_attribute = dynamic_pointer_cast<IntegerAttribute>( obj );
+		if( int_attribute )
+		{
+			key.addValue( int_attribute->m_value );
+			return;
+		}
+		shared_ptr<BoolAttribute> bool_attribute = dynamic_pointer_cast<BoolAttribute>( obj );
+		if( bool_attribute )
+		{
+			key.addValue( bool_attribute->m_value );
+			return;
+		}
+		shared_ptr<LogicalAttribute> logical_attribute = dynamic_pointer_cast<LogicalAttribute>( obj );
+		if( logical_attribute )
+		{
+			key.addValue( logical_attribute->m_value );
+			return;
+		}
+		shared_ptr<StringAttribute> string_attribute = dynamic_pointer_cast<StringAttribute>( obj );
+		if( string_attribute )
+		{
+			key.addBytes( string_attribute->m_value.data(), string_attribute->m_value.size() );
+			return;
+		}
+
+		// type objects, like IfcLengthMeasure
+		std::stringstream strs;
+		obj->getStepParameter( strs, true );
+		const std::string step_param = strs.str();
+		key.addBytes( step_param.data(), step_param.size() );
+	}
+
+	static ItemContentKey computeContentKey( const shared_ptr<BuildingEntity>& entity )
+	{
+		ItemContentKey key;
+		std::unordered_map<const BuildingEntity*, ItemContentKey> map_visited;
+		computeContentKey( entity, key, map_visited );
+		return key;
+	}
+
+	static bool isEqualContent( const shared_ptr<BuildingObject>& obj1, const shared_ptr<BuildingObject>& obj2, std::set<std::pair<const BuildingEntity*, const BuildingEntity*> >& set_compared )
+	{
+		if( obj1 == obj2 )
+		{
+			return true;
+		}
+		if( !obj1 || !obj2 )
+		{
+			return false;
+		}
+		if( obj1->classID() != obj2->classID() )
+		{
+			return false;
+		}
+
+		shared_ptr<BuildingEntity> entity1 = dynamic_pointer_cast<BuildingEntity>( obj1 );
+		if( entity1 )
+		{
+			shared_ptr<BuildingEntity> entity2 = dynamic_pointer_cast<BuildingEntity>( obj2 );
+			if( !entity2 )
+			{
+				return false;
+			}
+
+			// pairs that are compared already (or currently, in case of cyclic references) do not need to be compared again
+			if( !set_compared.insert( { entity1.get(), entity2.get() } ).second )
+			{
+				return true;
+			}
+
+			std::vector<std::pair<std::string, shared_ptr<BuildingObject> > > vec_attributes1;
+			std::vector<std::pair<std::string, shared_ptr<BuildingObject> > > vec_attributes2;
+			entity1->getAttributes( vec_attributes1 );
+			entity2->getAttributes( vec_attributes2 );
+			if( vec_attributes1.size() != vec_attributes2.size() )
+			{
+				return false;
+			}
+			for( size_t ii = 0; ii < vec_attributes1.size(); ++ii )
+			{
+				if( !isEqualContent( vec_attributes1[ii].second, vec_attributes2[ii].second, set_compared ) )
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		shared_ptr<AttributeObjectVector> attribute_vector1 = dynamic_pointer_cast<AttributeObjectVector>( obj1 );
+		if( attribute_vector1 )
+		{
+			shared_ptr<AttributeObjectVector> attribute_vector2 = dynamic_pointer_cast<AttributeObjectVector>( obj2 );
+			if( !attribute_vector2 || attribute_vector1->m_vec.size() != attribute_vector2->m_vec.size() )
+			{
+				return false;
+			}
+			for( size_t ii = 0; ii < attribute_vector1->m_vec.size(); ++ii )
+			{
+				if( !isEqualContent( attribute_vector1->m_vec[ii], attribute_vector2->m_vec[ii], set_compared ) )
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		shared_ptr<RealAttribute> real_attribute1 = dynamic_pointer_cast<RealAttribute>( obj1 );
+		if( real_attribute1 )
+		{
+			shared_ptr<RealAttribute> real_attribute2 = dynamic_pointer_cast<RealAttribute>( obj2 );
+			return real_attribute2 && memcmp( &real_attribute1->m_value, &real_attribute2->m_value, sizeof( real_attribute1->m_value ) ) == 0;
+		}
+		shared_ptr<IntegerAttribute> int_attribute1 = dynamic_pointer_cast<IntegerAttribute>( obj1 );
+		if( int_attribute1 )
+		{
+			shared_ptr<IntegerAttribute> int_attribute2 = dynamic_pointer_cast<IntegerAttribute>( obj2 );
+			return int_attribute2 && int_attribute1->m_value == int_attribute2->m_value;
+		}
+		shared_ptr<BoolAttribute> bool_attribute1 = dynamic_pointer_cast<BoolAttribute>( obj1 );
+		if( bool_attribute1 )
+		{
+			shared_ptr<BoolAttribute> bool_attribute2 = dynamic_pointer_cast<BoolAttribute>( obj2 );
+			return bool_attribute2 && bool_attribute1->m_value == bool_attribute2->m_value;
+		}
+		shared_ptr<LogicalAttribute> logical_attribute1 = dynamic_pointer_cast<LogicalAttribute>( obj1 );
+		if( logical_attribute1 )
+		{
+			shared_ptr<LogicalAttribute> logical_attribute2 = dynamic_pointer_cast<LogicalAttribute>( obj2 );
+			return logical_attribute2 && logical_attribute1->m_value == logical_attribute2->m_value;
+		}
+		shared_ptr<StringAttribute> string_attribute1 = dynamic_pointer_cast<StringAttribute>( obj1 );
+		if( string_attribute1 )
+		{
+			shared_ptr<StringAttribute> string_attribute2 = dynamic_pointer_cast<StringAttribute>( obj2 );
+			return string_attribute2 && string_attribute1->m_value == string_attribute2->m_value;
+		}
+
+		// type objects, like IfcLengthMeasure
+		std::stringstream strs1;
+		std::stringstream strs2;
+		obj1->getStepParameter( strs1, true );
+		obj2->getStepParameter( strs2, true );
+		return strs1.str() == strs2.str();
+	}
+
+	static bool isEqualContent( const shared_ptr<BuildingEntity>& entity1, const shared_ptr<BuildingEntity>& entity2 )
+	{
+		std::set<std::pair<const BuildingEntity*, const BuildingEntity*> > set_compared;
+		return isEqualContent( entity1, entity2, set_compared );
+	}
+
+	/** If an item with equal content has been converted before, its geometry is added to item_data, and true is returned.
+	  The content of entity is compared with the entity of the cached item, so different entities with colliding keys are not mixed up. */
+	bool findItemShape( const ItemContentKey& key, const shared_ptr<BuildingEntity>& entity, shared_ptr<ItemShapeData>& item_data )
+	{
+		shared_ptr<ItemShapeData> cached_item;
+		shared_ptr<BuildingEntity> cached_entity;
+		{
+#ifdef _OPENMP
+			ScopedLock lock( m_writelock_item_cache );
+#endif
+			auto it_cache = m_map_item_shapes.find( key );
+			if( it_cache == m_map_item_shapes.end() )
+			{
+				return false;
+			}
+			cached_item = it_cache->second.m_item;
+			cached_entity = it_cache->second.m_entity.lock();
+		}
+
+		if( !cached_entity || !isEqualContent( cached_entity, entity ) )
+		{
+			return false;
+		}
+
+		{
+#ifdef _OPENMP
+			ScopedLock lock( m_writelock_item_cache );
+#endif
+			auto it_cache = m_map_item_shapes.find( key );
+			if( it_cache != m_map_item_shapes.end() )
+			{
+				++it_cache->second.m_num_hits;
+			}
+		}
+
+		copyGeometry( cached_item, item_data );
+		++m_num_cache_hits;
+		return true;
+	}
+
+	void addItemShape( const ItemContentKey& key, const shared_ptr<BuildingEntity>& entity, const shared_ptr<ItemShapeData>& item_data )
+	{
+		// the cache holds its own item, so that later modifications of item_data (for example replaced meshes after boolean operations) are not visible here
+		shared_ptr<ItemShapeData> cached_item( new ItemShapeData() );
+		copyGeometry( item_data, cached_item );
+
+#ifdef _OPENMP
+		ScopedLock lock( m_writelock_item_cache );
+#endif
+		m_map_item_shapes.insert( { key, CachedItemShape{ cached_item, entity, 0 } } );
+	}
+
+	/** If more than max_num_items are cached, items that have not been shared since the previous call are removed. Returns the number of removed items */
+	size_t evictUnusedItemShapes( size_t max_num_items )
+	{
+#ifdef _OPENMP
+		ScopedLock lock( m_writelock_item_cache );
+#endif
+		if( m_map_item_shapes.size() <= max_num_items )
+		{
+			return 0;
+		}
+
+		size_t num_evicted = 0;
+		for( auto it = m_map_item_shapes.begin(); it != m_map_item_shapes.end(); )
+		{
+			if( it->second.m_num_hits == 0 )
+			{
+				it = m_map_item_shapes.erase( it );
+				++num_evicted;
+				continue;
+			}
+			it->second.m_num_hits = 0;
+			++it;
+		}
+		return num_evicted;
+	}
+
+	static void copyGeometry( const shared_ptr<ItemShapeData>& source, shared_ptr<ItemShapeData>& target )
+	{
+		std::copy( source->m_vertex_points.begin(), source->m_vertex_points.end(), std::back_inserter( target->m_vertex_points ) );
+		std::copy( source->m_polylines.begin(), source->m_polylines.end(), std::back_inserter( target->m_polylines ) );
+		std::copy( source->m_meshsets.begin(), source->m_meshsets.end(), std::back_inserter( target->m_meshsets ) );
+		std::copy( source->m_meshsets_open.begin(), source->m_meshsets_open.end(), std::back_inserter( target->m_meshsets_open ) );
+		std::copy( source->m_triangle_meshes.begin(), source->m_triangle_meshes.end(), std::back_inserter( target->m_triangle_meshes ) );
+		std::copy( source->m_vec_text_literals.begin(), source->m_vec_text_literals.end(), std::back_inserter( target->m_vec_text_literals ) );
+
+		// child items are modified in place by applyTransformToItem, so each target gets its own child items
+		for( const shared_ptr<ItemShapeData>& source_child : source->m_child_items )
+		{
+			shared_ptr<ItemShapeData> target_child( new ItemShapeData() );
+			target_child->m_ifc_item = source_child->m_ifc_item;
+			target_child->m_ifc_representation = source_child->m_ifc_representation;
+			std::copy( source_child->m_vec_item_appearances.begin(), source_child->m_vec_item_appearances.end(), std::back_inserter( target_child->m_vec_item_appearances ) );
+			copyGeometry( source_child, target_child );
+			target->addChildItem( target_child, target );
+		}
+	}
+};
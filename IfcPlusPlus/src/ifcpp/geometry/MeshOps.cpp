@@ -15,12 +15,41 @@ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTH
 LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <atomic>
 #include "IncludeCarveHeaders.h"
 #include <ifcpp/geometry/FaceConverter.h>
 #include <ifcpp/IFC4X3/include/IfcCartesianPoint.h>
 #include "MeshOps.h"
+#include "ConversionBudget.h"
 using namespace IFC4X3;
 
+namespace
+{
+	//\brief Renews the modification stamp of a meshset when leaving a function that modifies it in place, so that cached check results are not reused. The meshset that was passed in is renewed as well, in case it has been replaced
+	class MeshSetModificationScope
+	{
+	public:
+		MeshSetModificationScope(shared_ptr<carve::mesh::MeshSet<3> >& meshset) : m_meshset(meshset), m_meshsetInput(meshset)
+		{
+		}
+		~MeshSetModificationScope()
+		{
+			if( m_meshsetInput )
+			{
+				m_meshsetInput->touch();
+			}
+			if( m_meshset && m_meshset != m_meshsetInput )
+			{
+				m_meshset->touch();
+			}
+		}
+
+	private:
+		shared_ptr<carve::mesh::MeshSet<3> >& m_meshset;
+		shared_ptr<carve::mesh::MeshSet<3> > m_meshsetInput;
+	};
+}
+
 size_t MeshOps::getNumFaces(const carve::mesh::MeshSet<3>* meshset)
 {
 	size_t num_faces = 0;
@@ -703,6 +732,7 @@ bool isBetterForExport(MeshSetInfo infoTriangulated, MeshSetInfo infoBefore)
 
 void MeshOps::retriangulateMeshSetForExport( shared_ptr<carve::mesh::MeshSet<3> >& meshset, const GeomProcessingParams& paramsInput)
 {
+	MeshSetModificationScope modificationScope(meshset);
 	if (!meshset)
 	{
 		return;
@@ -832,6 +862,7 @@ void MeshOps::retriangulateMeshSetForBoolOp(shared_ptr<carve::mesh::MeshSet<3> >
 
 void MeshOps::retriangulateMeshSetForBoolOp_earcut(shared_ptr<carve::mesh::MeshSet<3> >& meshset, bool ignoreResultOpenEdges, const GeomProcessingParams& paramsInput, size_t retryCount)
 {
+	MeshSetModificationScope modificationScope(meshset);
 	if (!meshset)
 	{
 		return;
@@ -959,6 +990,7 @@ void MeshOps::retriangulateMeshSetForBoolOp_earcut(shared_ptr<carve::mesh::MeshS
 
 void MeshOps::retriangulateMeshSetForBoolOp_carve(shared_ptr<carve::mesh::MeshSet<3> >& meshset, bool ignoreResultOpenEdges, const GeomProcessingParams& params, size_t retryCount)
 {
+	MeshSetModificationScope modificationScope(meshset);
 	if (!meshset)
 	{
 		return;
@@ -1646,6 +1678,7 @@ inline void removeFinEdges(carve::mesh::Mesh<3>* mesh, const GeomProcessingParam
 
 void removeFinEdges(shared_ptr<carve::mesh::MeshSet<3> >& meshset, const GeomProcessingParams& params)
 {
+	MeshSetModificationScope modificationScope(meshset);
 	for (carve::mesh::Mesh<3>*mesh : meshset->meshes)
 	{
 		removeFinEdges(mesh, params);
@@ -1697,6 +1730,7 @@ void findFinEdges(const shared_ptr<carve::mesh::MeshSet<3> >& meshset, std::set<
 
 void removeFinFaces(shared_ptr<carve::mesh::MeshSet<3> >& meshset, const GeomProcessingParams& params)
 {
+	MeshSetModificationScope modificationScope(meshset);
 	//return;
 	MeshSetInfo infoInput;
 	MeshOps::checkMeshSetValidAndClosed(meshset, infoInput, params);
@@ -1782,6 +1816,7 @@ void removeFinFaces(shared_ptr<carve::mesh::MeshSet<3> >& meshset, const GeomPro
 
 void MeshOps::removeDegenerateMeshes(shared_ptr<carve::mesh::MeshSet<3> >& meshsetInput, const GeomProcessingParams& paramsInput, bool ensureValidMesh)
 {
+	MeshSetModificationScope modificationScope(meshsetInput);
 	if (!meshsetInput)
 	{
 		return;
@@ -1843,6 +1878,7 @@ void MeshOps::removeDegenerateMeshes(shared_ptr<carve::mesh::MeshSet<3> >& meshs
 
 void MeshOps::removeDegenerateFacesInMeshSet(shared_ptr<carve::mesh::MeshSet<3> >& meshsetInput, const GeomProcessingParams& paramsInput, bool ensureValidMesh)
 {
+	MeshSetModificationScope modificationScope(meshsetInput);
 	if (!meshsetInput)
 	{
 		return;
@@ -2374,6 +2410,13 @@ size_t removeEdgeAndMergeFaces(carve::mesh::Edge<3>* edgeIn, const GeomProcessin
 
 size_t mergeCoplanarFacesInMeshSet(shared_ptr<carve::mesh::MeshSet<3> >& meshset, const GeomProcessingParams& paramsInput, bool shouldBeClosedManifold)
 {
+	MeshSetModificationScope modificationScope(meshset);
+	if (!shouldBeClosedManifold)
+	{
+		// merged faces are only kept if the result can be checked for a closed manifold. Each merge re-caches all edges of the mesh, so skip the work here
+		return 0;
+	}
+
 	shared_ptr<carve::mesh::MeshSet<3> > meshset_copy(meshset->clone());
 
 	GeomProcessingParams params(paramsInput);
@@ -2475,6 +2518,7 @@ size_t mergeCoplanarFacesInMeshSet(shared_ptr<carve::mesh::MeshSet<3> >& meshset
 
 void flipFacesOnOpenEdges(shared_ptr<carve::mesh::MeshSet<3>>& meshset, const GeomProcessingParams& params)
 {
+	MeshSetModificationScope modificationScope(meshset);
 	MeshSetInfo infoInput;
 	MeshOps::checkMeshSetValidAndClosed(meshset, infoInput, params);
 
@@ -2543,6 +2587,7 @@ void flipFacesOnOpenEdges(shared_ptr<carve::mesh::MeshSet<3>>& meshset, const Ge
 
 void MeshOps::resolveOpenEdges(shared_ptr<carve::mesh::MeshSet<3>>& meshset, const GeomProcessingParams& params)
 {
+	MeshSetModificationScope modificationScope(meshset);
 	if (!meshset)
 	{
 		return;
@@ -2878,6 +2923,7 @@ size_t removePointerToVertex(carve::mesh::Mesh<3>* mesh, carve::mesh::Vertex<3>*
 
 size_t mergeAlignedEdges(shared_ptr<carve::mesh::MeshSet<3> >& meshset, GeomProcessingParams& params )
 {
+	MeshSetModificationScope modificationScope(meshset);
 #ifdef _DEBUG
 	if (params.debugDump)
 	{
@@ -3136,7 +3182,7 @@ size_t mergeAlignedEdges(shared_ptr<carve::mesh::MeshSet<3> >& meshset, GeomProc
 	/// \param ignoreOpenEdgesInResult	If true, the result is kept even with open edges (good for visualization). If false, the result will be the input mesh in case open edges occur after triangulation (good for further boolean operations)
 void MeshOps::simplifyMeshSet(shared_ptr<carve::mesh::MeshSet<3> >& meshsetInput, const GeomProcessingParams& paramsInput, bool triangulateResult, bool shouldBeClosedManifold)
 {
-	if (!meshsetInput)
+	if (!meshsetInput || ConversionBudget::current().exceeded())
 	{
 		return;
 	}
@@ -3223,6 +3269,12 @@ void MeshOps::simplifyMeshSet(shared_ptr<carve::mesh::MeshSet<3> >& meshsetInput
 
 	dumpPolygon = false;
 
+	if (ConversionBudget::current().exceeded())
+	{
+		// meshsetInput already holds the best intermediate result
+		return;
+	}
+
 	try
 	{
 		removeFinEdges(meshset, params);
@@ -3625,7 +3677,181 @@ void MeshOps::checkMeshSetPointers(const shared_ptr<carve::mesh::MeshSet<3> >& m
 	}
 }
 
+namespace
+{
+	//\brief Result of checkMeshSetValidAndClosed for one state of a meshset, identified by its modification stamp
+	struct MeshSetCheckRecord
+	{
+		size_t stamp = 0;
+
+		// number of meshes, vertices, faces and edges, compared as a safeguard against modifications without touch()
+		size_t numMeshes = 0;
+		size_t numVertices = 0;
+		size_t numFaces = 0;
+		size_t numEdges = 0;
+
+		// parameters that the result depends on
+		double epsMergePoints = 0;
+		double epsMergeAlignedEdgesAngle = 0;
+		double minFaceArea = 0;
+		bool allowFinEdges = false;
+		bool allowDegenerateEdges = false;
+		bool allowZeroAreaFaces = false;
+		bool treatLongThinFaceAsDegenerate = false;
+
+		bool result = false;
+		MeshSetInfo info;
+
+		void setKey(const carve::mesh::MeshSet<3>* meshset, const GeomProcessingParams& params)
+		{
+			stamp = meshset->modification_stamp;
+			numMeshes = meshset->meshes.size();
+			numVertices = meshset->vertex_storage.size();
+			countFacesAndEdges(meshset, numFaces, numEdges);
+			epsMergePoints = params.epsMergePoints;
+			epsMergeAlignedEdgesAngle = params.epsMergeAlignedEdgesAngle;
+			minFaceArea = params.minFaceArea;
+			allowFinEdges = params.allowFinEdges;
+			allowDegenerateEdges = params.allowDegenerateEdges;
+			allowZeroAreaFaces = params.allowZeroAreaFaces;
+			treatLongThinFaceAsDegenerate = params.treatLongThinFaceAsDegenerate;
+		}
+
+		bool matches(const carve::mesh::MeshSet<3>* meshset, const GeomProcessingParams& params) const
+		{
+			if( stamp == 0 )
+			{
+				return false;
+			}
+
+			if( stamp != meshset->modification_stamp )
+			{
+				// an unmodified clone has the same result, as long as the result does not point to faces or edges of the original
+				if( stamp != meshset->clone_source_stamp || pointsToFacesOrEdges() )
+				{
+					return false;
+				}
+			}
+
+			if( epsMergePoints != params.epsMergePoints || epsMergeAlignedEdgesAngle != params.epsMergeAlignedEdgesAngle || minFaceArea != params.minFaceArea )
+			{
+				return false;
+			}
+			if( allowFinEdges != params.allowFinEdges || allowDegenerateEdges != params.allowDegenerateEdges || allowZeroAreaFaces != params.allowZeroAreaFaces
+				|| treatLongThinFaceAsDegenerate != params.treatLongThinFaceAsDegenerate )
+			{
+				return false;
+			}
+
+			if( numMeshes != meshset->meshes.size() || numVertices != meshset->vertex_storage.size() )
+			{
+				return false;
+			}
+			size_t meshsetNumFaces = 0;
+			size_t meshsetNumEdges = 0;
+			countFacesAndEdges(meshset, meshsetNumFaces, meshsetNumEdges);
+			return numFaces == meshsetNumFaces && numEdges == meshsetNumEdges;
+		}
+
+		bool pointsToFacesOrEdges() const
+		{
+			return info.zeroAreaFaces.size() > 0 || info.degenerateEdges.size() > 0 || info.finEdges.size() > 0 || info.finFaces.size() > 0;
+		}
+
+		static void countFacesAndEdges(const carve::mesh::MeshSet<3>* meshset, size_t& numFaces, size_t& numEdges)
+		{
+			numFaces = 0;
+			numEdges = 0;
+			for( const carve::mesh::Mesh<3>* mesh : meshset->meshes )
+			{
+				if( mesh )
+				{
+					numFaces += mesh->faces.size();
+					numEdges += mesh->open_edges.size() + mesh->closed_edges.size();
+				}
+			}
+		}
+	};
+
+	// a meshset is typically checked several times within one boolean operation, so a few records per thread are enough
+	const size_t NUM_MESHSET_CHECK_RECORDS = 16;
+
+	struct MeshSetCheckCache
+	{
+		MeshSetCheckRecord records[NUM_MESHSET_CHECK_RECORDS];
+		size_t nextRecord = 0;
+	};
+
+	MeshSetCheckCache& getMeshSetCheckCache()
+	{
+		static thread_local MeshSetCheckCache cache;
+		return cache;
+	}
+
+	std::atomic<size_t> g_numMeshSetChecks{ 0 };
+	std::atomic<size_t> g_numMeshSetChecksAvoided{ 0 };
+}
+
+static bool checkMeshSetValidAndClosedUncached(const shared_ptr<carve::mesh::MeshSet<3>>& meshset, MeshSetInfo& info, const GeomProcessingParams& params);
+
 bool MeshOps::checkMeshSetValidAndClosed(const shared_ptr<carve::mesh::MeshSet<3>>& meshset, MeshSetInfo& info, const GeomProcessingParams& params)
+{
+	if( !meshset || meshset->meshes.size() == 0 )
+	{
+		return checkMeshSetValidAndClosedUncached(meshset, info, params);
+	}
+
+	MeshSetCheckCache& cache = getMeshSetCheckCache();
+	for( const MeshSetCheckRecord& record : cache.records )
+	{
+		if( record.matches(meshset.get(), params) )
+		{
+			StatusCallback* report_callback = info.report_callback;
+			BuildingEntity* entity = info.entity;
+			info.copyFromOther(record.info);
+			info.report_callback = report_callback;
+			info.entity = entity;
+			info.meshset = meshset;
+			++g_numMeshSetChecksAvoided;
+			return record.result;
+		}
+	}
+
+	const size_t stampBefore = meshset->modification_stamp;
+	bool result = checkMeshSetValidAndClosedUncached(meshset, info, params);
+	++g_numMeshSetChecks;
+
+	// if negative meshes have been inverted by the check, the result is cached with the next check
+	if( meshset->modification_stamp == stampBefore )
+	{
+		MeshSetCheckRecord& record = cache.records[cache.nextRecord];
+		cache.nextRecord = (cache.nextRecord + 1) % NUM_MESHSET_CHECK_RECORDS;
+		record.setKey(meshset.get(), params);
+		record.result = result;
+		record.info.copyFromOther(info);
+		record.info.report_callback = nullptr;
+		record.info.entity = nullptr;
+	}
+	return result;
+}
+
+size_t MeshOps::getNumMeshSetChecks()
+{
+	return g_numMeshSetChecks;
+}
+
+size_t MeshOps::getNumMeshSetChecksAvoided()
+{
+	return g_numMeshSetChecksAvoided;
+}
+
+void MeshOps::resetMeshSetCheckCounters()
+{
+	g_numMeshSetChecks = 0;
+	g_numMeshSetChecksAvoided = 0;
+}
+
+static bool checkMeshSetValidAndClosedUncached(const shared_ptr<carve::mesh::MeshSet<3>>& meshset, MeshSetInfo& info, const GeomProcessingParams& params)
 {
 	info.meshset = meshset;
 	bool allowFinEdges = params.allowFinEdges;
@@ -3701,7 +3927,7 @@ bool MeshOps::checkMeshSetValidAndClosed(const shared_ptr<carve::mesh::MeshSet<3
 
 	// check for valid pointers first
 	bool checkForDegenerateEdges = true;
-	checkMeshSetPointers(meshset, checkForDegenerateEdges, params, info);
+	MeshOps::checkMeshSetPointers(meshset, checkForDegenerateEdges, params, info);
 	if (!info.allPointersValid)
 	{
 		info.meshSetValid = false;
@@ -3816,7 +4042,7 @@ bool MeshOps::checkMeshSetValidAndClosed(const shared_ptr<carve::mesh::MeshSet<3
 	}
 
 	std::stringstream err;
-	bool meshes_closed = checkMeshSetNonNegativeAndClosed(meshset, params);
+	bool meshes_closed = MeshOps::checkMeshSetNonNegativeAndClosed(meshset, params);
 	if (meshes_closed)
 	{
 		// check volume
@@ -3884,6 +4110,8 @@ bool intersectRayTriangle(const glm::dvec3& rayOrigin, const glm::dvec3& rayDire
 
 void MeshOps::flattenFacePlanes(shared_ptr<carve::mesh::MeshSet<3> >& op1, shared_ptr<carve::mesh::MeshSet<3> >& op2, const GeomProcessingParams& params)
 {
+	MeshSetModificationScope modificationScope1(op1);
+	MeshSetModificationScope modificationScope2(op2);
 	// project face points into coplanar face
 	double epsAngle = params.epsMergeAlignedEdgesAngle * 100.0;
 	double epsDistanceSinglePoints = params.epsMergePoints * 10.0;
@@ -4060,6 +4288,7 @@ void MeshOps::flattenFacePlanes(shared_ptr<carve::mesh::MeshSet<3> >& op1, share
 ///\param[in] dumpMeshes: write meshes to dump file for debugging
 void MeshOps::intersectOpenEdgesWithPoints(shared_ptr<carve::mesh::MeshSet<3> >& meshsetInput, const GeomProcessingParams& params)
 {
+	MeshSetModificationScope modificationScope(meshsetInput);
 	if (!meshsetInput)
 	{
 		return;
@@ -4297,6 +4526,7 @@ void MeshOps::intersectOpenEdgesWithPoints(shared_ptr<carve::mesh::MeshSet<3> >&
 ///\param[in] dumpMeshes: write meshes to dump file for debugging
 void MeshOps::intersectOpenEdgesWithEdges(shared_ptr<carve::mesh::MeshSet<3> >& meshset, const GeomProcessingParams& params)
 {
+	MeshSetModificationScope modificationScope(meshset);
 	if (!meshset)
 	{
 		return;
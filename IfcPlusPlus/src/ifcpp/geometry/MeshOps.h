@@ -212,6 +212,11 @@ public:
 
 	static bool checkMeshSetValidAndClosed(const shared_ptr<carve::mesh::MeshSet<3>>& meshset, MeshSetInfo& info, const GeomProcessingParams& params );
 
+	/// \brief Number of full checks in checkMeshSetValidAndClosed, and number of checks answered from the results of earlier checks of unmodified meshsets
+	static size_t getNumMeshSetChecks();
+	static size_t getNumMeshSetChecksAvoided();
+	static void resetMeshSetCheckCounters();
+
 	static bool checkMeshSetNonNegativeAndClosed(const shared_ptr<carve::mesh::MeshSet<3>> mesh_set, const GeomProcessingParams& params);
 
 	static void checkMeshPointers(const carve::mesh::Mesh<3>* mesh, bool checkForDegenerateEdges, const GeomProcessingParams& params, MeshSetInfo& info);
@@ -0,0 +1,591 @@
+/* -*-c++-*- IfcQuery www.ifcquery.com
+*
+MIT License
+
+Copyright (c) 2017 Fabian Gerold
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+#include <ifcpp/model/BasicTypes.h>
+#include "IncludeCarveHeaders.h"
+#include "TriangleMeshData.h"
+
+/**
+*\brief Class MeshSimplifier: reduces the number of triangles of a TriangleMeshData by edge collapses, cheapest first, measured by quadric error metrics (Garland and Heckbert).
+* simplify can be called repeatedly with decreasing targets, so that all levels of detail of a mesh are produced in one pass over the edge collapses.
+*/
+class MeshSimplifier
+{
+public:
+	MeshSimplifier( const TriangleMeshData& mesh )
+	{
+		m_closed = mesh.m_closed;
+		weldVertices( mesh );
+		initQuadrics();
+		initCollapses();
+	}
+
+	size_t getNumTriangles() const { return m_num_triangles; }
+
+	/** Maximum distance of the simplified mesh to the planes of the original triangles, estimated from the quadric error of the collapses done so far */
+	double getGeometricError() const { return m_geometric_error; }
+
+	/**
+	*\brief Collapses edges until the mesh has target_num_triangles or less, or no more edge can be collapsed without changing the topology or flipping triangles.
+	*\return true if at least one edge has been collapsed
+	*/
+	bool simplify( size_t target_num_triangles )
+	{
+		bool collapsed = false;
+		while( m_num_triangles > target_num_triangles && !m_collapses.empty() )
+		{
+			const Collapse collapse = m_collapses.top();
+			m_collapses.pop();
+			if( !m_vertex_alive[collapse.v0] || !m_vertex_alive[collapse.v1] )
+			{
+				continue;
+			}
+			if( m_vertex_stamp[collapse.v0] != collapse.stamp0 || m_vertex_stamp[collapse.v1] != collapse.stamp1 )
+			{
+				continue;
+			}
+			if( !isCollapseValid( collapse.v0, collapse.v1, collapse.position ) )
+			{
+				// pushed again when the neighborhood changes
+				continue;
+			}
+
+			applyCollapse( collapse.v0, collapse.v1, collapse.position );
+			m_geometric_error = std::max( m_geometric_error, std::sqrt( std::max( collapse.cost, 0.0 ) ) );
+			collapsed = true;
+		}
+		return collapsed;
+	}
+
+	/** Creates indexed triangles of the current state, with per face normals like TriangleMeshData::createFromMeshSet */
+	shared_ptr<TriangleMeshData> createTriangleMesh( bool single_precision ) const
+	{
+		shared_ptr<TriangleMeshData> triangle_mesh( new TriangleMeshData() );
+		triangle_mesh->m_single_precision = single_precision;
+		triangle_mesh->m_closed = m_closed;
+
+		// output vertices of each welded vertex, one per distinct normal
+		std::vector<std::vector<std::pair<vec3, uint32_t> > > vertex_outputs( m_positions.size() );
+		for( size_t ii = 0; ii < m_triangles.size(); ++ii )
+		{
+			if( !m_triangle_alive[ii] )
+			{
+				continue;
+			}
+
+			const Triangle& triangle = m_triangles[ii];
+			vec3 normal = computeNormal( m_positions[triangle.v[0]], m_positions[triangle.v[1]], m_positions[triangle.v[2]] );
+			const double length = normal.length();
+			if( length <= 0 )
+			{
+				continue;
+			}
+			normal *= 1.0 / length;
+			const vec3 normal_float = carve::geom::VECTOR( (float)normal.x, (float)normal.y, (float)normal.z );
+
+			for( int jj = 0; jj < 3; ++jj )
+			{
+				const uint32_t vertex_index = triangle.v[jj];
+				uint32_t output_index = UINT32_MAX;
+				for( const std::pair<vec3, uint32_t>& output : vertex_outputs[vertex_index] )
+				{
+					if( output.first == normal_float )
+					{
+						output_index = output.second;
+						break;
+					}
+				}
+
+				if( output_index == UINT32_MAX )
+				{
+					output_index = (uint32_t)triangle_mesh->getNumVertices();
+					const vec3& point = m_positions[vertex_index];
+					if( single_precision )
+					{
+						triangle_mesh->m_positions_float.push_back( (float)point.x );
+						triangle_mesh->m_positions_float.push_back( (float)point.y );
+						triangle_mesh->m_positions_float.push_back( (float)point.z );
+					}
+					else
+					{
+						triangle_mesh->m_positions_double.push_back( point.x );
+						triangle_mesh->m_positions_double.push_back( point.y );
+						triangle_mesh->m_positions_double.push_back( point.z );
+					}
+					triangle_mesh->m_normals.push_back( (float)normal_float.x );
+					triangle_mesh->m_normals.push_back( (float)normal_float.y );
+					triangle_mesh->m_normals.push_back( (float)normal_float.z );
+					vertex_outputs[vertex_index].push_back( { normal_float, output_index } );
+				}
+				triangle_mesh->m_indices.push_back( output_index );
+			}
+		}
+
+		triangle_mesh->m_positions_double.shrink_to_fit();
+		triangle_mesh->m_positions_float.shrink_to_fit();
+		triangle_mesh->m_normals.shrink_to_fit();
+		triangle_mesh->m_indices.shrink_to_fit();
+		return triangle_mesh;
+	}
+
+protected:
+	//\brief Symmetric 4x4 matrix of the sum of squared distances to a set of planes
+	struct Quadric
+	{
+		double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+		void addPlane( const vec3& normal, double d )
+		{
+			a2 += normal.x*normal.x;	ab += normal.x*normal.y;	ac += normal.x*normal.z;	ad += normal.x*d;
+			b2 += normal.y*normal.y;	bc += normal.y*normal.z;	bd += normal.y*d;
+			c2 += normal.z*normal.z;	cd += normal.z*d;
+			d2 += d*d;
+		}
+
+		void operator+=( const Quadric& other )
+		{
+			a2 += other.a2;	ab += other.ab;	ac += other.ac;	ad += other.ad;
+			b2 += other.b2;	bc += other.bc;	bd += other.bd;
+			c2 += other.c2;	cd += other.cd;
+			d2 += other.d2;
+		}
+
+		double evaluate( const vec3& p ) const
+		{
+			return a2*p.x*p.x + 2.0*ab*p.x*p.y + 2.0*ac*p.x*p.z + 2.0*ad*p.x
+				+ b2*p.y*p.y + 2.0*bc*p.y*p.z + 2.0*bd*p.y
+				+ c2*p.z*p.z + 2.0*cd*p.z
+				+ d2;
+		}
+
+		//\brief Point with minimal error, if the planes are not (nearly) parallel
+		bool computeMinimum( vec3& result ) const
+		{
+			const double det = a2*( b2*c2 - bc*bc ) - ab*( ab*c2 - bc*ac ) + ac*( ab*bc - b2*ac );
+			if( std::abs( det ) < 1e-8 )
+			{
+				return false;
+			}
+			const double inv_det = 1.0 / det;
+			result.x = -inv_det*( ad*( b2*c2 - bc*bc ) - ab*( bd*c2 - bc*cd ) + ac*( bd*bc - b2*cd ) );
+			result.y = -inv_det*( a2*( bd*c2 - cd*bc ) - ad*( ab*c2 - bc*ac ) + ac*( ab*cd - bd*ac ) );
+			result.z = -inv_det*( a2*( b2*cd - bc*bd ) - ab*( ab*cd - bd*ac ) + ad*( ab*bc - b2*ac ) );
+			return true;
+		}
+	};
+
+	struct Triangle
+	{
+		uint32_t v[3];
+
+		bool contains( uint32_t vertex_index ) const { return v[0] == vertex_index || v[1] == vertex_index || v[2] == vertex_index; }
+	};
+
+	struct Collapse
+	{
+		double cost;
+		uint32_t v0;
+		uint32_t v1;
+		uint32_t stamp0;
+		uint32_t stamp1;
+		vec3 position;
+
+		bool operator>( const Collapse& other ) const { return cost > other.cost; }
+	};
+
+	struct PositionHash
+	{
+		size_t operator()( const vec3& point ) const
+		{
+			size_t hash = 0;
+			for( int ii = 0; ii < 3; ++ii )
+			{
+				// +0.0 for -0.0, consistent with operator==
+				const double coord = point[ii] + 0.0;
+				uint64_t bits;
+				std::memcpy( &bits, &coord, sizeof( bits ) );
+				hash ^= std::hash<uint64_t>()( bits ) + 0x9e3779b9 + ( hash << 6 ) + ( hash >> 2 );
+			}
+			return hash;
+		}
+	};
+
+	struct PositionEqual
+	{
+		bool operator()( const vec3& a, const vec3& b ) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+	};
+
+	const size_t										m_max_valence = 24;
+	bool												m_closed = false;
+	std::vector<vec3>									m_positions;
+	std::vector<Quadric>								m_quadrics;
+	std::vector<bool>									m_vertex_alive;
+	std::vector<uint32_t>								m_vertex_stamp;
+	std::vector<std::vector<uint32_t> >					m_vertex_triangles;
+	std::vector<Triangle>								m_triangles;
+	std::vector<bool>									m_triangle_alive;
+	size_t												m_num_triangles = 0;
+	double												m_geometric_error = 0;
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > m_collapses;
+
+	static vec3 computeNormal( const vec3& p0, const vec3& p1, const vec3& p2 )
+	{
+		return carve::geom::cross( p1 - p0, p2 - p0 );
+	}
+
+	//\brief Vertices of TriangleMeshData are split at edges with different face normals. The edge collapses need the connectivity, so vertices at the same position are merged
+	void weldVertices( const TriangleMeshData& mesh )
+	{
+		std::unordered_map<vec3, uint32_t, PositionHash, PositionEqual> map_position_index;
+		std::vector<uint32_t> vertex_map( mesh.getNumVertices() );
+		for( size_t ii = 0; ii < vertex_map.size(); ++ii )
+		{
+			const vec3 point = mesh.getPosition( ii );
+			auto it_insert = map_position_index.insert( { point, (uint32_t)m_positions.size() } );
+			if( it_insert.second )
+			{
+				m_positions.push_back( point );
+			}
+			vertex_map[ii] = it_insert.first->second;
+		}
+
+		m_vertex_triangles.resize( m_positions.size() );
+		for( size_t ii = 0; ii + 2 < mesh.m_indices.size(); ii += 3 )
+		{
+			Triangle triangle = { { vertex_map[mesh.m_indices[ii]], vertex_map[mesh.m_indices[ii + 1]], vertex_map[mesh.m_indices[ii + 2]] } };
+			if( triangle.v[0] == triangle.v[1] || triangle.v[1] == triangle.v[2] || triangle.v[2] == triangle.v[0] )
+			{
+				continue;
+			}
+			const uint32_t triangle_index = (uint32_t)m_triangles.size();
+			m_triangles.push_back( triangle );
+			for( int jj = 0; jj < 3; ++jj )
+			{
+				m_vertex_triangles[triangle.v[jj]].push_back( triangle_index );
+			}
+		}
+		m_num_triangles = m_triangles.size();
+		m_triangle_alive.assign( m_triangles.size(), true );
+		m_vertex_alive.assign( m_positions.size(), true );
+		m_vertex_stamp.assign( m_positions.size(), 0 );
+	}
+
+	void initQuadrics()
+	{
+		m_quadrics.resize( m_positions.size() );
+
+		// each edge with the triangles it belongs to, to find the boundary
+		std::unordered_map<uint64_t, std::vector<uint32_t> > map_edge_triangles;
+		for( size_t ii = 0; ii < m_triangles.size(); ++ii )
+		{
+			const Triangle& triangle = m_triangles[ii];
+			const vec3& p0 = m_positions[triangle.v[0]];
+			vec3 normal = computeNormal( p0, m_positions[triangle.v[1]], m_positions[triangle.v[2]] );
+			const double length = normal.length();
+			if( length <= 0 )
+			{
+				continue;
+			}
+			normal *= 1.0 / length;
+			const double d = -carve::geom::dot( normal, p0 );
+			for( int jj = 0; jj < 3; ++jj )
+			{
+				m_quadrics[triangle.v[jj]].addPlane( normal, d );
+				map_edge_triangles[edgeKey( triangle.v[jj], triangle.v[( jj + 1 ) % 3] )].push_back( (uint32_t)ii );
+			}
+		}
+
+		// boundary edges keep their position by a plane through the edge, perpendicular to the triangle
+		for( auto it = map_edge_triangles.begin(); it != map_edge_triangles.end(); ++it )
+		{
+			if( it->second.size() != 1 )
+			{
+				continue;
+			}
+			const Triangle& triangle = m_triangles[it->second[0]];
+			const uint32_t v0 = (uint32_t)( it->first >> 32 );
+			const uint32_t v1 = (uint32_t)( it->first & 0xFFFFFFFF );
+			const vec3 face_normal = computeNormal( m_positions[triangle.v[0]], m_positions[triangle.v[1]], m_positions[triangle.v[2]] );
+			vec3 normal = carve::geom::cross( m_positions[v1] - m_positions[v0], face_normal );
+			const double length = normal.length();
+			if( length <= 0 )
+			{
+				continue;
+			}
+			normal *= 1.0 / length;
+			const double d = -carve::geom::dot( normal, m_positions[v0] );
+			m_quadrics[v0].addPlane( normal, d );
+			m_quadrics[v1].addPlane( normal, d );
+		}
+	}
+
+	void initCollapses()
+	{
+		for( const Triangle& triangle : m_triangles )
+		{
+			for( int jj = 0; jj < 3; ++jj )
+			{
+				const uint32_t v0 = triangle.v[jj];
+				const uint32_t v1 = triangle.v[( jj + 1 ) % 3];
+				// interior edges are in two triangles, add them once
+				if( v0 < v1 || !hasTriangleWithEdge( v1, v0 ) )
+				{
+					addCollapse( v0, v1 );
+				}
+			}
+		}
+	}
+
+	static uint64_t edgeKey( uint32_t v0, uint32_t v1 )
+	{
+		if( v0 > v1 )
+		{
+			std::swap( v0, v1 );
+		}
+		return ( (uint64_t)v0 << 32 ) | v1;
+	}
+
+	bool hasTriangleWithEdge( uint32_t v0, uint32_t v1 ) const
+	{
+		for( uint32_t triangle_index : m_vertex_triangles[v0] )
+		{
+			const Triangle& triangle = m_triangles[triangle_index];
+			for( int jj = 0; jj < 3; ++jj )
+			{
+				if( triangle.v[jj] == v0 && triangle.v[( jj + 1 ) % 3] == v1 )
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	void addCollapse( uint32_t v0, uint32_t v1 )
+	{
+		Quadric quadric = m_quadrics[v0];
+		quadric += m_quadrics[v1];
+
+		const vec3& p0 = m_positions[v0];
+		const vec3& p1 = m_positions[v1];
+		Collapse collapse;
+		collapse.v0 = v0;
+		collapse.v1 = v1;
+		collapse.stamp0 = m_vertex_stamp[v0];
+		collapse.stamp1 = m_vertex_stamp[v1];
+		collapse.position = p0;
+		collapse.cost = quadric.evaluate( p0 );
+
+		const vec3 candidates[2] = { p1, ( p0 + p1 )*0.5 };
+		for( const vec3& candidate : candidates )
+		{
+			const double cost = quadric.evaluate( candidate );
+			if( cost < collapse.cost )
+			{
+				collapse.cost = cost;
+				collapse.position = candidate;
+			}
+		}
+
+		vec3 minimum;
+		if( quadric.computeMinimum( minimum ) )
+		{
+			// far away from the edge, the minimum of nearly parallel planes is not stable
+			const double edge_length = ( p1 - p0 ).length();
+			if( ( minimum - ( p0 + p1 )*0.5 ).length() <= edge_length )
+			{
+				const double cost = quadric.evaluate( minimum );
+				if( cost < collapse.cost )
+				{
+					collapse.cost = cost;
+					collapse.position = minimum;
+				}
+			}
+		}
+		m_collapses.push( collapse );
+	}
+
+	//\brief Checks that the collapse keeps the mesh manifold, does not flip triangles and does not create duplicate triangles
+	bool isCollapseValid( uint32_t v0, uint32_t v1, const vec3& position ) const
+	{
+		// link condition: the common neighbors of v0 and v1 are the opposite vertices of the triangles at edge v0-v1
+		std::vector<uint32_t> neighbors0, neighbors1, opposite;
+		for( uint32_t triangle_index : m_vertex_triangles[v0] )
+		{
+			const Triangle& triangle = m_triangles[triangle_index];
+			for( int jj = 0; jj < 3; ++jj )
+			{
+				if( triangle.v[jj] != v0 )
+				{
+					neighbors0.push_back( triangle.v[jj] );
+				}
+			}
+			if( triangle.contains( v1 ) )
+			{
+				for( int jj = 0; jj < 3; ++jj )
+				{
+					if( triangle.v[jj] != v0 && triangle.v[jj] != v1 )
+					{
+						opposite.push_back( triangle.v[jj] );
+					}
+				}
+			}
+		}
+		for( uint32_t triangle_index : m_vertex_triangles[v1] )
+		{
+			const Triangle& triangle = m_triangles[triangle_index];
+			for( int jj = 0; jj < 3; ++jj )
+			{
+				if( triangle.v[jj] != v1 )
+				{
+					neighbors1.push_back( triangle.v[jj] );
+				}
+			}
+		}
+		std::sort( neighbors0.begin(), neighbors0.end() );
+		neighbors0.erase( std::unique( neighbors0.begin(), neighbors0.end() ), neighbors0.end() );
+		std::sort( neighbors1.begin(), neighbors1.end() );
+		neighbors1.erase( std::unique( neighbors1.begin(), neighbors1.end() ), neighbors1.end() );
+		std::sort( opposite.begin(), opposite.end() );
+		opposite.erase( std::unique( opposite.begin(), opposite.end() ), opposite.end() );
+
+		// collapses on flat regions have no cost and would gather into fans around a few vertices, which makes each further collapse at these vertices expensive
+		if( neighbors0.size() + neighbors1.size() > m_max_valence )
+		{
+			return false;
+		}
+
+		std::vector<uint32_t> common;
+		std::set_intersection( neighbors0.begin(), neighbors0.end(), neighbors1.begin(), neighbors1.end(), std::back_inserter( common ) );
+		if( common != opposite )
+		{
+			return false;
+		}
+
+		// a tetrahedron would collapse into two coincident triangles
+		if( neighbors0.size() <= 3 && neighbors1.size() <= 3 )
+		{
+			return false;
+		}
+
+		for( uint32_t vertex_index : { v0, v1 } )
+		{
+			for( uint32_t triangle_index : m_vertex_triangles[vertex_index] )
+			{
+				const Triangle& triangle = m_triangles[triangle_index];
+				if( triangle.contains( v0 ) && triangle.contains( v1 ) )
+				{
+					continue;
+				}
+
+				vec3 points[3];
+				for( int jj = 0; jj < 3; ++jj )
+				{
+					points[jj] = triangle.v[jj] == vertex_index ? position : m_positions[triangle.v[jj]];
+				}
+				const vec3 normal_before = computeNormal( m_positions[triangle.v[0]], m_positions[triangle.v[1]], m_positions[triangle.v[2]] );
+				const vec3 normal_after = computeNormal( points[0], points[1], points[2] );
+				const double length_after = normal_after.length();
+				if( length_after <= 0 )
+				{
+					return false;
+				}
+				if( carve::geom::dot( normal_before, normal_after ) <= 0.2*normal_before.length()*length_after )
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	void applyCollapse( uint32_t v0, uint32_t v1, const vec3& position )
+	{
+		m_positions[v0] = position;
+		m_quadrics[v0] += m_quadrics[v1];
+		m_vertex_alive[v1] = false;
+		++m_vertex_stamp[v0];
+		++m_vertex_stamp[v1];
+
+		std::vector<uint32_t> opposite;
+		for( uint32_t triangle_index : m_vertex_triangles[v1] )
+		{
+			Triangle& triangle = m_triangles[triangle_index];
+			if( triangle.contains( v0 ) )
+			{
+				m_triangle_alive[triangle_index] = false;
+				--m_num_triangles;
+				for( int jj = 0; jj < 3; ++jj )
+				{
+					if( triangle.v[jj] != v0 && triangle.v[jj] != v1 )
+					{
+						opposite.push_back( triangle.v[jj] );
+					}
+				}
+				continue;
+			}
+			for( int jj = 0; jj < 3; ++jj )
+			{
+				if( triangle.v[jj] == v1 )
+				{
+					triangle.v[jj] = v0;
+				}
+			}
+			m_vertex_triangles[v0].push_back( triangle_index );
+		}
+		std::vector<uint32_t>().swap( m_vertex_triangles[v1] );
+
+		// remove the collapsed triangles from the opposite vertices. At a boundary, an opposite vertex may be no neighbor of v0 anymore
+		for( uint32_t opposite_vertex : opposite )
+		{
+			std::vector<uint32_t>& triangles = m_vertex_triangles[opposite_vertex];
+			triangles.erase( std::remove_if( triangles.begin(), triangles.end(), [&]( uint32_t triangle_index ) { return !m_triangle_alive[triangle_index]; } ), triangles.end() );
+		}
+
+		std::vector<uint32_t> neighbors;
+		std::vector<uint32_t>& triangles0 = m_vertex_triangles[v0];
+		triangles0.erase( std::remove_if( triangles0.begin(), triangles0.end(), [&]( uint32_t triangle_index ) { return !m_triangle_alive[triangle_index]; } ), triangles0.end() );
+		for( uint32_t triangle_index : triangles0 )
+		{
+			const Triangle& triangle = m_triangles[triangle_index];
+			for( int jj = 0; jj < 3; ++jj )
+			{
+				if( triangle.v[jj] != v0 )
+				{
+					neighbors.push_back( triangle.v[jj] );
+				}
+			}
+		}
+		std::sort( neighbors.begin(), neighbors.end() );
+		neighbors.erase( std::unique( neighbors.begin(), neighbors.end() ), neighbors.end() );
+
+		for( uint32_t neighbor : neighbors )
+		{
+			addCollapse( v0, neighbor );
+		}
+	}
+};
@@ -0,0 +1,1008 @@
+/* -*-c++-*- IfcQuery www.ifcquery.com
+*
+MIT License
+
+Copyright (c) 2017 Fabian Gerold
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <unordered_set>
+#include <vector>
+#include <ifcpp/model/BasicTypes.h>
+#include <ifcpp/model/StatusCallback.h>
+#include <ifcpp/model/UnitConverter.h>
+#include <IfcAxis2Placement3D.h>
+#include <IfcBoundingBox.h>
+#include <IfcCurve.h>
+#include <IfcDirection.h>
+#include <IfcElement.h>
+#include <IfcExtrudedAreaSolid.h>
+#include <IfcFeatureElementSubtraction.h>
+#include <IfcObjectPlacement.h>
+#include <IfcPositiveLengthMeasure.h>
+#include <IfcProductRepresentation.h>
+#include <IfcReal.h>
+#include <IfcRelVoidsElement.h>
+#include <IfcRepresentation.h>
+#include <IfcRepresentationItem.h>
+
+#include "IncludeCarveHeaders.h"
+#include "GeometryInputData.h"
+#include "GeometrySettings.h"
+#include "GeomUtils.h"
+#include "PlacementConverter.h"
+#include "ProfileConverter.h"
+#include "Sweeper.h"
+
+/**\brief Subtracts openings from an extruded host without 3D boolean operations.
+  Applies if the host is a single IfcExtrudedAreaSolid and all openings are IfcExtrudedAreaSolids, extruded parallel to the host, or parallel to one of the axes of a box shaped host.
+  Openings that do not cover the full depth of the host split it into slabs. For each slab, the difference of the profiles is computed in 2D and extruded with Sweeper::extrude.
+  The 2D difference is limited to openings that lie completely inside the host profile (they become holes), and to profiles with axis aligned edges only (computed on a grid).
+  In all other cases, subtractOpenings returns false, and the caller falls back to CSG. */
+class PrismaticOpenings : public StatusCallback
+{
+protected:
+	shared_ptr<GeometrySettings>		m_geom_settings;
+	shared_ptr<UnitConverter>			m_unit_converter;
+	shared_ptr<CurveConverter>			m_curve_converter;
+	shared_ptr<SplineConverter>			m_spline_converter;
+	shared_ptr<PlacementConverter>		m_placement_converter;
+	shared_ptr<Sweeper>					m_sweeper;
+	std::atomic<size_t>					m_num_products_handled{ 0 };
+
+	//\brief Profile loops in product coordinates, and extrusion vector
+	struct Prism
+	{
+		std::vector<std::vector<vec3> >	m_loops;
+		vec3							m_extrusion;
+	};
+
+	//\brief Orthonormal coordinate system of the host: u and v in the profile plane, w in extrusion direction
+	struct PrismFrame
+	{
+		vec3	m_origin;
+		vec3	m_u;
+		vec3	m_v;
+		vec3	m_w;
+		double	m_depth = 0;
+
+		vec2 toProfile( const vec3& point ) const
+		{
+			const vec3 delta = point - m_origin;
+			return carve::geom::VECTOR( dot( delta, m_u ), dot( delta, m_v ) );
+		}
+
+		double toDepth( const vec3& point ) const
+		{
+			return dot( point - m_origin, m_w );
+		}
+	};
+
+	//\brief Opening in host coordinates: profile loop and range along w
+	struct OpeningProfile
+	{
+		std::vector<vec2>	m_loop;
+		double				m_depth_start = 0;
+		double				m_depth_end = 0;
+		vec2				m_min;
+		vec2				m_max;
+	};
+
+	typedef std::vector<std::vector<vec2> > FaceLoops;
+
+public:
+	PrismaticOpenings( shared_ptr<GeometrySettings>& gs, shared_ptr<UnitConverter>& uc, shared_ptr<CurveConverter>& cc, shared_ptr<SplineConverter>& sc, shared_ptr<PlacementConverter>& pc, shared_ptr<Sweeper>& sw )
+		: m_geom_settings( gs ), m_unit_converter( uc ), m_curve_converter( cc ), m_spline_converter( sc ), m_placement_converter( pc ), m_sweeper( sw )
+	{
+	}
+
+	virtual ~PrismaticOpenings()
+	{
+	}
+
+	void setUnitConverter( shared_ptr<UnitConverter>& unit_converter )
+	{
+		m_unit_converter = unit_converter;
+	}
+
+	/** Number of products where openings have been subtracted without CSG */
+	size_t getNumProductsHandled() const { return m_num_products_handled; }
+	void resetNumProductsHandled() { m_num_products_handled = 0; }
+
+	/** Subtracts all openings of ifc_element from product_shape, if host and openings are parallel extrusions. Returns false if the preconditions are not met, product_shape is unchanged in that case. */
+	bool subtractOpenings( const shared_ptr<IfcElement>& ifc_element, shared_ptr<ProductShapeData>& product_shape )
+	{
+		shared_ptr<ItemShapeData> host_item;
+		shared_ptr<IfcExtrudedAreaSolid> host_solid;
+		if( !findHostItem( product_shape, host_item, host_solid ) )
+		{
+			return false;
+		}
+
+		Prism host_prism;
+		carve::math::Matrix identity_matrix;
+		if( !getPrism( host_solid, identity_matrix, host_prism ) )
+		{
+			return false;
+		}
+
+		// openings in product coordinates
+		carve::math::Matrix product_matrix_inverse;
+		if( !GeomUtils::computeInverse( product_shape->getTransform(), product_matrix_inverse, 0.01 / m_unit_converter->getCustomLengthFactor() ) )
+		{
+			return false;
+		}
+
+		std::vector<Prism> vec_opening_prisms;
+		for( auto& rel_voids_weak : ifc_element->m_HasOpenings_inverse )
+		{
+			if( rel_voids_weak.expired() )
+			{
+				continue;
+			}
+			shared_ptr<IfcRelVoidsElement> rel_voids( rel_voids_weak );
+			shared_ptr<IfcFeatureElementSubtraction> opening = rel_voids->m_RelatedOpeningElement;
+			if( !opening )
+			{
+				continue;
+			}
+			if( !opening->m_Representation )
+			{
+				continue;
+			}
+
+			shared_ptr<IfcExtrudedAreaSolid> opening_solid;
+			if( !findOpeningSolid( opening, opening_solid ) )
+			{
+				return false;
+			}
+			if( !opening_solid )
+			{
+				// no volume to subtract
+				continue;
+			}
+
+			shared_ptr<ProductShapeData> opening_placement_data( new ProductShapeData() );
+			if( opening->m_ObjectPlacement )
+			{
+				std::unordered_set<IfcObjectPlacement*> opening_placements_applied;
+				m_placement_converter->convertIfcObjectPlacement( opening->m_ObjectPlacement, opening_placement_data, opening_placements_applied, false );
+			}
+			carve::math::Matrix opening_matrix = product_matrix_inverse*opening_placement_data->getTransform();
+
+			Prism opening_prism;
+			if( !getPrism( opening_solid, opening_matrix, opening_prism ) )
+			{
+				return false;
+			}
+			vec_opening_prisms.push_back( opening_prism );
+		}
+
+		// try the extrusion direction of the host first. A box can be seen as extrusion along any of its edges, so walls with openings through the thickness qualify too
+		std::vector<Prism> host_candidates;
+		host_candidates.push_back( host_prism );
+		getBoxAlternatives( host_prism, host_candidates );
+
+		for( const Prism& host_candidate : host_candidates )
+		{
+			PrismFrame frame;
+			if( !computeFrame( host_candidate, frame ) )
+			{
+				continue;
+			}
+
+			std::vector<shared_ptr<carve::mesh::MeshSet<3> > > vec_result_meshsets;
+			bool host_unchanged = false;
+			if( subtractInFrame( host_candidate, frame, vec_opening_prisms, vec_result_meshsets, host_unchanged, ifc_element ) )
+			{
+				if( !host_unchanged )
+				{
+					host_item->m_meshsets = vec_result_meshsets;
+				}
+				++m_num_products_handled;
+				return true;
+			}
+		}
+		return false;
+	}
+
+protected:
+	static bool hasMeshes( const shared_ptr<ItemShapeData>& item )
+	{
+		if( item->m_meshsets.size() > 0 || item->m_meshsets_open.size() > 0 || item->m_triangle_meshes.size() > 0 )
+		{
+			return true;
+		}
+		for( const shared_ptr<ItemShapeData>& child_item : item->m_child_items )
+		{
+			if( child_item && hasMeshes( child_item ) )
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//\brief The product needs to consist of one IfcExtrudedAreaSolid, that is not inside a mapped item. Other items must not have meshes
+	static bool findHostItem( const shared_ptr<ProductShapeData>& product_shape, shared_ptr<ItemShapeData>& host_item, shared_ptr<IfcExtrudedAreaSolid>& host_solid )
+	{
+		size_t num_items_with_meshes = 0;
+		for( const shared_ptr<ItemShapeData>& representation_item : product_shape->m_geometric_items )
+		{
+			if( !representation_item )
+			{
+				continue;
+			}
+			if( !hasMeshes( representation_item ) )
+			{
+				continue;
+			}
+			if( representation_item->m_meshsets.size() > 0 || representation_item->m_meshsets_open.size() > 0 )
+			{
+				return false;
+			}
+
+			for( const shared_ptr<ItemShapeData>& child_item : representation_item->m_child_items )
+			{
+				if( !child_item )
+				{
+					continue;
+				}
+				if( !hasMeshes( child_item ) )
+				{
+					continue;
+				}
+				++num_items_with_meshes;
+				if( num_items_with_meshes > 1 )
+				{
+					return false;
+				}
+
+				if( child_item->m_child_items.size() > 0 || child_item->m_meshsets_open.size() > 0 )
+				{
+					return false;
+				}
+				host_solid = dynamic_pointer_cast<IfcExtrudedAreaSolid>( child_item->m_ifc_item );
+				if( !host_solid )
+				{
+					return false;
+				}
+				host_item = child_item;
+			}
+		}
+		return num_items_with_meshes == 1;
+	}
+
+	//\brief The opening needs to consist of one IfcExtrudedAreaSolid. Items without volume are ignored, anything else is left to CSG
+	static bool findOpeningSolid( const shared_ptr<IfcFeatureElementSubtraction>& opening, shared_ptr<IfcExtrudedAreaSolid>& opening_solid )
+	{
+		for( const shared_ptr<IfcRepresentation>& ifc_representation : opening->m_Representation->m_Representations )
+		{
+			if( !ifc_representation )
+			{
+				continue;
+			}
+			for( const shared_ptr<IfcRepresentationItem>& representation_item : ifc_representation->m_Items )
+			{
+				if( !representation_item )
+				{
+					continue;
+				}
+				if( dynamic_pointer_cast<IfcBoundingBox>( representation_item ) || dynamic_pointer_cast<IfcCurve>( representation_item ) )
+				{
+					continue;
+				}
+				shared_ptr<IfcExtrudedAreaSolid> extruded_solid = dynamic_pointer_cast<IfcExtrudedAreaSolid>( representation_item );
+				if( !extruded_solid || opening_solid )
+				{
+					return false;
+				}
+				opening_solid = extruded_solid;
+			}
+		}
+		return true;
+	}
+
+	//\brief Computes profile and extrusion of an IfcExtrudedAreaSolid the same way as SolidModelConverter, and transforms them with item_matrix
+	bool getPrism( const shared_ptr<IfcExtrudedAreaSolid>& extruded_area, const carve::math::Matrix& item_matrix, Prism& prism )
+	{
+		if( !extruded_area->m_ExtrudedDirection || !extruded_area->m_Depth || !extruded_area->m_SweptArea )
+		{
+			return false;
+		}
+
+		const double length_factor = m_unit_converter->getLengthInMeterFactor();
+		const double depth = extruded_area->m_Depth->m_value*length_factor;
+		std::vector<shared_ptr<IfcReal> >& vec_direction = extruded_area->m_ExtrudedDirection->m_DirectionRatios;
+		if( !GeomUtils::allPointersValid( vec_direction ) || vec_direction.size() < 2 )
+		{
+			return false;
+		}
+		vec3 extrusion_vector = carve::geom::VECTOR( vec_direction[0]->m_value * depth, vec_direction[1]->m_value * depth, 0 );
+		if( vec_direction.size() > 2 )
+		{
+			extrusion_vector.z = vec_direction[2]->m_value * depth;
+		}
+
+		// only extrusions perpendicular to the profile
+		const double extrusion_length = extrusion_vector.length();
+		if( extrusion_length < EPS_M6 )
+		{
+			return false;
+		}
+		if( std::abs( extrusion_vector.x ) > EPS_M9*extrusion_length || std::abs( extrusion_vector.y ) > EPS_M9*extrusion_length )
+		{
+			return false;
+		}
+
+		// the cached ProfileConverter is modified by SolidModelConverter in other threads, so compute the profile here
+		ProfileConverter profile_converter( m_curve_converter, m_spline_converter );
+		profile_converter.setMessageTarget( this );
+		profile_converter.computeProfile( extruded_area->m_SweptArea );
+		std::vector<std::vector<vec2> > paths = profile_converter.getCoordinates();
+		profile_converter.simplifyPaths( paths );
+
+		carve::math::Matrix matrix = item_matrix;
+		if( extruded_area->m_Position )
+		{
+			shared_ptr<TransformData> position_transform;
+			m_placement_converter->convertIfcAxis2Placement3D( extruded_area->m_Position, position_transform );
+			if( position_transform )
+			{
+				matrix = item_matrix*position_transform->m_matrix;
+			}
+		}
+
+		for( std::vector<vec2>& path : paths )
+		{
+			bool mergeAlignedEdges = true;
+			GeomUtils::simplifyPolygon( path, mergeAlignedEdges );
+			GeomUtils::unClosePolygon( path );
+			if( path.size() < 3 )
+			{
+				continue;
+			}
+			if( std::abs( GeomUtils::signedArea( path ) ) < EPS_DEFAULT )
+			{
+				continue;
+			}
+
+			std::vector<vec3> loop;
+			for( const vec2& point : path )
+			{
+				loop.push_back( matrix*carve::geom::VECTOR( point.x, point.y, 0 ) );
+			}
+			prism.m_loops.push_back( loop );
+		}
+
+		if( prism.m_loops.size() == 0 )
+		{
+			return false;
+		}
+
+		// outer loop first
+		std::stable_sort( prism.m_loops.begin(), prism.m_loops.end(), []( const std::vector<vec3>& a, const std::vector<vec3>& b ) { return a.size() > 0 && b.size() > 0 && loopArea( a ) > loopArea( b ); } );
+
+		prism.m_extrusion = matrix*extrusion_vector - matrix*carve::geom::VECTOR( 0, 0, 0 );
+		return true;
+	}
+
+	static double loopArea( const std::vector<vec3>& loop )
+	{
+		vec3 normal = carve::geom::VECTOR( 0, 0, 0 );
+		for( size_t ii = 0; ii < loop.size(); ++ii )
+		{
+			normal += cross( loop[ii], loop[( ii + 1 ) % loop.size()] );
+		}
+		return 0.5*normal.length();
+	}
+
+	//\brief If the host is a box, adds the prisms along the two other axes
+	static void getBoxAlternatives( const Prism& host, std::vector<Prism>& host_candidates )
+	{
+		if( host.m_loops.size() != 1 || host.m_loops[0].size() != 4 )
+		{
+			return;
+		}
+
+		const std::vector<vec3>& corners = host.m_loops[0];
+		const vec3 edge0 = corners[1] - corners[0];
+		const vec3 edge1 = corners[2] - corners[1];
+		const vec3 edge2 = corners[3] - corners[2];
+		const vec3 edge3 = corners[0] - corners[3];
+		const double eps = EPS_M6;
+		if( std::abs( dot( edge0.normalized(), edge1.normalized() ) ) > eps || ( edge0 + edge2 ).length() > eps || ( edge1 + edge3 ).length() > eps )
+		{
+			return;
+		}
+
+		const vec3& extrusion = host.m_extrusion;
+
+		// extrusion along edge0, starting at the face through corners 0 and 3
+		Prism along_edge0;
+		along_edge0.m_loops.push_back( { corners[0], corners[3], corners[3] + extrusion, corners[0] + extrusion } );
+		along_edge0.m_extrusion = edge0;
+		host_candidates.push_back( along_edge0 );
+
+		// extrusion along edge1, starting at the face through corners 1 and 0
+		Prism along_edge1;
+		along_edge1.m_loops.push_back( { corners[1], corners[0], corners[0] + extrusion, corners[1] + extrusion } );
+		along_edge1.m_extrusion = edge1;
+		host_candidates.push_back( along_edge1 );
+	}
+
+	static bool computeFrame( const Prism& host, PrismFrame& frame )
+	{
+		frame.m_depth = host.m_extrusion.length();
+		if( frame.m_depth < EPS_M6 )
+		{
+			return false;
+		}
+		frame.m_w = host.m_extrusion/frame.m_depth;
+
+		const std::vector<vec3>& outer_loop = host.m_loops[0];
+		frame.m_origin = outer_loop[0];
+		for( size_t ii = 1; ii < outer_loop.size(); ++ii )
+		{
+			vec3 edge = outer_loop[ii] - outer_loop[0];
+			edge = edge - frame.m_w*dot( edge, frame.m_w );
+			if( edge.length() > EPS_M6 )
+			{
+				frame.m_u = edge.normalized();
+				frame.m_v = cross( frame.m_w, frame.m_u );
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static bool isPointInLoop( const vec2& point, const std::vector<vec2>& loop )
+	{
+		bool inside = false;
+		for( size_t ii = 0, jj = loop.size() - 1; ii < loop.size(); jj = ii++ )
+		{
+			const vec2& pi = loop[ii];
+			const vec2& pj = loop[jj];
+			if( ( pi.y > point.y ) != ( pj.y > point.y ) )
+			{
+				const double x_intersect = pj.x + ( point.y - pj.y )*( pi.x - pj.x )/( pi.y - pj.y );
+				if( point.x < x_intersect )
+				{
+					inside = !inside;
+				}
+			}
+		}
+		return inside;
+	}
+
+	static double distancePointSegment( const vec2& point, const vec2& a, const vec2& b )
+	{
+		const vec2 ab = b - a;
+		const double length2 = dot( ab, ab );
+		double t = 0;
+		if( length2 > 0 )
+		{
+			t = std::max( 0.0, std::min( 1.0, dot( point - a, ab )/length2 ) );
+		}
+		return ( a + ab*t - point ).length();
+	}
+
+	//\brief True if the segments intersect or come closer than eps
+	static bool segmentsTouch( const vec2& a0, const vec2& a1, const vec2& b0, const vec2& b1, double eps )
+	{
+		const double o1 = carve::geom2d::orient2d( a0, a1, b0 );
+		const double o2 = carve::geom2d::orient2d( a0, a1, b1 );
+		const double o3 = carve::geom2d::orient2d( b0, b1, a0 );
+		const double o4 = carve::geom2d::orient2d( b0, b1, a1 );
+		if( ( ( o1 > 0 && o2 < 0 ) || ( o1 < 0 && o2 > 0 ) ) && ( ( o3 > 0 && o4 < 0 ) || ( o3 < 0 && o4 > 0 ) ) )
+		{
+			return true;
+		}
+		return distancePointSegment( a0, b0, b1 ) < eps || distancePointSegment( a1, b0, b1 ) < eps
+			|| distancePointSegment( b0, a0, a1 ) < eps || distancePointSegment( b1, a0, a1 ) < eps;
+	}
+
+	static bool loopsTouch( const std::vector<vec2>& loop_a, const std::vector<vec2>& loop_b, double eps )
+	{
+		for( size_t ii = 0; ii < loop_a.size(); ++ii )
+		{
+			const vec2& a0 = loop_a[ii];
+			const vec2& a1 = loop_a[( ii + 1 ) % loop_a.size()];
+			for( size_t jj = 0; jj < loop_b.size(); ++jj )
+			{
+				if( segmentsTouch( a0, a1, loop_b[jj], loop_b[( jj + 1 ) % loop_b.size()], eps ) )
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	static void computeBounds( const std::vector<vec2>& loop, vec2& min, vec2& max )
+	{
+		min = loop[0];
+		max = loop[0];
+		for( const vec2& point : loop )
+		{
+			min.x = std::min( min.x, point.x );
+			min.y = std::min( min.y, point.y );
+			max.x = std::max( max.x, point.x );
+			max.y = std::max( max.y, point.y );
+		}
+	}
+
+	static bool boundsOverlap( const vec2& min_a, const vec2& max_a, const vec2& min_b, const vec2& max_b, double eps )
+	{
+		return min_a.x <= max_b.x + eps && min_b.x <= max_a.x + eps && min_a.y <= max_b.y + eps && min_b.y <= max_a.y + eps;
+	}
+
+	bool subtractInFrame( const Prism& host, const PrismFrame& frame, const std::vector<Prism>& vec_opening_prisms, std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& vec_result_meshsets,
+		bool& host_unchanged, const shared_ptr<IfcElement>& ifc_element )
+	{
+		const double eps = EPS_M6;
+
+		FaceLoops host_loops;
+		for( const std::vector<vec3>& loop : host.m_loops )
+		{
+			std::vector<vec2> loop_2d;
+			for( const vec3& point : loop )
+			{
+				if( std::abs( frame.toDepth( point ) ) > eps )
+				{
+					return false;
+				}
+				loop_2d.push_back( frame.toProfile( point ) );
+			}
+			host_loops.push_back( loop_2d );
+		}
+
+		// openings in the profile plane of the host, with their range along the extrusion
+		std::vector<OpeningProfile> vec_openings;
+		for( const Prism& opening_prism : vec_opening_prisms )
+		{
+			const double opening_depth = opening_prism.m_extrusion.length();
+			if( cross( opening_prism.m_extrusion/opening_depth, frame.m_w ).length() > EPS_M9 )
+			{
+				return false;
+			}
+			if( opening_prism.m_loops.size() != 1 )
+			{
+				return false;
+			}
+
+			OpeningProfile opening;
+			const std::vector<vec3>& opening_loop = opening_prism.m_loops[0];
+			for( const vec3& point : opening_loop )
+			{
+				opening.m_loop.push_back( frame.toProfile( point ) );
+			}
+			const double depth0 = frame.toDepth( opening_loop[0] );
+			const double depth1 = depth0 + dot( opening_prism.m_extrusion, frame.m_w );
+			opening.m_depth_start = std::min( depth0, depth1 );
+			opening.m_depth_end = std::max( depth0, depth1 );
+			if( opening.m_depth_end < eps || opening.m_depth_start > frame.m_depth - eps )
+			{
+				// outside of the host
+				continue;
+			}
+			computeBounds( opening.m_loop, opening.m_min, opening.m_max );
+			vec_openings.push_back( opening );
+		}
+
+		// openings that end inside the host split it into slabs
+		std::vector<double> slab_bounds = { 0, frame.m_depth };
+		for( const OpeningProfile& opening : vec_openings )
+		{
+			for( double depth : { opening.m_depth_start, opening.m_depth_end } )
+			{
+				if( depth > eps && depth < frame.m_depth - eps )
+				{
+					slab_bounds.push_back( depth );
+				}
+			}
+		}
+		std::sort( slab_bounds.begin(), slab_bounds.end() );
+		std::vector<double> slab_bounds_unique;
+		for( double depth : slab_bounds )
+		{
+			if( slab_bounds_unique.size() == 0 || depth - slab_bounds_unique.back() > eps )
+			{
+				slab_bounds_unique.push_back( depth );
+			}
+		}
+		slab_bounds_unique.back() = frame.m_depth;
+
+		// adjacent slabs with the same openings are extruded together
+		std::vector<std::vector<size_t> > vec_slab_openings;
+		std::vector<std::pair<double, double> > vec_slab_ranges;
+		for( size_t ii = 0; ii + 1 < slab_bounds_unique.size(); ++ii )
+		{
+			const double slab_start = slab_bounds_unique[ii];
+			const double slab_end = slab_bounds_unique[ii + 1];
+			std::vector<size_t> slab_openings;
+			for( size_t jj = 0; jj < vec_openings.size(); ++jj )
+			{
+				if( vec_openings[jj].m_depth_start < slab_start + eps && vec_openings[jj].m_depth_end > slab_end - eps )
+				{
+					slab_openings.push_back( jj );
+				}
+			}
+
+			if( vec_slab_openings.size() > 0 && vec_slab_openings.back() == slab_openings )
+			{
+				vec_slab_ranges.back().second = slab_end;
+				continue;
+			}
+			vec_slab_openings.push_back( slab_openings );
+			vec_slab_ranges.push_back( { slab_start, slab_end } );
+		}
+
+		host_unchanged = true;
+		std::vector<std::vector<FaceLoops> > vec_slab_faces( vec_slab_openings.size() );
+		for( size_t ii = 0; ii < vec_slab_openings.size(); ++ii )
+		{
+			std::vector<const OpeningProfile*> slab_openings;
+			for( size_t opening_index : vec_slab_openings[ii] )
+			{
+				slab_openings.push_back( &vec_openings[opening_index] );
+			}
+
+			bool slab_unchanged = false;
+			if( !subtractProfilesAsHoles( host_loops, slab_openings, vec_slab_faces[ii], slab_unchanged ) )
+			{
+				vec_slab_faces[ii].clear();
+				if( !subtractProfilesOnGrid( host_loops, slab_openings, vec_slab_faces[ii], slab_unchanged ) )
+				{
+					return false;
+				}
+			}
+			if( !slab_unchanged )
+			{
+				host_unchanged = false;
+			}
+		}
+
+		if( host_unchanged )
+		{
+			return true;
+		}
+
+		GeomProcessingParams params( m_geom_settings, ifc_element.get(), this );
+		for( size_t ii = 0; ii < vec_slab_faces.size(); ++ii )
+		{
+			const double slab_start = vec_slab_ranges[ii].first;
+			const double slab_end = vec_slab_ranges[ii].second;
+			const vec3 slab_origin = frame.m_origin + frame.m_w*slab_start;
+			carve::math::Matrix slab_matrix( frame.m_u.x, frame.m_v.x, frame.m_w.x, slab_origin.x,
+				frame.m_u.y, frame.m_v.y, frame.m_w.y, slab_origin.y,
+				frame.m_u.z, frame.m_v.z, frame.m_w.z, slab_origin.z,
+				0, 0, 0, 1 );
+
+			for( const FaceLoops& face_loops : vec_slab_faces[ii] )
+			{
+				shared_ptr<ItemShapeData> slab_item( new ItemShapeData() );
+				m_sweeper->extrude( face_loops, carve::geom::VECTOR( 0, 0, slab_end - slab_start ), slab_item, params );
+				if( slab_item->m_meshsets.size() == 0 || slab_item->m_meshsets_open.size() > 0 )
+				{
+					return false;
+				}
+				slab_item->applyTransformToItem( slab_matrix, params.epsMergePoints, true );
+				std::copy( slab_item->m_meshsets.begin(), slab_item->m_meshsets.end(), std::back_inserter( vec_result_meshsets ) );
+			}
+		}
+		return true;
+	}
+
+	//\brief Openings that are strictly inside the host profile are added as holes. Fails if any opening touches the boundary or another opening
+	static bool subtractProfilesAsHoles( const FaceLoops& host_loops, const std::vector<const OpeningProfile*>& slab_openings, std::vector<FaceLoops>& result_faces, bool& unchanged )
+	{
+		const double eps = EPS_M6;
+		const std::vector<vec2>& host_outer = host_loops[0];
+		vec2 host_min, host_max;
+		computeBounds( host_outer, host_min, host_max );
+
+		FaceLoops face_loops = host_loops;
+		std::vector<const OpeningProfile*> holes;
+		for( const OpeningProfile* opening : slab_openings )
+		{
+			if( !boundsOverlap( opening->m_min, opening->m_max, host_min, host_max, eps ) )
+			{
+				continue;
+			}
+
+			for( const std::vector<vec2>& host_loop : host_loops )
+			{
+				if( loopsTouch( opening->m_loop, host_loop, eps ) )
+				{
+					return false;
+				}
+			}
+
+			// without touching edges, the loops are either nested or disjoint
+			if( !isPointInLoop( opening->m_loop[0], host_outer ) )
+			{
+				if( isPointInLoop( host_outer[0], opening->m_loop ) )
+				{
+					return false;
+				}
+				continue;
+			}
+			for( size_t jj = 1; jj < host_loops.size(); ++jj )
+			{
+				const std::vector<vec2>& host_hole = host_loops[jj];
+				if( isPointInLoop( opening->m_loop[0], host_hole ) || isPointInLoop( host_hole[0], opening->m_loop ) )
+				{
+					return false;
+				}
+			}
+
+			for( const OpeningProfile* hole : holes )
+			{
+				if( !boundsOverlap( opening->m_min, opening->m_max, hole->m_min, hole->m_max, eps ) )
+				{
+					continue;
+				}
+				if( loopsTouch( opening->m_loop, hole->m_loop, eps ) || isPointInLoop( opening->m_loop[0], hole->m_loop ) || isPointInLoop( hole->m_loop[0], opening->m_loop ) )
+				{
+					return false;
+				}
+			}
+			holes.push_back( opening );
+			face_loops.push_back( opening->m_loop );
+		}
+
+		unchanged = holes.size() == 0;
+		result_faces.push_back( face_loops );
+		return true;
+	}
+
+	//\brief Difference of profiles with axis aligned edges. The plane is divided into cells by all edges, and the boundary of the remaining cells is traced
+	static bool subtractProfilesOnGrid( const FaceLoops& host_loops, const std::vector<const OpeningProfile*>& slab_openings, std::vector<FaceLoops>& result_faces, bool& unchanged )
+	{
+		const double eps = EPS_M6;
+		std::vector<const std::vector<vec2>*> all_loops;
+		for( const std::vector<vec2>& host_loop : host_loops )
+		{
+			all_loops.push_back( &host_loop );
+		}
+		for( const OpeningProfile* opening : slab_openings )
+		{
+			all_loops.push_back( &opening->m_loop );
+		}
+
+		std::vector<double> grid_x, grid_y;
+		for( const std::vector<vec2>* loop : all_loops )
+		{
+			for( size_t ii = 0; ii < loop->size(); ++ii )
+			{
+				const vec2& p0 = ( *loop )[ii];
+				const vec2& p1 = ( *loop )[( ii + 1 ) % loop->size()];
+				if( std::abs( p1.x - p0.x ) > eps && std::abs( p1.y - p0.y ) > eps )
+				{
+					return false;
+				}
+				grid_x.push_back( p0.x );
+				grid_y.push_back( p0.y );
+			}
+		}
+
+		auto mergeCoordinates = [eps]( std::vector<double>& coords )
+		{
+			std::sort( coords.begin(), coords.end() );
+			std::vector<double> merged;
+			for( double coord : coords )
+			{
+				if( merged.size() == 0 || coord - merged.back() > eps )
+				{
+					merged.push_back( coord );
+				}
+			}
+			coords = merged;
+		};
+		mergeCoordinates( grid_x );
+		mergeCoordinates( grid_y );
+		if( grid_x.size() < 2 || grid_y.size() < 2 )
+		{
+			return false;
+		}
+
+		const size_t num_cells_x = grid_x.size() - 1;
+		const size_t num_cells_y = grid_y.size() - 1;
+		if( num_cells_x*num_cells_y > 1000000 )
+		{
+			return false;
+		}
+
+		// classify cells by their center points
+		std::vector<char> cell_solid( num_cells_x*num_cells_y, 0 );
+		auto cellCenter = [&]( size_t ix, size_t iy ) { return carve::geom::VECTOR( 0.5*( grid_x[ix] + grid_x[ix + 1] ), 0.5*( grid_y[iy] + grid_y[iy + 1] ) ); };
+		auto markLoop = [&]( const std::vector<vec2>& loop, char value )
+		{
+			vec2 loop_min, loop_max;
+			computeBounds( loop, loop_min, loop_max );
+			const size_t ix_begin = std::lower_bound( grid_x.begin(), grid_x.end(), loop_min.x - eps ) - grid_x.begin();
+			const size_t iy_begin = std::lower_bound( grid_y.begin(), grid_y.end(), loop_min.y - eps ) - grid_y.begin();
+			for( size_t ix = ix_begin; ix < num_cells_x && grid_x[ix] < loop_max.x - eps; ++ix )
+			{
+				for( size_t iy = iy_begin; iy < num_cells_y && grid_y[iy] < loop_max.y - eps; ++iy )
+				{
+					if( isPointInLoop( cellCenter( ix, iy ), loop ) )
+					{
+						cell_solid[ix*num_cells_y + iy] = value;
+					}
+				}
+			}
+		};
+
+		markLoop( host_loops[0], 1 );
+		for( size_t ii = 1; ii < host_loops.size(); ++ii )
+		{
+			markLoop( host_loops[ii], 0 );
+		}
+		const std::vector<char> cell_solid_host = cell_solid;
+		for( const OpeningProfile* opening : slab_openings )
+		{
+			markLoop( opening->m_loop, 0 );
+		}
+		unchanged = cell_solid == cell_solid_host;
+		if( unchanged )
+		{
+			result_faces.push_back( host_loops );
+			return true;
+		}
+
+		auto isSolid = [&]( long long ix, long long iy )
+		{
+			if( ix < 0 || iy < 0 || ix >= (long long)num_cells_x || iy >= (long long)num_cells_y )
+			{
+				return false;
+			}
+			return cell_solid[ix*num_cells_y + iy] != 0;
+		};
+
+		// directed boundary edges with solid cells on the left side. Directions: 0: +x, 1: +y, 2: -x, 3: -y
+		const long long num_vertices_y = (long long)num_cells_y + 1;
+		const int step_x[4] = { 1, 0, -1, 0 };
+		const int step_y[4] = { 0, 1, 0, -1 };
+		const int left_cell_x[4] = { 0, -1, -1, 0 };
+		const int left_cell_y[4] = { 0, 0, -1, -1 };
+		std::vector<unsigned char> vertex_edges( ( num_cells_x + 1 )*num_vertices_y, 0 );
+		for( long long ix = 0; ix < (long long)num_cells_x; ++ix )
+		{
+			for( long long iy = 0; iy < (long long)num_cells_y; ++iy )
+			{
+				if( !isSolid( ix, iy ) )
+				{
+					continue;
+				}
+				if( !isSolid( ix, iy - 1 ) ) vertex_edges[ix*num_vertices_y + iy] |= 1;
+				if( !isSolid( ix + 1, iy ) ) vertex_edges[( ix + 1 )*num_vertices_y + iy] |= 2;
+				if( !isSolid( ix, iy + 1 ) ) vertex_edges[( ix + 1 )*num_vertices_y + iy + 1] |= 4;
+				if( !isSolid( ix - 1, iy ) ) vertex_edges[ix*num_vertices_y + iy + 1] |= 8;
+			}
+		}
+
+		// trace loops. At vertices with two outgoing edges, the leftmost turn keeps touching components apart
+		std::vector<std::vector<vec2> > outer_loops;
+		std::vector<std::vector<vec2> > hole_loops;
+		std::vector<vec2> hole_test_points;
+		std::vector<unsigned char> vertex_edges_used( vertex_edges.size(), 0 );
+		for( long long start_vertex = 0; start_vertex < (long long)vertex_edges.size(); ++start_vertex )
+		{
+			for( int start_direction = 0; start_direction < 4; ++start_direction )
+			{
+				const unsigned char start_mask = (unsigned char)( 1 << start_direction );
+				if( !( vertex_edges[start_vertex] & start_mask ) || ( vertex_edges_used[start_vertex] & start_mask ) )
+				{
+					continue;
+				}
+
+				std::vector<long long> loop_vertices;
+				std::vector<int> loop_directions;
+				long long vertex = start_vertex;
+				int direction = start_direction;
+				while( true )
+				{
+					vertex_edges_used[vertex] |= (unsigned char)( 1 << direction );
+					loop_vertices.push_back( vertex );
+					loop_directions.push_back( direction );
+
+					const long long next_vertex = vertex + step_x[direction]*num_vertices_y + step_y[direction];
+					int next_direction = -1;
+					for( int turn : { 1, 0, 3 } )
+					{
+						const int candidate = ( direction + turn ) % 4;
+						if( vertex_edges[next_vertex] & ( 1 << candidate ) )
+						{
+							next_direction = candidate;
+							break;
+						}
+					}
+					if( next_direction < 0 )
+					{
+						return false;
+					}
+					if( vertex_edges_used[next_vertex] & ( 1 << next_direction ) )
+					{
+						break;
+					}
+					vertex = next_vertex;
+					direction = next_direction;
+				}
+
+				std::vector<vec2> loop;
+				for( size_t ii = 0; ii < loop_vertices.size(); ++ii )
+				{
+					const int incoming_direction = loop_directions[( ii + loop_directions.size() - 1 ) % loop_directions.size()];
+					if( incoming_direction != loop_directions[ii] )
+					{
+						const long long ix = loop_vertices[ii]/num_vertices_y;
+						const long long iy = loop_vertices[ii]%num_vertices_y;
+						loop.push_back( carve::geom::VECTOR( grid_x[ix], grid_y[iy] ) );
+					}
+				}
+				if( loop.size() < 4 )
+				{
+					return false;
+				}
+
+				if( GeomUtils::signedArea( loop ) > 0 )
+				{
+					outer_loops.push_back( loop );
+				}
+				else
+				{
+					const long long ix = loop_vertices[0]/num_vertices_y + left_cell_x[loop_directions[0]];
+					const long long iy = loop_vertices[0]%num_vertices_y + left_cell_y[loop_directions[0]];
+					hole_loops.push_back( loop );
+					hole_test_points.push_back( cellCenter( ix, iy ) );
+				}
+			}
+		}
+
+		for( const std::vector<vec2>& outer_loop : outer_loops )
+		{
+			result_faces.push_back( { outer_loop } );
+		}
+
+		// each hole belongs to the smallest outer loop around the solid cell next to it
+		for( size_t ii = 0; ii < hole_loops.size(); ++ii )
+		{
+			size_t best_outer = outer_loops.size();
+			double best_area = 0;
+			for( size_t jj = 0; jj < outer_loops.size(); ++jj )
+			{
+				if( !isPointInLoop( hole_test_points[ii], outer_loops[jj] ) )
+				{
+					continue;
+				}
+				const double area = GeomUtils::signedArea( outer_loops[jj] );
+				if( best_outer == outer_loops.size() || area < best_area )
+				{
+					best_outer = jj;
+					best_area = area;
+				}
+			}
+			if( best_outer == outer_loops.size() )
+			{
+				return false;
+			}
+			result_faces[best_outer].push_back( hole_loops[ii] );
+		}
+		return true;
+	}
+};
@@ -0,0 +1,810 @@
+/* -*-c++-*- IfcQuery www.ifcquery.com
+*
+MIT License
+
+Copyright (c) 2017 Fabian Gerold
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <queue>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <ifcpp/model/BasicTypes.h>
+#include <ifcpp/model/OpenMPIncludes.h>
+#include <ifcpp/IFC4X3/include/IfcFeatureElementSubtraction.h>
+#include <ifcpp/IFC4X3/include/IfcProduct.h>
+#include "GeometryInputData.h"
+#include "IncludeCarveHeaders.h"
+
+/**
+*\brief Class ProductBVH: bounding volume hierarchy over the world coordinate bounding boxes of converted products, or of their geometric items.
+*
+* The tree is built with the surface area heuristic and stored in one array of nodes, the two children of a node are adjacent.
+* Queries are const and can run concurrently. updateProduct refits the boxes after the geometry of a product changed, which is cheap,
+* but the tree quality degrades if products move far, then build should be called again.
+*/
+class ProductBVH
+{
+public:
+	struct Element
+	{
+		shared_ptr<ProductShapeData>	m_product;
+		shared_ptr<ItemShapeData>		m_item;		// nullptr if the element is the whole product
+		vec3							m_min;
+		vec3							m_max;
+	};
+
+	struct Node
+	{
+		vec3		m_min;
+		vec3		m_max;
+		uint32_t	m_first = 0;		// leaf: first position in m_element_order. Inner node: index of the left child, the right child follows
+		uint32_t	m_count = 0;		// number of elements of a leaf, 0 for inner nodes
+	};
+
+	struct RayHit
+	{
+		size_t m_element;
+		double m_distance;		// distance along the ray where it enters the bounding box of the element
+	};
+
+protected:
+	std::vector<Element>		m_elements;
+	std::vector<Node>			m_nodes;
+	std::vector<uint32_t>		m_element_order;	// element indices, each leaf refers to a contiguous range
+	std::vector<uint32_t>		m_parents;			// parent node of each node
+	std::vector<uint32_t>		m_element_leaf;		// leaf node of each element
+	std::unordered_map<const ProductShapeData*, std::vector<size_t> > m_map_product_elements;
+	size_t						m_max_depth = 0;
+	size_t						m_max_leaf_size = 4;
+
+	static constexpr size_t NUM_BINS = 16;
+	static constexpr size_t MIN_PARALLEL_BUILD_SIZE = 4096;
+	static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+public:
+	const std::vector<Element>& getElements() const { return m_elements; }
+	const std::vector<Node>& getNodes() const { return m_nodes; }
+	const Element& getElement( size_t element_index ) const { return m_elements[element_index]; }
+
+	//\brief Elements per leaf, smaller leaves make queries faster but the tree larger
+	void setMaxLeafSize( size_t max_leaf_size ) { m_max_leaf_size = std::max( size_t( 1 ), max_leaf_size ); }
+
+	/**
+	*\brief Collects the products of map_shape_data (result of GeometryConverter::getShapeInputData) and builds the tree.
+	*\param per_item		One element per geometric item of a product instead of one per product
+	*/
+	void build( const std::map<std::string, shared_ptr<ProductShapeData> >& map_shape_data, bool per_item )
+	{
+		std::vector<shared_ptr<ProductShapeData> > vec_products;
+		for( auto it = map_shape_data.begin(); it != map_shape_data.end(); ++it )
+		{
+			const shared_ptr<ProductShapeData>& product_shape = it->second;
+			if( !product_shape || product_shape->m_ifc_object_definition.expired() )
+			{
+				continue;
+			}
+			shared_ptr<IFC4X3::IfcObjectDefinition> ifc_object_def( product_shape->m_ifc_object_definition );
+			if( !dynamic_pointer_cast<IFC4X3::IfcProduct>( ifc_object_def ) || dynamic_pointer_cast<IFC4X3::IfcFeatureElementSubtraction>( ifc_object_def ) )
+			{
+				// openings are already subtracted from their building elements
+				continue;
+			}
+			vec_products.push_back( product_shape );
+		}
+
+		const int num_products = (int)vec_products.size();
+		std::vector<std::vector<Element> > vec_product_elements( num_products );
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16)
+#endif
+		for( int i = 0; i < num_products; ++i )
+		{
+			const shared_ptr<ProductShapeData>& product_shape = vec_products[i];
+			if( per_item )
+			{
+				for( const shared_ptr<ItemShapeData>& item : product_shape->m_geometric_items )
+				{
+					Element element;
+					element.m_product = product_shape;
+					element.m_item = item;
+					if( computeElementBoundingBox( element ) )
+					{
+						vec_product_elements[i].push_back( element );
+					}
+				}
+			}
+			else
+			{
+				Element element;
+				element.m_product = product_shape;
+				if( computeElementBoundingBox( element ) )
+				{
+					vec_product_elements[i].push_back( element );
+				}
+			}
+		}
+
+		std::vector<Element> vec_elements;
+		for( std::vector<Element>& product_elements : vec_product_elements )
+		{
+			std::move( product_elements.begin(), product_elements.end(), std::back_inserter( vec_elements ) );
+		}
+		build( vec_elements );
+	}
+
+	//\brief Builds the tree over the given elements, in parallel
+	void build( const std::vector<Element>& vec_elements )
+	{
+		m_elements = vec_elements;
+		m_nodes.clear();
+		m_parents.clear();
+		m_element_leaf.clear();
+		m_element_order.clear();
+		m_map_product_elements.clear();
+		m_max_depth = 0;
+
+		const size_t num_elements = m_elements.size();
+		for( size_t ii = 0; ii < num_elements; ++ii )
+		{
+			m_map_product_elements[m_elements[ii].m_product.get()].push_back( ii );
+		}
+		if( num_elements == 0 )
+		{
+			return;
+		}
+
+		m_element_order.resize( num_elements );
+		std::vector<vec3> vec_centroids( num_elements );
+		for( size_t ii = 0; ii < num_elements; ++ii )
+		{
+			m_element_order[ii] = (uint32_t)ii;
+			vec_centroids[ii] = ( m_elements[ii].m_min + m_elements[ii].m_max )*0.5;
+		}
+
+		m_nodes.resize( 2 * num_elements );
+		std::atomic<uint32_t> num_nodes( 1 );
+#ifdef _OPENMP
+#pragma omp parallel
+		{
+#pragma omp single
+			buildNode( 0, 0, num_elements, vec_centroids.data(), &num_nodes );
+		}
+#else
+		buildNode( 0, 0, num_elements, vec_centroids.data(), &num_nodes );
+#endif
+		m_nodes.resize( num_nodes );
+		m_nodes.shrink_to_fit();
+
+		// parents, leaves of elements and depth
+		m_parents.assign( m_nodes.size(), NO_PARENT );
+		m_element_leaf.assign( num_elements, 0 );
+		std::vector<std::pair<uint32_t, size_t> > stack( 1, std::make_pair( 0u, size_t( 1 ) ) );
+		while( !stack.empty() )
+		{
+			const uint32_t node_index = stack.back().first;
+			const size_t depth = stack.back().second;
+			stack.pop_back();
+			m_max_depth = std::max( m_max_depth, depth );
+			const Node& node = m_nodes[node_index];
+			if( node.m_count > 0 )
+			{
+				for( uint32_t ii = node.m_first; ii < node.m_first + node.m_count; ++ii )
+				{
+					m_element_leaf[m_element_order[ii]] = node_index;
+				}
+				continue;
+			}
+			m_parents[node.m_first] = node_index;
+			m_parents[node.m_first + 1] = node_index;
+			stack.push_back( { node.m_first, depth + 1 } );
+			stack.push_back( { node.m_first + 1, depth + 1 } );
+		}
+	}
+
+	//\brief Elements whose bounding box intersects the box [box_min, box_max]
+	void queryBox( const vec3& box_min, const vec3& box_max, std::vector<size_t>& result ) const
+	{
+		traverse( [&]( const vec3& node_min, const vec3& node_max ) { return boxesOverlap( node_min, node_max, box_min, box_max ) ? 1 : 0; }, result );
+	}
+
+	//\brief Elements whose bounding box contains the point
+	void queryPoint( const vec3& point, std::vector<size_t>& result ) const
+	{
+		queryBox( point, point, result );
+	}
+
+	/**
+	*\brief Elements whose bounding box is at least partially on the inner side of all planes, for view frustum culling.
+	* A point p is on the inner side of a plane if dot(plane.N, p) + plane.d >= 0.
+	*/
+	void queryFrustum( const std::vector<carve::geom::plane<3> >& planes, std::vector<size_t>& result ) const
+	{
+		traverse( [&]( const vec3& node_min, const vec3& node_max )
+		{
+			bool fully_inside = true;
+			for( const carve::geom::plane<3>& plane : planes )
+			{
+				// corners of the box farthest in front of and behind the plane
+				const vec3 corner_front = carve::geom::VECTOR( plane.N.x >= 0 ? node_max.x : node_min.x, plane.N.y >= 0 ? node_max.y : node_min.y, plane.N.z >= 0 ? node_max.z : node_min.z );
+				if( dot( plane.N, corner_front ) + plane.d < 0 )
+				{
+					return 0;
+				}
+				const vec3 corner_back = carve::geom::VECTOR( plane.N.x >= 0 ? node_min.x : node_max.x, plane.N.y >= 0 ? node_min.y : node_max.y, plane.N.z >= 0 ? node_min.z : node_max.z );
+				if( dot( plane.N, corner_back ) + plane.d < 0 )
+				{
+					fully_inside = false;
+				}
+			}
+			return fully_inside ? 2 : 1;
+		}, result );
+	}
+
+	//\brief Elements whose bounding box is hit by the ray within max_distance, sorted by distance
+	void queryRay( const vec3& origin, const vec3& direction, double max_distance, std::vector<RayHit>& hits ) const
+	{
+		hits.clear();
+		if( m_nodes.empty() )
+		{
+			return;
+		}
+
+		const vec3 inv_direction = inverseDirection( direction );
+		std::vector<uint32_t> stack;
+		stack.reserve( m_max_depth + 1 );
+		stack.push_back( 0 );
+		while( !stack.empty() )
+		{
+			const Node& node = m_nodes[stack.back()];
+			stack.pop_back();
+			double distance;
+			if( !intersectRay( node.m_min, node.m_max, origin, inv_direction, max_distance, distance ) )
+			{
+				continue;
+			}
+			if( node.m_count == 0 )
+			{
+				stack.push_back( node.m_first );
+				stack.push_back( node.m_first + 1 );
+				continue;
+			}
+			for( uint32_t ii = node.m_first; ii < node.m_first + node.m_count; ++ii )
+			{
+				const uint32_t element_index = m_element_order[ii];
+				if( intersectRay( m_elements[element_index].m_min, m_elements[element_index].m_max, origin, inv_direction, max_distance, distance ) )
+				{
+					hits.push_back( { element_index, distance } );
+				}
+			}
+		}
+		std::sort( hits.begin(), hits.end(), []( const RayHit& a, const RayHit& b ) { return a.m_distance < b.m_distance; } );
+	}
+
+	/**
+	*\brief Closest element hit by the ray, for picking. Nodes are visited front to back and skipped if they are farther than the closest hit so far.
+	*\param intersect		Exact test of an element, returns true and the distance if the element is hit
+	*\return element index, or SIZE_MAX if nothing is hit
+	*/
+	size_t findClosestHit( const vec3& origin, const vec3& direction, const std::function<bool( size_t, double& )>& intersect, double& hit_distance ) const
+	{
+		size_t closest_element = SIZE_MAX;
+		hit_distance = std::numeric_limits<double>::max();
+		if( m_nodes.empty() )
+		{
+			return closest_element;
+		}
+
+		const vec3 inv_direction = inverseDirection( direction );
+		std::vector<std::pair<uint32_t, double> > stack;
+		stack.reserve( m_max_depth + 1 );
+		double distance;
+		if( intersectRay( m_nodes[0].m_min, m_nodes[0].m_max, origin, inv_direction, hit_distance, distance ) )
+		{
+			stack.push_back( { 0, distance } );
+		}
+		while( !stack.empty() )
+		{
+			const std::pair<uint32_t, double> entry = stack.back();
+			stack.pop_back();
+			if( entry.second > hit_distance )
+			{
+				continue;
+			}
+
+			const Node& node = m_nodes[entry.first];
+			if( node.m_count > 0 )
+			{
+				for( uint32_t ii = node.m_first; ii < node.m_first + node.m_count; ++ii )
+				{
+					const uint32_t element_index = m_element_order[ii];
+					double element_distance;
+					if( !intersectRay( m_elements[element_index].m_min, m_elements[element_index].m_max, origin, inv_direction, hit_distance, element_distance ) )
+					{
+						continue;
+					}
+					if( intersect( element_index, element_distance ) && element_distance < hit_distance )
+					{
+						hit_distance = element_distance;
+						closest_element = element_index;
+					}
+				}
+				continue;
+			}
+
+			double distance_left, distance_right;
+			const bool hit_left = intersectRay( m_nodes[node.m_first].m_min, m_nodes[node.m_first].m_max, origin, inv_direction, hit_distance, distance_left );
+			const bool hit_right = intersectRay( m_nodes[node.m_first + 1].m_min, m_nodes[node.m_first + 1].m_max, origin, inv_direction, hit_distance, distance_right );
+			// the nearer child is pushed last, so that it is visited first
+			if( hit_left && hit_right && distance_left < distance_right )
+			{
+				stack.push_back( { node.m_first + 1, distance_right } );
+				stack.push_back( { node.m_first, distance_left } );
+			}
+			else
+			{
+				if( hit_left ) stack.push_back( { node.m_first, distance_left } );
+				if( hit_right ) stack.push_back( { node.m_first + 1, distance_right } );
+			}
+		}
+		return closest_element;
+	}
+
+	//\brief The k elements with the nearest bounding boxes to the point, sorted by distance. The distance is 0 for boxes that contain the point
+	void queryNearest( const vec3& point, size_t k, std::vector<std::pair<size_t, double> >& result ) const
+	{
+		result.clear();
+		if( m_nodes.empty() || k == 0 )
+		{
+			return;
+		}
+
+		typedef std::pair<double, uint32_t> Entry;		// squared distance, node or element index
+		std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > queue_nodes;
+		std::priority_queue<Entry> queue_best;		// k nearest so far, farthest on top
+		queue_nodes.push( { squaredDistance( m_nodes[0].m_min, m_nodes[0].m_max, point ), 0 } );
+		while( !queue_nodes.empty() )
+		{
+			const Entry entry = queue_nodes.top();
+			queue_nodes.pop();
+			if( queue_best.size() == k && entry.first > queue_best.top().first )
+			{
+				break;
+			}
+
+			const Node& node = m_nodes[entry.second];
+			if( node.m_count == 0 )
+			{
+				queue_nodes.push( { squaredDistance( m_nodes[node.m_first].m_min, m_nodes[node.m_first].m_max, point ), node.m_first } );
+				queue_nodes.push( { squaredDistance( m_nodes[node.m_first + 1].m_min, m_nodes[node.m_first + 1].m_max, point ), node.m_first + 1 } );
+				continue;
+			}
+			for( uint32_t ii = node.m_first; ii < node.m_first + node.m_count; ++ii )
+			{
+				const uint32_t element_index = m_element_order[ii];
+				const double distance2 = squaredDistance( m_elements[element_index].m_min, m_elements[element_index].m_max, point );
+				if( queue_best.size() < k )
+				{
+					queue_best.push( { distance2, element_index } );
+				}
+				else if( distance2 < queue_best.top().first )
+				{
+					queue_best.pop();
+					queue_best.push( { distance2, element_index } );
+				}
+			}
+		}
+
+		result.resize( queue_best.size() );
+		for( size_t ii = result.size(); ii > 0; --ii )
+		{
+			result[ii - 1] = { queue_best.top().second, std::sqrt( queue_best.top().first ) };
+			queue_best.pop();
+		}
+	}
+
+	/**
+	*\brief Recomputes the bounding boxes of the elements of a product after its geometry or placement changed, and refits the tree.
+	* If items have been added to or removed from the product, build has to be called instead.
+	*/
+	void updateProduct( const shared_ptr<ProductShapeData>& product_shape )
+	{
+		auto it_find = m_map_product_elements.find( product_shape.get() );
+		if( it_find == m_map_product_elements.end() )
+		{
+			return;
+		}
+		for( size_t element_index : it_find->second )
+		{
+			Element& element = m_elements[element_index];
+			if( !computeElementBoundingBox( element ) )
+			{
+				// no geometry anymore: an inverted box is never found by queries
+				element.m_min = carve::geom::VECTOR( std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max() );
+				element.m_max = -element.m_min;
+			}
+			refitFromLeaf( m_element_leaf[element_index] );
+		}
+	}
+
+	//\brief Sets the bounding box of one element and refits its ancestors
+	void updateElement( size_t element_index, const vec3& box_min, const vec3& box_max )
+	{
+		m_elements[element_index].m_min = box_min;
+		m_elements[element_index].m_max = box_max;
+		refitFromLeaf( m_element_leaf[element_index] );
+	}
+
+	//\brief Computes the bounding box of a product or item in world coordinates
+	static bool computeElementBoundingBox( Element& element )
+	{
+		carve::geom::aabb<3> bbox;
+		std::set<ItemShapeData*> set_visited;
+		if( element.m_item )
+		{
+			element.m_item->computeBoundingBox( bbox, set_visited );
+		}
+		else
+		{
+			for( const shared_ptr<ItemShapeData>& item : element.m_product->m_geometric_items )
+			{
+				carve::geom::aabb<3> item_bbox;
+				item->computeBoundingBox( item_bbox, set_visited );
+				if( item_bbox.isEmpty() )
+				{
+					continue;
+				}
+				if( bbox.isEmpty() )
+				{
+					bbox = item_bbox;
+				}
+				else
+				{
+					bbox.unionAABB( item_bbox );
+				}
+			}
+		}
+		if( bbox.isEmpty() )
+		{
+			return false;
+		}
+
+		// transform the corners of the box to world coordinates
+		const carve::math::Matrix transform = element.m_product->getTransform();
+		const vec3 local_min = bbox.min();
+		const vec3 local_max = bbox.max();
+		for( int ii = 0; ii < 8; ++ii )
+		{
+			const vec3 corner = carve::geom::VECTOR( ( ii & 1 ) ? local_max.x : local_min.x, ( ii & 2 ) ? local_max.y : local_min.y, ( ii & 4 ) ? local_max.z : local_min.z );
+			const vec3 corner_world = transform*corner;
+			if( ii == 0 )
+			{
+				element.m_min = corner_world;
+				element.m_max = corner_world;
+				continue;
+			}
+			element.m_min = carve::geom::VECTOR( std::min( element.m_min.x, corner_world.x ), std::min( element.m_min.y, corner_world.y ), std::min( element.m_min.z, corner_world.z ) );
+			element.m_max = carve::geom::VECTOR( std::max( element.m_max.x, corner_world.x ), std::max( element.m_max.y, corner_world.y ), std::max( element.m_max.z, corner_world.z ) );
+		}
+		return true;
+	}
+
+protected:
+	static bool boxesOverlap( const vec3& min1, const vec3& max1, const vec3& min2, const vec3& max2 )
+	{
+		return min1.x <= max2.x && min2.x <= max1.x && min1.y <= max2.y && min2.y <= max1.y && min1.z <= max2.z && min2.z <= max1.z;
+	}
+
+	static double surfaceArea( const vec3& box_min, const vec3& box_max )
+	{
+		const vec3 extent = box_max - box_min;
+		return extent.x*extent.y + extent.y*extent.z + extent.z*extent.x;
+	}
+
+	static double squaredDistance( const vec3& box_min, const vec3& box_max, const vec3& point )
+	{
+		double distance2 = 0;
+		for( int ii = 0; ii < 3; ++ii )
+		{
+			const double delta = point[ii] < box_min[ii] ? box_min[ii] - point[ii] : ( point[ii] > box_max[ii] ? point[ii] - box_max[ii] : 0 );
+			distance2 += delta*delta;
+		}
+		return distance2;
+	}
+
+	static vec3 inverseDirection( const vec3& direction )
+	{
+		const double huge = std::numeric_limits<double>::max();
+		return carve::geom::VECTOR( direction.x != 0 ? 1.0 / direction.x : huge, direction.y != 0 ? 1.0 / direction.y : huge, direction.z != 0 ? 1.0 / direction.z : huge );
+	}
+
+	//\brief Slab test, distance is where the ray enters the box, or 0 if the origin is inside
+	static bool intersectRay( const vec3& box_min, const vec3& box_max, const vec3& origin, const vec3& inv_direction, double max_distance, double& distance )
+	{
+		double t_min = 0;
+		double t_max = max_distance;
+		for( int ii = 0; ii < 3; ++ii )
+		{
+			double t1 = ( box_min[ii] - origin[ii] )*inv_direction[ii];
+			double t2 = ( box_max[ii] - origin[ii] )*inv_direction[ii];
+			if( t1 > t2 )
+			{
+				std::swap( t1, t2 );
+			}
+			if( t1 != t1 || t2 != t2 )
+			{
+				// 0 * infinity for a ray in the plane of a box face
+				if( origin[ii] < box_min[ii] || origin[ii] > box_max[ii] )
+				{
+					return false;
+				}
+				continue;
+			}
+			t_min = std::max( t_min, t1 );
+			t_max = std::min( t_max, t2 );
+			if( t_min > t_max )
+			{
+				return false;
+			}
+		}
+		distance = t_min;
+		return true;
+	}
+
+	/**
+	*\brief Depth first traversal. test returns 0 to skip a node, 1 to descend and 2 to take all elements of the node without further tests.
+	* Elements of leaves are tested with the same function.
+	*/
+	template<typename TestFunction>
+	void traverse( const TestFunction& test, std::vector<size_t>& result ) const
+	{
+		result.clear();
+		if( m_nodes.empty() )
+		{
+			return;
+		}
+
+		std::vector<std::pair<uint32_t, bool> > stack;		// node index, all elements below are accepted
+		stack.reserve( m_max_depth + 1 );
+		stack.push_back( { 0, false } );
+		while( !stack.empty() )
+		{
+			const uint32_t node_index = stack.back().first;
+			bool accept_all = stack.back().second;
+			stack.pop_back();
+			const Node& node = m_nodes[node_index];
+			if( !accept_all )
+			{
+				const int test_result = test( node.m_min, node.m_max );
+				if( test_result == 0 )
+				{
+					continue;
+				}
+				accept_all = test_result == 2;
+			}
+
+			if( node.m_count == 0 )
+			{
+				stack.push_back( { node.m_first + 1, accept_all } );
+				stack.push_back( { node.m_first, accept_all } );
+				continue;
+			}
+			for( uint32_t ii = node.m_first; ii < node.m_first + node.m_count; ++ii )
+			{
+				const uint32_t element_index = m_element_order[ii];
+				if( accept_all || test( m_elements[element_index].m_min, m_elements[element_index].m_max ) != 0 )
+				{
+					result.push_back( element_index );
+				}
+			}
+		}
+	}
+
+	void computeNodeBounds( Node& node ) const
+	{
+		if( node.m_count == 0 )
+		{
+			const Node& left = m_nodes[node.m_first];
+			const Node& right = m_nodes[node.m_first + 1];
+			node.m_min = carve::geom::VECTOR( std::min( left.m_min.x, right.m_min.x ), std::min( left.m_min.y, right.m_min.y ), std::min( left.m_min.z, right.m_min.z ) );
+			node.m_max = carve::geom::VECTOR( std::max( left.m_max.x, right.m_max.x ), std::max( left.m_max.y, right.m_max.y ), std::max( left.m_max.z, right.m_max.z ) );
+			return;
+		}
+
+		const double max_value = std::numeric_limits<double>::max();
+		node.m_min = carve::geom::VECTOR( max_value, max_value, max_value );
+		node.m_max = -node.m_min;
+		for( uint32_t ii = node.m_first; ii < node.m_first + node.m_count; ++ii )
+		{
+			const Element& element = m_elements[m_element_order[ii]];
+			node.m_min = carve::geom::VECTOR( std::min( node.m_min.x, element.m_min.x ), std::min( node.m_min.y, element.m_min.y ), std::min( node.m_min.z, element.m_min.z ) );
+			node.m_max = carve::geom::VECTOR( std::max( node.m_max.x, element.m_max.x ), std::max( node.m_max.y, element.m_max.y ), std::max( node.m_max.z, element.m_max.z ) );
+		}
+	}
+
+	void refitFromLeaf( uint32_t node_index )
+	{
+		while( node_index != NO_PARENT )
+		{
+			Node& node = m_nodes[node_index];
+			const vec3 previous_min = node.m_min;
+			const vec3 previous_max = node.m_max;
+			computeNodeBounds( node );
+			if( node.m_min == previous_min && node.m_max == previous_max )
+			{
+				break;
+			}
+			node_index = m_parents[node_index];
+		}
+	}
+
+	// pointers instead of references, the variables of OpenMP tasks are copied
+	void buildNode( uint32_t node_index, size_t first, size_t count, const vec3* vec_centroids, std::atomic<uint32_t>* num_nodes )
+	{
+		Node& node = m_nodes[node_index];
+		node.m_first = (uint32_t)first;
+		node.m_count = (uint32_t)count;
+		computeNodeBounds( node );
+		if( count <= m_max_leaf_size )
+		{
+			return;
+		}
+
+		vec3 centroid_min = vec_centroids[m_element_order[first]];
+		vec3 centroid_max = centroid_min;
+		for( size_t ii = first + 1; ii < first + count; ++ii )
+		{
+			const vec3& centroid = vec_centroids[m_element_order[ii]];
+			centroid_min = carve::geom::VECTOR( std::min( centroid_min.x, centroid.x ), std::min( centroid_min.y, centroid.y ), std::min( centroid_min.z, centroid.z ) );
+			centroid_max = carve::geom::VECTOR( std::max( centroid_max.x, centroid.x ), std::max( centroid_max.y, centroid.y ), std::max( centroid_max.z, centroid.z ) );
+		}
+
+		// binned surface area heuristic: cost of a split is area(left)*count(left) + area(right)*count(right)
+		int best_axis = -1;
+		size_t best_split = 0;
+		double best_cost = surfaceArea( node.m_min, node.m_max )*count;
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			const double extent = centroid_max[axis] - centroid_min[axis];
+			if( extent <= 0 )
+			{
+				continue;
+			}
+			const double bin_scale = NUM_BINS / extent;
+
+			size_t bin_count[NUM_BINS] = {};
+			vec3 bin_min[NUM_BINS];
+			vec3 bin_max[NUM_BINS];
+			for( size_t ii = first; ii < first + count; ++ii )
+			{
+				const uint32_t element_index = m_element_order[ii];
+				const size_t bin = std::min( NUM_BINS - 1, size_t( ( vec_centroids[element_index][axis] - centroid_min[axis] )*bin_scale ) );
+				const Element& element = m_elements[element_index];
+				if( bin_count[bin]++ == 0 )
+				{
+					bin_min[bin] = element.m_min;
+					bin_max[bin] = element.m_max;
+					continue;
+				}
+				bin_min[bin] = carve::geom::VECTOR( std::min( bin_min[bin].x, element.m_min.x ), std::min( bin_min[bin].y, element.m_min.y ), std::min( bin_min[bin].z, element.m_min.z ) );
+				bin_max[bin] = carve::geom::VECTOR( std::max( bin_max[bin].x, element.m_max.x ), std::max( bin_max[bin].y, element.m_max.y ), std::max( bin_max[bin].z, element.m_max.z ) );
+			}
+
+			// sweep from the right to get the cost of the right side of each split
+			double right_cost[NUM_BINS] = {};
+			size_t right_count = 0;
+			vec3 right_min, right_max;
+			for( size_t bin = NUM_BINS - 1; bin > 0; --bin )
+			{
+				if( bin_count[bin] > 0 )
+				{
+					if( right_count == 0 )
+					{
+						right_min = bin_min[bin];
+						right_max = bin_max[bin];
+					}
+					else
+					{
+						right_min = carve::geom::VECTOR( std::min( right_min.x, bin_min[bin].x ), std::min( right_min.y, bin_min[bin].y ), std::min( right_min.z, bin_min[bin].z ) );
+						right_max = carve::geom::VECTOR( std::max( right_max.x, bin_max[bin].x ), std::max( right_max.y, bin_max[bin].y ), std::max( right_max.z, bin_max[bin].z ) );
+					}
+					right_count += bin_count[bin];
+				}
+				right_cost[bin] = right_count > 0 ? surfaceArea( right_min, right_max )*right_count : 0;
+			}
+
+			size_t left_count = 0;
+			vec3 left_min, left_max;
+			for( size_t split = 1; split < NUM_BINS; ++split )
+			{
+				const size_t bin = split - 1;
+				if( bin_count[bin] > 0 )
+				{
+					if( left_count == 0 )
+					{
+						left_min = bin_min[bin];
+						left_max = bin_max[bin];
+					}
+					else
+					{
+						left_min = carve::geom::VECTOR( std::min( left_min.x, bin_min[bin].x ), std::min( left_min.y, bin_min[bin].y ), std::min( left_min.z, bin_min[bin].z ) );
+						left_max = carve::geom::VECTOR( std::max( left_max.x, bin_max[bin].x ), std::max( left_max.y, bin_max[bin].y ), std::max( left_max.z, bin_max[bin].z ) );
+					}
+					left_count += bin_count[bin];
+				}
+				if( left_count == 0 || left_count == count )
+				{
+					continue;
+				}
+				const double cost = surfaceArea( left_min, left_max )*left_count + right_cost[split];
+				if( cost < best_cost )
+				{
+					best_cost = cost;
+					best_axis = axis;
+					best_split = split;
+				}
+			}
+		}
+
+		size_t num_left = 0;
+		if( best_axis >= 0 )
+		{
+			const double bin_scale = NUM_BINS / ( centroid_max[best_axis] - centroid_min[best_axis] );
+			uint32_t* split_position = std::partition( m_element_order.data() + first, m_element_order.data() + first + count, [&]( uint32_t element_index )
+			{
+				return std::min( NUM_BINS - 1, size_t( ( vec_centroids[element_index][best_axis] - centroid_min[best_axis] )*bin_scale ) ) < best_split;
+			} );
+			num_left = split_position - ( m_element_order.data() + first );
+		}
+		else
+		{
+			if( count <= 4 * m_max_leaf_size )
+			{
+				// splitting does not pay off
+				return;
+			}
+			// all centroids equal, or no split is cheaper: split at the median of the longest axis
+			const vec3 extent = centroid_max - centroid_min;
+			const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : ( extent.y >= extent.z ? 1 : 2 );
+			num_left = count / 2;
+			std::nth_element( m_element_order.begin() + first, m_element_order.begin() + first + num_left, m_element_order.begin() + first + count,
+				[&]( uint32_t a, uint32_t b ) { return vec_centroids[a][axis] < vec_centroids[b][axis]; } );
+		}
+
+		const uint32_t left_index = num_nodes->fetch_add( 2 );
+		node.m_first = left_index;
+		node.m_count = 0;
+
+		if( count >= MIN_PARALLEL_BUILD_SIZE )
+		{
+#ifdef _OPENMP
+#pragma omp task
+#endif
+			buildNode( left_index, first, num_left, vec_centroids, num_nodes );
+		}
+		else
+		{
+			buildNode( left_index, first, num_left, vec_centroids, num_nodes );
+		}
+		buildNode( left_index + 1, first + num_left, count - num_left, vec_centroids, num_nodes );
+	}
+};
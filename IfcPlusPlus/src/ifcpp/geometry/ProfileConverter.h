@@ -1138,7 +1138,11 @@ public:
 			return;
 		}
 		//int num_segments = (int)( std::abs( opening_angle ) / ( 2.0*M_PI )*gs->getNumVerticesPerCircle() ); // TODO: adapt to model size and complexity
-		if( num_segments < gs->getMinNumVerticesPerArc() )
+		if( gs->isAdaptiveTessellation() )
+		{
+			num_segments = gs->getNumSegmentsAdaptive( radius, opening_angle );
+		}
+		else if( num_segments < gs->getMinNumVerticesPerArc() )
 		{
 			num_segments = gs->getMinNumVerticesPerArc();
 		}
@@ -67,6 +67,10 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OU
 #include "SolidModelConverter.h"
 #include "FaceConverter.h"
 #include "ProfileCache.h"
+#include "ItemShapeCache.h"
+#include "GeometryDiskCache.h"
+#include "PrismaticOpenings.h"
+#include "ConversionBudget.h"
 
 class LabRepresentationConverter : public StatusCallback
 {
@@ -80,8 +84,11 @@ protected:
 	shared_ptr<PlacementConverter>		m_placement_converter;
 	shared_ptr<CurveConverter>			m_curve_converter;
 	shared_ptr<ProfileCache>			m_profile_cache;
+	shared_ptr<ItemShapeCache>			m_item_shape_cache;
+	shared_ptr<GeometryDiskCache>		m_geometry_disk_cache;
 	shared_ptr<FaceConverter>			m_face_converter;
 	shared_ptr<SolidModelConverter>		m_solid_converter;
+	shared_ptr<PrismaticOpenings>		m_prismatic_openings;
 	
 public:
 	LabRepresentationConverter( shared_ptr<GeometrySettings> geom_settings, shared_ptr<UnitConverter> unit_converter )
@@ -94,8 +101,11 @@ public:
 		m_placement_converter = shared_ptr<PlacementConverter>( new PlacementConverter( m_unit_converter ) );
 		m_curve_converter = shared_ptr<CurveConverter>( new CurveConverter( m_geom_settings, m_placement_converter, m_point_converter, m_spline_converter ) );
 		m_profile_cache = shared_ptr<ProfileCache>( new ProfileCache( m_curve_converter, m_spline_converter ) );
+		m_item_shape_cache = shared_ptr<ItemShapeCache>( new ItemShapeCache() );
+		m_geometry_disk_cache = shared_ptr<GeometryDiskCache>( new GeometryDiskCache() );
 		m_face_converter = shared_ptr<FaceConverter>( new FaceConverter( m_geom_settings, m_unit_converter, m_curve_converter, m_spline_converter, m_sweeper, m_profile_cache ) );
 		m_solid_converter = shared_ptr<SolidModelConverter>( new SolidModelConverter( m_geom_settings, m_point_converter, m_curve_converter, m_face_converter, m_profile_cache, m_sweeper ) );
+		m_prismatic_openings = shared_ptr<PrismaticOpenings>( new PrismaticOpenings( m_geom_settings, m_unit_converter, m_curve_converter, m_spline_converter, m_placement_converter, m_sweeper ) );
 		
 
 		// this redirects the callback messages from all converters to RepresentationConverter's callback
@@ -106,8 +116,11 @@ public:
 		m_placement_converter->setMessageTarget( this );
 		m_curve_converter->setMessageTarget( this );
 		m_profile_cache->setMessageTarget( this );
+		m_item_shape_cache->setMessageTarget( this );
+		m_geometry_disk_cache->setMessageTarget( this );
 		m_face_converter->setMessageTarget( this );
 		m_solid_converter->setMessageTarget( this );
+		m_prismatic_openings->setMessageTarget( this );
 	}
 
 	virtual ~LabRepresentationConverter()
@@ -118,7 +131,9 @@ public:
 	void clearCache()
 	{
 		m_profile_cache->clearProfileCache();
+		m_item_shape_cache->clearItemShapeCache();
 		m_styles_converter->clearStylesCache();
+		m_styles_converter->clearAppearancePalette();
 	}
 	shared_ptr<GeometrySettings>&		getGeomSettings()	{ return m_geom_settings; }
 	shared_ptr<UnitConverter>&			getUnitConverter() { return m_unit_converter; }
@@ -129,8 +144,11 @@ public:
 	shared_ptr<PlacementConverter>&		getPlacementConverter() { return m_placement_converter; }
 	shared_ptr<CurveConverter>&			getCurveConverter() { return m_curve_converter; }
 	shared_ptr<ProfileCache>&			getProfileCache()	{ return m_profile_cache; }
+	shared_ptr<ItemShapeCache>&			getItemShapeCache()	{ return m_item_shape_cache; }
+	shared_ptr<GeometryDiskCache>&		getGeometryDiskCache() { return m_geometry_disk_cache; }
 	shared_ptr<FaceConverter>&			getFaceConverter() { return m_face_converter; }
 	shared_ptr<SolidModelConverter>&	getSolidConverter() { return m_solid_converter; }
+	shared_ptr<PrismaticOpenings>&		getPrismaticOpenings() { return m_prismatic_openings; }
 
 	void setUnitConverter( shared_ptr<UnitConverter>& unit_converter )
 	{
@@ -139,6 +157,7 @@ public:
 		m_sweeper->m_unit_converter = unit_converter;
 		m_placement_converter->m_unit_converter = unit_converter;
 		m_face_converter->m_unit_converter = unit_converter;
+		m_prismatic_openings->setUnitConverter( unit_converter );
 	}
 
 	void convertRepresentationStyle( const shared_ptr<IfcRepresentationItem>& representation_item, std::vector<shared_ptr<AppearanceData> >& vec_appearance_data )
@@ -168,7 +187,7 @@ public:
 
 				try
 				{
-					convertIfcGeometricRepresentationItem( geom_item, geom_item_data );
+					convertIfcGeometricRepresentationItemCached( geom_item, geom_item_data );
 				}
 				catch( BuildingException& e )
 				{
@@ -385,6 +404,55 @@ public:
 #endif
 	}
 
+	void convertIfcGeometricRepresentationItemCached( const shared_ptr<IfcGeometricRepresentationItem>& geom_item, shared_ptr<ItemShapeData>& item_data )
+	{
+		const bool cache_in_memory = m_geom_settings->cacheItemShapes();
+		const bool cache_on_disk = m_geometry_disk_cache->isEnabled();
+		if( !cache_in_memory && !cache_on_disk )
+		{
+			convertIfcGeometricRepresentationItem( geom_item, item_data );
+			return;
+		}
+
+		const ItemContentKey key = ItemShapeCache::computeContentKey( geom_item );
+		bool found = cache_in_memory && m_item_shape_cache->findItemShape( key, geom_item, item_data );
+		if( !found && cache_on_disk && m_geometry_disk_cache->loadItemShape( key, item_data, m_geom_settings->getEpsilonMergePoints() ) )
+		{
+			found = true;
+			if( cache_in_memory )
+			{
+				m_item_shape_cache->addItemShape( key, geom_item, item_data );
+			}
+		}
+
+		if( found )
+		{
+			// styles are attached to the item entity, not to its content
+			if( m_geom_settings->handleStyledItems() )
+			{
+				std::vector<shared_ptr<AppearanceData> > vec_appearance_data;
+				convertRepresentationStyle( geom_item, vec_appearance_data );
+				std::copy( vec_appearance_data.begin(), vec_appearance_data.end(), std::back_inserter( item_data->m_vec_item_appearances ) );
+			}
+			return;
+		}
+
+		convertIfcGeometricRepresentationItem( geom_item, item_data );
+		if( ConversionBudget::current().exceeded() )
+		{
+			// boolean operations may have been skipped, so the shape must not be shared with other items
+			return;
+		}
+		if( cache_in_memory )
+		{
+			m_item_shape_cache->addItemShape( key, geom_item, item_data );
+		}
+		if( cache_on_disk )
+		{
+			m_geometry_disk_cache->storeItemShape( key, item_data );
+		}
+	}
+
 	void convertIfcGeometricRepresentationItem( const shared_ptr<IfcGeometricRepresentationItem>& geom_item, shared_ptr<ItemShapeData>& item_data )
 	{
 		//ENTITY IfcGeometricRepresentationItem
@@ -426,6 +494,14 @@ public:
 		shared_ptr<IfcSolidModel> solid_model = dynamic_pointer_cast<IfcSolidModel>( geom_item );
 		if( solid_model )
 		{
+			shared_ptr<IfcSweptDiskSolid> swept_disk_solid = dynamic_pointer_cast<IfcSweptDiskSolid>( solid_model );
+			if( swept_disk_solid && m_geom_settings->createSweptDiskTriangleMeshes() )
+			{
+				// not a boolean operand. If openings are subtracted, collectMeshes creates the carve meshset
+				m_solid_converter->convertIfcSweptDiskSolid( swept_disk_solid, item_data, true );
+				return;
+			}
+
 			m_solid_converter->convertIfcSolidModel( solid_model, item_data );
 			return;
 		}
@@ -1010,6 +1086,9 @@ public:
 
 	void collectMeshes(shared_ptr<ItemShapeData> geom_item, std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& vec_meshes)
 	{
+		// swept disks converted directly to triangles need a carve meshset for boolean operations
+		geom_item->createMeshSetsFromTriangleMeshes(m_geom_settings->getEpsilonMergePoints());
+
 		std::copy(geom_item->m_meshsets.begin(), geom_item->m_meshsets.end(), std::back_inserter(vec_meshes));
 		std::copy(geom_item->m_meshsets_open.begin(), geom_item->m_meshsets_open.end(), std::back_inserter(vec_meshes));
 
@@ -1022,13 +1101,38 @@ public:
 
 	void subtractOpeningFromProductShape(shared_ptr<ItemShapeData>& productShapeItem, std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& vec_opening_meshes, const shared_ptr<IfcElement>& ifc_element)
 	{
-		for (size_t i_product_meshset = 0; i_product_meshset < productShapeItem->m_meshsets.size(); ++i_product_meshset)
+		const int num_product_meshsets = (int)productShapeItem->m_meshsets.size();
+		const ConversionBudget budget = ConversionBudget::current();
+		for (int i_product_meshset = 0; i_product_meshset < num_product_meshsets; ++i_product_meshset)
 		{
-			// go through all meshsets of the item
-			shared_ptr<carve::mesh::MeshSet<3> >& product_meshset = productShapeItem->m_meshsets[i_product_meshset];
+			// meshsets are independent, so idle threads can take over the subtraction
+#ifdef _OPENMP
+#pragma omp task firstprivate(i_product_meshset, budget) shared(productShapeItem, vec_opening_meshes, ifc_element) if(num_product_meshsets > 1)
+#endif
+			{
+				ScopedConversionBudget scopedBudget(budget);
 
-			// do the subtraction
-			CSG_Adapter::computeCSG(product_meshset, vec_opening_meshes, carve::csg::CSG::A_MINUS_B, m_geom_settings, this, ifc_element);
+				// go through all meshsets of the item
+				shared_ptr<carve::mesh::MeshSet<3> >& product_meshset = productShapeItem->m_meshsets[i_product_meshset];
+
+				// do the subtraction
+				try
+				{
+					CSG_Adapter::computeCSG(product_meshset, vec_opening_meshes, carve::csg::CSG::A_MINUS_B, m_geom_settings, this, ifc_element);
+				}
+				catch (carve::exception& e)
+				{
+					messageCallback(e.str(), StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, ifc_element.get());
+				}
+				catch (std::exception& e)
+				{
+					messageCallback(e.what(), StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, ifc_element.get());
+				}
+				catch (...)
+				{
+					messageCallback("undefined error", StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, ifc_element.get());
+				}
+			}
 		}
 
 		for (shared_ptr<ItemShapeData>& product_item_data : productShapeItem->m_child_items)
@@ -1040,6 +1144,46 @@ public:
 
 			subtractOpeningFromProductShape(product_item_data, vec_opening_meshes, ifc_element);
 		}
+#ifdef _OPENMP
+#pragma omp taskwait
+#endif
+	}
+
+	shared_ptr<ProductShapeData> convertOpeningShape(const shared_ptr<IfcElement>& ifc_element, const shared_ptr<IfcFeatureElementSubtraction>& opening)
+	{
+		// opening can have its own relative placement
+		shared_ptr<IfcObjectPlacement>	opening_placement = opening->m_ObjectPlacement;
+		shared_ptr<ProductShapeData> product_shape_opening(new ProductShapeData());
+		if (opening->m_GlobalId)
+		{
+			product_shape_opening->m_entity_guid = opening->m_GlobalId->m_value;
+		}
+		if (opening_placement)
+		{
+			std::unordered_set<IfcObjectPlacement*> opening_placements_applied;
+			m_placement_converter->convertIfcObjectPlacement(opening_placement, product_shape_opening, opening_placements_applied, false);
+		}
+
+		for (shared_ptr<IfcRepresentation> ifc_opening_representation : opening->m_Representation->m_Representations)
+		{
+			shared_ptr<ItemShapeData> opening_item(new ItemShapeData());
+
+			try
+			{
+				convertIfcRepresentation(ifc_opening_representation, opening_item);
+			}
+			catch (BuildingException& e)
+			{
+				messageCallback(e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "", ifc_element.get());
+			}
+			catch (std::exception& e)
+			{
+				messageCallback(e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "", ifc_element.get());
+			}
+
+			product_shape_opening->addGeometricItem(opening_item, product_shape_opening);
+		}
+		return product_shape_opening;
 	}
 
 	void subtractOpenings(const shared_ptr<IfcElement>& ifc_element, shared_ptr<ProductShapeData>& product_shape)
@@ -1050,6 +1194,22 @@ public:
 			return;
 		}
 
+		// extruded host and parallel extruded openings: subtract in 2D, without CSG
+		if (m_geom_settings->usePrismaticOpenings() && product_shape->m_ifc_object_definition.lock() == ifc_element)
+		{
+			try
+			{
+				if (m_prismatic_openings->subtractOpenings(ifc_element, product_shape))
+				{
+					return;
+				}
+			}
+			catch (std::exception& e)
+			{
+				messageCallback(e.what(), StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, ifc_element.get());
+			}
+		}
+
 		// convert opening representation
 		bool allOpeningsRelativeToProduct = true;
 		carve::math::Matrix product_transform = product_shape->getTransform();
@@ -1070,8 +1230,7 @@ public:
 				continue;
 			}
 
-			std::vector<shared_ptr<ProductShapeData> > vec_opening_shapes;
-
+			std::vector<shared_ptr<IfcFeatureElementSubtraction> > vec_openings;
 			for (auto& rel_voids_weak : vec_rel_voids)
 			{
 				if (rel_voids_weak.expired())
@@ -1088,39 +1247,47 @@ public:
 				{
 					continue;
 				}
+				vec_openings.push_back(opening);
+			}
 
-				// opening can have its own relative placement
-
-				shared_ptr<IfcObjectPlacement>	opening_placement = opening->m_ObjectPlacement;
-				shared_ptr<ProductShapeData> product_shape_opening(new ProductShapeData());
-				if (opening->m_GlobalId)
-				{
-					product_shape_opening->m_entity_guid = opening->m_GlobalId->m_value;
-				}
-				if (opening_placement)
-				{
-					std::unordered_set<IfcObjectPlacement*> opening_placements_applied;
-					m_placement_converter->convertIfcObjectPlacement(opening_placement, product_shape_opening, opening_placements_applied, false);
-				}
-
-				for (shared_ptr<IfcRepresentation> ifc_opening_representation : opening->m_Representation->m_Representations)
+			// openings are converted independently, as tasks that can be taken over by idle threads
+			const int num_openings = (int)vec_openings.size();
+			std::vector<shared_ptr<ProductShapeData> > vec_opening_shapes(num_openings);
+			const ConversionBudget budget = ConversionBudget::current();
+			for (int i_opening = 0; i_opening < num_openings; ++i_opening)
+			{
+#ifdef _OPENMP
+#pragma omp task firstprivate(i_opening, budget) shared(vec_openings, vec_opening_shapes, ifc_element) if(num_openings > 1)
+#endif
 				{
-					shared_ptr<ItemShapeData> opening_item(new ItemShapeData());
-
+					ScopedConversionBudget scopedBudget(budget);
 					try
 					{
-						convertIfcRepresentation(ifc_opening_representation, opening_item);
+						vec_opening_shapes[i_opening] = convertOpeningShape(ifc_element, vec_openings[i_opening]);
 					}
-					catch (BuildingException& e)
+					catch (carve::exception& e)
 					{
-						messageCallback(e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "", ifc_element.get());
+						messageCallback(e.str(), StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, vec_openings[i_opening].get());
 					}
 					catch (std::exception& e)
 					{
-						messageCallback(e.what(), StatusCallback::MESSAGE_TYPE_ERROR, "", ifc_element.get());
+						messageCallback(e.what(), StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, vec_openings[i_opening].get());
+					}
+					catch (...)
+					{
+						messageCallback("undefined error", StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, vec_openings[i_opening].get());
 					}
+				}
+			}
+#ifdef _OPENMP
+#pragma omp taskwait
+#endif
 
-					product_shape_opening->addGeometricItem(opening_item, product_shape_opening);
+			for (shared_ptr<ProductShapeData>& product_shape_opening : vec_opening_shapes)
+			{
+				if (!product_shape_opening)
+				{
+					continue;
 				}
 
 				// bring opening meshes to global position
@@ -1129,8 +1296,6 @@ public:
 				{
 					allOpeningsRelativeToProduct = false;
 				}
-
-				vec_opening_shapes.push_back(product_shape_opening);
 			}
 
 			std::vector<shared_ptr<carve::mesh::MeshSet<3> > > vec_opening_meshes;
@@ -1141,6 +1306,11 @@ public:
 
 			for (shared_ptr<ProductShapeData>& product_shape_opening : vec_opening_shapes)
 			{
+				if (!product_shape_opening)
+				{
+					continue;
+				}
+
 				if (allOpeningsRelativeToProduct)
 				{
 					carve::math::Matrix opening_transform_relative = product_shape_opening->getRelativeTransform(product_shape);
@@ -56,6 +56,7 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OU
 #include "CurveConverter.h"
 #include "Sweeper.h"
 #include "CSG_Adapter.h"
+#include "ConversionBudget.h"
 #include "IncludeCarveHeaders.h"
 
 class SolidModelConverter : public StatusCallback
@@ -273,67 +274,83 @@ public:
 			return;
 		}
 
-		shared_ptr<IfcSweptDiskSolid> swept_disp_solid = dynamic_pointer_cast<IfcSweptDiskSolid>( solid_model );
-		if( swept_disp_solid )
+		shared_ptr<IfcSweptDiskSolid> swept_disk_solid = dynamic_pointer_cast<IfcSweptDiskSolid>( solid_model );
+		if( swept_disk_solid )
 		{
-			//ENTITY IfcSweptDiskSolid;
-			//	ENTITY IfcRepresentationItem;
-			//	INVERSE
-			//		LayerAssignments	 : 	SET OF IfcPresentationLayerAssignment FOR AssignedItems;
-			//		StyledByItem	 : 	SET [0:1] OF IfcStyledItem FOR Item;
-			//	ENTITY IfcGeometricRepresentationItem;
-			//	ENTITY IfcSolidModel;
-			//		DERIVE
-			//		Dim	 : 	IfcDimensionCount :=  3;
-			//	ENTITY IfcSweptDiskSolid;
-			//		Directrix	 : 	IfcCurve;
-			//		Radius	 : 	IfcPositiveLengthMeasure;
-			//		InnerRadius	 : 	OPTIONAL IfcPositiveLengthMeasure;
-			//		StartParam	 : 	OPTIONAL IfcParameterValue;
-			//		EndParam	 : 	OPTIONAL IfcParameterValue;
-			//END_ENTITY;	
+			convertIfcSweptDiskSolid( swept_disk_solid, item_data );
+			return;
+		}
 
-			shared_ptr<IfcCurve>& directrix_curve = swept_disp_solid->m_Directrix;
-			double radius = 0.0;
-			const double length_in_meter = m_curve_converter->getPointConverter()->getUnitConverter()->getLengthInMeterFactor();
-			if( swept_disp_solid->m_Radius )
-			{
-				radius = swept_disp_solid->m_Radius->m_value*length_in_meter;
-			}
+		messageCallback( "Unhandled IFC Representation", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, solid_model.get() );
+	}
 
-			double radius_inner = -1.0;
-			if( swept_disp_solid->m_InnerRadius )
-			{
-				radius_inner = swept_disp_solid->m_InnerRadius->m_value*length_in_meter;
-			}
+	/*\brief Converts IfcSweptDiskSolid
+	  \param[in] create_triangle_mesh Create the triangle mesh directly, without carve meshset. Only for swept disks that are not a boolean operand, see GeometrySettings::createSweptDiskTriangleMeshes
+	**/
+	void convertIfcSweptDiskSolid( const shared_ptr<IfcSweptDiskSolid>& swept_disk_solid, shared_ptr<ItemShapeData> item_data, bool create_triangle_mesh = false )
+	{
+		//ENTITY IfcSweptDiskSolid;
+		//	ENTITY IfcRepresentationItem;
+		//	INVERSE
+		//		LayerAssignments	 : 	SET OF IfcPresentationLayerAssignment FOR AssignedItems;
+		//		StyledByItem	 : 	SET [0:1] OF IfcStyledItem FOR Item;
+		//	ENTITY IfcGeometricRepresentationItem;
+		//	ENTITY IfcSolidModel;
+		//		DERIVE
+		//		Dim	 : 	IfcDimensionCount :=  3;
+		//	ENTITY IfcSweptDiskSolid;
+		//		Directrix	 : 	IfcCurve;
+		//		Radius	 : 	IfcPositiveLengthMeasure;
+		//		InnerRadius	 : 	OPTIONAL IfcPositiveLengthMeasure;
+		//		StartParam	 : 	OPTIONAL IfcParameterValue;
+		//		EndParam	 : 	OPTIONAL IfcParameterValue;
+		//END_ENTITY;	
+
+		shared_ptr<IfcCurve>& directrix_curve = swept_disk_solid->m_Directrix;
+		double radius = 0.0;
+		const double length_in_meter = m_curve_converter->getPointConverter()->getUnitConverter()->getLengthInMeterFactor();
+		if( swept_disk_solid->m_Radius )
+		{
+			radius = swept_disk_solid->m_Radius->m_value*length_in_meter;
+		}
 
-			// TODO: handle start param, end param
+		double radius_inner = -1.0;
+		if( swept_disk_solid->m_InnerRadius )
+		{
+			radius_inner = swept_disk_solid->m_InnerRadius->m_value*length_in_meter;
+		}
 
-			std::vector<vec3> segment_start_points;
-			std::vector<vec3> basis_curve_points;
-			m_curve_converter->convertIfcCurve( directrix_curve, basis_curve_points, segment_start_points, true );
-			GeomUtils::removeDuplicates(basis_curve_points);
+		// TODO: handle start param, end param
 
-			shared_ptr<ItemShapeData> item_data_solid( new ItemShapeData() );
-			const int nvc = m_geom_settings->getNumVerticesPerCircleWithRadius(radius);
-			int nvc_disk = nvc;
-			if( radius < 0.1 )
+		std::vector<vec3> segment_start_points;
+		std::vector<vec3> basis_curve_points;
+		m_curve_converter->convertIfcCurve( directrix_curve, basis_curve_points, segment_start_points, true );
+		GeomUtils::removeDuplicates(basis_curve_points);
+
+		shared_ptr<ItemShapeData> item_data_solid( new ItemShapeData() );
+		const int nvc = m_geom_settings->getNumVerticesPerCircleWithRadius(radius);
+		int nvc_disk = nvc;
+		if( radius < 0.1 && !m_geom_settings->isAdaptiveTessellation() )
+		{
+			nvc_disk = std::min(12, nvc);
+			if( radius < 0.05 )
 			{
-				nvc_disk = std::min(12, nvc);
-				if( radius < 0.05 )
-				{
-					nvc_disk = std::min(8, nvc);
-				}
+				nvc_disk = std::min(8, nvc);
 			}
-			
-			GeomProcessingParams params( m_geom_settings, swept_disp_solid.get(),  this );
-			m_sweeper->sweepDisk( basis_curve_points, item_data_solid, params, nvc_disk, radius, radius_inner );
-			item_data->addItemData( item_data_solid );
-
-			return;
 		}
-
-		messageCallback( "Unhandled IFC Representation", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, solid_model.get() );
+		
+		GeomProcessingParams params( m_geom_settings, swept_disk_solid.get(),  this );
+		if( create_triangle_mesh )
+		{
+			shared_ptr<TriangleMeshData> triangle_mesh = m_sweeper->sweepDiskTriangleMesh( basis_curve_points, params, nvc_disk, radius, radius_inner );
+			if( triangle_mesh )
+			{
+				item_data->m_triangle_meshes.push_back( triangle_mesh );
+				return;
+			}
+		}
+		m_sweeper->sweepDisk( basis_curve_points, item_data_solid, params, nvc_disk, radius, radius_inner );
+		item_data->addItemData( item_data_solid );
 	}
 
 	void convertIfcExtrudedAreaSolid( const shared_ptr<IfcExtrudedAreaSolid>& extruded_area, shared_ptr<ItemShapeData> item_data )
@@ -507,6 +524,23 @@ public:
 		GeomUtils::closestPointOnLine( origin, axis_location, axis_direction, base_point );
 		base_point *= -1.0;
 
+		if( m_geom_settings->isAdaptiveTessellation() )
+		{
+			// the largest distance of the profile from the axis determines the deviation
+			const vec3 axis_normalized = axis_direction.normalized();
+			double max_radius = 0;
+			for( const std::vector<vec2>& loop : profile_coords )
+			{
+				for( const vec2& pt : loop )
+				{
+					const vec3 pt_3d = carve::geom::VECTOR( pt.x, pt.y, 0 ) + base_point;
+					max_radius = std::max( max_radius, carve::geom::cross( pt_3d, axis_normalized ).length() );
+				}
+			}
+			num_segments = m_geom_settings->getNumSegmentsAdaptive( max_radius, revolution_angle );
+			d_angle = revolution_angle / num_segments;
+		}
+
 		// check if we have to change the direction
 		vec3  polygon_normal = GeomUtils::computePolygon2DNormal( profile_coords[0] );
 		const vec2&  pt0_2d = profile_coords[0][0];
@@ -818,28 +852,99 @@ public:
 			return;
 		}
 
-		// convert the first operand
 		shared_ptr<ItemShapeData> first_operand_data( new ItemShapeData() );
+		shared_ptr<ItemShapeData> second_operand_data( new ItemShapeData() );
 		shared_ptr<ItemShapeData> empty_operand;
-		convertIfcBooleanOperand( ifc_first_operand, first_operand_data, empty_operand );
+
+		// a half space solid is bounded by the first operand, otherwise the operands are independent and can be converted in parallel.
+		// If not, the task is executed immediately
+		const bool second_operand_independent = !dynamic_pointer_cast<IfcHalfSpaceSolid>( ifc_second_operand );
+
+		// tasks run with the time budget of the product that is converted
+		const ConversionBudget budget = ConversionBudget::current();
+
+		// convert the first operand
+#ifdef _OPENMP
+#pragma omp task firstprivate(budget) shared(ifc_first_operand, first_operand_data, empty_operand) if(second_operand_independent)
+#endif
+		{
+			ScopedConversionBudget scopedBudget( budget );
+			try
+			{
+				convertIfcBooleanOperand( ifc_first_operand, first_operand_data, empty_operand );
+			}
+			catch( carve::exception& e )
+			{
+				messageCallback( e.str(), StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, bool_result.get() );
+			}
+			catch( std::exception& e )
+			{
+				messageCallback( e.what(), StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, bool_result.get() );
+			}
+			catch( ... )
+			{
+				messageCallback( "undefined error", StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, bool_result.get() );
+			}
+		}
 
 		// convert the second operand
-		shared_ptr<ItemShapeData> second_operand_data( new ItemShapeData() );
-		convertIfcBooleanOperand( ifc_second_operand, second_operand_data, first_operand_data );
+		try
+		{
+			convertIfcBooleanOperand( ifc_second_operand, second_operand_data, second_operand_independent ? empty_operand : first_operand_data );
+		}
+		catch( carve::exception& e )
+		{
+			messageCallback( e.str(), StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, bool_result.get() );
+		}
+		catch( std::exception& e )
+		{
+			messageCallback( e.what(), StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, bool_result.get() );
+		}
+		catch( ... )
+		{
+			// the first operand task still refers to local variables, so nothing may leave this function before the taskwait
+			messageCallback( "undefined error", StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, bool_result.get() );
+		}
+#ifdef _OPENMP
+#pragma omp taskwait
+#endif
 
 		// for every first operand polyhedrons, apply all second operand polyhedrons
 		std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& vec_first_operand_meshsets = first_operand_data->m_meshsets;
-		for( size_t i_meshset_first = 0; i_meshset_first < vec_first_operand_meshsets.size(); ++i_meshset_first )
+		std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& vec_second_operand_meshsets = second_operand_data->m_meshsets;
+		const int num_first_operand_meshsets = (int)vec_first_operand_meshsets.size();
+		for( int i_meshset_first = 0; i_meshset_first < num_first_operand_meshsets; ++i_meshset_first )
 		{
-			shared_ptr<carve::mesh::MeshSet<3> >& first_operand_meshset = vec_first_operand_meshsets[i_meshset_first];
-
-			if (!first_operand_meshset)
+#ifdef _OPENMP
+#pragma omp task firstprivate(i_meshset_first, budget) shared(vec_first_operand_meshsets, vec_second_operand_meshsets, csg_operation, bool_result) if(num_first_operand_meshsets > 1)
+#endif
 			{
-				continue;
+				ScopedConversionBudget scopedBudget( budget );
+				shared_ptr<carve::mesh::MeshSet<3> >& first_operand_meshset = vec_first_operand_meshsets[i_meshset_first];
+				if( first_operand_meshset )
+				{
+					try
+					{
+						CSG_Adapter::computeCSG( first_operand_meshset, vec_second_operand_meshsets, csg_operation, m_geom_settings, this, bool_result );
+					}
+					catch( carve::exception& e )
+					{
+						messageCallback( e.str(), StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, bool_result.get() );
+					}
+					catch( std::exception& e )
+					{
+						messageCallback( e.what(), StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, bool_result.get() );
+					}
+					catch( ... )
+					{
+						messageCallback( "undefined error", StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__, bool_result.get() );
+					}
+				}
 			}
-			std::vector<shared_ptr<carve::mesh::MeshSet<3> > >& vec_second_operand_meshsets = second_operand_data->m_meshsets;
-			CSG_Adapter::computeCSG( first_operand_meshset, vec_second_operand_meshsets, csg_operation, m_geom_settings, this, bool_result );
 		}
+#ifdef _OPENMP
+#pragma omp taskwait
+#endif
 
 		// now copy processed first operands to result input data
 		std::copy( first_operand_data->m_meshsets.begin(), first_operand_data->m_meshsets.end(), std::back_inserter( item_data->m_meshsets ) );
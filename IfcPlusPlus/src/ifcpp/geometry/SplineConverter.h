@@ -147,63 +147,466 @@ public:
 		}
 	}
 
-	static void computeRationalBSpline( const size_t order, const size_t numCurvePoints, const std::vector<vec3>& controlPoints, std::vector<double>& weights,
-		std::vector<double>& knotVec, std::vector<double>& curvePoints )
+	//\brief Control points in homogeneous coordinates (x*w, y*w, z*w, w), one array per coordinate so that the evaluation loops can be vectorized
+	struct HomogeneousControlPoints
 	{
-		if( knotVec.size() < 2)
+		std::vector<double> x, y, z, w;
+
+		void assign( const std::vector<vec3>& controlPoints, const std::vector<double>& weights )
 		{
-			return;
+			const size_t numControlPoints = controlPoints.size();
+			x.resize( numControlPoints );
+			y.resize( numControlPoints );
+			z.resize( numControlPoints );
+			w.resize( numControlPoints );
+			for( size_t ii = 0; ii < numControlPoints; ++ii )
+			{
+				// missing weights default to 1
+				const double weight = ii < weights.size() ? weights[ii] : 1.0;
+				x[ii] = controlPoints[ii].x*weight;
+				y[ii] = controlPoints[ii].y*weight;
+				z[ii] = controlPoints[ii].z*weight;
+				w[ii] = weight;
+			}
+		}
+	};
+
+	//\brief Knot spans and the degree+1 non-zero basis functions of a list of parameters, stored contiguously per parameter
+	struct BasisFunctionBatch
+	{
+		size_t degree = 0;
+		std::vector<size_t> spans;
+		std::vector<double> basis;
+
+		const double* basisAt( size_t ii ) const { return &basis[ii*( degree + 1 )]; }
+	};
+
+	//\brief Returns the index i of the knot span [knotVec[i], knotVec[i+1]) that contains t, with degree <= i < numControlPoints. The end of the curve is in the last non-empty span
+	static size_t findKnotSpan( const size_t degree, const double t, const std::vector<double>& knotVec, const size_t numControlPoints )
+	{
+		const size_t n = numControlPoints - 1;
+		if( t >= knotVec[n + 1] )
+		{
+			size_t span = n;
+			while( span > degree && knotVec[span] >= knotVec[span + 1] )
+			{
+				--span;
+			}
+			return span;
+		}
+		if( t <= knotVec[degree] )
+		{
+			size_t span = degree;
+			while( span < n && knotVec[span + 1] <= knotVec[span] )
+			{
+				++span;
+			}
+			return span;
+		}
+
+		size_t low = degree;
+		size_t high = n + 1;
+		size_t mid = ( low + high ) / 2;
+		while( t < knotVec[mid] || t >= knotVec[mid + 1] )
+		{
+			if( t < knotVec[mid] )
+			{
+				high = mid;
+			}
+			else
+			{
+				low = mid;
+			}
+			mid = ( low + high ) / 2;
+		}
+		return mid;
+	}
+
+	//\brief Cox-de Boor recursion for the degree+1 basis functions that are non-zero in the given knot span. left and right are scratch buffers of size degree+1
+	static void computeLocalBasisFunctions( const size_t span, const double t, const size_t degree, const std::vector<double>& knotVec, double* basis, double* left, double* right )
+	{
+		basis[0] = 1.0;
+		for( size_t jj = 1; jj <= degree; ++jj )
+		{
+			left[jj] = t - knotVec[span + 1 - jj];
+			right[jj] = knotVec[span + jj] - t;
+			double saved = 0.0;
+			for( size_t rr = 0; rr < jj; ++rr )
+			{
+				const double denominator = right[rr + 1] + left[jj - rr];
+				const double temp = denominator != 0.0 ? basis[rr] / denominator : 0.0;
+				basis[rr] = saved + right[rr + 1] * temp;
+				saved = left[jj - rr] * temp;
+			}
+			basis[jj] = saved;
+		}
+	}
+
+	//\brief Computes knot spans and basis functions for all parameters. Parameters in ascending order reuse the span of the previous parameter if possible
+	static void computeBasisFunctionBatch( const size_t degree, const std::vector<double>& knotVec, const size_t numControlPoints, const std::vector<double>& params, BasisFunctionBatch& batch )
+	{
+		const size_t numParams = params.size();
+		batch.degree = degree;
+		batch.spans.resize( numParams );
+		batch.basis.resize( numParams*( degree + 1 ) );
+
+		std::vector<double> left( degree + 1 ), right( degree + 1 );
+		size_t span = degree;
+		for( size_t ii = 0; ii < numParams; ++ii )
+		{
+			const double t = params[ii];
+			if( !( t >= knotVec[span] && t < knotVec[span + 1] ) )
+			{
+				span = findKnotSpan( degree, t, knotVec, numControlPoints );
+			}
+			batch.spans[ii] = span;
+			computeLocalBasisFunctions( span, t, degree, knotVec, &batch.basis[ii*( degree + 1 )], left.data(), right.data() );
+		}
+	}
+
+	//\brief Evaluates a rational B-spline curve for all parameters of the batch
+	static void evaluateBSplineCurve( const BasisFunctionBatch& batch, const HomogeneousControlPoints& cp, std::vector<vec3>& curvePoints )
+	{
+		const size_t degree = batch.degree;
+		const size_t numParams = batch.spans.size();
+		curvePoints.resize( numParams );
+		for( size_t ii = 0; ii < numParams; ++ii )
+		{
+			const double* basis = batch.basisAt( ii );
+			const size_t offset = batch.spans[ii] - degree;
+			const double* px = &cp.x[offset];
+			const double* py = &cp.y[offset];
+			const double* pz = &cp.z[offset];
+			const double* pw = &cp.w[offset];
+			double x = 0, y = 0, z = 0, w = 0;
+			for( size_t kk = 0; kk <= degree; ++kk )
+			{
+				x += basis[kk] * px[kk];
+				y += basis[kk] * py[kk];
+				z += basis[kk] * pz[kk];
+				w += basis[kk] * pw[kk];
+			}
+			if( w != 0.0 )
+			{
+				curvePoints[ii] = carve::geom::VECTOR( x / w, y / w, z / w );
+			}
+			else
+			{
+				curvePoints[ii] = carve::geom::VECTOR( 0, 0, 0 );
+			}
+		}
+	}
+
+	/**\brief Evaluates a rational B-spline surface on the grid of parameters of batchU x batchV. The control points are given row by row (numControlPointsV per row).
+	For each u parameter, the rows that are weighted by the basis functions in u are combined first, so that each grid point only needs degreeV+1 multiplications */
+	static void evaluateBSplineSurface( const BasisFunctionBatch& batchU, const BasisFunctionBatch& batchV, const HomogeneousControlPoints& cp, const size_t numControlPointsV, std::vector<vec3>& gridPoints )
+	{
+		const size_t degreeU = batchU.degree;
+		const size_t degreeV = batchV.degree;
+		const size_t numParamsU = batchU.spans.size();
+		const size_t numParamsV = batchV.spans.size();
+		gridPoints.resize( numParamsU*numParamsV );
+
+		HomogeneousControlPoints row;
+		row.x.resize( numControlPointsV );
+		row.y.resize( numControlPointsV );
+		row.z.resize( numControlPointsV );
+		row.w.resize( numControlPointsV );
+
+		for( size_t iu = 0; iu < numParamsU; ++iu )
+		{
+			const double* basisU = batchU.basisAt( iu );
+			const size_t offsetU = batchU.spans[iu] - degreeU;
+			std::fill( row.x.begin(), row.x.end(), 0.0 );
+			std::fill( row.y.begin(), row.y.end(), 0.0 );
+			std::fill( row.z.begin(), row.z.end(), 0.0 );
+			std::fill( row.w.begin(), row.w.end(), 0.0 );
+			for( size_t kk = 0; kk <= degreeU; ++kk )
+			{
+				const double b = basisU[kk];
+				const size_t rowStart = ( offsetU + kk )*numControlPointsV;
+				const double* px = &cp.x[rowStart];
+				const double* py = &cp.y[rowStart];
+				const double* pz = &cp.z[rowStart];
+				const double* pw = &cp.w[rowStart];
+				for( size_t jj = 0; jj < numControlPointsV; ++jj )
+				{
+					row.x[jj] += b * px[jj];
+					row.y[jj] += b * py[jj];
+					row.z[jj] += b * pz[jj];
+					row.w[jj] += b * pw[jj];
+				}
+			}
+
+			for( size_t iv = 0; iv < numParamsV; ++iv )
+			{
+				const double* basisV = batchV.basisAt( iv );
+				const size_t offsetV = batchV.spans[iv] - degreeV;
+				double x = 0, y = 0, z = 0, w = 0;
+				for( size_t kk = 0; kk <= degreeV; ++kk )
+				{
+					x += basisV[kk] * row.x[offsetV + kk];
+					y += basisV[kk] * row.y[offsetV + kk];
+					z += basisV[kk] * row.z[offsetV + kk];
+					w += basisV[kk] * row.w[offsetV + kk];
+				}
+				vec3& point = gridPoints[iu*numParamsV + iv];
+				if( w != 0.0 )
+				{
+					point = carve::geom::VECTOR( x / w, y / w, z / w );
+				}
+				else
+				{
+					point = carve::geom::VECTOR( 0, 0, 0 );
+				}
+			}
 		}
-		// order: order of the BSpline basis function
-		std::vector<double> basis_func;  // basis function for parameter value t
-		basis_func.resize( controlPoints.size() + 1, 0.0 );
+	}
 
-		const size_t n_plus_order = controlPoints.size() + order; // number of knot values
-		if( knotVec.size() != n_plus_order )
+	//\brief Makes sure the knot vector matches the number of control points and the order. Otherwise, a uniform open knot vector is generated and the order is reduced if there are not enough control points
+	static void validateKnotVector( const size_t numControlPoints, size_t& order, std::vector<double>& knotVec )
+	{
+		if( order > numControlPoints )
+		{
+			order = numControlPoints;
+		}
+
+		const size_t n_plus_order = numControlPoints + order; // number of knot values
+		bool valid = knotVec.size() == n_plus_order;
+		for( size_t ii = 1; valid && ii < knotVec.size(); ++ii )
+		{
+			valid = knotVec[ii - 1] <= knotVec[ii];
+		}
+		if( valid )
+		{
+			// the curve needs a non-empty parameter range
+			valid = knotVec[order - 1] < knotVec[numControlPoints];
+		}
+
+		if( !valid )
 		{
 			// generate a uniform open knot vector
 			knotVec.resize( n_plus_order, 0.0 );
-			computeKnotVector( controlPoints.size(), order, knotVec );
+			computeKnotVector( numControlPoints, order, knotVec );
 		}
+	}
 
-		double t = knotVec[0]; // parameter value 0 <= t <= npts - k + 1
-		double step = (knotVec[knotVec.size() - 1] - knotVec[0])/ ( (double)( numCurvePoints - 1 ) );
+	//\brief Equidistant parameters over the range of the curve, from knotVec[degree] to knotVec[numControlPoints]
+	static void computeParameters( const size_t degree, const size_t numControlPoints, const std::vector<double>& knotVec, const size_t numParams, std::vector<double>& params )
+	{
+		const double t_start = knotVec[degree];
+		const double t_end = knotVec[numControlPoints];
+		params.resize( numParams );
+		if( numParams == 1 )
+		{
+			params[0] = t_start;
+			return;
+		}
 
-		std::vector<double> control_points_coords;
-		for( size_t ii = 0; ii < controlPoints.size(); ++ii )
+		const double step = ( t_end - t_start ) / (double)( numParams - 1 );
+		for( size_t ii = 0; ii < numParams; ++ii )
 		{
-			control_points_coords.push_back( controlPoints[ii].x );
-			control_points_coords.push_back( controlPoints[ii].y );
-			control_points_coords.push_back( controlPoints[ii].z );
+			params[ii] = t_start + step*(double)ii;
 		}
+		params[numParams - 1] = t_end;
+	}
 
-		size_t offset_i = 0;
-		double temp;
-		for( size_t ii = 0; ii < numCurvePoints; ++ii )
+	/**\brief Parameters for adaptive tessellation. Each knot span starts with max(2, degree) intervals, then intervals are bisected until the midpoint is closer than
+	maxDeviation to the chord and the chords on both sides of the midpoint turn by less than maxAngle. All midpoints of a pass are evaluated in one batch */
+	static void computeAdaptiveParameters( const size_t degree, const std::vector<double>& knotVec, const size_t numControlPoints, const HomogeneousControlPoints& cp,
+		const double maxDeviation, const double maxAngle, std::vector<double>& params )
+	{
+		const size_t maxNumPoints = 100000;
+		const size_t maxNumPasses = 16;
+		const size_t numIntervalsPerSpan = std::max( size_t(2), degree );
+		params.clear();
+		for( size_t span = degree; span < numControlPoints; ++span )
 		{
-			if( t > knotVec[knotVec.size() - 1] - 0.000001 )
+			const double t0 = knotVec[span];
+			const double t1 = knotVec[span + 1];
+			if( !( t1 > t0 ) )
+			{
+				continue;
+			}
+			for( size_t ii = 0; ii < numIntervalsPerSpan; ++ii )
 			{
-				t = knotVec[knotVec.size() - 1];
+				params.push_back( t0 + ( t1 - t0 )*(double)ii / (double)numIntervalsPerSpan );
 			}
+		}
+		params.push_back( knotVec[numControlPoints] );
+
+		BasisFunctionBatch batch;
+		std::vector<vec3> points;
+		computeBasisFunctionBatch( degree, knotVec, numControlPoints, params, batch );
+		evaluateBSplineCurve( batch, cp, points );
+
+		// interval ii is between params[ii] and params[ii+1]
+		std::vector<char> check_interval( params.size() - 1, 1 );
+		const double cosMaxAngle = std::cos( std::min( maxAngle, M_PI ) );
+		std::vector<double> midParams;
+		std::vector<vec3> midPoints;
+		std::vector<double> paramsRefined;
+		std::vector<vec3> pointsRefined;
+		std::vector<char> check_interval_refined;
+		for( size_t pass = 0; pass < maxNumPasses; ++pass )
+		{
+			midParams.clear();
+			for( size_t ii = 0; ii < check_interval.size(); ++ii )
+			{
+				if( check_interval[ii] )
+				{
+					midParams.push_back( 0.5*( params[ii] + params[ii + 1] ) );
+				}
+			}
+			if( midParams.empty() || params.size() + midParams.size() > maxNumPoints )
+			{
+				break;
+			}
+
+			computeBasisFunctionBatch( degree, knotVec, numControlPoints, midParams, batch );
+			evaluateBSplineCurve( batch, cp, midPoints );
 
-			// generate the basis function for this value of t
-			computRationalBasisFunctions( order, t, controlPoints.size(), knotVec, weights, basis_func );
+			paramsRefined.clear();
+			pointsRefined.clear();
+			check_interval_refined.clear();
+			size_t i_mid = 0;
+			for( size_t ii = 0; ii < params.size(); ++ii )
+			{
+				paramsRefined.push_back( params[ii] );
+				pointsRefined.push_back( points[ii] );
+				if( ii + 1 == params.size() || !check_interval[ii] )
+				{
+					check_interval_refined.push_back( 0 );
+					continue;
+				}
+
+				const vec3& a = points[ii];
+				const vec3& b = points[ii + 1];
+				const vec3& mid = midPoints[i_mid];
+				const vec3 ab = b - a;
+				const vec3 a_mid = mid - a;
+				const vec3 mid_b = b - mid;
+				double deviation = a_mid.length();
+				const double ab_length2 = ab.length2();
+				if( ab_length2 > 0.0 )
+				{
+					const double s = std::max( 0.0, std::min( 1.0, carve::geom::dot( a_mid, ab ) / ab_length2 ) );
+					deviation = ( a_mid - ab*s ).length();
+				}
+
+				bool split = deviation > maxDeviation;
+				if( !split )
+				{
+					const double length_product = a_mid.length()*mid_b.length();
+					if( length_product > 0.0 )
+					{
+						split = carve::geom::dot( a_mid, mid_b ) < cosMaxAngle*length_product;
+					}
+				}
+
+				if( split )
+				{
+					check_interval_refined.push_back( 1 );
+					paramsRefined.push_back( midParams[i_mid] );
+					pointsRefined.push_back( mid );
+				}
+				check_interval_refined.push_back( split ? 1 : 0 );
+				++i_mid;
+			}
+			check_interval_refined.pop_back();	// no interval after the last point
+
+			params.swap( paramsRefined );
+			points.swap( pointsRefined );
+			check_interval.swap( check_interval_refined );
+		}
+	}
 
-			for( size_t jj = 0; jj < 3; ++jj )
+	static void convertKnotVector( const std::vector<shared_ptr<IfcParameterValue> >& ifc_knots, const std::vector<shared_ptr<IfcInteger> >& ifc_knot_mult, std::vector<double>& knotVector )
+	{
+		for( size_t ii = 0; ii < ifc_knots.size(); ++ii )
+		{
+			const shared_ptr<IfcParameterValue>& knot_parameter = ifc_knots[ii];
+			if( !knot_parameter )
 			{
-				curvePoints[offset_i + jj] = 0.;
+				continue;
+			}
+			double knot_value = knot_parameter->m_value;
 
-				for( size_t kk = 0; kk < controlPoints.size(); ++kk )
+			int num_multiply_knot_value = 1;
+			if( ifc_knot_mult.size() == ifc_knots.size() )
+			{
+				if( ifc_knot_mult[ii] )
 				{
-					// matrix multiplication
-					temp = basis_func[kk] * control_points_coords[jj + kk * 3];
-					curvePoints[offset_i + jj] = curvePoints[offset_i + jj] + temp;
+					num_multiply_knot_value = ifc_knot_mult[ii]->m_value;
 				}
 			}
 
-			offset_i = offset_i + 3;
-			t = t + step;
+			for( int jj = 0; jj < num_multiply_knot_value; ++jj )
+			{
+				knotVector.push_back( knot_value );
+			}
+		}
+	}
+
+	/**\brief Computes numCurvePoints points of a rational B-spline curve, equidistant in the parameter range. Only the order basis functions that are non-zero
+	in the knot span of a parameter are evaluated. weights[i] belongs to controlPoints[i], missing weights are 1. curvePoints receives x,y,z of each point */
+	static void computeRationalBSpline( const size_t order, const size_t numCurvePoints, const std::vector<vec3>& controlPoints, std::vector<double>& weights,
+		std::vector<double>& knotVec, std::vector<double>& curvePoints )
+	{
+		if( controlPoints.size() < 2 || order < 1 || numCurvePoints < 1 )
+		{
+			return;
+		}
+
+		const size_t numControlPoints = controlPoints.size();
+		size_t orderValid = order;
+		validateKnotVector( numControlPoints, orderValid, knotVec );
+		const size_t degree = orderValid - 1;
+
+		std::vector<double> params;
+		computeParameters( degree, numControlPoints, knotVec, numCurvePoints, params );
+
+		BasisFunctionBatch batch;
+		computeBasisFunctionBatch( degree, knotVec, numControlPoints, params, batch );
+
+		HomogeneousControlPoints cp;
+		cp.assign( controlPoints, weights );
+
+		std::vector<vec3> points;
+		evaluateBSplineCurve( batch, cp, points );
+
+		curvePoints.resize( 3 * numCurvePoints );
+		for( size_t ii = 0; ii < numCurvePoints; ++ii )
+		{
+			curvePoints[3 * ii] = points[ii].x;
+			curvePoints[3 * ii + 1] = points[ii].y;
+			curvePoints[3 * ii + 2] = points[ii].z;
+		}
+	}
+
+	//\brief Computes the points of a rational B-spline curve with the parameters of computeAdaptiveParameters. weights[i] belongs to controlPoints[i], missing weights are 1
+	static void computeRationalBSplineAdaptive( const size_t order, const std::vector<vec3>& controlPoints, const std::vector<double>& weights, std::vector<double>& knotVec,
+		const double maxDeviation, const double maxAngle, std::vector<vec3>& curvePoints )
+	{
+		if( controlPoints.size() < 2 || order < 1 )
+		{
+			return;
 		}
+
+		const size_t numControlPoints = controlPoints.size();
+		size_t orderValid = order;
+		validateKnotVector( numControlPoints, orderValid, knotVec );
+		const size_t degree = orderValid - 1;
+
+		HomogeneousControlPoints cp;
+		cp.assign( controlPoints, weights );
+
+		std::vector<double> params;
+		computeAdaptiveParameters( degree, knotVec, numControlPoints, cp, maxDeviation, maxAngle, params );
+
+		BasisFunctionBatch batch;
+		computeBasisFunctionBatch( degree, knotVec, numControlPoints, params, batch );
+		evaluateBSplineCurve( batch, cp, curvePoints );
 	}
 
 	SplineConverter( shared_ptr<GeometrySettings>& geom_settings, shared_ptr<PointConverter>& pt_converter )
@@ -243,49 +646,20 @@ public:
 
 		//	set weighting factors to 1.0 in case of homogeneous curve
 		std::vector<double> weights;
-		weights.resize( numControlPoints + 1, 1.0 );
+		weights.resize( numControlPoints, 1.0 );
 
 		shared_ptr<IfcBSplineCurveWithKnots> bspline_curve_with_knots = dynamic_pointer_cast<IfcBSplineCurveWithKnots>( bspline_curve );
 		if( bspline_curve_with_knots )
 		{
-			std::vector<shared_ptr<IfcInteger> >&			ifc_knot_mult = bspline_curve_with_knots->m_KnotMultiplicities;
-			std::vector<shared_ptr<IfcParameterValue> >&	ifc_knots = bspline_curve_with_knots->m_Knots;
 			//shared_ptr<IfcKnotType>&						ifc_knot_spec = bspline_curve_with_knots->m_KnotSpec;
-
-			for( size_t ii = 0; ii < ifc_knots.size(); ++ii )
-			{
-				shared_ptr<IfcParameterValue>& knot_parameter = ifc_knots[ii];
-				double knot_value = knot_parameter->m_value;
-				
-				int num_multiply_knot_value = 1;
-				if( ifc_knot_mult.size() == ifc_knots.size() )
-				{
-					num_multiply_knot_value = ifc_knot_mult[ii]->m_value;
-				}
-				
-				for( int jj = 0; jj < num_multiply_knot_value; ++jj )
-				{
-					knotVector.push_back( knot_value );
-				}
-			}
+			convertKnotVector( bspline_curve_with_knots->m_Knots, bspline_curve_with_knots->m_KnotMultiplicities, knotVector );
 
 #ifdef _DEBUG
-			std::stringstream controlPointsStringStream;
-			for( size_t i_weight = 0; i_weight < controlPoints.size(); ++i_weight )
-			{
-				controlPointsStringStream << controlPoints[i_weight].x << "  " << controlPoints[i_weight].y << "  " << controlPoints[i_weight].z << "\n";
-			}
-			std::string controlPointsString = controlPointsStringStream.str();
-
 			// check knot multiplicities and degree
-			const size_t n_plus_order = controlPoints.size() + order; // number of knot values
-			int n = numControlPoints - 1;
-			int k = order;
-			size_t numKnots = n + k + 1;
+			size_t numKnots = numControlPoints + order;
 			if( numKnots != knotVector.size() )
 			{
-				knotVector.clear();  // valid knot vector will be computed in computeRationalBSpline
-				std::cout << "invalid knot vector/KnotMultiplicities" << std::endl;
+				std::cout << "invalid knot vector/KnotMultiplicities" << std::endl;	// valid knot vector will be computed in computeRationalBSpline
 			}
 #endif
 
@@ -293,14 +667,33 @@ public:
 			if( r_bspline_curve_with_knots )
 			{
 				std::vector<shared_ptr<IfcReal> >& ifc_vec_weigths = r_bspline_curve_with_knots->m_WeightsData;
-				weights.resize( ifc_vec_weigths.size() );
-				for( size_t i_weight = 0; i_weight < ifc_vec_weigths.size(); ++i_weight )
+				for( size_t i_weight = 0; i_weight < ifc_vec_weigths.size() && i_weight < numControlPoints; ++i_weight )
 				{
-					weights[i_weight] = ifc_vec_weigths[i_weight]->m_value;
+					if( ifc_vec_weigths[i_weight] )
+					{
+						weights[i_weight] = ifc_vec_weigths[i_weight]->m_value;
+					}
 				}
 			}
 		}
 
+		if( m_geom_settings->isAdaptiveTessellation() )
+		{
+			std::vector<vec3> curvePoints;
+			computeRationalBSplineAdaptive( order, controlPoints, weights, knotVector, m_geom_settings->getMaxChordalDeviation(), m_geom_settings->getMaxSegmentAngle(), curvePoints );
+			if( curvePoints.empty() )
+			{
+				return;
+			}
+
+			if( target_vec.size() > 2 )
+			{
+				segment_start_points.push_back( curvePoints[0] );
+			}
+			std::copy( curvePoints.begin(), curvePoints.end(), std::back_inserter( target_vec ) );
+			return;
+		}
+
 		std::vector<double> curvePointsCoords;
 		curvePointsCoords.resize( 3 * numCurvePoints, 0.0 );
 		computeRationalBSpline( order, numCurvePoints, controlPoints, weights, knotVector, curvePointsCoords );
@@ -316,57 +709,171 @@ public:
 		}
 	}
 
+	//\brief Adaptive parameters of a surface in one direction: union of the adaptive parameters of all rows of control points in that direction
+	static void computeAdaptiveSurfaceParameters( const size_t degree, const std::vector<double>& knotVec, const HomogeneousControlPoints& cp, const size_t numControlPoints,
+		const size_t numRows, const size_t stride, const size_t rowStride, const double maxDeviation, const double maxAngle, std::vector<double>& params )
+	{
+		HomogeneousControlPoints row;
+		std::vector<double> rowParams;
+		params.clear();
+		for( size_t i_row = 0; i_row < numRows; ++i_row )
+		{
+			row.x.resize( numControlPoints );
+			row.y.resize( numControlPoints );
+			row.z.resize( numControlPoints );
+			row.w.resize( numControlPoints );
+			for( size_t ii = 0; ii < numControlPoints; ++ii )
+			{
+				const size_t index = i_row*rowStride + ii*stride;
+				row.x[ii] = cp.x[index];
+				row.y[ii] = cp.y[index];
+				row.z[ii] = cp.z[index];
+				row.w[ii] = cp.w[index];
+			}
+			computeAdaptiveParameters( degree, knotVec, numControlPoints, row, maxDeviation, maxAngle, rowParams );
+			std::copy( rowParams.begin(), rowParams.end(), std::back_inserter( params ) );
+		}
+		std::sort( params.begin(), params.end() );
+		params.erase( std::unique( params.begin(), params.end() ), params.end() );
+	}
 
-
-	void convertIfcBSplineSurface( const shared_ptr<IfcBSplineSurface>& ifc_bspline_surface, shared_ptr<carve::input::PolylineSetData>& polyline_data )
+	/**\brief Evaluates the surface on a grid of numControlPoints * NumVerticesPerControlPoint parameters in each direction, or of adaptive parameters, see GeometrySettings::setMaxChordalDeviation. gridPoints is filled row by row, with numPointsV points per row.
+	Returns false if the surface is not valid */
+	bool computeBSplineSurfaceGrid( const shared_ptr<IfcBSplineSurface>& ifc_bspline_surface, std::vector<vec3>& gridPoints, size_t& numPointsU, size_t& numPointsV ) const
 	{
-		// IfcBSplineSurface -----------------------------------------------------------
-		// attributes:
-		//int degree_u = ifc_bspline_surface->m_UDegree;
-		//int degree_v = ifc_bspline_surface->m_VDegree;
+		if( !ifc_bspline_surface || !ifc_bspline_surface->m_UDegree || !ifc_bspline_surface->m_VDegree )
+		{
+			return false;
+		}
+
+		// control points are given as list of rows in u direction, each row has the same number of points in v direction
 		std::vector<std::vector<shared_ptr<IfcCartesianPoint> > >& ifc_control_points = ifc_bspline_surface->m_ControlPointsList;
-		shared_ptr<IfcBSplineSurfaceForm> surface_form = ifc_bspline_surface->m_SurfaceForm;
-		//LogicalEnum u_closed = ifc_bspline_surface->m_UClosed;
-		//LogicalEnum v_closed = ifc_bspline_surface->m_VClosed;
-		//LogicalEnum	self_intersect = ifc_bspline_surface->m_SelfIntersect;
+		const size_t numControlPointsU = ifc_control_points.size();
+		if( numControlPointsU < 2 )
+		{
+			return false;
+		}
+		const size_t numControlPointsV = ifc_control_points[0].size();
+		if( numControlPointsV < 2 )
+		{
+			return false;
+		}
+		for( const std::vector<shared_ptr<IfcCartesianPoint> >& row : ifc_control_points )
+		{
+			if( row.size() != numControlPointsV )
+			{
+				return false;
+			}
+			for( const shared_ptr<IfcCartesianPoint>& point : row )
+			{
+				if( !point )
+				{
+					return false;
+				}
+			}
+		}
+
+		std::vector<vec3> controlPoints;
+		m_point_converter->convertIfcCartesianPointVector2D( ifc_control_points, controlPoints );
+
+		size_t orderU = ifc_bspline_surface->m_UDegree->m_value + 1;
+		size_t orderV = ifc_bspline_surface->m_VDegree->m_value + 1;
+		std::vector<double> knotsU, knotsV;
+		std::vector<double> weights( numControlPointsU*numControlPointsV, 1.0 );
 
 		shared_ptr<IfcBSplineSurfaceWithKnots> bspline_surface_with_knots = dynamic_pointer_cast<IfcBSplineSurfaceWithKnots>( ifc_bspline_surface );
 		if( bspline_surface_with_knots )
 		{
-			//std::vector<int >& u_mult = bspline_surface_with_knots->m_UMultiplicities;
-			//std::vector<int >& v_mult = bspline_surface_with_knots->m_VMultiplicities;
-			//std::vector<shared_ptr<IfcParameterValue> >& ifc_u_knots = bspline_surface_with_knots->m_UKnots;
-			//std::vector<shared_ptr<IfcParameterValue> >& ifc_v_knots = bspline_surface_with_knots->m_VKnots;
-
-			//shared_ptr<IfcKnotType>& knot_spec = bspline_surface_with_knots->m_KnotSpec;
-
+			convertKnotVector( bspline_surface_with_knots->m_UKnots, bspline_surface_with_knots->m_UMultiplicities, knotsU );
+			convertKnotVector( bspline_surface_with_knots->m_VKnots, bspline_surface_with_knots->m_VMultiplicities, knotsV );
 
 			shared_ptr<IfcRationalBSplineSurfaceWithKnots> r_bspline_surface_with_knots = dynamic_pointer_cast<IfcRationalBSplineSurfaceWithKnots>( ifc_bspline_surface );
 			if( r_bspline_surface_with_knots )
 			{
-				//std::vector<std::vector<double > >& weights = r_bspline_surface_with_knots->m_WeightsData;
-
+				std::vector<std::vector<shared_ptr<IfcReal> > >& ifc_weights = r_bspline_surface_with_knots->m_WeightsData;
+				for( size_t iu = 0; iu < ifc_weights.size() && iu < numControlPointsU; ++iu )
+				{
+					for( size_t iv = 0; iv < ifc_weights[iu].size() && iv < numControlPointsV; ++iv )
+					{
+						if( ifc_weights[iu][iv] )
+						{
+							weights[iu*numControlPointsV + iv] = ifc_weights[iu][iv]->m_value;
+						}
+					}
+				}
 			}
 		}
 
-		std::vector<vec3> control_point_array;
+		validateKnotVector( numControlPointsU, orderU, knotsU );
+		validateKnotVector( numControlPointsV, orderV, knotsV );
 
-		m_point_converter->convertIfcCartesianPointVector2D( ifc_control_points, control_point_array );
+		HomogeneousControlPoints cp;
+		cp.assign( controlPoints, weights );
 
-		//unsigned int numPathU = 10;
-		//unsigned int numPathV = 10;
+		std::vector<double> paramsU, paramsV;
+		if( m_geom_settings->isAdaptiveTessellation() )
+		{
+			const double maxDeviation = m_geom_settings->getMaxChordalDeviation();
+			const double maxAngle = m_geom_settings->getMaxSegmentAngle();
+			computeAdaptiveSurfaceParameters( orderU - 1, knotsU, cp, numControlPointsU, numControlPointsV, numControlPointsV, 1, maxDeviation, maxAngle, paramsU );
+			computeAdaptiveSurfaceParameters( orderV - 1, knotsV, cp, numControlPointsV, numControlPointsU, 1, numControlPointsV, maxDeviation, maxAngle, paramsV );
+		}
+		else
+		{
+			const size_t numVerticesPerControlPoint = std::max( 1, m_geom_settings->getNumVerticesPerControlPoint() );
+			computeParameters( orderU - 1, numControlPointsU, knotsU, numControlPointsU * numVerticesPerControlPoint, paramsU );
+			computeParameters( orderV - 1, numControlPointsV, knotsV, numControlPointsV * numVerticesPerControlPoint, paramsV );
+		}
+		numPointsU = paramsU.size();
+		numPointsV = paramsV.size();
+
+		BasisFunctionBatch batchU, batchV;
+		computeBasisFunctionBatch( orderU - 1, knotsU, numControlPointsU, paramsU, batchU );
+		computeBasisFunctionBatch( orderV - 1, knotsV, numControlPointsV, paramsV, batchV );
+		evaluateBSplineSurface( batchU, batchV, cp, numControlPointsV, gridPoints );
+		return true;
+	}
 
-		const size_t eta = ifc_control_points.size();
-		if( eta < 2 )
+	//\brief Converts the surface to a grid of polylines along the u and v direction
+	void convertIfcBSplineSurface( const shared_ptr<IfcBSplineSurface>& ifc_bspline_surface, shared_ptr<carve::input::PolylineSetData>& polyline_data )
+	{
+		// IfcBSplineSurface -----------------------------------------------------------
+		//shared_ptr<IfcBSplineSurfaceForm> surface_form = ifc_bspline_surface->m_SurfaceForm;
+		//LogicalEnum u_closed = ifc_bspline_surface->m_UClosed;
+		//LogicalEnum v_closed = ifc_bspline_surface->m_VClosed;
+		//LogicalEnum	self_intersect = ifc_bspline_surface->m_SelfIntersect;
+		//shared_ptr<IfcKnotType>& knot_spec = bspline_surface_with_knots->m_KnotSpec;
+
+		std::vector<vec3> gridPoints;
+		size_t numPointsU = 0;
+		size_t numPointsV = 0;
+		if( !computeBSplineSurfaceGrid( ifc_bspline_surface, gridPoints, numPointsU, numPointsV ) )
 		{
+			messageCallback( "Invalid IfcBSplineSurface", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, ifc_bspline_surface.get() );
 			return;
 		}
-		//const size_t zeta = ifc_control_points[0].size();
 
-		//const int num_points_per_section = eta*zeta;
-		// TODO: implement
-#ifdef _DEBUG
-		std::cout << "IfcBSplineSurface not yet implemented" << std::endl;
-#endif
+		const int indexOffset = (int)polyline_data->points.size();
+		polyline_data->points.insert( polyline_data->points.end(), gridPoints.begin(), gridPoints.end() );
+
+		for( size_t iu = 0; iu < numPointsU; ++iu )
+		{
+			polyline_data->beginPolyline();
+			polyline_data->reservePolyline( numPointsV );
+			for( size_t iv = 0; iv < numPointsV; ++iv )
+			{
+				polyline_data->addPolylineIndex( indexOffset + (int)( iu*numPointsV + iv ) );
+			}
+		}
+
+		for( size_t iv = 0; iv < numPointsV; ++iv )
+		{
+			polyline_data->beginPolyline();
+			polyline_data->reservePolyline( numPointsU );
+			for( size_t iu = 0; iu < numPointsU; ++iu )
+			{
+				polyline_data->addPolylineIndex( indexOffset + (int)( iu*numPointsV + iv ) );
+			}
+		}
 	}
 };
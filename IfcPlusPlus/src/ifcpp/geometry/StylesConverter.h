@@ -18,8 +18,11 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OU
 #pragma once
 
 #include <map>
+#include <shared_mutex>
+#include <unordered_map>
 
 #include <ifcpp/geometry/AppearanceData.h>
+#include <ifcpp/geometry/AppearancePalette.h>
 #include <ifcpp/model/BasicTypes.h>
 #include <ifcpp/model/OpenMPIncludes.h>
 #include <ifcpp/model/StatusCallback.h>
@@ -72,23 +75,64 @@ using namespace IFC4X3;
 class StylesConverter : public StatusCallback
 {
 protected:
-	std::map<int, shared_ptr<AppearanceData> > m_map_ifc_styles;
+	std::unordered_map<int, shared_ptr<AppearanceData> > m_map_ifc_styles;
+	std::unordered_map<int, std::vector<shared_ptr<AppearanceData> > > m_map_styled_items;
+	shared_ptr<AppearancePalette> m_appearance_palette;
 
 #ifdef _OPENMP
-	Mutex m_writelock_styles_converter;
+	// styles are converted once and then looked up by many threads, so lookups take a shared lock only
+	std::shared_mutex m_writelock_styles_converter;
 #endif
 
 public:
 	StylesConverter()
 	{
+		m_appearance_palette = shared_ptr<AppearancePalette>( new AppearancePalette() );
 	}
 	virtual ~StylesConverter()
 	{
 	}
 
+	shared_ptr<AppearancePalette>& getAppearancePalette() { return m_appearance_palette; }
+
+	//\brief Clears the cached styles. The palette is kept, so that palette ids of existing appearances remain valid
 	void clearStylesCache()
 	{
+#ifdef _OPENMP
+		std::unique_lock<std::shared_mutex> lock( m_writelock_styles_converter );
+#endif
 		m_map_ifc_styles.clear();
+		m_map_styled_items.clear();
+	}
+
+	void clearAppearancePalette()
+	{
+		m_appearance_palette->clearPalette();
+	}
+
+	bool findCachedStyle( int style_id, shared_ptr<AppearanceData>& appearance_data )
+	{
+#ifdef _OPENMP
+		std::shared_lock<std::shared_mutex> lock( m_writelock_styles_converter );
+#endif
+		auto it_find_existing_style = m_map_ifc_styles.find( style_id );
+		if( it_find_existing_style == m_map_ifc_styles.end() )
+		{
+			return false;
+		}
+		appearance_data = it_find_existing_style->second;
+		return true;
+	}
+
+	//\brief Replaces the completely converted appearance by its palette entry, and caches it for the style entity
+	void addCachedStyle( int style_id, shared_ptr<AppearanceData>& appearance_data )
+	{
+		appearance_data = m_appearance_palette->addAppearance( appearance_data );
+
+#ifdef _OPENMP
+		std::unique_lock<std::shared_mutex> lock( m_writelock_styles_converter );
+#endif
+		m_map_ifc_styles.insert( { style_id, appearance_data } );
 	}
 
 	static void convertIfcSpecularHighlightSelect( shared_ptr<IfcSpecularHighlightSelect> highlight_select, shared_ptr<AppearanceData>& appearance_data )
@@ -271,38 +315,28 @@ public:
 	void convertIfcPresentationStyle( shared_ptr<IfcPresentationStyle> presentation_style, shared_ptr<AppearanceData>& appearance_data )
 	{
 		int style_id = presentation_style->m_tag;
-#ifdef _OPENMP
+		if( findCachedStyle( style_id, appearance_data ) )
 		{
-			ScopedLock lock(m_writelock_styles_converter);
-#endif
-			auto it_find_existing_style = m_map_ifc_styles.find( style_id );
-			if( it_find_existing_style != m_map_ifc_styles.end() )
-			{
-				// use existing appearance
-				appearance_data = it_find_existing_style->second;
-				if( appearance_data->m_complete )
-				{
-					return;
-				}
-			}
-			else
-			{
-				if( !appearance_data )
-				{
-					appearance_data = shared_ptr<AppearanceData>( new AppearanceData( style_id ) );
-				}
+			return;
+		}
 
-				m_map_ifc_styles[style_id] = appearance_data;
-			}
-#ifdef _OPENMP
+		if( !appearance_data )
+		{
+			appearance_data = shared_ptr<AppearanceData>( new AppearanceData( style_id ) );
 		}
-#endif
+		convertIfcPresentationStyleData( presentation_style, appearance_data );
+
+		// the appearance is visible to other threads only after it is complete
+		addCachedStyle( style_id, appearance_data );
+	}
 
+	static void convertIfcPresentationStyleData( shared_ptr<IfcPresentationStyle> presentation_style, shared_ptr<AppearanceData>& appearance_data )
+	{
 		// ENTITY IfcPresentationStyle	ABSTRACT SUPERTYPE OF(ONEOF(IfcCurveStyle, IfcFillAreaStyle, IfcSurfaceStyle, IfcSymbolStyle, IfcTextStyle));
 		shared_ptr<IfcCurveStyle> curve_style = dynamic_pointer_cast<IfcCurveStyle>( presentation_style );
 		if( curve_style )
 		{
-			convertIfcCurveStyle( curve_style, appearance_data );
+			convertIfcCurveStyleData( curve_style, appearance_data );
 			return;
 		}
 
@@ -330,7 +364,7 @@ public:
 
 					if( hatching->m_HatchLineAppearance )
 					{
-						convertIfcCurveStyle(hatching->m_HatchLineAppearance, appearance_data);
+						convertIfcCurveStyleData(hatching->m_HatchLineAppearance, appearance_data);
 					}
 					continue;
 				}
@@ -381,7 +415,7 @@ public:
 		shared_ptr<IfcSurfaceStyle> surface_style = dynamic_pointer_cast<IfcSurfaceStyle>( presentation_style );
 		if( surface_style )
 		{
-			convertIfcSurfaceStyle( surface_style, appearance_data );
+			convertIfcSurfaceStyleData( surface_style, appearance_data );
 			return;
 		}
 
@@ -403,31 +437,21 @@ public:
 			return;
 		}
 		int style_id = curve_style->m_tag;
-#ifdef _OPENMP
+		if( findCachedStyle( style_id, appearance_data ) )
 		{
-			ScopedLock lock(m_writelock_styles_converter);
-#endif
-			auto it_find_existing_style = m_map_ifc_styles.find( style_id );
-			if( it_find_existing_style != m_map_ifc_styles.end() )
-			{
-				appearance_data = it_find_existing_style->second;
-				if( appearance_data->m_complete )
-				{
-					return;
-				}
-			}
-			else
-			{
-				if( !appearance_data )
-				{
-					appearance_data = shared_ptr<AppearanceData>( new AppearanceData( style_id ) );
-				}
+			return;
+		}
 
-				m_map_ifc_styles[style_id] = appearance_data;
-			}
-#ifdef _OPENMP
+		if( !appearance_data )
+		{
+			appearance_data = shared_ptr<AppearanceData>( new AppearanceData( style_id ) );
 		}
-#endif
+		convertIfcCurveStyleData( curve_style, appearance_data );
+		addCachedStyle( style_id, appearance_data );
+	}
+
+	static void convertIfcCurveStyleData( shared_ptr<IfcCurveStyle> curve_style, shared_ptr<AppearanceData>& appearance_data )
+	{
 		appearance_data->m_apply_to_geometry_type = AppearanceData::GEOM_TYPE_CURVE;
 
 		//CurveFont		: OPTIONAL IfcCurveFontOrScaledCurveFontSelect;
@@ -666,35 +690,21 @@ public:
 			return;
 		}
 		const int style_id = surface_style->m_tag;
-
-#ifdef _OPENMP
-		{
-		ScopedLock lock(m_writelock_styles_converter);
-#endif
-		auto it_find_existing_style = m_map_ifc_styles.find( style_id );
-		if( it_find_existing_style != m_map_ifc_styles.end() )
+		if( findCachedStyle( style_id, appearance_data ) )
 		{
-			// todo: check if appearance compare is faster here
-			appearance_data = it_find_existing_style->second;
-			if( appearance_data->m_complete )
-			{
-				return;
-			}
-		}
-		else
-		{
-			if( !appearance_data )
-			{
-				appearance_data = shared_ptr<AppearanceData>( new AppearanceData( style_id ) );
-			}
-
-			m_map_ifc_styles[style_id] = appearance_data;
+			return;
 		}
 
-#ifdef _OPENMP
+		if( !appearance_data )
+		{
+			appearance_data = shared_ptr<AppearanceData>( new AppearanceData( style_id ) );
 		}
-#endif
+		convertIfcSurfaceStyleData( surface_style, appearance_data );
+		addCachedStyle( style_id, appearance_data );
+	}
 
+	static void convertIfcSurfaceStyleData( shared_ptr<IfcSurfaceStyle> surface_style, shared_ptr<AppearanceData>& appearance_data )
+	{
 		appearance_data->m_apply_to_geometry_type = AppearanceData::GEOM_TYPE_SURFACE;
 
 		std::vector<shared_ptr<IfcSurfaceStyleElementSelect> >& vec_styles = surface_style->m_Styles;
@@ -765,21 +775,19 @@ public:
 		shared_ptr<IfcStyledItem> styled_item( styled_item_weak );
 		const int style_id = styled_item->m_tag;
 
-#ifdef _OPENMP
-		{
-		ScopedLock lock(m_writelock_styles_converter);
-#endif
-		auto it_find_existing_style = m_map_ifc_styles.find( style_id );
-		if( it_find_existing_style != m_map_ifc_styles.end() )
 		{
-			vec_appearance_data.push_back( it_find_existing_style->second );
-			return;
-		}
-	
 #ifdef _OPENMP
-		}
+			std::shared_lock<std::shared_mutex> lock( m_writelock_styles_converter );
 #endif
+			auto it_find_existing_style = m_map_styled_items.find( style_id );
+			if( it_find_existing_style != m_map_styled_items.end() )
+			{
+				std::copy( it_find_existing_style->second.begin(), it_find_existing_style->second.end(), std::back_inserter( vec_appearance_data ) );
+				return;
+			}
+		}
 
+		std::vector<shared_ptr<AppearanceData> > vec_styled_item_appearances;
 		std::vector<shared_ptr<IfcPresentationStyle> >& vec_style_assigns = styled_item->m_Styles;
 		for( size_t i_style_assign = 0; i_style_assign < vec_style_assigns.size(); ++i_style_assign )
 		{
@@ -793,10 +801,16 @@ public:
 			convertIfcPresentationStyle( presentationStyle, appearance_data );
 			if( appearance_data )
 			{
-				vec_appearance_data.push_back( appearance_data );
+				vec_styled_item_appearances.push_back( appearance_data );
 			}
 			continue;
 		}
+		std::copy( vec_styled_item_appearances.begin(), vec_styled_item_appearances.end(), std::back_inserter( vec_appearance_data ) );
+
+#ifdef _OPENMP
+		std::unique_lock<std::shared_mutex> lock( m_writelock_styles_converter );
+#endif
+		m_map_styled_items.insert( { style_id, vec_styled_item_appearances } );
 	}
 
 	void convertIfcComplexPropertyColor( shared_ptr<IfcComplexProperty> complex_property, vec4& vec_color )
@@ -17,7 +17,9 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OU
 
 #pragma once
 
+#include <map>
 #include <ifcpp/model/BasicTypes.h>
+#include <ifcpp/model/OpenMPIncludes.h>
 #include <ifcpp/model/StatusCallback.h>
 #include <earcut/include/mapbox/earcut.hpp>
 #include "IncludeCarveHeaders.h"
@@ -30,6 +32,12 @@ class UnitConverter;
 
 class Sweeper : public StatusCallback
 {
+protected:
+	std::map<size_t, std::vector<vec2> >	m_unit_circles;		// cross section of swept disks with radius 1, per number of vertices
+#ifdef _OPENMP
+	Mutex m_writelock_unit_circles;
+#endif
+
 public:
 	shared_ptr<GeometrySettings>		m_geom_settings;
 	shared_ptr<UnitConverter>			m_unit_converter;
@@ -37,6 +45,27 @@ public:
 	Sweeper(shared_ptr<GeometrySettings>& settings, shared_ptr<UnitConverter>& uc) : m_geom_settings(settings), m_unit_converter(uc) {}
 	virtual ~Sweeper(){}
 
+	//\brief Points of a circle with radius 1 in the XY plane, starting at (0,1). Computed once per number of vertices and shared by all swept disks
+	const std::vector<vec2>& getUnitCircle( size_t nvc )
+	{
+#ifdef _OPENMP
+		ScopedLock lock( m_writelock_unit_circles );
+#endif
+		std::vector<vec2>& unit_circle = m_unit_circles[nvc];
+		if( unit_circle.size() != nvc )
+		{
+			unit_circle.resize( nvc );
+			double angle = 0;
+			double delta_angle = 2.0*M_PI/double(nvc);
+			for( size_t ii = 0; ii < nvc; ++ii )
+			{
+				unit_circle[ii] = carve::geom::VECTOR( sin(angle), cos(angle) );
+				angle += delta_angle;
+			}
+		}
+		return unit_circle;
+	}
+
 	/*\brief Extrudes a set of cross sections along a direction
 	  \param[in] paths Set of cross sections to extrude
 	  \param[in] dir Extrusion vector
@@ -395,49 +424,19 @@ public:
 		itemData->addClosedPolyhedron(meshOut, params, m_geom_settings);
 	}
 	
-	/*\brief Extrudes a circle cross section along a path. At turns, the points are placed in the bisecting plane
-	  \param[in] curve_points Path along which the circle is swept
-	  \param[in] e Ifc entity that the geometry belongs to (just for error messages). Pass a nullptr if no entity at hand.
-	  \param[out] item_data Container to add result polyhedron or polyline
+	/*\brief Computes the cross sections of a swept disk. At turns, the points are placed in the bisecting plane
+	  \param[in] curve_points Path along which the circle is swept, at least two points
 	  \param[in] nvc Number of vertices per circle
-	  \param[in] radius_inner If positive value is given, the swept disk becomes a pipe
+	  \param[out] outer_points nvc points per curve point
+	  \param[out] inner_points nvc points per curve point, if radius_inner is positive
 	**/
-	void sweepDisk( const std::vector<vec3>& curve_points, shared_ptr<ItemShapeData>& item_data, GeomProcessingParams& params, const size_t nvc, const double radius, const double radius_inner = -1 )
+	void computeSweptDiskCrossSections( const std::vector<vec3>& curve_points, GeomProcessingParams& params, const size_t nvc, const double radius, const double radius_inner, std::vector<vec3>& outer_points, std::vector<vec3>& inner_points )
 	{
 		const size_t num_curve_points = curve_points.size();
-		if( num_curve_points < 2 )
-		{
-			messageCallback( "num curve points < 2", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, params.ifc_entity );
-			return;
-		}
-
-		if( !item_data )
-		{
-			messageCallback( "!item_data", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, params.ifc_entity );
-			return;
-		}
-
-		if( radius < 0.001 )
-		{
-			// Cross section is just a point. Create a polyline
-			shared_ptr<carve::input::PolylineSetData> polyline_data( new carve::input::PolylineSetData() );
-			polyline_data->beginPolyline();
-			for( size_t i_polyline = 0; i_polyline < curve_points.size(); ++i_polyline )
-			{
-				const vec3& curve_pt = curve_points[i_polyline];
-				polyline_data->addVertex( curve_pt );
-				polyline_data->addPolylineIndex( 0 );
-				polyline_data->addPolylineIndex( i_polyline );
-			}
-			item_data->m_polylines.push_back( polyline_data );
-			return;
-		}
-
-		double use_radius_inner = radius_inner;
-		if( radius_inner > radius )
+		outer_points.reserve( num_curve_points*nvc );
+		if( radius_inner > 0 )
 		{
-			messageCallback( "radius_inner > radius", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, params.ifc_entity );
-			use_radius_inner = radius;
+			inner_points.reserve( num_curve_points*nvc );
 		}
 
 		double eps = params.epsMergePoints;
@@ -525,7 +524,6 @@ public:
 		vec3  section_local_z = curve_point_first - curve_point_second;
 		vec3  section_local_x = carve::geom::cross( section_local_y, section_local_z );
 		section_local_y = carve::geom::cross( section_local_x, section_local_z );
-		std::vector<vec3> inner_shape_points;
 	
 		section_local_x.normalize();
 		section_local_y.normalize();
@@ -537,30 +535,26 @@ public:
 			section_local_x.z,		section_local_y.z,		section_local_z.z,	0,
 			0,				0,				0,			1 );
 
-		double angle = 0;
-		double delta_angle = 2.0*M_PI/double(nvc);	// TODO: adapt to model size and complexity
+		const std::vector<vec2>& unit_circle = getUnitCircle( nvc );
 		std::vector<vec3> circle_points(nvc);
 		std::vector<vec3> circle_points_inner(nvc);
 		for( size_t ii = 0; ii < nvc; ++ii )
 		{
 			// cross section (circle) is defined in XY plane
-			double x = sin(angle);
-			double y = cos(angle);
+			double x = unit_circle[ii].x;
+			double y = unit_circle[ii].y;
 			vec3 vertex( carve::geom::VECTOR( x*radius, y*radius, 0.0 ) );
 			vertex = matrix_first_direction*vertex + curve_point_first;
 			circle_points[ii] = vertex;
 
-			if( use_radius_inner > 0 )
+			if( radius_inner > 0 )
 			{
-				vec3 vertex_inner( carve::geom::VECTOR( x*use_radius_inner, y*use_radius_inner, 0.0 ) );
+				vec3 vertex_inner( carve::geom::VECTOR( x*radius_inner, y*radius_inner, 0.0 ) );
 				vertex_inner = matrix_first_direction*vertex_inner + curve_point_first;
 				circle_points_inner[ii] = vertex_inner;
 			}
-			angle += delta_angle;
 		}
 
-		shared_ptr<carve::input::PolyhedronData> poly_data( new carve::input::PolyhedronData() );
-		
 		for( size_t ii = 0; ii<num_curve_points; ++ii )
 		{
 			const vec3& vertex_current = curve_points[ii];
@@ -636,10 +630,10 @@ public:
 					messageCallback( "no intersection found", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, params.ifc_entity );
 				}
 
-				poly_data->addVertex( vertex );
+				outer_points.push_back( vertex );
 			}
 
-			if( use_radius_inner > 0 )
+			if( radius_inner > 0 )
 			{
 				for( size_t jj = 0; jj < nvc; ++jj )
 				{
@@ -657,11 +651,71 @@ public:
 						messageCallback( "no intersection found", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, params.ifc_entity );
 					}
 
-					//inner_shape_points[jj] = vertex;
-					inner_shape_points.push_back( vertex );
+					inner_points.push_back( vertex );
 				}
 			}
 		}
+	}
+
+	/*\brief Extrudes a circle cross section along a path. At turns, the points are placed in the bisecting plane
+	  \param[in] curve_points Path along which the circle is swept
+	  \param[in] e Ifc entity that the geometry belongs to (just for error messages). Pass a nullptr if no entity at hand.
+	  \param[out] item_data Container to add result polyhedron or polyline
+	  \param[in] nvc Number of vertices per circle
+	  \param[in] radius_inner If positive value is given, the swept disk becomes a pipe
+	**/
+	void sweepDisk( const std::vector<vec3>& curve_points, shared_ptr<ItemShapeData>& item_data, GeomProcessingParams& params, const size_t nvc, const double radius, const double radius_inner = -1 )
+	{
+		const size_t num_curve_points = curve_points.size();
+		if( num_curve_points < 2 )
+		{
+			messageCallback( "num curve points < 2", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, params.ifc_entity );
+			return;
+		}
+
+		if( !item_data )
+		{
+			messageCallback( "!item_data", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, params.ifc_entity );
+			return;
+		}
+
+		if( radius < 0.001 )
+		{
+			// Cross section is just a point. Create a polyline
+			shared_ptr<carve::input::PolylineSetData> polyline_data( new carve::input::PolylineSetData() );
+			polyline_data->beginPolyline();
+			for( size_t i_polyline = 0; i_polyline < curve_points.size(); ++i_polyline )
+			{
+				const vec3& curve_pt = curve_points[i_polyline];
+				polyline_data->addVertex( curve_pt );
+				polyline_data->addPolylineIndex( 0 );
+				polyline_data->addPolylineIndex( i_polyline );
+			}
+			item_data->m_polylines.push_back( polyline_data );
+			return;
+		}
+
+		double use_radius_inner = radius_inner;
+		if( radius_inner > radius )
+		{
+			messageCallback( "radius_inner > radius", StatusCallback::MESSAGE_TYPE_WARNING, __FUNC__, params.ifc_entity );
+			use_radius_inner = radius;
+		}
+		if( use_radius_inner > 0 && radius - use_radius_inner <= params.epsMergePoints )
+		{
+			// walls without thickness, like in sweepDiskTriangleMesh the disk is treated as solid
+			use_radius_inner = -1.0;
+		}
+
+		std::vector<vec3> outer_points;
+		std::vector<vec3> inner_shape_points;
+		computeSweptDiskCrossSections( curve_points, params, nvc, radius, use_radius_inner, outer_points, inner_shape_points );
+
+		shared_ptr<carve::input::PolyhedronData> poly_data( new carve::input::PolyhedronData() );
+		for( const vec3& point : outer_points )
+		{
+			poly_data->addVertex( point );
+		}
 
 		// outer shape
 		size_t num_vertices_outer = poly_data->getVertexCount();
@@ -769,7 +823,7 @@ public:
 		{
 			messageCallback( exception.what(), StatusCallback::MESSAGE_TYPE_WARNING, "", params.ifc_entity );  // calling function already in e.what()
 #ifdef _DEBUG
-			shared_ptr<carve::mesh::MeshSet<3> > meshset( poly_data->createMesh( carve::input::opts(), eps ) );
+			shared_ptr<carve::mesh::MeshSet<3> > meshset( poly_data->createMesh( carve::input::opts(), params.epsMergePoints ) );
 			glm::vec4 color( 0.7, 0.7, 0.7, 1.0 );
 			bool drawNormals = true;
 			GeomDebugDump::dumpMeshset( meshset, color, drawNormals, true );
@@ -777,12 +831,198 @@ public:
 		}
 
 	#ifdef _DEBUG
-		shared_ptr<carve::mesh::MeshSet<3> > meshset( poly_data->createMesh(carve::input::opts(), eps) );
+		shared_ptr<carve::mesh::MeshSet<3> > meshset( poly_data->createMesh(carve::input::opts(), params.epsMergePoints) );
 		MeshSetInfo infoMesh( this, params.ifc_entity );
 		MeshOps::checkMeshSetValidAndClosed( meshset, infoMesh, params);
 	#endif
 	}
 
+	/*\brief Creates the closed triangle mesh of a swept disk directly, without the carve mesh of sweepDisk. For swept disks that are not used in boolean operations,
+	  like reinforcing bars. The tube has smooth normals, the caps are flat.
+	  \param[in] radius_inner If positive and less than radius, the swept disk becomes a pipe
+	  \return nullptr if the swept disk degenerates, then sweepDisk handles it
+	**/
+	shared_ptr<TriangleMeshData> sweepDiskTriangleMesh( const std::vector<vec3>& curve_points, GeomProcessingParams& params, const size_t nvc, const double radius, const double radius_inner = -1 )
+	{
+		const size_t num_curve_points = curve_points.size();
+		if( num_curve_points < 2 || nvc < 3 || radius < 0.001 || radius_inner > radius )
+		{
+			return shared_ptr<TriangleMeshData>();
+		}
+
+		// an inner radius equal to the radius would give walls without thickness, the disk is treated as solid then
+		const bool hollow = radius_inner > 0 && radius - radius_inner > params.epsMergePoints;
+		std::vector<vec3> outer_points;
+		std::vector<vec3> inner_points;
+		computeSweptDiskCrossSections( curve_points, params, nvc, radius, hollow ? radius_inner : -1.0, outer_points, inner_points );
+
+		// direction of the path at each cross section
+		std::vector<vec3> tangents( num_curve_points );
+		for( size_t ii = 0; ii < num_curve_points; ++ii )
+		{
+			vec3 tangent = carve::geom::VECTOR( 0, 0, 0 );
+			if( ii > 0 )
+			{
+				tangent += ( curve_points[ii] - curve_points[ii - 1] ).normalized();
+			}
+			if( ii + 1 < num_curve_points )
+			{
+				tangent += ( curve_points[ii + 1] - curve_points[ii] ).normalized();
+			}
+			if( tangent.length2() > 0 )
+			{
+				tangent.normalize();
+			}
+			tangents[ii] = tangent;
+		}
+
+		shared_ptr<TriangleMeshData> triangle_mesh( new TriangleMeshData() );
+		triangle_mesh->m_single_precision = m_geom_settings->triangleMeshesSinglePrecision();
+		triangle_mesh->m_closed = true;
+		const size_t num_ring_vertices = num_curve_points*nvc;
+		const size_t num_vertices = ( num_ring_vertices + 2*nvc )*( hollow ? 2 : 1 );
+		const size_t num_triangles = ( num_curve_points - 1 )*nvc*2*( hollow ? 2 : 1 ) + ( hollow ? 4*nvc : 2*( nvc - 2 ) );
+		std::vector<double> positions;
+		positions.reserve( num_vertices*3 );
+		triangle_mesh->m_normals.reserve( num_vertices*3 );
+		triangle_mesh->m_indices.reserve( num_triangles*3 );
+
+		auto addVertex = [&]( const vec3& point, const vec3& normal )
+		{
+			positions.push_back( point.x );
+			positions.push_back( point.y );
+			positions.push_back( point.z );
+			triangle_mesh->m_normals.push_back( (float)normal.x );
+			triangle_mesh->m_normals.push_back( (float)normal.y );
+			triangle_mesh->m_normals.push_back( (float)normal.z );
+		};
+		auto addTriangle = [&]( size_t i0, size_t i1, size_t i2 )
+		{
+			triangle_mesh->m_indices.push_back( (uint32_t)i0 );
+			triangle_mesh->m_indices.push_back( (uint32_t)i1 );
+			triangle_mesh->m_indices.push_back( (uint32_t)i2 );
+		};
+
+		// tube vertices, normal perpendicular to the path
+		const std::vector<vec3>* rings[2] = { &outer_points, &inner_points };
+		for( int i_ring = 0; i_ring < ( hollow ? 2 : 1 ); ++i_ring )
+		{
+			const std::vector<vec3>& ring_points = *rings[i_ring];
+			const double normal_sign = i_ring == 0 ? 1.0 : -1.0;
+			for( size_t ii = 0; ii < num_curve_points; ++ii )
+			{
+				const vec3& center = curve_points[ii];
+				const vec3& tangent = tangents[ii];
+				for( size_t jj = 0; jj < nvc; ++jj )
+				{
+					const vec3& point = ring_points[ii*nvc + jj];
+					vec3 normal = point - center;
+					normal -= tangent*dot( normal, tangent );
+					if( normal.length2() > 0 )
+					{
+						normal.normalize();
+					}
+					addVertex( point, normal*normal_sign );
+				}
+			}
+		}
+
+		// cap vertices, with the normal of the cap
+		const size_t cap_offset = positions.size()/3;
+		const vec3 cap_normals[2] = { -tangents[0], tangents[num_curve_points - 1] };
+		for( int i_ring = 0; i_ring < ( hollow ? 2 : 1 ); ++i_ring )
+		{
+			const std::vector<vec3>& ring_points = *rings[i_ring];
+			for( size_t jj = 0; jj < nvc; ++jj )
+			{
+				addVertex( ring_points[jj], cap_normals[0] );
+			}
+			for( size_t jj = 0; jj < nvc; ++jj )
+			{
+				addVertex( ring_points[( num_curve_points - 1 )*nvc + jj], cap_normals[1] );
+			}
+		}
+
+		// same triangles as in sweepDisk
+		for( int i_ring = 0; i_ring < ( hollow ? 2 : 1 ); ++i_ring )
+		{
+			const size_t ring_offset = i_ring*num_ring_vertices;
+			for( size_t ii = 0; ii + 1 < num_curve_points; ++ii )
+			{
+				const size_t i_offset = ring_offset + ii*nvc;
+				const size_t i_offset_next = ring_offset + ( ii + 1 )*nvc;
+				for( size_t jj = 0; jj < nvc; ++jj )
+				{
+					const size_t current_loop_pt1 = jj + i_offset;
+					const size_t current_loop_pt2 = ( jj + 1 ) % nvc + i_offset;
+					const size_t next_loop_pt1 = jj + i_offset_next;
+					const size_t next_loop_pt2 = ( jj + 1 ) % nvc + i_offset_next;
+					if( i_ring == 0 )
+					{
+						addTriangle( current_loop_pt1, next_loop_pt1, next_loop_pt2 );
+						addTriangle( next_loop_pt2, current_loop_pt2, current_loop_pt1 );
+					}
+					else
+					{
+						addTriangle( current_loop_pt1, current_loop_pt2, next_loop_pt2 );
+						addTriangle( next_loop_pt2, next_loop_pt1, current_loop_pt1 );
+					}
+				}
+			}
+		}
+
+		const size_t front_cap = cap_offset;
+		const size_t back_cap = cap_offset + nvc;
+		if( hollow )
+		{
+			const size_t front_cap_inner = cap_offset + 2*nvc;
+			const size_t back_cap_inner = cap_offset + 3*nvc;
+			for( size_t jj = 0; jj < nvc; ++jj )
+			{
+				const size_t jj_next = ( jj + 1 ) % nvc;
+				addTriangle( front_cap + jj, front_cap + jj_next, front_cap_inner + jj );
+				addTriangle( front_cap + jj_next, front_cap_inner + jj_next, front_cap_inner + jj );
+				addTriangle( back_cap + jj, back_cap_inner + jj, back_cap + jj_next );
+				addTriangle( back_cap + jj_next, back_cap_inner + jj, back_cap_inner + jj_next );
+			}
+		}
+		else
+		{
+			for( size_t jj = 0; jj + 2 < nvc; ++jj )
+			{
+				addTriangle( front_cap, front_cap + jj + 1, front_cap + jj + 2 );
+				addTriangle( back_cap, back_cap + jj + 2, back_cap + jj + 1 );
+			}
+		}
+
+		// the orientation of the cross sections depends on the path, so check the winding by the volume
+		double volume6 = 0;
+		std::vector<uint32_t>& indices = triangle_mesh->m_indices;
+		const vec3& origin = curve_points[0];
+		auto getPoint = [&]( uint32_t vertex_index ) { return carve::geom::VECTOR( positions[vertex_index*3], positions[vertex_index*3 + 1], positions[vertex_index*3 + 2] ) - origin; };
+		for( size_t ii = 0; ii + 2 < indices.size(); ii += 3 )
+		{
+			volume6 += dot( getPoint( indices[ii] ), cross( getPoint( indices[ii + 1] ), getPoint( indices[ii + 2] ) ) );
+		}
+		if( volume6 < 0 )
+		{
+			for( size_t ii = 0; ii + 2 < indices.size(); ii += 3 )
+			{
+				std::swap( indices[ii + 1], indices[ii + 2] );
+			}
+		}
+
+		if( triangle_mesh->m_single_precision )
+		{
+			triangle_mesh->m_positions_float.assign( positions.begin(), positions.end() );
+		}
+		else
+		{
+			triangle_mesh->m_positions_double.swap( positions );
+		}
+		return triangle_mesh;
+	}
+
 	void findEnclosedLoops(const std::vector<std::vector<vec2> >& face_loops_input, std::vector<std::vector<std::vector<vec2> > >& profile_paths_enclosed, double eps)
 	{
 		if (face_loops_input.size() > 1)
@@ -0,0 +1,433 @@
+/* -*-c++-*- IfcQuery www.ifcquery.com
+*
+MIT License
+
+Copyright (c) 2017 Fabian Gerold
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <ifcpp/model/BasicTypes.h>
+#include "IncludeCarveHeaders.h"
+
+/**
+*\brief Class TriangleMeshData: indexed triangles of a carve meshset, for consumers that only need triangles (rendering, export).
+* Vertices with equal position and normal are shared between triangles, normals are per face (no smoothing).
+* Compared to the half-edge structure of carve::mesh::MeshSet, it needs a fraction of the memory.
+*/
+class TriangleMeshData
+{
+public:
+	std::vector<double>		m_positions_double;		// x, y, z per vertex, if m_single_precision is false
+	std::vector<float>		m_positions_float;		// x, y, z per vertex, if m_single_precision is true
+	std::vector<float>		m_normals;				// x, y, z per vertex
+	std::vector<uint32_t>	m_indices;				// three vertex indices per triangle, counter-clockwise seen from the front side
+	bool					m_single_precision = false;
+	bool					m_closed = false;		// created from a closed meshset
+
+	size_t getNumVertices() const { return m_normals.size() / 3; }
+	size_t getNumTriangles() const { return m_indices.size() / 3; }
+
+	vec3 getPosition( size_t vertex_index ) const
+	{
+		const size_t ii = vertex_index * 3;
+		if( m_single_precision )
+		{
+			return carve::geom::VECTOR( m_positions_float[ii], m_positions_float[ii + 1], m_positions_float[ii + 2] );
+		}
+		return carve::geom::VECTOR( m_positions_double[ii], m_positions_double[ii + 1], m_positions_double[ii + 2] );
+	}
+
+	vec3 getNormal( size_t vertex_index ) const
+	{
+		const size_t ii = vertex_index * 3;
+		return carve::geom::VECTOR( m_normals[ii], m_normals[ii + 1], m_normals[ii + 2] );
+	}
+
+	/** Memory used by the buffers, in bytes */
+	size_t getMemorySize() const
+	{
+		return sizeof( TriangleMeshData ) + m_positions_double.capacity() * sizeof( double ) + m_positions_float.capacity() * sizeof( float )
+			+ m_normals.capacity() * sizeof( float ) + m_indices.capacity() * sizeof( uint32_t );
+	}
+
+	void computeBoundingBox( carve::geom::aabb<3>& bbox ) const
+	{
+		const size_t num_vertices = getNumVertices();
+		if( num_vertices == 0 )
+		{
+			return;
+		}
+
+		// a box of a single point has zero extent and counts as empty, so collect min and max first
+		vec3 min_point = getPosition( 0 );
+		vec3 max_point = min_point;
+		for( size_t ii = 1; ii < num_vertices; ++ii )
+		{
+			const vec3 point = getPosition( ii );
+			min_point = carve::geom::VECTOR( std::min( min_point.x, point.x ), std::min( min_point.y, point.y ), std::min( min_point.z, point.z ) );
+			max_point = carve::geom::VECTOR( std::max( max_point.x, point.x ), std::max( max_point.y, point.y ), std::max( max_point.z, point.z ) );
+		}
+		carve::geom::aabb<3> mesh_bbox;
+		mesh_bbox.fit( min_point, max_point );
+		if( bbox.isEmpty() )
+		{
+			bbox = mesh_bbox;
+		}
+		else if( !mesh_bbox.isEmpty() )
+		{
+			bbox.unionAABB( mesh_bbox );
+		}
+	}
+
+	/**
+	*\brief Computes the matrix to transform normals with, which is the inverse transpose of mat up to a positive factor.
+	*\return true if mat mirrors the geometry, so that the orientation of triangles has to be reversed
+	*/
+	static bool computeNormalTransform( const carve::math::Matrix& mat, vec3 cofactors[3] )
+	{
+		const vec3 origin = mat*carve::geom::VECTOR( 0, 0, 0 );
+		const vec3 axis_x = mat*carve::geom::VECTOR( 1, 0, 0 ) - origin;
+		const vec3 axis_y = mat*carve::geom::VECTOR( 0, 1, 0 ) - origin;
+		const vec3 axis_z = mat*carve::geom::VECTOR( 0, 0, 1 ) - origin;
+
+		// the inverse transpose is the cofactor matrix divided by the determinant
+		cofactors[0] = carve::geom::cross( axis_y, axis_z );
+		cofactors[1] = carve::geom::cross( axis_z, axis_x );
+		cofactors[2] = carve::geom::cross( axis_x, axis_y );
+		const bool mirrored = carve::geom::dot( axis_x, cofactors[0] ) < 0;
+		if( mirrored )
+		{
+			cofactors[0] = -cofactors[0];
+			cofactors[1] = -cofactors[1];
+			cofactors[2] = -cofactors[2];
+		}
+		return mirrored;
+	}
+
+	static vec3 transformNormal( const vec3 cofactors[3], const vec3& normal )
+	{
+		vec3 normal_transformed = cofactors[0] * normal.x + cofactors[1] * normal.y + cofactors[2] * normal.z;
+		const double length = normal_transformed.length();
+		if( length > 0 )
+		{
+			normal_transformed *= 1.0 / length;
+		}
+		return normal_transformed;
+	}
+
+	void applyTransform( const carve::math::Matrix& mat )
+	{
+		vec3 cofactors[3];
+		const bool mirrored = computeNormalTransform( mat, cofactors );
+
+		const size_t num_vertices = getNumVertices();
+		for( size_t ii = 0; ii < num_vertices; ++ii )
+		{
+			const vec3 point = mat*getPosition( ii );
+			setPosition( ii, point );
+
+			const vec3 normal_transformed = transformNormal( cofactors, getNormal( ii ) );
+			m_normals[ii * 3] = (float)normal_transformed.x;
+			m_normals[ii * 3 + 1] = (float)normal_transformed.y;
+			m_normals[ii * 3 + 2] = (float)normal_transformed.z;
+		}
+
+		if( mirrored )
+		{
+			// mirroring reverses the orientation of the triangles
+			for( size_t ii = 0; ii + 2 < m_indices.size(); ii += 3 )
+			{
+				std::swap( m_indices[ii + 1], m_indices[ii + 2] );
+			}
+		}
+	}
+
+	/**
+	*\brief Writes the triangles into preallocated buffers, without allocating memory.
+	*\param positions			3 * getNumVertices() floats, or nullptr
+	*\param normals				3 * getNumVertices() floats, or nullptr
+	*\param indices				getNumTriangles() * 3 indices, or nullptr. index_offset is added to each index
+	*\param mat					Transformation to apply to positions and normals, or nullptr
+	*/
+	void copyToBuffers( float* positions, float* normals, uint32_t* indices, uint32_t index_offset, const carve::math::Matrix* mat ) const
+	{
+		vec3 cofactors[3];
+		const bool mirrored = mat ? computeNormalTransform( *mat, cofactors ) : false;
+		const size_t num_vertices = getNumVertices();
+
+		if( positions )
+		{
+			if( !mat && m_single_precision )
+			{
+				std::memcpy( positions, m_positions_float.data(), num_vertices * 3 * sizeof( float ) );
+			}
+			else
+			{
+				for( size_t ii = 0; ii < num_vertices; ++ii )
+				{
+					const vec3 point = mat ? ( *mat )*getPosition( ii ) : getPosition( ii );
+					positions[ii * 3] = (float)point.x;
+					positions[ii * 3 + 1] = (float)point.y;
+					positions[ii * 3 + 2] = (float)point.z;
+				}
+			}
+		}
+
+		if( normals )
+		{
+			if( !mat )
+			{
+				std::memcpy( normals, m_normals.data(), num_vertices * 3 * sizeof( float ) );
+			}
+			else
+			{
+				for( size_t ii = 0; ii < num_vertices; ++ii )
+				{
+					const vec3 normal = transformNormal( cofactors, getNormal( ii ) );
+					normals[ii * 3] = (float)normal.x;
+					normals[ii * 3 + 1] = (float)normal.y;
+					normals[ii * 3 + 2] = (float)normal.z;
+				}
+			}
+		}
+
+		if( indices )
+		{
+			const size_t num_indices = m_indices.size();
+			for( size_t ii = 0; ii + 2 < num_indices; ii += 3 )
+			{
+				indices[ii] = m_indices[ii] + index_offset;
+				indices[ii + 1] = m_indices[mirrored ? ii + 2 : ii + 1] + index_offset;
+				indices[ii + 2] = m_indices[mirrored ? ii + 1 : ii + 2] + index_offset;
+			}
+		}
+	}
+
+	/**
+	*\brief Triangulates the faces of a meshset, without copying vertices. Faces with more than three vertices are triangulated.
+	*\param min_triangle_area		Smaller triangles are skipped
+	*\param add_triangle			Called with the face and the three vertices of each triangle, counter-clockwise seen from the front side
+	*/
+	template<typename TriangleFunc>
+	static void triangulateMeshSet( const carve::mesh::MeshSet<3>* meshset, double min_triangle_area, double eps, TriangleFunc add_triangle )
+	{
+		if( !meshset )
+		{
+			return;
+		}
+
+		std::vector<carve::mesh::Vertex<3>* > face_vertices;
+		std::vector<carve::geom::vector<2> > face_vertices_2d;
+		std::vector<carve::triangulate::tri_idx> face_triangles;
+
+		for( const carve::mesh::Mesh<3>* mesh : meshset->meshes )
+		{
+			for( const carve::mesh::Face<3>* face : mesh->faces )
+			{
+				if( face->n_edges < 3 )
+				{
+					continue;
+				}
+
+				face_vertices.clear();
+				face->getVertices( face_vertices );
+
+				face_triangles.clear();
+				if( face_vertices.size() == 3 )
+				{
+					face_triangles.push_back( carve::triangulate::tri_idx( 0, 1, 2 ) );
+				}
+				else
+				{
+					face_vertices_2d.clear();
+					for( const carve::mesh::Vertex<3>* vertex : face_vertices )
+					{
+						face_vertices_2d.push_back( face->project( vertex->v ) );
+					}
+
+					try
+					{
+						carve::triangulate::triangulate( face_vertices_2d, face_triangles, eps );
+					}
+					catch( ... )
+					{
+						// fall back to a triangle fan, correct for convex faces
+						face_triangles.clear();
+						for( size_t ii = 1; ii + 1 < face_vertices.size(); ++ii )
+						{
+							face_triangles.push_back( carve::triangulate::tri_idx( 0, ii, ii + 1 ) );
+						}
+					}
+				}
+
+				for( const carve::triangulate::tri_idx& triangle : face_triangles )
+				{
+					const carve::mesh::Vertex<3>* v0 = face_vertices[triangle.a];
+					const carve::mesh::Vertex<3>* v1 = face_vertices[triangle.b];
+					const carve::mesh::Vertex<3>* v2 = face_vertices[triangle.c];
+					const double area = carve::geom::cross( v1->v - v0->v, v2->v - v0->v ).length()*0.5;
+					if( area <= min_triangle_area )
+					{
+						continue;
+					}
+					add_triangle( face, v0, v1, v2 );
+				}
+			}
+		}
+	}
+
+	/**
+	*\brief Creates indexed triangles from the faces of a meshset, see triangulateMeshSet.
+	*\param single_precision		Store positions as float instead of double
+	*\param min_triangle_area		Smaller triangles are skipped
+	*/
+	static shared_ptr<TriangleMeshData> createFromMeshSet( const carve::mesh::MeshSet<3>* meshset, bool closed, bool single_precision, double min_triangle_area, double eps )
+	{
+		shared_ptr<TriangleMeshData> triangle_mesh( new TriangleMeshData() );
+		triangle_mesh->m_single_precision = single_precision;
+		triangle_mesh->m_closed = closed;
+
+		std::unordered_map<VertexKey, uint32_t, VertexKeyHash> map_vertex_index;
+		triangulateMeshSet( meshset, min_triangle_area, eps, [&]( const carve::mesh::Face<3>* face, const carve::mesh::Vertex<3>* v0, const carve::mesh::Vertex<3>* v1, const carve::mesh::Vertex<3>* v2 )
+		{
+			const vec3& face_normal = face->plane.N;
+			const float normal[3] = { (float)face_normal.x, (float)face_normal.y, (float)face_normal.z };
+			triangle_mesh->m_indices.push_back( triangle_mesh->addVertex( map_vertex_index, v0, normal ) );
+			triangle_mesh->m_indices.push_back( triangle_mesh->addVertex( map_vertex_index, v1, normal ) );
+			triangle_mesh->m_indices.push_back( triangle_mesh->addVertex( map_vertex_index, v2, normal ) );
+		} );
+
+		triangle_mesh->m_positions_double.shrink_to_fit();
+		triangle_mesh->m_positions_float.shrink_to_fit();
+		triangle_mesh->m_normals.shrink_to_fit();
+		triangle_mesh->m_indices.shrink_to_fit();
+		return triangle_mesh;
+	}
+
+	/**
+	*\brief Creates a carve meshset from the triangles, for boolean operations. Vertices at the same position are merged.
+	*/
+	carve::mesh::MeshSet<3>* createMeshSet( double eps ) const
+	{
+		carve::input::PolyhedronData poly_data;
+		std::map<std::array<double, 3>, int> map_position_index;
+		std::vector<int> vertex_map( getNumVertices() );
+		for( size_t ii = 0; ii < vertex_map.size(); ++ii )
+		{
+			const vec3 point = getPosition( ii );
+			auto it_insert = map_position_index.insert( { { point.x, point.y, point.z }, (int)poly_data.getVertexCount() } );
+			if( it_insert.second )
+			{
+				poly_data.addVertex( point );
+			}
+			vertex_map[ii] = it_insert.first->second;
+		}
+
+		for( size_t ii = 0; ii + 2 < m_indices.size(); ii += 3 )
+		{
+			poly_data.addFace( vertex_map[m_indices[ii]], vertex_map[m_indices[ii + 1]], vertex_map[m_indices[ii + 2]] );
+		}
+		return poly_data.createMesh( carve::input::opts(), eps );
+	}
+
+protected:
+	struct VertexKey
+	{
+		const carve::mesh::Vertex<3>* vertex;
+		float normal[3];
+
+		bool operator==( const VertexKey& other ) const
+		{
+			// bitwise, consistent with VertexKeyHash also for -0 and +0
+			return vertex == other.vertex && std::memcmp( normal, other.normal, sizeof( normal ) ) == 0;
+		}
+	};
+
+	struct VertexKeyHash
+	{
+		size_t operator()( const VertexKey& key ) const
+		{
+			size_t hash = std::hash<const void*>()( key.vertex );
+			for( int ii = 0; ii < 3; ++ii )
+			{
+				uint32_t bits;
+				std::memcpy( &bits, &key.normal[ii], sizeof( bits ) );
+				hash ^= bits + 0x9e3779b9 + ( hash << 6 ) + ( hash >> 2 );
+			}
+			return hash;
+		}
+	};
+
+	uint32_t addVertex( std::unordered_map<VertexKey, uint32_t, VertexKeyHash>& map_vertex_index, const carve::mesh::Vertex<3>* vertex, const float normal[3] )
+	{
+		VertexKey key = { vertex, { normal[0], normal[1], normal[2] } };
+		auto it_find = map_vertex_index.find( key );
+		if( it_find != map_vertex_index.end() )
+		{
+			return it_find->second;
+		}
+
+		const uint32_t vertex_index = (uint32_t)getNumVertices();
+		m_normals.insert( m_normals.end(), normal, normal + 3 );
+		if( m_single_precision )
+		{
+			m_positions_float.push_back( (float)vertex->v.x );
+			m_positions_float.push_back( (float)vertex->v.y );
+			m_positions_float.push_back( (float)vertex->v.z );
+		}
+		else
+		{
+			m_positions_double.push_back( vertex->v.x );
+			m_positions_double.push_back( vertex->v.y );
+			m_positions_double.push_back( vertex->v.z );
+		}
+		map_vertex_index.insert( { key, vertex_index } );
+		return vertex_index;
+	}
+
+	void setPosition( size_t vertex_index, const vec3& point )
+	{
+		const size_t ii = vertex_index * 3;
+		if( m_single_precision )
+		{
+			m_positions_float[ii] = (float)point.x;
+			m_positions_float[ii + 1] = (float)point.y;
+			m_positions_float[ii + 2] = (float)point.z;
+		}
+		else
+		{
+			m_positions_double[ii] = point.x;
+			m_positions_double[ii + 1] = point.y;
+			m_positions_double[ii + 2] = point.z;
+		}
+	}
+};
+
+/**
+*\brief Class TriangleMeshLevelOfDetail: simplified triangle meshes of an item, see GeometryConverter::createLevelsOfDetail
+*/
+class TriangleMeshLevelOfDetail
+{
+public:
+	std::vector<shared_ptr<TriangleMeshData> >	m_triangle_meshes;		// simplified version of each of ItemShapeData::m_triangle_meshes, in the same order
+	double										m_geometric_error = 0;	// estimated maximum distance to the full resolution meshes
+};
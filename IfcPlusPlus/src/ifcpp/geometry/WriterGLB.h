@@ -0,0 +1,763 @@
+/* -*-c++-*- IfcQuery www.ifcquery.com
+*
+MIT License
+
+Copyright (c) 2017 Fabian Gerold
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <locale>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <ifcpp/model/BasicTypes.h>
+#include <ifcpp/model/OpenMPIncludes.h>
+#include <ifcpp/model/StatusCallback.h>
+#include "AppearanceData.h"
+#include "FlatGeometryExport.h"
+#include "GeometryInputData.h"
+#include "GeometrySettings.h"
+#include "TriangleMeshData.h"
+
+/**
+*\brief Class WriterGLB: writes converted products to a binary glTF 2.0 file (GLB), for web viewers.
+*
+* Meshes with equal triangles, up to a rotation and translation, are written once and referenced by the nodes of all products that use them.
+* The vertices of instances must be in the same order, as for the meshes of mapped items. Mirrored meshes are not instanced.
+* Appearances with equal colors are merged into one material. One node per product carries the product transform and the GUID as name.
+* The binary chunk is written in batches of limited size, so apart from the triangle meshes no copy of the model is kept in memory.
+*/
+class WriterGLB : public StatusCallback
+{
+protected:
+	//\brief Local frame of a mesh, derived from its vertices in index order. Meshes that differ by a rotation have equal coordinates in their frames
+	struct MeshFrame
+	{
+		bool m_valid = false;
+		vec3 m_origin;
+		vec3 m_axes[3];
+
+		vec3 toLocal( const vec3& point ) const
+		{
+			const vec3 delta = point - m_origin;
+			return carve::geom::VECTOR( dot( m_axes[0], delta ), dot( m_axes[1], delta ), dot( m_axes[2], delta ) );
+		}
+		vec3 toLocalDirection( const vec3& direction ) const
+		{
+			return carve::geom::VECTOR( dot( m_axes[0], direction ), dot( m_axes[1], direction ), dot( m_axes[2], direction ) );
+		}
+	};
+
+	struct UniqueGeometry
+	{
+		const TriangleMeshData* m_mesh = nullptr;
+		vec3 m_offset;
+		MeshFrame m_frame;
+		float m_min[3] = { 0, 0, 0 };
+		float m_max[3] = { 0, 0, 0 };
+		size_t m_position_offset = 0;		// byte offsets in the binary chunk
+		size_t m_normal_offset = 0;
+		size_t m_index_offset = 0;
+	};
+
+	shared_ptr<GeometrySettings>	m_geom_settings;
+	double							m_instance_tolerance = 1e-6;
+	size_t							m_max_batch_bytes = 64 * 1024 * 1024;
+	bool							m_y_up = true;
+
+public:
+	WriterGLB( shared_ptr<GeometrySettings>& geom_settings ) : m_geom_settings( geom_settings )
+	{
+	}
+
+	//\brief Meshes are instanced if their vertices differ by less than this distance, after moving them to the same origin, or to the same local frame
+	void setInstanceTolerance( double tolerance ) { m_instance_tolerance = tolerance; }
+
+	//\brief Maximum size of the vertex data that is prepared in memory before writing it
+	void setMaxBatchSize( size_t bytes ) { m_max_batch_bytes = bytes; }
+
+	//\brief glTF is Y-up, IFC is Z-up. If true, a root node rotates the model accordingly
+	void setYUp( bool y_up ) { m_y_up = y_up; }
+
+	bool writeFile( const std::string& filename, const std::map<std::string, shared_ptr<ProductShapeData> >& map_shape_data, const std::vector<std::string>& guids = std::vector<std::string>() )
+	{
+		std::ofstream out( filename, std::ios::binary );
+		if( !out.is_open() )
+		{
+			messageCallback( "Could not open file " + filename, StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__ );
+			return false;
+		}
+		return writeStream( out, map_shape_data, guids );
+	}
+
+	/**
+	*\brief Writes the products of map_shape_data (result of GeometryConverter::getShapeInputData) to a GLB stream.
+	*\param guids		Products to write, all products with geometry if empty
+	*/
+	bool writeStream( std::ostream& out, const std::map<std::string, shared_ptr<ProductShapeData> >& map_shape_data, const std::vector<std::string>& guids = std::vector<std::string>() )
+	{
+		FlatGeometryExporter exporter( m_geom_settings );
+		if( !exporter.prepare( map_shape_data, guids ) )
+		{
+			messageCallback( "Model has too many vertices for GLB export", StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__ );
+			return false;
+		}
+
+		const std::vector<FlatMeshRange>& mesh_ranges = exporter.getMeshRanges();
+		const int num_mesh_ranges = (int)mesh_ranges.size();
+
+		// find instances: meshes are compared relative to the minimum of their bounding box, and then in their local frame
+		std::vector<vec3> vec_offsets( num_mesh_ranges );
+		std::vector<uint64_t> vec_hashes( num_mesh_ranges );
+		std::vector<MeshFrame> vec_frames( num_mesh_ranges );
+		std::vector<uint64_t> vec_frame_hashes( num_mesh_ranges );
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16)
+#endif
+		for( int i = 0; i < num_mesh_ranges; ++i )
+		{
+			const TriangleMeshData& mesh = *exporter.getMesh( i );
+			vec_offsets[i] = computeOffset( mesh );
+			vec_hashes[i] = computeGeometryHash( mesh, vec_offsets[i] );
+			if( computeFrame( mesh, vec_frames[i] ) )
+			{
+				vec_frame_hashes[i] = computeFrameHash( mesh, vec_frames[i] );
+			}
+		}
+
+		// instance transforms of meshes that are rotated relative to their geometry. Others are moved by their offset
+		std::vector<UniqueGeometry> vec_geometries;
+		std::vector<size_t> vec_geometry_index( num_mesh_ranges );
+		std::map<size_t, carve::math::Matrix> map_rotated_instances;
+		std::unordered_map<uint64_t, std::vector<size_t> > map_hash_geometries;
+		std::unordered_map<uint64_t, std::vector<size_t> > map_frame_hash_geometries;
+		for( int i = 0; i < num_mesh_ranges; ++i )
+		{
+			const TriangleMeshData* mesh = exporter.getMesh( i ).get();
+			std::vector<size_t>& candidates = map_hash_geometries[vec_hashes[i]];
+			bool found = false;
+			for( size_t candidate : candidates )
+			{
+				const UniqueGeometry& geometry = vec_geometries[candidate];
+				if( geometry.m_mesh == mesh || isSameGeometry( *geometry.m_mesh, geometry.m_offset, *mesh, vec_offsets[i] ) )
+				{
+					vec_geometry_index[i] = candidate;
+					found = true;
+					break;
+				}
+			}
+			if( !found && vec_frames[i].m_valid )
+			{
+				for( size_t candidate : map_frame_hash_geometries[vec_frame_hashes[i]] )
+				{
+					const UniqueGeometry& geometry = vec_geometries[candidate];
+					if( isSameGeometryInFrame( *geometry.m_mesh, geometry.m_frame, *mesh, vec_frames[i] ) )
+					{
+						vec_geometry_index[i] = candidate;
+						map_rotated_instances[i] = computeInstanceTransform( geometry, vec_frames[i] );
+						found = true;
+						break;
+					}
+				}
+			}
+			if( !found )
+			{
+				vec_geometry_index[i] = vec_geometries.size();
+				candidates.push_back( vec_geometries.size() );
+				if( vec_frames[i].m_valid )
+				{
+					map_frame_hash_geometries[vec_frame_hashes[i]].push_back( vec_geometries.size() );
+				}
+				UniqueGeometry geometry;
+				geometry.m_mesh = mesh;
+				geometry.m_offset = vec_offsets[i];
+				geometry.m_frame = vec_frames[i];
+				vec_geometries.push_back( geometry );
+			}
+		}
+
+		// layout of the binary chunk: all positions, all normals, all indices
+		size_t positions_size = 0;
+		size_t indices_size = 0;
+		for( UniqueGeometry& geometry : vec_geometries )
+		{
+			geometry.m_position_offset = positions_size;
+			positions_size += geometry.m_mesh->getNumVertices() * 3 * sizeof( float );
+			geometry.m_index_offset = indices_size;
+			indices_size += geometry.m_mesh->m_indices.size() * sizeof( uint32_t );
+		}
+		for( UniqueGeometry& geometry : vec_geometries )
+		{
+			geometry.m_normal_offset = geometry.m_position_offset;
+		}
+		const size_t normals_size = positions_size;
+		const size_t bin_size = positions_size + normals_size + indices_size;
+
+		const int num_geometries = (int)vec_geometries.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16)
+#endif
+		for( int i = 0; i < num_geometries; ++i )
+		{
+			computePositionBounds( vec_geometries[i] );
+		}
+
+		// materials, merged by value, and glTF meshes for each used combination of geometry and material
+		std::vector<std::string> vec_materials;
+		std::map<std::array<int, 7>, size_t> map_material_index;
+		std::vector<std::pair<size_t, size_t> > vec_meshes;
+		std::map<std::pair<size_t, size_t>, size_t> map_mesh_index;
+		std::vector<size_t> vec_range_mesh_index( num_mesh_ranges );
+		for( int i = 0; i < num_mesh_ranges; ++i )
+		{
+			const FlatMeshRange& mesh_range = mesh_ranges[i];
+			shared_ptr<AppearanceData> appearance;
+			if( mesh_range.m_appearance_id >= 0 )
+			{
+				appearance = exporter.getAppearances()[mesh_range.m_appearance_id];
+			}
+			const size_t material_index = getMaterialIndex( appearance, !mesh_range.m_closed, vec_materials, map_material_index );
+
+			const std::pair<size_t, size_t> mesh_key( vec_geometry_index[i], material_index );
+			auto it_inserted = map_mesh_index.insert( { mesh_key, vec_meshes.size() } );
+			if( it_inserted.second )
+			{
+				vec_meshes.push_back( mesh_key );
+			}
+			vec_range_mesh_index[i] = it_inserted.first->second;
+		}
+
+		const std::string json = createJson( exporter, vec_geometries, vec_offsets, map_rotated_instances, vec_range_mesh_index, vec_meshes, vec_materials, positions_size, normals_size, indices_size );
+
+		// GLB container: header, JSON chunk padded with spaces, binary chunk
+		const size_t json_chunk_size = ( json.size() + 3 ) / 4 * 4;
+		const size_t total_size = 12 + 8 + json_chunk_size + ( bin_size > 0 ? 8 + bin_size : 0 );
+		if( total_size > UINT32_MAX )
+		{
+			messageCallback( "Model too large for GLB export", StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__ );
+			return false;
+		}
+
+		writeUInt32( out, 0x46546C67 );		// "glTF"
+		writeUInt32( out, 2 );
+		writeUInt32( out, (uint32_t)total_size );
+		writeUInt32( out, (uint32_t)json_chunk_size );
+		writeUInt32( out, 0x4E4F534A );		// "JSON"
+		out.write( json.data(), json.size() );
+		out.write( "   ", json_chunk_size - json.size() );
+
+		if( bin_size > 0 )
+		{
+			writeUInt32( out, (uint32_t)bin_size );
+			writeUInt32( out, 0x004E4942 );		// "BIN"
+			writePositions( out, vec_geometries );
+			for( const UniqueGeometry& geometry : vec_geometries )
+			{
+				const std::vector<float>& normals = geometry.m_mesh->m_normals;
+				out.write( (const char*)normals.data(), normals.size() * sizeof( float ) );
+			}
+			for( const UniqueGeometry& geometry : vec_geometries )
+			{
+				const std::vector<uint32_t>& indices = geometry.m_mesh->m_indices;
+				out.write( (const char*)indices.data(), indices.size() * sizeof( uint32_t ) );
+			}
+		}
+		out.flush();
+
+		if( !out.good() )
+		{
+			messageCallback( "Error writing GLB stream", StatusCallback::MESSAGE_TYPE_ERROR, __FUNC__ );
+			return false;
+		}
+
+		std::stringstream strs;
+		strs << "GLB export: " << exporter.getSizes().m_num_products << " products, " << num_mesh_ranges << " meshes, " << num_geometries << " unique geometries, " << vec_materials.size() << " materials, " << total_size / 1024 << " kB";
+		messageCallback( strs.str(), StatusCallback::MESSAGE_TYPE_GENERAL_MESSAGE, "" );
+		return true;
+	}
+
+protected:
+	static void writeUInt32( std::ostream& out, uint32_t value )
+	{
+		const unsigned char bytes[4] = { (unsigned char)( value & 0xFF ), (unsigned char)( ( value >> 8 ) & 0xFF ), (unsigned char)( ( value >> 16 ) & 0xFF ), (unsigned char)( ( value >> 24 ) & 0xFF ) };
+		out.write( (const char*)bytes, 4 );
+	}
+
+	static vec3 computeOffset( const TriangleMeshData& mesh )
+	{
+		carve::geom::aabb<3> bbox;
+		mesh.computeBoundingBox( bbox );
+		if( bbox.isEmpty() )
+		{
+			return carve::geom::VECTOR( 0, 0, 0 );
+		}
+		return bbox.min();
+	}
+
+	uint64_t computeGeometryHash( const TriangleMeshData& mesh, const vec3& offset ) const
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		auto addValue = [&]( int64_t value )
+		{
+			hash ^= (uint64_t)value;
+			hash *= 1099511628211ULL;
+		};
+
+		addValue( (int64_t)mesh.getNumVertices() );
+		addValue( (int64_t)mesh.m_indices.size() );
+		for( uint32_t index : mesh.m_indices )
+		{
+			addValue( index );
+		}
+		const size_t num_vertices = mesh.getNumVertices();
+		for( size_t ii = 0; ii < num_vertices; ++ii )
+		{
+			const vec3 point = mesh.getPosition( ii ) - offset;
+			addValue( std::llround( point.x / m_instance_tolerance ) );
+			addValue( std::llround( point.y / m_instance_tolerance ) );
+			addValue( std::llround( point.z / m_instance_tolerance ) );
+		}
+		return hash;
+	}
+
+	bool isSameGeometry( const TriangleMeshData& mesh1, const vec3& offset1, const TriangleMeshData& mesh2, const vec3& offset2 ) const
+	{
+		if( mesh1.getNumVertices() != mesh2.getNumVertices() || mesh1.m_indices != mesh2.m_indices )
+		{
+			return false;
+		}
+		const size_t num_vertices = mesh1.getNumVertices();
+		for( size_t ii = 0; ii < num_vertices; ++ii )
+		{
+			const vec3 delta = ( mesh1.getPosition( ii ) - offset1 ) - ( mesh2.getPosition( ii ) - offset2 );
+			if( std::abs( delta.x ) > m_instance_tolerance || std::abs( delta.y ) > m_instance_tolerance || std::abs( delta.z ) > m_instance_tolerance )
+			{
+				return false;
+			}
+			if( dot( mesh1.getNormal( ii ), mesh2.getNormal( ii ) ) < 0.9999 )
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**\brief Computes a local frame from the vertices in index order: the origin is the centroid, the first axis points to the first vertex
+	  that is nearly as far from the centroid as the farthest vertex, the second axis to the first vertex that is nearly as far from the first axis as the farthest.
+	  Returns false for meshes without extent in two directions */
+	bool computeFrame( const TriangleMeshData& mesh, MeshFrame& frame ) const
+	{
+		const size_t num_vertices = mesh.getNumVertices();
+		if( num_vertices < 3 )
+		{
+			return false;
+		}
+
+		vec3 origin = carve::geom::VECTOR( 0, 0, 0 );
+		for( size_t ii = 0; ii < num_vertices; ++ii )
+		{
+			origin += mesh.getPosition( ii );
+		}
+		origin /= (double)num_vertices;
+
+		double max_length2 = 0;
+		for( size_t ii = 0; ii < num_vertices; ++ii )
+		{
+			max_length2 = std::max( max_length2, ( mesh.getPosition( ii ) - origin ).length2() );
+		}
+		const double min_extent = 1000.0 * m_instance_tolerance;
+		if( max_length2 < min_extent*min_extent )
+		{
+			return false;
+		}
+
+		vec3 axis0;
+		for( size_t ii = 0; ii < num_vertices; ++ii )
+		{
+			const vec3 delta = mesh.getPosition( ii ) - origin;
+			if( delta.length2() >= 0.9*max_length2 )
+			{
+				axis0 = delta.normalized();
+				break;
+			}
+		}
+
+		double max_orthogonal_length2 = 0;
+		for( size_t ii = 0; ii < num_vertices; ++ii )
+		{
+			const vec3 delta = mesh.getPosition( ii ) - origin;
+			max_orthogonal_length2 = std::max( max_orthogonal_length2, ( delta - axis0*dot( axis0, delta ) ).length2() );
+		}
+		if( max_orthogonal_length2 < min_extent*min_extent )
+		{
+			return false;
+		}
+
+		vec3 axis1;
+		for( size_t ii = 0; ii < num_vertices; ++ii )
+		{
+			const vec3 delta = mesh.getPosition( ii ) - origin;
+			const vec3 orthogonal = delta - axis0*dot( axis0, delta );
+			if( orthogonal.length2() >= 0.9*max_orthogonal_length2 )
+			{
+				axis1 = orthogonal.normalized();
+				break;
+			}
+		}
+
+		frame.m_origin = origin;
+		frame.m_axes[0] = axis0;
+		frame.m_axes[1] = axis1;
+		frame.m_axes[2] = cross( axis0, axis1 );
+		frame.m_valid = true;
+		return true;
+	}
+
+	//\brief Hash of the topology and of the coordinates in the local frame, rounded to a multiple of the tolerance
+	uint64_t computeFrameHash( const TriangleMeshData& mesh, const MeshFrame& frame ) const
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		auto addValue = [&]( int64_t value )
+		{
+			hash ^= (uint64_t)value;
+			hash *= 1099511628211ULL;
+		};
+
+		addValue( (int64_t)mesh.getNumVertices() );
+		addValue( (int64_t)mesh.m_indices.size() );
+		for( uint32_t index : mesh.m_indices )
+		{
+			addValue( index );
+		}
+		const size_t num_vertices = mesh.getNumVertices();
+		for( size_t ii = 0; ii < num_vertices; ++ii )
+		{
+			const vec3 point = frame.toLocal( mesh.getPosition( ii ) );
+			addValue( std::llround( point.x / m_instance_tolerance ) );
+			addValue( std::llround( point.y / m_instance_tolerance ) );
+			addValue( std::llround( point.z / m_instance_tolerance ) );
+		}
+		return hash;
+	}
+
+	bool isSameGeometryInFrame( const TriangleMeshData& mesh1, const MeshFrame& frame1, const TriangleMeshData& mesh2, const MeshFrame& frame2 ) const
+	{
+		if( mesh1.getNumVertices() != mesh2.getNumVertices() || mesh1.m_indices != mesh2.m_indices )
+		{
+			return false;
+		}
+		const size_t num_vertices = mesh1.getNumVertices();
+		for( size_t ii = 0; ii < num_vertices; ++ii )
+		{
+			const vec3 delta = frame1.toLocal( mesh1.getPosition( ii ) ) - frame2.toLocal( mesh2.getPosition( ii ) );
+			if( std::abs( delta.x ) > m_instance_tolerance || std::abs( delta.y ) > m_instance_tolerance || std::abs( delta.z ) > m_instance_tolerance )
+			{
+				return false;
+			}
+			if( dot( frame1.toLocalDirection( mesh1.getNormal( ii ) ), frame2.toLocalDirection( mesh2.getNormal( ii ) ) ) < 0.9999 )
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**\brief Transform of the node of a mesh that is a rotated instance of geometry. The positions of geometry are written relative to its offset,
+	  so the transform moves them back by the offset, into the frame of geometry, and from there into the frame of the instance */
+	static carve::math::Matrix computeInstanceTransform( const UniqueGeometry& geometry, const MeshFrame& frame )
+	{
+		// rotation: column cc is the image of the unit vector cc
+		vec3 columns[3];
+		for( int cc = 0; cc < 3; ++cc )
+		{
+			columns[cc] = carve::geom::VECTOR( 0, 0, 0 );
+			for( int jj = 0; jj < 3; ++jj )
+			{
+				columns[cc] += frame.m_axes[jj] * geometry.m_frame.m_axes[jj][cc];
+			}
+		}
+		const vec3 offset_in_frame = geometry.m_offset - geometry.m_frame.m_origin;
+		const vec3 translation = columns[0]*offset_in_frame.x + columns[1]*offset_in_frame.y + columns[2]*offset_in_frame.z + frame.m_origin;
+
+		carve::math::Matrix transform;
+		for( int cc = 0; cc < 3; ++cc )
+		{
+			transform.m[cc][0] = columns[cc].x;
+			transform.m[cc][1] = columns[cc].y;
+			transform.m[cc][2] = columns[cc].z;
+			transform.m[cc][3] = 0;
+		}
+		transform.m[3][0] = translation.x;
+		transform.m[3][1] = translation.y;
+		transform.m[3][2] = translation.z;
+		transform.m[3][3] = 1;
+		return transform;
+	}
+
+	static void computePositionBounds( UniqueGeometry& geometry )
+	{
+		const size_t num_vertices = geometry.m_mesh->getNumVertices();
+		for( size_t ii = 0; ii < num_vertices; ++ii )
+		{
+			const vec3 point = geometry.m_mesh->getPosition( ii ) - geometry.m_offset;
+			const float coords[3] = { (float)point.x, (float)point.y, (float)point.z };
+			for( int jj = 0; jj < 3; ++jj )
+			{
+				if( ii == 0 || coords[jj] < geometry.m_min[jj] ) geometry.m_min[jj] = coords[jj];
+				if( ii == 0 || coords[jj] > geometry.m_max[jj] ) geometry.m_max[jj] = coords[jj];
+			}
+		}
+	}
+
+	//\brief Positions are converted to float relative to the offset of their geometry, in parallel batches of at most m_max_batch_bytes
+	void writePositions( std::ostream& out, const std::vector<UniqueGeometry>& vec_geometries ) const
+	{
+		std::vector<float> batch;
+		size_t batch_begin = 0;
+		while( batch_begin < vec_geometries.size() )
+		{
+			size_t batch_end = batch_begin;
+			size_t batch_floats = 0;
+			while( batch_end < vec_geometries.size() )
+			{
+				const size_t num_floats = vec_geometries[batch_end].m_mesh->getNumVertices() * 3;
+				if( batch_end > batch_begin && ( batch_floats + num_floats ) * sizeof( float ) > m_max_batch_bytes )
+				{
+					break;
+				}
+				batch_floats += num_floats;
+				++batch_end;
+			}
+
+			batch.resize( batch_floats );
+			const size_t batch_offset = vec_geometries[batch_begin].m_position_offset;
+			const int num_batch_geometries = (int)( batch_end - batch_begin );
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16)
+#endif
+			for( int i = 0; i < num_batch_geometries; ++i )
+			{
+				const UniqueGeometry& geometry = vec_geometries[batch_begin + i];
+				float* target = batch.data() + ( geometry.m_position_offset - batch_offset ) / sizeof( float );
+				const size_t num_vertices = geometry.m_mesh->getNumVertices();
+				for( size_t ii = 0; ii < num_vertices; ++ii )
+				{
+					const vec3 point = geometry.m_mesh->getPosition( ii ) - geometry.m_offset;
+					target[ii * 3] = (float)point.x;
+					target[ii * 3 + 1] = (float)point.y;
+					target[ii * 3 + 2] = (float)point.z;
+				}
+			}
+
+			out.write( (const char*)batch.data(), batch.size() * sizeof( float ) );
+			batch_begin = batch_end;
+		}
+	}
+
+	static size_t getMaterialIndex( const shared_ptr<AppearanceData>& appearance, bool double_sided, std::vector<std::string>& vec_materials, std::map<std::array<int, 7>, size_t>& map_material_index )
+	{
+		double r = 0.8, g = 0.8, b = 0.8, alpha = 1.0, roughness = 0.9;
+		bool blend = false;
+		if( appearance )
+		{
+			r = appearance->m_color_diffuse.r();
+			g = appearance->m_color_diffuse.g();
+			b = appearance->m_color_diffuse.b();
+			alpha = appearance->m_transparency;
+			blend = appearance->m_set_transparent && alpha < 1.0;
+			if( appearance->m_specular_roughness > 0 )
+			{
+				roughness = appearance->m_specular_roughness;
+			}
+		}
+
+		auto clamp01 = []( double value ) { return value < 0 ? 0.0 : ( value > 1 ? 1.0 : value ); };
+		r = clamp01( r );
+		g = clamp01( g );
+		b = clamp01( b );
+		alpha = clamp01( alpha );
+		roughness = clamp01( roughness );
+
+		const std::array<int, 7> key = { (int)std::lround( r * 1000 ), (int)std::lround( g * 1000 ), (int)std::lround( b * 1000 ), (int)std::lround( alpha * 1000 ),
+			(int)std::lround( roughness * 1000 ), blend ? 1 : 0, double_sided ? 1 : 0 };
+		auto it_find = map_material_index.find( key );
+		if( it_find != map_material_index.end() )
+		{
+			return it_find->second;
+		}
+
+		std::stringstream strs;
+		strs.imbue( std::locale::classic() );
+		strs << "{\"pbrMetallicRoughness\":{\"baseColorFactor\":[" << key[0] * 0.001 << "," << key[1] * 0.001 << "," << key[2] * 0.001 << "," << key[3] * 0.001 << "]"
+			<< ",\"metallicFactor\":0,\"roughnessFactor\":" << key[4] * 0.001 << "}";
+		if( blend )
+		{
+			strs << ",\"alphaMode\":\"BLEND\"";
+		}
+		if( double_sided )
+		{
+			strs << ",\"doubleSided\":true";
+		}
+		strs << "}";
+
+		const size_t material_index = vec_materials.size();
+		vec_materials.push_back( strs.str() );
+		map_material_index[key] = material_index;
+		return material_index;
+	}
+
+	static void writeJsonString( std::ostream& strs, const std::string& str )
+	{
+		strs << "\"";
+		for( char c : str )
+		{
+			if( c == '"' || c == '\\' )
+			{
+				strs << '\\' << c;
+			}
+			else if( (unsigned char)c < 0x20 )
+			{
+				strs << "\\u" << std::hex << std::setw( 4 ) << std::setfill( '0' ) << (int)c << std::dec << std::setfill( ' ' );
+			}
+			else
+			{
+				strs << c;
+			}
+		}
+		strs << "\"";
+	}
+
+	std::string createJson( const FlatGeometryExporter& exporter, const std::vector<UniqueGeometry>& vec_geometries, const std::vector<vec3>& vec_offsets,
+		const std::map<size_t, carve::math::Matrix>& map_rotated_instances, const std::vector<size_t>& vec_range_mesh_index,
+		const std::vector<std::pair<size_t, size_t> >& vec_meshes, const std::vector<std::string>& vec_materials, size_t positions_size, size_t normals_size, size_t indices_size ) const
+	{
+		const std::vector<shared_ptr<ProductShapeData> >& vec_products = exporter.getProducts();
+		const std::vector<FlatProductRange>& product_ranges = exporter.getProductRanges();
+		const size_t bin_size = positions_size + normals_size + indices_size;
+
+		std::stringstream strs;
+		strs.imbue( std::locale::classic() );
+		strs << std::setprecision( 17 );
+		strs << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"IFC++\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}]";
+
+		// node 0 is the root, then one node per product, followed by its mesh nodes
+		strs << ",\"nodes\":[{\"name\":\"IFC model\"";
+		if( m_y_up )
+		{
+			strs << ",\"matrix\":[1,0,0,0,0,0,-1,0,0,1,0,0,0,0,0,1]";
+		}
+		// glTF does not allow an empty children array, so it is omitted for an empty model
+		size_t node_index = 1;
+		for( size_t ii = 0; ii < product_ranges.size(); ++ii )
+		{
+			strs << ( ii > 0 ? "," : ",\"children\":[" ) << node_index;
+			node_index += 1 + product_ranges[ii].m_num_meshes;
+		}
+		strs << ( product_ranges.size() > 0 ? "]}" : "}" );
+
+		node_index = 1;
+		for( size_t ii = 0; ii < product_ranges.size(); ++ii )
+		{
+			const FlatProductRange& product_range = product_ranges[ii];
+			const carve::math::Matrix transform = vec_products[ii]->getTransform();
+			strs << ",{\"name\":";
+			writeJsonString( strs, vec_products[ii]->m_entity_guid );
+			strs << ",\"matrix\":[";
+			for( int jj = 0; jj < 16; ++jj )
+			{
+				strs << ( jj > 0 ? "," : "" ) << transform.v[jj];
+			}
+			strs << "]";
+			for( size_t jj = 0; jj < product_range.m_num_meshes; ++jj )
+			{
+				strs << ( jj > 0 ? "," : ",\"children\":[" ) << node_index + 1 + jj;
+			}
+			strs << ( product_range.m_num_meshes > 0 ? "]}" : "}" );
+
+			for( size_t jj = product_range.m_first_mesh; jj < product_range.m_first_mesh + product_range.m_num_meshes; ++jj )
+			{
+				const vec3& offset = vec_offsets[jj];
+				strs << ",{\"mesh\":" << vec_range_mesh_index[jj];
+				auto it_rotated = map_rotated_instances.find( jj );
+				if( it_rotated != map_rotated_instances.end() )
+				{
+					strs << ",\"matrix\":[";
+					for( int kk = 0; kk < 16; ++kk )
+					{
+						strs << ( kk > 0 ? "," : "" ) << it_rotated->second.v[kk];
+					}
+					strs << "]";
+				}
+				else if( offset.x != 0 || offset.y != 0 || offset.z != 0 )
+				{
+					strs << ",\"translation\":[" << offset.x << "," << offset.y << "," << offset.z << "]";
+				}
+				strs << "}";
+			}
+			node_index += 1 + product_range.m_num_meshes;
+		}
+		strs << "]";
+
+		strs << std::setprecision( 9 );
+		if( vec_meshes.size() > 0 )
+		{
+			// accessors 3*i, 3*i+1, 3*i+2 are positions, normals and indices of geometry i
+			strs << ",\"meshes\":[";
+			for( size_t ii = 0; ii < vec_meshes.size(); ++ii )
+			{
+				const size_t geometry_index = vec_meshes[ii].first;
+				strs << ( ii > 0 ? "," : "" ) << "{\"primitives\":[{\"attributes\":{\"POSITION\":" << geometry_index * 3 << ",\"NORMAL\":" << geometry_index * 3 + 1 << "},\"indices\":" << geometry_index * 3 + 2
+					<< ",\"material\":" << vec_meshes[ii].second << "}]}";
+			}
+			strs << "]";
+
+			strs << ",\"materials\":[";
+			for( size_t ii = 0; ii < vec_materials.size(); ++ii )
+			{
+				strs << ( ii > 0 ? "," : "" ) << vec_materials[ii];
+			}
+			strs << "]";
+
+			strs << ",\"accessors\":[";
+			for( size_t ii = 0; ii < vec_geometries.size(); ++ii )
+			{
+				const UniqueGeometry& geometry = vec_geometries[ii];
+				const size_t num_vertices = geometry.m_mesh->getNumVertices();
+				strs << ( ii > 0 ? "," : "" );
+				strs << "{\"bufferView\":0,\"byteOffset\":" << geometry.m_position_offset << ",\"componentType\":5126,\"count\":" << num_vertices << ",\"type\":\"VEC3\""
+					<< ",\"min\":[" << geometry.m_min[0] << "," << geometry.m_min[1] << "," << geometry.m_min[2] << "],\"max\":[" << geometry.m_max[0] << "," << geometry.m_max[1] << "," << geometry.m_max[2] << "]}";
+				strs << ",{\"bufferView\":1,\"byteOffset\":" << geometry.m_normal_offset << ",\"componentType\":5126,\"count\":" << num_vertices << ",\"type\":\"VEC3\"}";
+				strs << ",{\"bufferView\":2,\"byteOffset\":" << geometry.m_index_offset << ",\"componentType\":5125,\"count\":" << geometry.m_mesh->m_indices.size() << ",\"type\":\"SCALAR\"}";
+			}
+			strs << "]";
+
+			strs << ",\"bufferViews\":[";
+			strs << "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" << positions_size << ",\"byteStride\":12,\"target\":34962}";
+			strs << ",{\"buffer\":0,\"byteOffset\":" << positions_size << ",\"byteLength\":" << normals_size << ",\"byteStride\":12,\"target\":34962}";
+			strs << ",{\"buffer\":0,\"byteOffset\":" << positions_size + normals_size << ",\"byteLength\":" << indices_size << ",\"target\":34963}";
+			strs << "]";
+
+			strs << ",\"buffers\":[{\"byteLength\":" << bin_size << "}]";
+		}
+		strs << "}";
+		return strs.str();
+	}
+};
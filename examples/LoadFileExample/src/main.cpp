@@ -213,6 +213,17 @@ void resolveShapeData(shared_ptr<ProductShapeData>& shapeData)
 				}
 			}
 		}
+
+		// indexed triangles, if enabled with GeometrySettings::setCreateTriangleMeshes
+		for (auto triangleMesh : geometricItem->m_triangle_meshes)
+		{
+			for (size_t ii = 0; ii < triangleMesh->m_indices.size(); ++ii)
+			{
+				carve::geom::vector<3> pointLocal = triangleMesh->getPosition(triangleMesh->m_indices[ii]);
+				carve::geom::vector<3> pointGlobal = localTransform * pointLocal;
+				std::cout << "point in triangle mesh: (" << pointGlobal.x << "/" << pointGlobal.y << "/" << pointGlobal.z << ")" << std::endl;
+			}
+		}
 	}
 	
 	for (auto child_object : shapeData->m_vec_children)